@@ -0,0 +1,483 @@
+/**HashCheck********************************************************************
+
+  File        bench.c
+
+  Resume      Microbenchmark of every algorithm and implementation.
+
+  Description Hashes messages from 16 bytes to 1 GiB with each implementation
+              the host supports and prints, per algorithm, implementation,
+              mode and size, the median throughput, cycles per byte and
+              messages per second, with the median and 99th percentile time
+              of a message over the trials, as CSV or JSON.
+
+              "single" rows hash every message with init, update and final;
+              "batch" rows, for the algorithms with a batch function and
+              messages of up to 64K, hash them BENCH_BATCH at a time.
+
+              Cycles are read with rdtsc, so they are reference cycles of
+              the TSC, not core cycles: pin the frequency for exact figures.
+
+              Build it from the top of the repository with:
+
+              gcc -O2 -pthread -o hashbench bench/bench.c src/[a-z]*.c
+
+              and run 'hashbench --help' for the options.
+
+  See also    HashCheck.h
+
+  Autor       Raúl San Martín Aniceto
+
+  Copyright (c) 2018 Raúl San Martín Aniceto
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "../src/HashCheck.h"
+
+#ifdef HASH_X86
+#include <x86intrin.h>
+#endif
+
+/*---------------------------------------------------------------------------*/
+/* Constant declarations                                                     */
+/*---------------------------------------------------------------------------*/
+
+#define BENCH_BUFFER (64*1024*1024) //Bigger messages are this buffer repeated
+#define BENCH_REGION (1024*1024)    //Small messages are spread over it
+#define BENCH_TRIAL (4*1024*1024)   //Bytes hashed by a trial, at least
+#define BENCH_BIG (64*1024*1024)    //Messages from here run BENCH_BIG_TRIALS
+#define BENCH_BIG_TRIALS 3
+#define BENCH_BATCH 64              //Messages given to a batch function
+#define BENCH_BATCH_MAX (64*1024)   //Largest message of the batch rows
+
+enum{//Long options
+  OPT_FORMAT = 256,
+  OPT_ALGO,
+  OPT_IMPL,
+  OPT_MIN_SIZE,
+  OPT_MAX_SIZE,
+  OPT_TRIALS
+};
+
+typedef enum{
+  FORMAT_CSV,
+  FORMAT_JSON
+}format_t;
+
+/*---------------------------------------------------------------------------*/
+/* Structure declarations                                                    */
+/*---------------------------------------------------------------------------*/
+
+typedef struct{
+  format_t format;
+  const char *algo;     //Only this algorithm, NULL for all
+  const char *impl;     //Only this implementation, NULL for all
+  size_t min_size;
+  size_t max_size;
+  unsigned trials;
+}options_t;
+
+//Median and 99th percentile of a row, per message
+typedef struct{
+  size_t messages;      //Per trial
+  unsigned trials;
+  double ns_median;
+  double ns_p99;
+  double cycles_median; //0 if there is no cycle counter
+}stats_t;
+
+/*---------------------------------------------------------------------------*/
+/* Variable declarations                                                     */
+/*---------------------------------------------------------------------------*/
+
+static struct option long_options[] = {
+  {"help",     no_argument,       0, 'h'},
+  {"format",   required_argument, 0, OPT_FORMAT},
+  {"algo",     required_argument, 0, OPT_ALGO},
+  {"impl",     required_argument, 0, OPT_IMPL},
+  {"min-size", required_argument, 0, OPT_MIN_SIZE},
+  {"max-size", required_argument, 0, OPT_MAX_SIZE},
+  {"trials",   required_argument, 0, OPT_TRIALS},
+  {0, 0, 0, 0}
+};
+
+static uint8_t *buffer;
+
+static int rows = 0; //Printed so far, JSON needs commas between them
+
+/*---------------------------------------------------------------------------*/
+/* Static function prototypes                                                */
+/*---------------------------------------------------------------------------*/
+
+static int parse_options(int argc, char **argv, options_t *options);
+
+static int parse_size(const char *arg, size_t *size);
+
+static void print_help(const char *program_name);
+
+static void bench_algo(const options_t *options, const hash_algo *algo,
+                       const hash_impl *impl);
+
+static void run_single(const hash_algo *algo, size_t size, size_t count);
+
+static void run_batch(const hash_algo *algo, size_t size, size_t count);
+
+static void measure(const hash_algo *algo, int batch, size_t size,
+                    unsigned trials, stats_t *stats);
+
+static void print_row(const options_t *options, const hash_algo *algo,
+                      const hash_impl *impl, const char *mode, size_t size,
+                      const stats_t *stats);
+
+static uint64_t now_ns(void);
+
+static uint64_t now_cycles(void);
+
+static int compare_doubles(const void *a, const void *b);
+
+/*---------------------------------------------------------------------------*/
+/* Function definitions                                                      */
+/*---------------------------------------------------------------------------*/
+
+int main(int argc, char **argv){
+  options_t options;
+  const hash_algo *algo;
+  const hash_impl *impl;
+  unsigned features = cpu_features();
+  size_t i;
+
+  if(parse_options(argc, argv, &options)){
+    return -1;
+  }
+
+  buffer = malloc(BENCH_BUFFER);
+  if(buffer == NULL){
+    perror("malloc");
+    return -1;
+  }
+  for(i = 0; i < BENCH_BUFFER; i++){
+    buffer[i] = (uint8_t)(i * 131 + 7);
+  }
+
+  if(options.format == FORMAT_CSV){
+    printf("algo,impl,mode,size,messages,trials,mb_s,cycles_byte,msgs_s,"
+           "ns_median,ns_p99\n");
+  }else{
+    printf("[\n");
+  }
+
+  for(algo = hash_algos; algo->name != NULL; algo++){
+    if((options.algo != NULL) && strcmp(options.algo, algo->name)){
+      continue;
+    }
+    for(impl = algo->impls; impl->name != NULL; impl++){
+      if(((options.impl != NULL) && strcmp(options.impl, impl->name))
+         || ((impl->features & features) != impl->features)){
+        continue;
+      }
+      //The host runs it but the selftest at startup demoted it
+      if(!hash_impl_usable(impl)){
+        fprintf(stderr, "%s: %s %s skipped, it failed the selftest\n",
+                argv[0], algo->name, impl->name);
+        continue;
+      }
+      bench_algo(&options, algo, impl);
+    }
+  }
+
+  if(options.format == FORMAT_JSON){
+    printf("\n]\n");
+  }
+  free(buffer);
+  return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Static function definitions                                               */
+/*---------------------------------------------------------------------------*/
+
+static int parse_options(int argc, char **argv, options_t *options){
+  int c;
+  char *end;
+
+  options->format = FORMAT_CSV;
+  options->algo = NULL;
+  options->impl = NULL;
+  options->min_size = 16;
+  options->max_size = 1024*1024*1024;
+  options->trials = 15;
+
+  while((c = getopt_long(argc, argv, "h", long_options, NULL)) != -1){
+    switch(c){
+      case 'h':
+        print_help(argv[0]);
+        exit(0);
+
+      case OPT_FORMAT:
+        if(!strcmp(optarg, "csv")){
+          options->format = FORMAT_CSV;
+        }else if(!strcmp(optarg, "json")){
+          options->format = FORMAT_JSON;
+        }else{
+          fprintf(stderr, "%s: invalid format, use csv or json\n", argv[0]);
+          return -1;
+        }
+      break;
+
+      case OPT_ALGO:
+        if(hash_find(optarg) == NULL){
+          fprintf(stderr, "%s: unknown algorithm '%s'\n", argv[0], optarg);
+          return -1;
+        }
+        options->algo = optarg;
+      break;
+
+      case OPT_IMPL:
+        options->impl = optarg;
+      break;
+
+      case OPT_MIN_SIZE:
+      case OPT_MAX_SIZE:
+        if(parse_size(optarg, (c == OPT_MIN_SIZE) ? &options->min_size
+                                                  : &options->max_size)){
+          fprintf(stderr, "%s: invalid size '%s'\n", argv[0], optarg);
+          return -1;
+        }
+      break;
+
+      case OPT_TRIALS:
+        options->trials = strtoul(optarg, &end, 10);
+        if((end == optarg) || *end || (options->trials == 0)
+           || (options->trials > 10000)){
+          fprintf(stderr, "%s: invalid number of trials\n", argv[0]);
+          return -1;
+        }
+      break;
+
+      default:
+        fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
+        return -1;
+    }
+  }
+  return 0;
+}
+
+//Same syntax as --buffer-size of HashCheck, a number with K, M or G after
+static int parse_size(const char *arg, size_t *size){
+  char *end;
+  unsigned long long value = strtoull(arg, &end, 10);
+
+  if((end == arg) || (*arg == '-')){
+    return -1;
+  }
+  switch(*end){
+    case 'K':
+      value <<= 10;
+      end++;
+    break;
+
+    case 'M':
+      value <<= 20;
+      end++;
+    break;
+
+    case 'G':
+      value <<= 30;
+      end++;
+    break;
+  }
+  if(*end || (value == 0)){
+    return -1;
+  }
+  *size = value;
+  return 0;
+}
+
+static void print_help(const char *program_name){
+  printf("usage: %s [OPTION]...\n", program_name);
+  printf("Measure every checksum and implementation this host supports.\n\n");
+  printf("\t    --format=FORMAT  csv (default) or json\n");
+  printf("\t    --algo=NAME      only the NAME checksum, e.g. sha256\n");
+  printf("\t    --impl=NAME      only the NAME implementation, e.g. avx2\n");
+  printf("\t    --min-size=N     smallest message, 16 by default\n");
+  printf("\t    --max-size=N     largest message, 1G by default. Sizes go\n");
+  printf("\t                     up by four times and may end in K, M or G\n");
+  printf("\t    --trials=N       measures of each size, 15 by default (%d\n",
+         BENCH_BIG_TRIALS);
+  printf("\t                     from %dM)\n", BENCH_BIG >> 20);
+  printf("\t-h, --help           display this help and exit\n");
+}
+
+static void bench_algo(const options_t *options, const hash_algo *algo,
+                       const hash_impl *impl){
+  stats_t stats;
+  size_t size;
+
+  //Rows are only printed for the implementation that really runs
+  if(hash_use_impl(impl->name)){
+    fprintf(stderr, "%s %s skipped, it cannot be chosen\n", algo->name,
+            impl->name);
+    return;
+  }
+  for(size = options->min_size; size <= options->max_size; size *= 4){
+    unsigned trials = options->trials;
+    if((size >= BENCH_BIG) && (trials > BENCH_BIG_TRIALS)){
+      trials = BENCH_BIG_TRIALS;
+    }
+
+    measure(algo, 0, size, trials, &stats);
+    print_row(options, algo, impl, "single", size, &stats);
+    if((algo->batch != NULL) && (size <= BENCH_BATCH_MAX)){
+      measure(algo, 1, size, trials, &stats);
+      print_row(options, algo, impl, "batch", size, &stats);
+    }
+    if(size > options->max_size / 4){//The next one would overflow
+      break;
+    }
+  }
+  hash_use_impl("auto");
+}
+
+//Hashes count messages of size bytes one by one
+static void run_single(const hash_algo *algo, size_t size, size_t count){
+  uint8_t digest[HASH_MAX_DIGEST];
+  hash_ctx ctx;
+  size_t span = (size < BENCH_REGION) ? BENCH_REGION / size : 1;
+  size_t i;
+
+  for(i = 0; i < count; i++){
+    size_t left = size;
+
+    algo->init(&ctx);
+    if(size <= BENCH_BUFFER){
+      algo->update(&ctx, buffer + (i % span) * size, size);
+    }else{
+      for(; left >= BENCH_BUFFER; left -= BENCH_BUFFER){
+        algo->update(&ctx, buffer, BENCH_BUFFER);
+      }
+      algo->update(&ctx, buffer, left);
+    }
+    algo->final(&ctx, digest);
+  }
+}
+
+//Same through the batch function, BENCH_BATCH messages at a time
+static void run_batch(const hash_algo *algo, size_t size, size_t count){
+  static uint8_t digests[BENCH_BATCH * HASH_MAX_DIGEST];
+  const uint8_t *msgs[BENCH_BATCH];
+  size_t lens[BENCH_BATCH];
+  size_t span = BENCH_REGION / size;
+  size_t i;
+
+  for(i = 0; i < BENCH_BATCH; i++){
+    msgs[i] = buffer + (i % span) * size;
+    lens[i] = size;
+  }
+  for(i = 0; i < count; i += BENCH_BATCH){
+    size_t n = (count - i < BENCH_BATCH) ? count - i : BENCH_BATCH;
+    algo->batch(msgs, lens, n, digests);
+  }
+}
+
+//One warm-up and trials measured runs of enough messages to last a while
+static void measure(const hash_algo *algo, int batch, size_t size,
+                    unsigned trials, stats_t *stats){
+  double ns[trials];
+  double cycles[trials];
+  size_t count = (size < BENCH_TRIAL) ? BENCH_TRIAL / size : 1;
+  unsigned t;
+
+  if(batch){
+    count = (count + BENCH_BATCH - 1) / BENCH_BATCH * BENCH_BATCH;
+  }
+  if(size < BENCH_BIG){
+    (batch ? run_batch : run_single)(algo, size, count);
+  }
+
+  for(t = 0; t < trials; t++){
+    uint64_t start_ns = now_ns();
+    uint64_t start_cycles = now_cycles();
+    (batch ? run_batch : run_single)(algo, size, count);
+    cycles[t] = (double)(now_cycles() - start_cycles) / count;
+    ns[t] = (double)(now_ns() - start_ns) / count;
+  }
+  qsort(ns, trials, sizeof(double), compare_doubles);
+  qsort(cycles, trials, sizeof(double), compare_doubles);
+
+  stats->messages = count;
+  stats->trials = trials;
+  stats->ns_median = ns[trials / 2];
+  stats->ns_p99 = ns[(trials * 99 + 99) / 100 - 1]; //Nearest rank
+  stats->cycles_median = cycles[trials / 2];
+}
+
+static void print_row(const options_t *options, const hash_algo *algo,
+                      const hash_impl *impl, const char *mode, size_t size,
+                      const stats_t *stats){
+  double mb_s = size / stats->ns_median * 1e3;
+  double msgs_s = 1e9 / stats->ns_median;
+  double cycles_byte = stats->cycles_median / size;
+
+  if(options->format == FORMAT_CSV){
+    printf("%s,%s,%s,%zu,%zu,%u,%.1f,%.2f,%.0f,%.1f,%.1f\n", algo->name,
+           impl->name, mode, size, stats->messages, stats->trials, mb_s,
+           cycles_byte, msgs_s, stats->ns_median, stats->ns_p99);
+  }else{
+    printf("%s  {\"algo\": \"%s\", \"impl\": \"%s\", \"mode\": \"%s\", "
+           "\"size\": %zu, \"messages\": %zu, \"trials\": %u, "
+           "\"mb_s\": %.1f, \"cycles_byte\": %.2f, \"msgs_s\": %.0f, "
+           "\"ns_median\": %.1f, \"ns_p99\": %.1f}", rows ? ",\n" : "",
+           algo->name, impl->name, mode, size, stats->messages,
+           stats->trials, mb_s, cycles_byte, msgs_s, stats->ns_median,
+           stats->ns_p99);
+  }
+  rows++;
+  fflush(stdout);
+}
+
+static uint64_t now_ns(void){
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+//Reference cycles of the TSC, 0 where there is none
+static uint64_t now_cycles(void){
+#ifdef HASH_X86
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+static int compare_doubles(const void *a, const void *b){
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+
+  return (x > y) - (x < y);
+}
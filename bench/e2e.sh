@@ -0,0 +1,191 @@
+#!/bin/bash
+#
+# End-to-end benchmark of HashCheck against the coreutils *sum tools.
+#
+# Generates synthetic corpora under WORKDIR (./e2e-work by default) and times
+# every mode of both tools on them, printing one CSV line per run and one
+# with the median of the runs of each case:
+#
+#   mode,algo,tool,run,wall_s,user_s,sys_s,maxrss_kb,syscalls
+#
+# Modes: big (one large file), multi (many small files given in the command
+# line through xargs), recursive (small files and a deep tree), check (-c of
+# the list of the small files) and stdin (a stream through a pipe).
+#
+# Every case runs once to warm the page cache before the timed runs, unless
+# DROP_CACHES=1, which drops the caches before each run (needs root). Syscalls
+# are counted in an extra run under strace, "-" when it is not installed.
+#
+# Usage: bench/e2e.sh [WORKDIR]
+#
+# Environment, defaults in brackets:
+#   BIG_SIZE     size of the big file and of the stdin stream [10G]
+#   SMALL_FILES  number of small files, spread 1000 per directory [1000000]
+#   SMALL_SIZE   size of each small file [4096]
+#   TREE_DEPTH   levels of the deep tree, with 8 files of up to 64K each [64]
+#   ALGOS        checksums to compare, each must have a coreutils tool
+#                [sha256 md5]
+#   MODES        modes to run [big multi recursive check stdin]
+#   RUNS         timed runs of each case [3]
+#   HASHCHECK    HashCheck binary, built from src/ into WORKDIR if unset
+#   CC           compiler of HashCheck and runstat [gcc]
+#
+# The corpora are kept in WORKDIR and only generated again when the sizes
+# change. For a quick run: BIG_SIZE=256M SMALL_FILES=20000 bench/e2e.sh
+
+set -eu
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+WORK=${1:-e2e-work}
+BIG_SIZE=${BIG_SIZE:-10G}
+SMALL_FILES=${SMALL_FILES:-1000000}
+SMALL_SIZE=${SMALL_SIZE:-4096}
+TREE_DEPTH=${TREE_DEPTH:-64}
+ALGOS=${ALGOS:-sha256 md5}
+MODES=${MODES:-big multi recursive check stdin}
+RUNS=${RUNS:-3}
+CC=${CC:-gcc}
+DROP_CACHES=${DROP_CACHES:-0}
+
+mkdir -p "$WORK"
+WORK=$(cd "$WORK" && pwd)
+
+#Tools
+RUNSTAT=$WORK/runstat
+$CC -O2 -o "$RUNSTAT" "$ROOT/bench/runstat.c"
+if [ -z "${HASHCHECK:-}" ]; then
+  HASHCHECK=$WORK/HashCheck
+  $CC -O2 -pthread -o "$HASHCHECK" "$ROOT"/src/*.c
+fi
+STRACE=$(command -v strace || true)
+
+#Bytes of a size that may end in K, M or G
+bytes(){
+  case $1 in
+    *K) echo $(( ${1%K} << 10 ));;
+    *M) echo $(( ${1%M} << 20 ));;
+    *G) echo $(( ${1%G} << 30 ));;
+    *)  echo "$1";;
+  esac
+}
+
+#Corpora, generated again when their parameters change
+corpus(){
+  local name=$1 params=$2
+  if [ "$(cat "$WORK/$name.params" 2>/dev/null)" = "$params" ]; then
+    return 1
+  fi
+  echo "generating $name ($params)" >&2
+  rm -rf "${WORK:?}/$name" "$WORK/$name.params"
+  return 0
+}
+
+if corpus big "$BIG_SIZE"; then
+  head -c "$(bytes "$BIG_SIZE")" /dev/urandom > "$WORK/big"
+  echo "$BIG_SIZE" > "$WORK/big.params"
+fi
+
+if corpus small "$SMALL_FILES $SMALL_SIZE"; then
+  left=$SMALL_FILES
+  dir=0
+  while [ "$left" -gt 0 ]; do
+    n=$(( left < 1000 ? left : 1000 ))
+    mkdir -p "$WORK/small/$dir"
+    head -c $(( n * SMALL_SIZE )) /dev/urandom |
+      split -b "$SMALL_SIZE" -a 3 -d - "$WORK/small/$dir/f"
+    left=$(( left - n ))
+    dir=$(( dir + 1 ))
+  done
+  echo "$SMALL_FILES $SMALL_SIZE" > "$WORK/small.params"
+fi
+
+if corpus tree "$TREE_DEPTH"; then
+  dir=$WORK/tree
+  for level in $(seq "$TREE_DEPTH"); do
+    mkdir -p "$dir"
+    for i in 0 1 2 3 4 5 6 7; do
+      head -c $(( (level * 8 + i) * 1031 % 65536 )) /dev/urandom > "$dir/f$i"
+    done
+    dir=$dir/d$level
+  done
+  echo "$TREE_DEPTH" > "$WORK/tree.params"
+fi
+
+#Command of a case, for HashCheck or for the coreutils tool of algo
+command_of(){
+  local mode=$1 algo=$2 tool=$3 prog
+  if [ "$tool" = coreutils ]; then
+    prog=${algo}sum
+  else
+    prog="$HASHCHECK $algo"
+  fi
+  case $mode in
+    big)       echo "$prog '$WORK/big'";;
+    multi)     echo "find '$WORK/small' -type f | xargs $prog";;
+    recursive)
+      if [ "$tool" = coreutils ]; then
+        echo "find '$WORK/small' '$WORK/tree' -type f -print0 | sort -z |" \
+             "xargs -0 $prog"
+      else
+        echo "$prog -r '$WORK/small' '$WORK/tree'"
+      fi;;
+    check)     echo "$prog -c '$WORK/$algo.list'";;
+    stdin)     echo "head -c $(bytes "$BIG_SIZE") /dev/zero | $prog";;
+  esac
+}
+
+drop_caches(){
+  if [ "$DROP_CACHES" = 1 ]; then
+    sync
+    echo 3 > /proc/sys/vm/drop_caches
+  fi
+}
+
+#Median of the numbers on stdin, "-" if any is not a number
+median(){
+  sort -g | awk '{v[NR] = $1} $1 !~ /^[0-9.]+$/ {bad = 1}
+                 END {if(bad || !NR) print "-"; else print v[int((NR + 1) / 2)]}'
+}
+
+echo "mode,algo,tool,run,wall_s,user_s,sys_s,maxrss_kb,syscalls"
+for algo in $ALGOS; do
+  if ! command -v "${algo}sum" > /dev/null; then
+    echo "skipping $algo, ${algo}sum is not installed" >&2
+    continue
+  fi
+  case " $MODES " in
+    *" check "*)
+      if [ ! -s "$WORK/$algo.list" ] \
+         || [ "$WORK/small.params" -nt "$WORK/$algo.list" ]; then
+        find "$WORK/small" -type f | xargs "${algo}sum" > "$WORK/$algo.list"
+      fi;;
+  esac
+
+  for mode in $MODES; do
+    for tool in hashcheck coreutils; do
+      cmd=$(command_of "$mode" "$algo" "$tool")
+      syscalls=-
+      if [ -n "$STRACE" ]; then
+        "$STRACE" -f -c -o "$WORK/strace.out" sh -c "$cmd" > /dev/null
+        syscalls=$(awk '$NF == "total" {print $4}' "$WORK/strace.out")
+      fi
+      if [ "$DROP_CACHES" != 1 ]; then
+        sh -c "$cmd" > /dev/null
+      fi
+
+      : > "$WORK/runs"
+      for run in $(seq "$RUNS"); do
+        drop_caches
+        "$RUNSTAT" -o "$WORK/stat" sh -c "$cmd" > /dev/null ||
+          echo "$mode $algo $tool: exit status $?" >&2
+        read -r wall user sys rss _ < "$WORK/stat"
+        echo "$wall $user $sys $rss" >> "$WORK/runs"
+        echo "$mode,$algo,$tool,$run,$wall,$user,$sys,$rss,$syscalls"
+      done
+      echo "$mode,$algo,$tool,median,$(
+        for col in 1 2 3 4; do
+          cut -d' ' -f$col "$WORK/runs" | median
+        done | paste -sd,),$syscalls"
+    done
+  done
+done
@@ -0,0 +1,97 @@
+/**HashCheck********************************************************************
+
+  File        runstat.c
+
+  Resume      Runs a command and prints its wall time, CPU time and peak RSS.
+
+  Description Used by e2e.sh where GNU time is not installed. The figures
+              of the command include those of every process it waited for,
+              so 'sh -c' pipelines are measured whole. The line written to
+              FILE is:
+
+              wall_s user_s sys_s maxrss_kb exit_status
+
+              Build it with: gcc -O2 -o runstat bench/runstat.c
+
+  See also    e2e.sh
+
+  Autor       Raúl San Martín Aniceto
+
+  Copyright (c) 2018 Raúl San Martín Aniceto
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+/*---------------------------------------------------------------------------*/
+/* Function definitions                                                      */
+/*---------------------------------------------------------------------------*/
+
+int main(int argc, char **argv){
+  struct timespec start, end;
+  struct rusage usage;
+  int status;
+  pid_t pid;
+  FILE *out;
+
+  if((argc < 4) || strcmp(argv[1], "-o")){
+    fprintf(stderr, "usage: %s -o FILE COMMAND [ARG]...\n", argv[0]);
+    return 2;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  pid = fork();
+  if(pid < 0){
+    perror("fork");
+    return 2;
+  }
+  if(pid == 0){
+    execvp(argv[3], argv + 3);
+    perror(argv[3]);
+    _exit(127);
+  }
+  if(waitpid(pid, &status, 0) < 0){
+    perror("waitpid");
+    return 2;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  getrusage(RUSAGE_CHILDREN, &usage);
+
+  out = fopen(argv[2], "w");
+  if(out == NULL){
+    perror(argv[2]);
+    return 2;
+  }
+  fprintf(out, "%.3f %.3f %.3f %ld %d\n",
+          (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9,
+          usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6,
+          usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6,
+          usage.ru_maxrss, WIFEXITED(status) ? WEXITSTATUS(status) : 128);
+  fclose(out);
+
+  return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
@@ -32,9 +32,16 @@ SOFTWARE.
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <getopt.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <signal.h>
+#include <ctype.h>
 
 #include "HashCheck.h"
 
@@ -42,6 +49,42 @@ SOFTWARE.
 /* Constant declarations                                                     */
 /*---------------------------------------------------------------------------*/
 
+#define DEFAULT_BUFFER_SIZE (128*1024) //Bytes read from a file at once
+
+#define DEFAULT_CHUNK_SIZE (4*1024*1024) //Leaves of --tree
+
+//Names the tree hashes in the tagged lines, e.g. SHA256-TREE-4M
+#define TREE_TAG "-TREE-"
+
+//Largest piece of a file mapped at once, keeps big files from exhausting
+//the address space
+#define MMAP_WINDOW ((sizeof(void *) > 4) ? ((size_t)1 << 30) : (64 << 20))
+
+//Files each worker may be ahead of the oldest file not printed yet
+#define JOBS_PER_WORKER 16
+
+//With a single algorithm that has a batch function, workers take up to
+//BATCH_FILES files at once and hash those of less than SMALL_FILE bytes
+//side by side
+#define BATCH_FILES 64
+#define SMALL_FILE (64*1024)
+
+enum{//Long options without a short equivalent
+  OPT_BUFFER_SIZE = 256,
+  OPT_IO,
+  OPT_ALL,
+  OPT_DIGEST_THREADS,
+  OPT_IMPL,
+  OPT_LIST_IMPLS,
+  OPT_SELFTEST,
+  OPT_TREE,
+  OPT_CHUNK_SIZE
+};
+
+typedef enum{//How regular files are read
+  IO_MMAP,
+  IO_READ
+}io_t;
 
 /*---------------------------------------------------------------------------*/
 /* Type declarations                                                         */
@@ -58,9 +101,113 @@ typedef struct{
   int quiet;
   int version;
   int check;
+  size_t buffer_size;
+  io_t io;
+  unsigned jobs;
+  int all;
+  int digest_threads;
+  int recursive;
+  const char *impl;     //Implementations to run, see hash_use_impl
+  size_t length;        //Bytes of the shake outputs, 0 for their default
+  int list_impls;
+  int selftest;
+  const char *tree;     //Algorithm of the tree hashes, NULL for plain ones
+  size_t chunk_size;
+  const char *invalid;  //Why an option argument is not valid
   int no_valid_optn;
 }args_t;
 
+typedef struct{
+  io_t io;
+  uint8_t *buf;     //Used by read(2), also when mmap is not possible
+  size_t buf_size;
+  //Window of a file being hashed from its mapping, see sigbus_handler
+  uint8_t *map;
+  size_t map_len;
+  int truncated;    //The file shrank under map, the digest is wrong
+}reader_t;
+
+typedef struct digester{//Computes every requested digest in a single pass
+  const hash_algo **algos;
+  size_t count;
+  hash_ctx *ctxs;           //One per algorithm
+  //With threads, algorithm i > 0 is hashed by threads[i - 1] and the caller
+  //hashes the first one, the barriers start and end every block
+  pthread_t *threads;
+  struct digester_lane *lanes;
+  pthread_barrier_t start;
+  pthread_barrier_t end;
+  pthread_mutex_t starting; //Held until every thread started or one failed
+  const uint8_t *data;      //Block being hashed by the threads
+  size_t len;
+  int stop;
+}digester_t;
+
+struct digester_lane{
+  digester_t *digester;
+  size_t index;
+};
+
+typedef struct{//Reused by a worker for every file
+  reader_t reader;
+  digester_t digester;
+  uint8_t *small;  //BATCH_FILES slots of SMALL_FILE bytes, NULL until needed
+  size_t tree;     //Chunk size of a tree hash, 0 for a plain one
+}worker_t;
+
+typedef struct{//A file to hash
+  const char *name;
+  char *path;          //name when found by -r, freed once emitted
+  int dir;             //Descriptor base is relative to, or AT_FDCWD
+  const char *base;
+  walk_dir_t *walked;  //Directory of a file found by -r, released once emitted
+  int unlisted;        //errno of a directory -r could not list, not hashed
+  int err;             //errno of the failure, 0 if digests are valid
+  uint8_t *digests;  //HASH_MAX_DIGEST bytes per algorithm
+}job_t;
+
+typedef struct{//Consecutive files handed to a worker at once
+  job_t *files;
+  size_t count;
+}batch_t;
+
+typedef struct{//A line of a checksum file
+  char *name;
+  const hash_algo *algo;
+  size_t tree;  //Chunk size of a tree hash, 0 for a plain one
+  int err;  //errno of the failure, 0 if digest is valid
+  uint8_t expected[HASH_MAX_DIGEST];
+  uint8_t digest[HASH_MAX_DIGEST];
+}entry_t;
+
+typedef struct{//Shared by every job of a run
+  const char *program;
+  const hash_algo **algos;
+  size_t count;
+  worker_t *workers;
+  unsigned num_workers;
+  int recursive;
+  int bin;
+  int status;
+  hash_batch_fn batch;  //Set when files are hashed in batches
+  size_t tree;          //Chunk size of --tree, 0 without it
+  //Only when checking
+  size_t lines;       //Properly formatted lines
+  size_t bad_lines;
+  size_t unreadable;
+  size_t mismatched;
+}run_t;
+
+typedef struct{//Fills the batches of hash_files in order
+  run_t *run;
+  pool_t *pool;
+  batch_t *batches;  //A ring of slots batches
+  size_t slots;
+  size_t per_batch;
+  size_t limit;      //Files of the batch being filled
+  size_t n;          //Batches submitted so far
+}feeder_t;
+
 static struct option long_options[] = {
   {"help",    no_argument,       0, 'h'},
   {"binary",  no_argument,       0, 'b'},
@@ -68,6 +215,18 @@ static struct option long_options[] = {
   {"quiet",   no_argument,       0, 'q'},
   {"version", no_argument,       0, 'v'},
   {"check",   no_argument,       0, 'c'},
+  {"buffer-size", required_argument, 0, OPT_BUFFER_SIZE},
+  {"io",      required_argument, 0, OPT_IO},
+  {"jobs",    required_argument, 0, 'j'},
+  {"length",  required_argument, 0, 'l'},
+  {"recursive", no_argument,     0, 'r'},
+  {"all",     no_argument,       0, OPT_ALL},
+  {"digest-threads", no_argument, 0, OPT_DIGEST_THREADS},
+  {"impl",    required_argument, 0, OPT_IMPL},
+  {"list-impls", no_argument,    0, OPT_LIST_IMPLS},
+  {"selftest", no_argument,      0, OPT_SELFTEST},
+  {"tree",    required_argument, 0, OPT_TREE},
+  {"chunk-size", required_argument, 0, OPT_CHUNK_SIZE},
   {0, 0, 0, 0}
 };
 
@@ -77,6 +236,12 @@ static struct option long_options[] = {
 
 uint8_t read_stdin  = 0;
 uint8_t quiet_flag  = 0;
+size_t xof_length   = 0; //Bytes of the outputs of shake, 0 for digest_len
+
+//Workers whose mappings sigbus_handler looks for the faulting address in
+worker_t *mapped_workers  = NULL;
+unsigned num_mapped       = 0;
+uintptr_t page_size       = 4096;
 
 /*---------------------------------------------------------------------------*/
 /* Macro declarations                                                        */
@@ -91,10 +256,94 @@ void print_help(char *program_name);
 
 void print_version();
 
+void print_impls();
+
+void print_selftest_fail(const hash_algo *algo, const hash_impl *impl,
+                         const char *test, size_t len, void *arg);
+
 args_t process_args(int num, char **arguments);
 
 int isDir(const char *path);
 
+int parse_size(const char *str, size_t *size);
+
+unsigned online_cpus();
+
+size_t select_algos(char *list, const hash_algo **algos, const char **bad);
+
+size_t output_len(const hash_algo *algo);
+
+worker_t *workers_create(unsigned count, const args_t *arguments,
+                         const hash_algo **algos, size_t num_algos);
+
+void workers_free(worker_t *workers, unsigned count);
+
+int digester_create(digester_t *digester, const hash_algo **algos,
+                    size_t count, int threaded);
+
+void digester_destroy(digester_t *digester);
+
+void digester_init(digester_t *digester);
+
+void digester_update(digester_t *digester, const uint8_t *data, size_t len);
+
+void digester_final(digester_t *digester, uint8_t *digests);
+
+void *digester_thread(void *arg);
+
+void hash_files(run_t *run, char **names, int count);
+
+void feed_file(feeder_t *feeder, const job_t *job, size_t files);
+
+void walk_file(char *path, const char *name, int dir_fd, walk_dir_t *dir,
+               size_t files, void *arg);
+
+void walk_error(const char *path, int err, void *arg);
+
+void hash_job(void *job, unsigned worker, void *arg);
+
+void emit_job(void *job, void *arg);
+
+void hash_batch(const hash_algo *algo, worker_t *worker, batch_t *batch);
+
+int read_small(int fd, uint8_t *buf, size_t *len);
+
+void check_files(run_t *run, char **names, int count);
+
+int check_manifest(run_t *run, pool_t *pool, FILE *fp, entry_t *entries,
+                   size_t *n, size_t slots);
+
+int parse_line(run_t *run, char *line, entry_t *entry);
+
+void check_job(void *job, unsigned worker, void *arg);
+
+void emit_check(void *job, void *arg);
+
+int hex_nibble(char c);
+
+void print_plural(size_t count, const char *one, const char *many);
+
+int hash_file(int dir, const char *name, worker_t *worker, uint8_t *digests);
+
+int hash_fd(int fd, worker_t *worker, uint8_t *digests);
+
+int feed_read(int fd, worker_t *worker);
+
+int feed_mmap(int fd, off_t size, worker_t *worker);
+
+void watch_mappings(worker_t *workers, unsigned count);
+
+void sigbus_handler(int sig, siginfo_t *info, void *context);
+
+void print_digest(const hash_algo *algo, const uint8_t *digest,
+                  const char *name, int bin);
+
+void print_tagged(const hash_algo *algo, const uint8_t *digest,
+                  const char *name);
+
+void print_tree(const hash_algo *algo, const uint8_t *digest,
+                const char *name, size_t chunk);
+
 /*---------------------------------------------------------------------------*/
 /* Main                                                                      */
 /*---------------------------------------------------------------------------*/
@@ -112,7 +361,9 @@ int main(int argc, char **argv){
     return -1;
   }
 
-  if(argc <= (optind + 1)){
+  //Files follow the command, with --all and --tree there is no command
+  int files = optind + ((arguments.all || arguments.tree) ? 0 : 1);
+  if(argc <= files){
     read_stdin = 1;
   }
 
@@ -126,147 +377,132 @@ int main(int argc, char **argv){
     return 0;
   }
 
-  FILE *fp = NULL;
-  uint8_t *msg = NULL;
-  size_t checksum_len;
-  size_t file_len;
-
-  char mode[3] = "r\0\0";
-
-  if(arguments.quiet){
-    quiet_flag = 1;
+  if(arguments.invalid){
+    printf("%s: %s\n", argv[0], arguments.invalid);
+    return -1;
   }
-  if(arguments.check){
-    fp = fopen(argv[optind], "r");
 
-    if(isDir(argv[optind])){
-      errno = EISDIR;
-      fclose(fp);
-    }
+  if(arguments.list_impls){
+    print_impls();
+    return 0;
+  }
 
-    if((fp == NULL) || errno){
-      printf("%s: %s: %s\n", argv[0], argv[optind], strerror(errno));
-      if(msg != NULL){
-        free(msg);
-      }
+  if(arguments.selftest){
+    int failed = hash_selftest(1, print_selftest_fail, NULL);
+    if(failed < 0){
+      printf("%s: not enough memory for the selftest\n", argv[0]);
       return -1;
     }
-  }else{
-    if(read_stdin == 0){
-      if(arguments.bin){
-        strcpy(mode, "rb");
-      }else{
-        strcpy(mode, "r");
-      }
-
-      fp = fopen(argv[optind+1], mode);
-
-      if(isDir(argv[optind+1])){
-        errno = EISDIR;
-        fclose(fp);
-      }
-
-      if((fp == NULL) || errno){
-        printf("%s: %s: %s\n", argv[0], argv[optind+1], strerror(errno));
-        return -1;
-      }
-
-      fseek(fp, 0, SEEK_END);
-      file_len = ftell(fp);
-      fseek(fp, 0, SEEK_SET);
+    if(failed){
+      printf("%s: %d implementations failed the selftest\n", argv[0], failed);
+      return 1;
+    }
+    printf("%s: every implementation passed the selftest\n", argv[0]);
+    return 0;
+  }
 
-      msg = malloc(file_len + 1);
-      fread(msg, file_len, 1, fp);
-      fclose(fp);
+  if(hash_use_impl(arguments.impl)){
+    printf("%s: implementation '%s' is not available on this host\n",
+           argv[0], arguments.impl);
+    printf("Try '%s --list-impls' to see those that are.\n", argv[0]);
+    return -1;
+  }
 
-      msg[file_len] = 0;
-    }else{
-      char buff;
-      size_t chars_readed = 0;
-      while((buff = getc(stdin)) != EOF){
-        chars_readed++;
-        msg = realloc(msg, chars_readed + 1);
-        msg[chars_readed - 1] = buff;
-      }
-      if(chars_readed == 0){
-        msg = malloc(sizeof(uint8_t));
-      }
-      msg[chars_readed] = '\0';
-      file_len = chars_readed;
-    }
+  if(!arguments.all && !arguments.tree && (optind >= argc)){
+    printf("%s: missing command\n", argv[0]);
+    printf("Try '%s --help' for more information.\n", argv[0]);
+    return -1;
   }
 
-  uint8_t digest[64] = {0};
+  size_t num_algos = 0;
+  while(hash_algos[num_algos].name != NULL){
+    num_algos++;
+  }
+  const hash_algo *algos[num_algos];
 
-  if(!strcmp(argv[optind], "md5")){
-    checksum_len = 16;
-    if(md5_sum(msg, file_len, digest)){
-      if(msg != NULL){
-        free(msg);
-      }
+  if(arguments.tree){
+    if(arguments.all){
+      printf("%s: --tree and --all cannot be used together\n", argv[0]);
       return -1;
     }
-  }else if(!strcmp(argv[optind], "sha1")){
-    checksum_len = 20;
-    if(sha1_sum(msg, file_len, digest)){
-      if(msg != NULL){
-        free(msg);
-      }
+    algos[0] = hash_find(arguments.tree);
+    if(algos[0] == NULL){
+      printf("%s: %s: No valid command\n", argv[0], arguments.tree);
       return -1;
     }
-  }
-  else if(!strcmp(argv[optind], "sha224")){
-    checksum_len = 28;
-    if(sha224_sum(msg, file_len, digest)){
-      if(msg != NULL){
-        free(msg);
-      }
-      return -1;
+    num_algos = 1;
+  }else if(arguments.all){
+    size_t i;
+    for(i = 0; i < num_algos; i++){
+      algos[i] = &hash_algos[i];
     }
-  }else if(!strcmp(argv[optind], "sha256")){
-    checksum_len = 32;
-    if(sha256_sum(msg, file_len, digest)){
-      if(msg != NULL){
-        free(msg);
-      }
+  }else{
+    const char *bad;
+    num_algos = select_algos(argv[optind], algos, &bad);
+    if(num_algos == 0){
+      printf("%s: %s: No valid command\n", argv[0], bad);
       return -1;
     }
   }
-  else if(!strcmp(argv[optind], "sha384")){
-    checksum_len = 48;
-    if(sha384_sum(msg, file_len, digest)){
-      if(msg != NULL){
-        free(msg);
-      }
-      return -1;
-    }
-  }else if(!strcmp(argv[optind], "sha512")){
-    checksum_len = 64;
-    if(sha512_sum(msg, file_len, digest)){
-      if(msg != NULL){
-        free(msg);
-      }
+  if(arguments.quiet){
+    quiet_flag = 1;
+  }
+  if(arguments.length && arguments.tree){
+    printf("%s: --length cannot be used with --tree\n", argv[0]);
+    return -1;
+  }
+  if(arguments.length){
+    size_t i;
+    for(i = 0; (i < num_algos) && (algos[i]->xof == NULL); i++);
+    if(i == num_algos){
+      printf("%s: --length only applies to shake128 and shake256\n", argv[0]);
       return -1;
     }
-  }else{
-    printf("%s: %s: No valid command\n", argv[0], argv[optind]);
-    free(msg);
-    return -1;
+    xof_length = arguments.length;
   }
 
-  int i;
-  for(i = 0; i<checksum_len; i++){
-    printf("%02x", digest[i]);
+  char *std_in[] = {"-"};
+  char **names = read_stdin ? std_in : argv + files;
+  int count = read_stdin ? 1 : argc - files;
+
+  //Each worker streams its files through its own buffer and contexts, when
+  //checking each file is hashed with the algorithm of its line
+  run_t run;
+  run.program = argv[0];
+  run.algos = algos;
+  run.count = num_algos;
+  run.bin = arguments.bin;
+  run.status = 0;
+  run.num_workers = arguments.jobs;
+  //The jobs also bound the threads that share a single big input
+  hash_set_threads(arguments.jobs);
+  run.recursive = arguments.recursive;
+  run.tree = arguments.tree ? arguments.chunk_size : 0;
+  //The batches only give outputs of the default length
+  run.batch = ((num_algos == 1) && !xof_length && !run.tree)
+              ? algos[0]->batch : NULL;
+  run.workers = workers_create(run.num_workers, &arguments, algos,
+                               arguments.check ? 1 : num_algos);
+  if(run.workers == NULL){
+    printf("%s: %s\n", argv[0], strerror(ENOMEM));
+    return -1;
   }
-  if(argv[optind+1]){
-    printf("  %s\n", argv[optind+1]);
-  }else{
-    printf("  -\n");
+  unsigned w;
+  for(w = 0; w < run.num_workers; w++){
+    run.workers[w].tree = run.tree;
+  }
+  if(arguments.io == IO_MMAP){
+    watch_mappings(run.workers, run.num_workers);
   }
 
-  if(msg != NULL){
-    free(msg);
+  if(arguments.check){
+    check_files(&run, names, count);
+  }else{
+    hash_files(&run, names, count);
   }
+
+  workers_free(run.workers, run.num_workers);
+  return run.status;
 }
 
 /*---------------------------------------------------------------------------*/
@@ -282,9 +518,37 @@ void print_help(char *program_name){
     printf("\t-c, --check          read checksums from the FILEs and check them\n");
     printf("\t-t, --text           read in text mode (by default)\n");
     printf("\t    --quiet          don't print OK for each successfully verified file\n");
+    printf("\t    --buffer-size=N  read files N bytes at a time, N may end in K, M\n");
+    printf("\t                     or G (128K by default)\n");
+    printf("\t    --io=METHOD      read regular files with mmap (default) or\n");
+    printf("\t                     read\n");
+    printf("\t-j, --jobs=N         hash up to N files at once, or a big file with\n");
+    printf("\t                     N threads for blake3, blake2bp, blake2sp and\n");
+    printf("\t                     --tree\n");
+    printf("\t                     (one per online CPU by default)\n");
+    printf("\t-l, --length=BITS    output BITS bits of shake128 and shake256, a\n");
+    printf("\t                     multiple of 8 up to 512 (256 and 512 by\n");
+    printf("\t                     default)\n");
+    printf("\t-r, --recursive      hash every file below the FILEs that are\n");
+    printf("\t                     directories, sorted by name\n");
+    printf("\t    --all            compute every checksum, no OPTION is given\n");
+    printf("\t    --tree=OPTION    hash each FILE as a tree of OPTION checksums of\n");
+    printf("\t                     its chunks, hashed in parallel, no OPTION is\n");
+    printf("\t                     given; see Tree hash below\n");
+    printf("\t    --chunk-size=N   chunks of N bytes for --tree, N may end in K, M\n");
+    printf("\t                     or G (4M by default)\n");
+    printf("\t    --digest-threads hash each checksum on its own thread\n");
+    printf("\t    --impl=NAME      run the NAME implementation of the checksums,\n");
+    printf("\t                     e.g. scalar or avx2 (auto, the fastest, by\n");
+    printf("\t                     default)\n");
+    printf("\t    --list-impls     list the implementations this host runs\n");
+    printf("\t    --selftest       check every implementation of every checksum\n");
+    printf("\t                     against known answers and the scalar one\n");
     printf("\t-h, --help           display this help and exit\n");
     printf("\t-v, --version        output version information and exit\n\n");
     printf("Options:\n");
+    printf("\tSeveral OPTIONs separated by commas, e.g. md5,sha256, compute all\n");
+    printf("\tof them reading each file only once.\n\n");
     printf("\t-Message Digest Algorithm:\n");
     printf("\n\tmd5                  Print or check MD5 (128-bit) checksums\n");
     printf("\n\t-Secure Hash Algorithm 1:\n");
@@ -294,6 +558,38 @@ void print_help(char *program_name){
     printf("\tsha256               Print or check SHA-256 checksums\n");
     printf("\tsha384               Print or check SHA-384 checksums\n");
     printf("\tsha512               Print or check SHA-512 checksums\n");
+    printf("\tsha512_224           Print or check SHA-512/224 checksums\n");
+    printf("\tsha512_256           Print or check SHA-512/256 checksums\n");
+    printf("\n\t-Secure Hash Algorithm 3:\n");
+    printf("\n\tsha3_224             Print or check SHA3-224 checksums\n");
+    printf("\tsha3_256             Print or check SHA3-256 checksums\n");
+    printf("\tsha3_384             Print or check SHA3-384 checksums\n");
+    printf("\tsha3_512             Print or check SHA3-512 checksums\n");
+    printf("\tshake128             Print or check SHAKE128 outputs, see --length\n");
+    printf("\tshake256             Print or check SHAKE256 outputs, see --length\n");
+    printf("\n\t-BLAKE2:\n");
+    printf("\n\tblake2b              Print or check BLAKE2b (512-bit) checksums\n");
+    printf("\tblake2s              Print or check BLAKE2s (256-bit) checksums\n");
+    printf("\tblake2bp             Print or check BLAKE2bp (512-bit) checksums\n");
+    printf("\tblake2sp             Print or check BLAKE2sp (256-bit) checksums\n");
+    printf("\n\t-BLAKE3:\n");
+    printf("\n\tblake3               Print or check BLAKE3 (256-bit) checksums\n");
+    printf("\n\t-xxHash, fast but not cryptographic:\n");
+    printf("\n\txxh64                Print or check XXH64 (64-bit) checksums\n");
+    printf("\txxh3                 Print or check XXH3 (64-bit) checksums\n");
+    printf("\txxh128               Print or check XXH128 (128-bit) checksums\n");
+    printf("\n\t-Cyclic redundancy checks, not cryptographic:\n");
+    printf("\n\tcrc32c               Print or check CRC-32C (Castagnoli) checksums\n");
+    printf("\tcrc32                Print or check CRC-32 checksums, as zlib\n");
+    printf("\tcksum                Print or check POSIX cksum CRCs, in hex\n");
+    printf("\nTree hash:\n");
+    printf("\tWith --tree=H the FILE is split in chunks of --chunk-size bytes,\n");
+    printf("\tthe last one may be shorter and an empty FILE is one empty chunk.\n");
+    printf("\tEach chunk gives the leaf H(0x00 || chunk) and each pair of nodes,\n");
+    printf("\tfrom the left, the parent H(0x01 || left || right); the last node\n");
+    printf("\tof an odd level moves up unchanged. The root is printed as\n");
+    printf("\t'H-TREE-SIZE (FILE) = hex', e.g. SHA256-TREE-4M, and --check\n");
+    printf("\tverifies those lines with the chunk size they name.\n");
 }
 
 void print_version(){
@@ -306,6 +602,30 @@ void print_version(){
   printf("Writen by Raul San Martin Aniceto.\n");
 }
 
+//One line per algorithm with the implementations the host supports
+void print_impls(){
+  const hash_algo *algo;
+  const hash_impl *impl;
+
+  for(algo = hash_algos; algo->name != NULL; algo++){
+    printf("%-12s", algo->name);
+    for(impl = algo->impls; impl->name != NULL; impl++){
+      if(hash_impl_usable(impl)){
+        printf(" %s", impl->name);
+      }
+    }
+    putchar('\n');
+  }
+}
+
+//Reports an implementation hash_selftest demoted
+void print_selftest_fail(const hash_algo *algo, const hash_impl *impl,
+                         const char *test, size_t len, void *arg){
+  (void)arg;
+  printf("%s: %s failed the %s test on %zu bytes\n", algo->name, impl->name,
+         test, len);
+}
+
 args_t process_args(int num, char **arguments){
   args_t result;
   int option_index;
@@ -317,9 +637,22 @@ args_t process_args(int num, char **arguments){
   result.quiet = 0;
   result.version = 0;
   result.check = 0;
+  result.buffer_size = DEFAULT_BUFFER_SIZE;
+  result.io = IO_MMAP;
+  result.jobs = online_cpus();
+  result.all = 0;
+  result.digest_threads = 0;
+  result.recursive = 0;
+  result.impl = "auto";
+  result.length = 0;
+  result.list_impls = 0;
+  result.selftest = 0;
+  result.tree = NULL;
+  result.chunk_size = DEFAULT_CHUNK_SIZE;
+  result.invalid = NULL;
   result.no_valid_optn = 0;
 
-  while((c = getopt_long(num, arguments,"hbtqvc:",long_options,
+  while((c = getopt_long(num, arguments,"hbtqvcrj:l:",long_options,
             &option_index)) != -1){
     switch(c){
       case 'h':
@@ -346,6 +679,79 @@ args_t process_args(int num, char **arguments){
         result.check = 1;
       break;
 
+      case OPT_BUFFER_SIZE:
+        if(parse_size(optarg, &result.buffer_size)){
+          result.invalid = "invalid buffer size";
+        }
+      break;
+
+      case 'j':
+        errno = 0;
+        char *end;
+        unsigned long jobs = strtoul(optarg, &end, 10);
+        if(errno || (end == optarg) || *end || (jobs == 0) || (jobs > 4096)
+           || (*optarg == '-')){
+          result.invalid = "invalid number of jobs";
+        }else{
+          result.jobs = jobs;
+        }
+      break;
+
+      case 'l':
+        errno = 0;
+        unsigned long bits = strtoul(optarg, &end, 10);
+        if(errno || (end == optarg) || *end || (bits == 0) || (bits % 8)
+           || (bits > 8 * HASH_MAX_DIGEST) || (*optarg == '-')){
+          result.invalid = "invalid length, use a multiple of 8 up to 512";
+        }else{
+          result.length = bits / 8;
+        }
+      break;
+
+      case 'r':
+        result.recursive = 1;
+      break;
+
+      case OPT_ALL:
+        result.all = 1;
+      break;
+
+      case OPT_DIGEST_THREADS:
+        result.digest_threads = 1;
+      break;
+
+      case OPT_IMPL:
+        result.impl = optarg;
+      break;
+
+      case OPT_LIST_IMPLS:
+        result.list_impls = 1;
+      break;
+
+      case OPT_SELFTEST:
+        result.selftest = 1;
+      break;
+
+      case OPT_TREE:
+        result.tree = optarg;
+      break;
+
+      case OPT_CHUNK_SIZE:
+        if(parse_size(optarg, &result.chunk_size)){
+          result.invalid = "invalid chunk size";
+        }
+      break;
+
+      case OPT_IO:
+        if(!strcmp(optarg, "mmap")){
+          result.io = IO_MMAP;
+        }else if(!strcmp(optarg, "read")){
+          result.io = IO_READ;
+        }else{
+          result.invalid = "invalid I/O method, use mmap or read";
+        }
+      break;
+
       case '?':
         result.no_valid_optn = optind - 1;
       break;
@@ -364,3 +770,983 @@ int isDir(const char *path){
   }
   return S_ISDIR(statbuf.st_mode);
 }
+
+int parse_size(const char *str, size_t *size){
+  char *end;
+  unsigned long long value;
+  int shift = 0;
+
+  errno = 0;
+  value = strtoull(str, &end, 10);
+  if((end == str) || errno || (*str == '-')){
+    return -1;
+  }
+
+  switch(*end){
+    case 'K':
+      shift = 10;
+      end++;
+    break;
+
+    case 'M':
+      shift = 20;
+      end++;
+    break;
+
+    case 'G':
+      shift = 30;
+      end++;
+    break;
+  }
+
+  if((*end != '\0') || (value == 0) || (value > (SIZE_MAX >> shift))){
+    return -1;
+  }
+  *size = (size_t)value << shift;
+  return 0;
+}
+
+//name is relative to the directory dir, or AT_FDCWD
+int hash_file(int dir, const char *name, worker_t *worker, uint8_t *digests){
+  struct stat st;
+  int fd;
+  int err;
+
+  if((dir == AT_FDCWD) && !strcmp(name, "-")){
+    io_t io = worker->reader.io;
+    worker->reader.io = IO_READ; //stdin may be a partially consumed file
+    err = hash_fd(STDIN_FILENO, worker, digests);
+    worker->reader.io = io;
+    return err;
+  }
+
+  fd = openat(dir, name, O_RDONLY);
+  if(fd < 0){
+    return -1;
+  }
+  if(!fstat(fd, &st) && S_ISDIR(st.st_mode)){
+    close(fd);
+    errno = EISDIR;
+    return -1;
+  }
+
+  err = hash_fd(fd, worker, digests);
+  close(fd);
+
+  return err;
+}
+
+int hash_fd(int fd, worker_t *worker, uint8_t *digests){
+  struct stat st;
+  int err;
+
+  if(worker->tree){
+    return tree_hash_fd(worker->digester.algos[0], fd, worker->tree, digests);
+  }
+
+  digester_init(&worker->digester);
+  //procfs and sysfs files report 0 bytes whatever they hold, only read(2)
+  //sees their contents
+  if((worker->reader.io == IO_MMAP) && !fstat(fd, &st) && S_ISREG(st.st_mode)
+     && (st.st_size > 0)){
+    err = feed_mmap(fd, st.st_size, worker);
+  }else{
+    err = feed_read(fd, worker);
+  }
+  if(err){
+    return -1;
+  }
+  digester_final(&worker->digester, digests);
+
+  return 0;
+}
+
+int feed_read(int fd, worker_t *worker){
+  reader_t *reader = &worker->reader;
+  ssize_t readed;
+
+  for(;;){
+    readed = read(fd, reader->buf, reader->buf_size);
+    if(readed == 0){//End of file
+      break;
+    }
+    if(readed < 0){
+      if(errno == EINTR){
+        continue;
+      }
+      return -1;
+    }
+    digester_update(&worker->digester, reader->buf, readed);
+  }
+
+  return 0;
+}
+
+int feed_mmap(int fd, off_t size, worker_t *worker){
+  reader_t *reader = &worker->reader;
+  off_t offset = 0;
+
+  //The file is mapped window by window and hashed straight from the mapping
+  while(offset < size){
+    size_t len = MMAP_WINDOW;
+    if((off_t)len > size - offset){
+      len = size - offset;
+    }
+
+    uint8_t *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, offset);
+    if(map == MAP_FAILED){//The rest is read, from where the mappings ended
+      if(lseek(fd, offset, SEEK_SET) < 0){
+        return -1;
+      }
+      return feed_read(fd, worker);
+    }
+    madvise(map, len, MADV_SEQUENTIAL);
+    madvise(map, len, MADV_WILLNEED);
+
+    __atomic_store_n(&reader->map_len, len, __ATOMIC_RELAXED);
+    __atomic_store_n(&reader->map, map, __ATOMIC_RELEASE);
+    digester_update(&worker->digester, map, len);
+    __atomic_store_n(&reader->map, NULL, __ATOMIC_RELEASE);
+    munmap(map, len);
+    if(reader->truncated){
+      reader->truncated = 0;
+      errno = EIO;
+      return -1;
+    }
+    offset += len;
+  }
+
+  return 0;
+}
+
+//Installs sigbus_handler for the mappings of workers
+void watch_mappings(worker_t *workers, unsigned count){
+  struct sigaction action;
+  long page = sysconf(_SC_PAGESIZE);
+
+  if(page > 0){
+    page_size = page;
+  }
+  mapped_workers = workers;
+  num_mapped = count;
+
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = sigbus_handler;
+  action.sa_flags = SA_SIGINFO;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGBUS, &action, NULL);
+}
+
+//Reading the pages of a mapping past the end of a file that shrank raises
+//SIGBUS, on whichever thread is hashing them. The rest of the window is
+//replaced by zeros so the hash goes on, and feed_mmap fails once it ends.
+//Faults outside the mappings kill the program as usual.
+void sigbus_handler(int sig, siginfo_t *info, void *context){
+  uint8_t *addr = info->si_addr;
+  unsigned i;
+  (void)context;
+
+  for(i = 0; i < num_mapped; i++){
+    reader_t *reader = &mapped_workers[i].reader;
+    uint8_t *map = __atomic_load_n(&reader->map, __ATOMIC_ACQUIRE);
+    size_t len = __atomic_load_n(&reader->map_len, __ATOMIC_RELAXED);
+
+    if((map != NULL) && (addr >= map) && (addr < map + len)){
+      uint8_t *page = (uint8_t *)((uintptr_t)addr & ~(page_size - 1));
+      if(mmap(page, map + len - page, PROT_READ,
+              MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED){
+        reader->truncated = 1;
+        return;
+      }
+      break;
+    }
+  }
+  signal(sig, SIG_DFL); //The access faults again and is fatal
+}
+
+void print_digest(const hash_algo *algo, const uint8_t *digest,
+                  const char *name, int bin){
+  size_t i;
+
+  for(i = 0; i < output_len(algo); i++){
+    printf("%02x", digest[i]);
+  }
+  //Same layout as coreutils, '*' marks files read in binary mode
+  printf(" %c%s\n", bin ? '*' : ' ', name);
+}
+
+//BSD style line, used when several checksums are printed for each file
+void print_tagged(const hash_algo *algo, const uint8_t *digest,
+                  const char *name){
+  const char *c;
+  size_t i;
+
+  for(c = algo->name; *c; c++){
+    putchar(toupper((unsigned char)*c));
+  }
+  printf(" (%s) = ", name);
+  for(i = 0; i < output_len(algo); i++){
+    printf("%02x", digest[i]);
+  }
+  putchar('\n');
+}
+
+//Tagged line of a tree hash, the chunk size in the largest unit that is exact
+void print_tree(const hash_algo *algo, const uint8_t *digest,
+                const char *name, size_t chunk){
+  static const char units[] = "KMG";
+  const char *c;
+  int unit = 0;
+  size_t i;
+
+  for(c = algo->name; *c; c++){
+    putchar(toupper((unsigned char)*c));
+  }
+  while((unit < 3) && !(chunk & 1023)){
+    chunk >>= 10;
+    unit++;
+  }
+  printf(TREE_TAG "%zu", chunk);
+  if(unit){
+    putchar(units[unit - 1]);
+  }
+  printf(" (%s) = ", name);
+  for(i = 0; i < algo->digest_len; i++){
+    printf("%02x", digest[i]);
+  }
+  putchar('\n');
+}
+
+unsigned online_cpus(){
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+  if(cpus < 1){
+    return 1;
+  }
+  return (cpus > 4096) ? 4096 : cpus;
+}
+
+size_t select_algos(char *list, const hash_algo **algos, const char **bad){
+  size_t count = 0;
+  char *save;
+  char *name;
+
+  for(name = strtok_r(list, ",", &save); name != NULL;
+      name = strtok_r(NULL, ",", &save)){
+    const hash_algo *algo = hash_find(name);
+    size_t i;
+
+    if(algo == NULL){
+      *bad = name;
+      return 0;
+    }
+    for(i = 0; (i < count) && (algos[i] != algo); i++);
+    if(i == count){//Repeated names are computed once
+      algos[count++] = algo;
+    }
+  }
+
+  *bad = list;
+  return count;
+}
+
+//Bytes of the digests of algo, those of --length for shake
+size_t output_len(const hash_algo *algo){
+  if(xof_length && (algo->xof != NULL)){
+    return xof_length;
+  }
+  return algo->digest_len;
+}
+
+worker_t *workers_create(unsigned count, const args_t *arguments,
+                         const hash_algo **algos, size_t num_algos){
+  worker_t *workers = calloc(count, sizeof(worker_t));
+  unsigned i;
+
+  if(workers == NULL){
+    return NULL;
+  }
+  for(i = 0; i < count; i++){
+    workers[i].reader.io = arguments->io;
+    workers[i].reader.buf_size = arguments->buffer_size;
+    workers[i].reader.buf = malloc(arguments->buffer_size);
+    if((workers[i].reader.buf == NULL)
+       || digester_create(&workers[i].digester, algos, num_algos,
+                          arguments->digest_threads)){
+      free(workers[i].reader.buf);
+      workers_free(workers, i);
+      return NULL;
+    }
+  }
+  return workers;
+}
+
+void workers_free(worker_t *workers, unsigned count){
+  unsigned i;
+
+  if(workers == NULL){
+    return;
+  }
+  for(i = 0; i < count; i++){
+    digester_destroy(&workers[i].digester);
+    free(workers[i].reader.buf);
+    free(workers[i].small);
+  }
+  free(workers);
+}
+
+int digester_create(digester_t *digester, const hash_algo **algos,
+                    size_t count, int threaded){
+  memset(digester, 0, sizeof(digester_t));
+  digester->algos = algos;
+  digester->count = count;
+  digester->ctxs = calloc(count, sizeof(hash_ctx));
+  if(digester->ctxs == NULL){
+    return -1;
+  }
+
+  if(!threaded || (count < 2)){
+    return 0;
+  }
+
+  digester->threads = calloc(count - 1, sizeof(pthread_t));
+  digester->lanes = calloc(count - 1, sizeof(struct digester_lane));
+  if((digester->threads == NULL) || (digester->lanes == NULL)){
+    free(digester->lanes);
+    free(digester->threads);
+    free(digester->ctxs);
+    return -1;
+  }
+  //The barriers count on every thread, so the threads wait for them to
+  //exist and are sent back if one of them cannot start
+  pthread_mutex_init(&digester->starting, NULL);
+  pthread_mutex_lock(&digester->starting);
+  size_t i;
+  for(i = 0; i < count - 1; i++){
+    digester->lanes[i].digester = digester;
+    digester->lanes[i].index = i + 1;
+    if(pthread_create(&digester->threads[i], NULL, digester_thread,
+                      &digester->lanes[i])){
+      break;
+    }
+  }
+  if(i == count - 1){
+    pthread_barrier_init(&digester->start, NULL, count);
+    pthread_barrier_init(&digester->end, NULL, count);
+    pthread_mutex_unlock(&digester->starting);
+    return 0;
+  }
+
+  //Without enough threads every algorithm is hashed by the caller
+  size_t started = i;
+  digester->stop = 1;
+  pthread_mutex_unlock(&digester->starting);
+  for(i = 0; i < started; i++){
+    pthread_join(digester->threads[i], NULL);
+  }
+  pthread_mutex_destroy(&digester->starting);
+  free(digester->lanes);
+  free(digester->threads);
+  digester->lanes = NULL;
+  digester->threads = NULL;
+  digester->stop = 0;
+
+  return 0;
+}
+
+void digester_destroy(digester_t *digester){
+  if(digester->threads != NULL){
+    size_t i;
+
+    digester->stop = 1;
+    pthread_barrier_wait(&digester->start);
+    for(i = 0; i < digester->count - 1; i++){
+      pthread_join(digester->threads[i], NULL);
+    }
+    pthread_barrier_destroy(&digester->end);
+    pthread_barrier_destroy(&digester->start);
+    pthread_mutex_destroy(&digester->starting);
+    free(digester->lanes);
+    free(digester->threads);
+  }
+  free(digester->ctxs);
+}
+
+void digester_init(digester_t *digester){
+  size_t i;
+
+  for(i = 0; i < digester->count; i++){
+    digester->algos[i]->init(&digester->ctxs[i]);
+  }
+}
+
+void digester_update(digester_t *digester, const uint8_t *data, size_t len){
+  size_t i;
+
+  if(digester->threads == NULL){
+    for(i = 0; i < digester->count; i++){
+      digester->algos[i]->update(&digester->ctxs[i], data, len);
+    }
+    return;
+  }
+
+  digester->data = data;
+  digester->len = len;
+  pthread_barrier_wait(&digester->start);
+  digester->algos[0]->update(&digester->ctxs[0], data, len);
+  pthread_barrier_wait(&digester->end);
+}
+
+void digester_final(digester_t *digester, uint8_t *digests){
+  size_t i;
+
+  for(i = 0; i < digester->count; i++){
+    const hash_algo *algo = digester->algos[i];
+
+    if(xof_length && (algo->xof != NULL)){
+      algo->xof(&digester->ctxs[i], digests + i * HASH_MAX_DIGEST,
+                xof_length);
+    }else{
+      algo->final(&digester->ctxs[i], digests + i * HASH_MAX_DIGEST);
+    }
+  }
+}
+
+//Hashes one of the algorithms of a digester, block after block
+void *digester_thread(void *arg){
+  struct digester_lane *lane = arg;
+  digester_t *digester = lane->digester;
+  size_t i = lane->index;
+
+  pthread_mutex_lock(&digester->starting);
+  pthread_mutex_unlock(&digester->starting);
+  if(digester->stop){//Another thread of the digester did not start
+    return NULL;
+  }
+  for(;;){
+    pthread_barrier_wait(&digester->start);
+    if(digester->stop){
+      break;
+    }
+    digester->algos[i]->update(&digester->ctxs[i], digester->data,
+                               digester->len);
+    pthread_barrier_wait(&digester->end);
+  }
+
+  return NULL;
+}
+
+void hash_files(run_t *run, char **names, int count){
+  size_t window = (size_t)run->num_workers * JOBS_PER_WORKER;
+  size_t per_batch = run->batch ? BATCH_FILES : 1;
+  batch_t *batches = calloc(window + 1, sizeof(batch_t));
+  job_t *jobs = calloc((window + 1) * per_batch, sizeof(job_t));
+  uint8_t *digests = calloc((window + 1) * per_batch * run->count,
+                            HASH_MAX_DIGEST);
+  pool_t *pool = NULL;
+
+  if((batches != NULL) && (jobs != NULL) && (digests != NULL)){
+    pool = pool_create(run->num_workers, window, hash_job, emit_job, run);
+  }
+  if(pool == NULL){
+    printf("%s: %s\n", run->program, strerror(ENOMEM));
+    free(digests);
+    free(jobs);
+    free(batches);
+    run->status = -1;
+    return;
+  }
+
+  //At most window batches are in the pool, so with one slot more the slot
+  //filled next always belongs to a batch already emitted
+  size_t n;
+  for(n = 0; n < (window + 1) * per_batch; n++){
+    jobs[n].digests = digests + n * run->count * HASH_MAX_DIGEST;
+  }
+  for(n = 0; n < window + 1; n++){
+    batches[n].files = jobs + n * per_batch;
+  }
+  feeder_t feeder = {run, pool, batches, window + 1, per_batch, 1, 0};
+
+  //The files found with -r are queued as soon as their directory is listed
+  int i;
+  for(i = 0; i < count; i++){
+    if(run->recursive && isDir(names[i])){
+      if(walk_tree(names[i], run->num_workers, walk_file, walk_error,
+                   &feeder)){
+        walk_error(names[i], errno, &feeder);
+      }
+      continue;
+    }
+    job_t job = {names[i], NULL, AT_FDCWD, names[i], NULL, 0, 0, NULL};
+    feed_file(&feeder, &job, count - i);
+  }
+  batch_t *batch = &batches[feeder.n % feeder.slots];
+  if(batch->count){
+    pool_submit(pool, batch);
+  }
+  pool_finish(pool);
+
+  free(digests);
+  free(jobs);
+  free(batches);
+}
+
+//Adds a file to the batch being filled and submits the batch once full.
+//files counts the operands left, or the files of the directory of path.
+void feed_file(feeder_t *feeder, const job_t *job, size_t files){
+  batch_t *batch = &feeder->batches[feeder->n % feeder->slots];
+
+  //Batches small enough to give every worker a share
+  if((batch->count == 0) && (feeder->per_batch > 1)){
+    size_t limit = files / feeder->run->num_workers;
+    feeder->limit = (limit < 1) ? 1 : (limit > feeder->per_batch)
+                    ? feeder->per_batch : limit;
+  }
+
+  job_t *file = &batch->files[batch->count++];
+  file->name = job->name;
+  file->path = job->path;
+  file->dir = job->dir;
+  file->base = job->base;
+  file->walked = job->walked;
+  file->unlisted = job->unlisted;
+  if(batch->count >= feeder->limit){
+    pool_submit(feeder->pool, batch);
+    feeder->n++;
+    feeder->batches[feeder->n % feeder->slots].count = 0;
+  }
+}
+
+//Called by walk_tree, in order. The file is opened relative to its
+//directory, which stays open until the batch is emitted.
+void walk_file(char *path, const char *name, int dir_fd, walk_dir_t *dir,
+               size_t files, void *arg){
+  job_t job = {path, path, dir_fd, name, dir, 0, 0, NULL};
+
+  feed_file(arg, &job, files);
+}
+
+//Called by walk_tree, in order. The error is queued like a file, so it is
+//reported between the lines of the files around it.
+void walk_error(const char *path, int err, void *arg){
+  run_t *run = ((feeder_t *)arg)->run;
+  char *copy = strdup(path);
+  job_t job = {copy, copy, AT_FDCWD, copy, NULL, err, 0, NULL};
+
+  if(copy == NULL){
+    fflush(stdout);
+    fprintf(stderr, "%s: %s: %s\n", run->program, path, strerror(err));
+    run->status = -1;
+    return;
+  }
+  feed_file(arg, &job, 1);
+}
+
+//Runs on a worker thread
+void hash_job(void *job, unsigned worker, void *arg){
+  batch_t *batch = job;
+  run_t *run = arg;
+  size_t i;
+
+  if(run->batch != NULL){
+    hash_batch(run->algos[0], &run->workers[worker], batch);
+    return;
+  }
+  for(i = 0; i < batch->count; i++){
+    job_t *file = &batch->files[i];
+
+    file->err = file->unlisted;
+    if(!file->err && hash_file(file->dir, file->base, &run->workers[worker],
+                               file->digests)){
+      file->err = errno;
+    }
+  }
+}
+
+//Runs on the main thread, in the order of the operands
+void emit_job(void *job, void *arg){
+  batch_t *batch = job;
+  run_t *run = arg;
+  size_t i, j;
+
+  for(i = 0; i < batch->count; i++){
+    job_t *file = &batch->files[i];
+
+    if(file->err){
+      fflush(stdout); //Keep the error next to its line
+      fprintf(stderr, "%s: %s: %s\n", run->program, file->name,
+              strerror(file->err));
+      run->status = -1;
+      continue;
+    }
+
+    if(run->tree){
+      print_tree(run->algos[0], file->digests, file->name, run->tree);
+      continue;
+    }
+    if(run->count == 1){
+      print_digest(run->algos[0], file->digests, file->name, run->bin);
+      continue;
+    }
+    for(j = 0; j < run->count; j++){
+      print_tagged(run->algos[j], file->digests + j * HASH_MAX_DIGEST,
+                   file->name);
+    }
+  }
+
+  for(i = 0; i < batch->count; i++){
+    free(batch->files[i].path);
+    batch->files[i].path = NULL;
+    if(batch->files[i].walked != NULL){
+      walk_release(batch->files[i].walked);
+      batch->files[i].walked = NULL;
+    }
+  }
+}
+
+//Reads the small files of a batch whole and hashes them together with the
+//batch function of algo, the rest are hashed one by one
+void hash_batch(const hash_algo *algo, worker_t *worker, batch_t *batch){
+  const uint8_t *msgs[BATCH_FILES];
+  size_t lens[BATCH_FILES];
+  job_t *small[BATCH_FILES];
+  uint8_t digests[BATCH_FILES * HASH_MAX_DIGEST];
+  size_t n = 0;
+  size_t i;
+
+  if(worker->small == NULL){
+    worker->small = malloc((size_t)BATCH_FILES * SMALL_FILE);
+  }
+  for(i = 0; i < batch->count; i++){
+    job_t *file = &batch->files[i];
+    struct stat st;
+    int fd;
+
+    file->err = file->unlisted;
+    if(file->err){
+      continue;
+    }
+    if((worker->small == NULL) || !strcmp(file->name, "-")){
+      if(hash_file(file->dir, file->base, worker, file->digests)){
+        file->err = errno;
+      }
+      continue;
+    }
+
+    fd = openat(file->dir, file->base, O_RDONLY);
+    if(fd < 0){
+      file->err = errno;
+      continue;
+    }
+    if(fstat(fd, &st)){
+      file->err = errno;
+    }else if(S_ISDIR(st.st_mode)){
+      file->err = EISDIR;
+    }else if(S_ISREG(st.st_mode) && (st.st_size >= SMALL_FILE)){
+      if(hash_fd(fd, worker, file->digests)){
+        file->err = errno;
+      }
+    }else{
+      uint8_t *buf = worker->small + n * SMALL_FILE;
+      size_t len;
+
+      if(read_small(fd, buf, &len)){
+        file->err = errno;
+      }else if(len < SMALL_FILE){
+        msgs[n] = buf;
+        lens[n] = len;
+        small[n++] = file;
+      }else{//It grew, hash it as a stream
+        digester_init(&worker->digester);
+        digester_update(&worker->digester, buf, len);
+        if(feed_read(fd, worker)){
+          file->err = errno;
+        }else{
+          digester_final(&worker->digester, file->digests);
+        }
+      }
+    }
+    close(fd);
+  }
+
+  if(n == 0){
+    return;
+  }
+  algo->batch(msgs, lens, n, digests);
+  for(i = 0; i < n; i++){
+    memcpy(small[i]->digests, digests + i * algo->digest_len,
+           algo->digest_len);
+  }
+}
+
+//Reads up to SMALL_FILE bytes of fd, less only at the end of the file
+int read_small(int fd, uint8_t *buf, size_t *len){
+  ssize_t readed;
+
+  *len = 0;
+  while(*len < SMALL_FILE){
+    readed = read(fd, buf + *len, SMALL_FILE - *len);
+    if(readed == 0){//End of file
+      break;
+    }
+    if(readed < 0){
+      if(errno == EINTR){
+        continue;
+      }
+      return -1;
+    }
+    *len += readed;
+  }
+
+  return 0;
+}
+
+void check_files(run_t *run, char **names, int count){
+  size_t window = (size_t)run->num_workers * JOBS_PER_WORKER;
+  entry_t *entries = calloc(window + 1, sizeof(entry_t));
+  pool_t *pool = NULL;
+  size_t n = 0;
+
+  if(entries != NULL){
+    pool = pool_create(run->num_workers, window, check_job, emit_check, run);
+  }
+  if(pool == NULL){
+    printf("%s: %s\n", run->program, strerror(ENOMEM));
+    free(entries);
+    run->status = -1;
+    return;
+  }
+
+  run->lines = 0;
+  run->bad_lines = 0;
+  run->unreadable = 0;
+  run->mismatched = 0;
+
+  int i;
+  for(i = 0; i < count; i++){
+    FILE *fp = strcmp(names[i], "-") ? fopen(names[i], "r") : stdin;
+    if((fp != NULL) && isDir(names[i])){
+      fclose(fp);
+      fp = NULL;
+      errno = EISDIR;
+    }
+    if(fp == NULL){
+      fprintf(stderr, "%s: %s: %s\n", run->program, names[i],
+              strerror(errno));
+      run->status = -1;
+      continue;
+    }
+
+    size_t lines = run->lines;
+    if(check_manifest(run, pool, fp, entries, &n, window + 1)){
+      fprintf(stderr, "%s: %s: %s\n", run->program, names[i],
+              strerror(errno));
+      run->status = -1;
+    }else if(run->lines == lines){
+      fprintf(stderr, "%s: %s: no properly formatted checksum lines found\n",
+              run->program, names[i]);
+      run->status = -1;
+    }
+    if(fp != stdin){
+      fclose(fp);
+    }
+  }
+  pool_finish(pool);
+
+  for(n = 0; n < window + 1; n++){
+    free(entries[n].name);
+  }
+  free(entries);
+
+  //Same summary as coreutils
+  if(run->bad_lines){
+    print_plural(run->bad_lines, "line is improperly formatted",
+                 "lines are improperly formatted");
+  }
+  if(run->unreadable){
+    print_plural(run->unreadable, "listed file could not be read",
+                 "listed files could not be read");
+  }
+  if(run->mismatched){
+    print_plural(run->mismatched, "computed checksum did NOT match",
+                 "computed checksums did NOT match");
+  }
+  if(run->bad_lines || run->unreadable || run->mismatched){
+    run->status = -1;
+  }
+}
+
+//Streams the lines of a checksum file into the pool, n counts the entries
+//submitted so far, they are kept in a ring of slots entries
+int check_manifest(run_t *run, pool_t *pool, FILE *fp, entry_t *entries,
+                   size_t *n, size_t slots){
+  char *line = NULL;
+  size_t size = 0;
+  ssize_t len;
+
+  errno = 0;
+  while((len = getline(&line, &size, fp)) >= 0){
+    if((len > 0) && (line[len - 1] == '\n')){
+      line[--len] = '\0';
+    }
+
+    entry_t *entry = &entries[*n % slots];
+    free(entry->name); //The line that used this slot was already emitted
+    entry->name = NULL;
+
+    if(parse_line(run, line, entry)){
+      run->bad_lines++;
+      continue;
+    }
+    run->lines++;
+    (*n)++;
+    pool_submit(pool, entry);
+  }
+  free(line);
+
+  return ferror(fp) ? -1 : 0;
+}
+
+//Accepts the coreutils formats 'hex  name', 'hex *name' and the tagged
+//'ALGO (name) = hex' and 'ALGO-TREE-SIZE (name) = hex'. Untagged lines are
+//matched by digest length against the algorithms given in the command line
+//and are tree hashes with --tree.
+int parse_line(run_t *run, char *line, entry_t *entry){
+  const hash_algo *algo = NULL;
+  size_t tree = 0;
+  size_t out_len;
+  char *hex;
+  char *name;
+  size_t hex_len;
+  size_t i;
+
+  char *open = strstr(line, " (");
+  char *close = strstr(line, ") = ");
+  if((open != NULL) && (close != NULL) && (open < close)){
+    char *tag = strstr(line, TREE_TAG);
+    size_t tag_len = open - line;
+    if((tag != NULL) && (tag < open)){
+      char size[32];
+      size_t size_len = open - tag - strlen(TREE_TAG);
+      if(size_len >= sizeof(size)){
+        return -1;
+      }
+      memcpy(size, tag + strlen(TREE_TAG), size_len);
+      size[size_len] = '\0';
+      if(parse_size(size, &tree)){
+        return -1;
+      }
+      tag_len = tag - line;
+    }
+    for(i = 0; hash_algos[i].name != NULL; i++){
+      if((strlen(hash_algos[i].name) == tag_len)
+         && !strncasecmp(hash_algos[i].name, line, tag_len)){
+        algo = &hash_algos[i];
+      }
+    }
+    name = close;
+    while((close = strstr(name + 1, ") = ")) != NULL){//The name may hold ") = "
+      name = close;
+    }
+    hex = name + 4;
+    *name = '\0';
+    name = open + 2;
+    hex_len = strlen(hex);
+  }else{
+    hex = line;
+    hex_len = strspn(line, "0123456789abcdefABCDEF");
+    if((line[hex_len] != ' ') || ((line[hex_len + 1] != ' ')
+       && (line[hex_len + 1] != '*'))){
+      return -1;
+    }
+    name = line + hex_len + 2;
+    tree = run->tree;
+    for(i = 0; i < run->count; i++){
+      if(output_len(run->algos[i]) * 2 == hex_len){
+        algo = run->algos[i];
+        break;
+      }
+    }
+  }
+
+  if(algo == NULL){
+    return -1;
+  }
+  //Tree hashes keep the default length of shake
+  out_len = tree ? algo->digest_len : output_len(algo);
+  if((hex_len != out_len * 2) || (*name == '\0')){
+    return -1;
+  }
+  for(i = 0; i < out_len; i++){
+    int high = hex_nibble(hex[2*i]);
+    int low = hex_nibble(hex[2*i + 1]);
+    if((high < 0) || (low < 0)){
+      return -1;
+    }
+    entry->expected[i] = (high << 4) | low;
+  }
+
+  entry->name = strdup(name);
+  if(entry->name == NULL){
+    return -1;
+  }
+  entry->algo = algo;
+  entry->tree = tree;
+  return 0;
+}
+
+//Runs on a worker thread
+void check_job(void *job, unsigned worker, void *arg){
+  entry_t *entry = job;
+  run_t *run = arg;
+  worker_t *self = &run->workers[worker];
+
+  //The digester of a worker holds a single context when checking
+  self->digester.algos = &entry->algo;
+  self->tree = entry->tree;
+
+  entry->err = 0;
+  if(hash_file(AT_FDCWD, entry->name, self, entry->digest)){
+    entry->err = errno;
+  }
+}
+
+//Runs on the main thread, in the order of the lines
+void emit_check(void *job, void *arg){
+  entry_t *entry = job;
+  run_t *run = arg;
+
+  if(entry->err){
+    fflush(stdout);
+    fprintf(stderr, "%s: %s: %s\n", run->program, entry->name,
+            strerror(entry->err));
+    printf("%s: FAILED open or read\n", entry->name);
+    run->unreadable++;
+  }else if(memcmp(entry->digest, entry->expected,
+                  entry->tree ? entry->algo->digest_len
+                              : output_len(entry->algo))){
+    printf("%s: FAILED\n", entry->name);
+    run->mismatched++;
+  }else if(!quiet_flag){
+    printf("%s: OK\n", entry->name);
+  }
+}
+
+int hex_nibble(char c){
+  if((c >= '0') && (c <= '9')){
+    return c - '0';
+  }
+  if((c >= 'a') && (c <= 'f')){
+    return c - 'a' + 10;
+  }
+  if((c >= 'A') && (c <= 'F')){
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+void print_plural(size_t count, const char *one, const char *many){
+  fflush(stdout);
+  fprintf(stderr, "WARNING: %zu %s\n", count, (count == 1) ? one : many);
+}
@@ -39,6 +39,25 @@ SOFTWARE.
 /* Constant declarations                                                     */
 /*---------------------------------------------------------------------------*/
 
+#define HASH_MAX_DIGEST 64 //Length in bytes of the longest digest
+
+//Instruction set extensions reported by cpu_features
+#define CPU_SSE2     (1u <<  0)
+#define CPU_SSSE3    (1u <<  1)
+#define CPU_SSE41    (1u <<  2)
+#define CPU_SSE42    (1u <<  3)
+#define CPU_PCLMUL   (1u <<  4)
+#define CPU_AVX      (1u <<  5)
+#define CPU_AVX2     (1u <<  6)
+#define CPU_BMI2     (1u <<  7)
+#define CPU_AVX512F  (1u <<  8)
+#define CPU_AVX512BW (1u <<  9)
+#define CPU_AVX512VL (1u << 10)
+#define CPU_SHA      (1u << 11)
+
+#define MB_MAX_LANES 16  //Most messages a multi-buffer kernel hashes at once
+#define MB_MAX_WORDS 8   //Most words of state of those kernels
+#define MB_MAX_BLOCK 128 //Longest block of those kernels, in bytes
 
 /*---------------------------------------------------------------------------*/
 /* Type declarations                                                         */
@@ -46,31 +65,304 @@ SOFTWARE.
 
 typedef unsigned __int128 uint128_t __attribute__((mode(TI)));
 
+typedef struct pool pool_t; //Opaque, see pool_create
+
+//Runs a job on the worker thread number worker
+typedef void (*pool_work_fn)(void *job, unsigned worker, void *arg);
+
+//Hands back a finished job, always in the order they were submitted
+typedef void (*pool_done_fn)(void *job, void *arg);
+
+typedef struct walk_dir walk_dir_t; //Opaque, see walk_tree
+
+//Reports a path that could not be read during a walk
+typedef void (*walk_error_fn)(const char *path, int err, void *arg);
+
+//Hands a file found by a walk, with the number of files of its directory.
+//name is path relative to dir_fd, the open directory, which stays open
+//until the callee calls walk_release(dir). The callee must free path.
+typedef void (*walk_file_fn)(char *path, const char *name, int dir_fd,
+                             walk_dir_t *dir, size_t files, void *arg);
+
+//Hashes count independent messages, digest i is stored at digests + i times
+//the digest length of the algorithm
+typedef void (*hash_batch_fn)(const uint8_t *const *msgs, const size_t *lens,
+                              size_t count, uint8_t *digests);
+
 /*---------------------------------------------------------------------------*/
 /* Structure declarations                                                    */
 /*---------------------------------------------------------------------------*/
 
+//Incremental md5 state. Only the last incomplete block is kept in memory.
+typedef struct{
+  uint32_t h[4];      //Intermediate hash value
+  uint64_t len;       //Bytes processed so far
+  uint8_t block[64];  //Pending bytes of the current block
+}md5_ctx;
+
+//Incremental sha1 state.
+typedef struct{
+  uint32_t h[5];
+  uint64_t len;
+  uint8_t block[64];
+}sha1_ctx;
+
+//Incremental sha224 and sha256 state, both share the same 512-bit blocks.
+typedef struct{
+  uint32_t h[8];
+  uint64_t len;
+  uint8_t block[64];
+}sha256_ctx;
+
+typedef sha256_ctx sha224_ctx;
+
+//Incremental sha384, sha512, sha512_224 and sha512_256 state, all share the
+//same 1024-bit blocks.
+typedef struct{
+  uint64_t h[8];
+  uint128_t len;
+  uint8_t block[128];
+}sha512_ctx;
+
+typedef sha512_ctx sha384_ctx;
+
+typedef sha512_ctx sha512_224_ctx;
+
+typedef sha512_ctx sha512_256_ctx;
+
+//Incremental blake2b state, also of the leaves and the root of blake2bp.
+//The last block is kept in memory even if it is full.
+typedef struct{
+  uint64_t h[8];
+  uint128_t len;        //Bytes hashed so far, without block
+  uint8_t block[128];
+  uint8_t block_len;
+  uint8_t last_node;    //Whether it is the last node of its level of a tree
+}blake2b_ctx;
+
+//Incremental blake2s state, also of the leaves and the root of blake2sp.
+typedef struct{
+  uint32_t h[8];
+  uint64_t len;
+  uint8_t block[64];
+  uint8_t block_len;
+  uint8_t last_node;
+}blake2s_ctx;
+
+//Incremental blake2bp state: the state of each leaf and the rounds of the
+//message not hashed yet, a round being a block for every leaf.
+typedef struct{
+  uint64_t h[4][8];
+  uint64_t len;             //Bytes hashed by each leaf so far
+  uint8_t tail[7 * 128];
+  uint16_t tail_len;
+}blake2bp_ctx;
+
+//Incremental blake2sp state.
+typedef struct{
+  uint32_t h[8][8];
+  uint64_t len;
+  uint8_t tail[15 * 64];
+  uint16_t tail_len;
+}blake2sp_ctx;
+
+//Incremental sha3 and shake state: the Keccak-f[1600] state with the message
+//absorbed so far, see keccak_f1600_scalar. All of them share it.
+typedef struct{
+  uint64_t a[25];
+  uint8_t rate;         //Bytes absorbed per permutation
+  uint8_t pos;          //Bytes of the current block absorbed so far
+  uint8_t pad;          //Domain bits and first bit of the padding
+}sha3_ctx;
+
+typedef sha3_ctx sha3_224_ctx;
+
+typedef sha3_ctx sha3_256_ctx;
+
+typedef sha3_ctx sha3_384_ctx;
+
+typedef sha3_ctx sha3_512_ctx;
+
+typedef sha3_ctx shake128_ctx;
+
+typedef sha3_ctx shake256_ctx;
+
+//Incremental blake3 state: the current chunk of 1 KiB and a stack with the
+//chaining value of each complete subtree, at most one per level of the tree.
+typedef struct{
+  uint32_t cv[8];       //Chaining value of the current chunk
+  uint64_t chunk;       //Index of the current chunk
+  uint8_t block[64];    //Pending bytes of the current block
+  uint8_t block_len;
+  uint8_t blocks;       //Blocks of the current chunk already compressed
+  uint8_t stack_len;
+  uint8_t stack[55 * 32];
+}blake3_ctx;
+
+//Incremental xxh64 state.
+typedef struct{
+  uint64_t v[4];        //Accumulators
+  uint64_t len;
+  uint8_t block[32];    //Pending bytes of the current stripe
+  uint8_t block_len;
+}xxh64_ctx;
+
+//Incremental xxh3 and xxh128 state: the accumulators of the stripes hashed
+//so far and the bytes after them, which are the whole message up to 256
+//bytes. The buffer is only hashed when more bytes follow it.
+typedef struct{
+  uint64_t acc[8];
+  uint64_t len;         //Bytes of the message so far
+  uint8_t block[256];   //Pending bytes, and the end of the last stripe
+  uint16_t block_len;
+  unsigned stripes;     //Stripes of the current block already hashed
+}xxh3_ctx;
+
+typedef xxh3_ctx xxh128_ctx;
+
+//Incremental crc32c, crc32 and cksum state: the register and, for cksum,
+//the length of the message.
+typedef struct{
+  uint32_t crc;
+  uint64_t len;
+}crc_ctx;
+
+typedef crc_ctx crc32c_ctx;
+
+typedef crc_ctx crc32_ctx;
+
+typedef crc_ctx cksum_ctx;
+
+//Storage for the context of any of the algorithms.
+typedef union{
+  md5_ctx md5;
+  sha1_ctx sha1;
+  sha256_ctx sha256;
+  sha512_ctx sha512;
+  blake2b_ctx blake2b;
+  blake2s_ctx blake2s;
+  blake2bp_ctx blake2bp;
+  blake2sp_ctx blake2sp;
+  sha3_ctx sha3;
+  blake3_ctx blake3;
+  xxh64_ctx xxh64;
+  xxh3_ctx xxh3;
+  crc_ctx crc;
+}hash_ctx;
+
+//One implementation of an algorithm, see hash_use_impl.
+typedef struct{
+  const char *name;   //As given to --impl, e.g. "avx2"
+  unsigned features;  //CPU_* flags it needs
+  void (*use)(void);  //Makes the algorithm run it
+}hash_impl;
+
+//Generic description of an algorithm, see hash_find.
+typedef struct{
+  const char *name;   //Command name, e.g. "sha256"
+  size_t digest_len;  //In bytes
+  void (*init)(hash_ctx *ctx);
+  void (*update)(hash_ctx *ctx, const uint8_t *msg, size_t len);
+  void (*final)(hash_ctx *ctx, uint8_t *digest);
+  hash_batch_fn batch;  //Many messages at once, NULL if not available
+  //Output of len bytes instead of digest_len, only for the extendable
+  //output functions, NULL for the rest
+  void (*xof)(hash_ctx *ctx, uint8_t *out, size_t len);
+  const hash_impl *impls; //From the slowest, "scalar", to the fastest
+}hash_algo;
+
+//Reports an implementation that failed test on a message of len bytes, see
+//hash_selftest
+typedef void (*selftest_fail_fn)(const hash_algo *algo, const hash_impl *impl,
+                                 const char *test, size_t len, void *arg);
+
+//A compression function that runs one block of lanes messages at once, see
+//mb_hash. The state is stored word by word in host order: word w of lane l
+//is word w * lanes + l, and so are the message words given to blocks.
+typedef struct{
+  const char *name;     //Instruction set, e.g. "avx2"
+  unsigned lanes;       //Messages hashed at once
+  unsigned words;       //Words of state
+  size_t word_size;     //4 or 8 bytes
+  size_t block_len;     //64 or 128 bytes, 16 words
+  size_t length_size;   //Bytes of the message length at the end of the pad
+  size_t digest_len;    //Leading bytes of the state that form the digest
+  int big_endian;       //Byte order of the words and of the length
+  const void *iv;       //Initial state of a single message
+  void (*blocks)(void *state, const void *msg);
+  void (*single)(void *h, const uint8_t *data, size_t blocks);
+}mb_kernel;
 
 /*---------------------------------------------------------------------------*/
 /* Variable declarations                                                     */
 /*---------------------------------------------------------------------------*/
 
+extern const hash_algo hash_algos[]; //Terminated by an entry with NULL name
+
+//Implementations of each family, terminated by an entry with NULL name
+extern const hash_impl md5_impls[];
+extern const hash_impl sha1_impls[];
+extern const hash_impl sha256_impls[]; //sha224 and sha256
+extern const hash_impl sha512_impls[]; //sha384, sha512 and sha512_224/256
+extern const hash_impl blake2b_impls[];
+extern const hash_impl blake2s_impls[];
+extern const hash_impl blake2bp_impls[];
+extern const hash_impl blake2sp_impls[];
+extern const hash_impl sha3_impls[]; //sha3_224 to sha3_512 and shake
+extern const hash_impl blake3_impls[];
+extern const hash_impl xxh64_impls[];
+extern const hash_impl xxh3_impls[]; //xxh3 and xxh128
+extern const hash_impl crc32c_impls[];
+extern const hash_impl crc32_impls[];
+extern const hash_impl cksum_impls[];
 
 /*---------------------------------------------------------------------------*/
 /* Macro declarations                                                        */
 /*---------------------------------------------------------------------------*/
 
+#if defined(__x86_64__) || defined(__i386__)
+#define HASH_X86 1 //Kernels for x86 extensions are built
+#endif
 
 /*---------------------------------------------------------------------------*/
 /* Function prototypes                                                       */
 /*---------------------------------------------------------------------------*/
 
+/**md5_init*******************************************************************
+
+  Resume       Incremental md5 checksum
+
+  Description  md5_init sets up ctx, md5_update feeds it with any number
+              of consecutive pieces of the message and md5_final pads the
+              last block and writes the checksum. Full blocks are processed
+              straight from the caller's buffer, only a partial block is
+              copied into ctx.
+
+  Parameters   -md5_ctx *ctx: The state of the computation.
+               -const uint8_t *msg: The next piece of the message.
+               -size_t len: The length of msg.
+               -uint8_t *digest: The result of the sum as an array of uint8_t
+                                of lenght 16. 128 bits in total.
+
+  Colat. Effe. ctx must be initialised again after md5_final.
+
+  See also     md5_sum
+
+******************************************************************************/
+
+void md5_init(md5_ctx *ctx);
+
+void md5_update(md5_ctx *ctx, const uint8_t *msg, size_t len);
+
+void md5_final(md5_ctx *ctx, uint8_t digest[16]);
+
 /**md5_sum*******************************************************************
 
   Resume       Computes the md5 checksum for a given message
 
-  Description  Computes the md5 checksum for a given message. If an error ocurs,
-              it returns -1 and errno is set.
+  Description  Computes the md5 checksum for a given message in a single
+              call. It is a wrapper over md5_init, md5_update and md5_final
+              so no memory is allocated. It always returns 0.
 
   Parameters   -uint8_t *initial_msg: The initial message.
                -size_t initial_len: The length of the initial_msg.
@@ -85,12 +377,41 @@ typedef unsigned __int128 uint128_t __attribute__((mode(TI)));
 
 int md5_sum(uint8_t *initial_msg, size_t initial_len, uint8_t digest[16]);
 
+/**sha1_init******************************************************************
+
+  Resume       Incremental sha1 checksum
+
+  Description  sha1_init sets up ctx, sha1_update feeds it with any number
+              of consecutive pieces of the message and sha1_final pads the
+              last block and writes the checksum. Full blocks are processed
+              straight from the caller's buffer, only a partial block is
+              copied into ctx.
+
+  Parameters   -sha1_ctx *ctx: The state of the computation.
+               -const uint8_t *msg: The next piece of the message.
+               -size_t len: The length of msg.
+               -uint8_t *digest: The result of the sum as an array of uint8_t
+                                of lenght 20. 160 bits in total.
+
+  Colat. Effe. ctx must be initialised again after sha1_final.
+
+  See also     sha1_sum
+
+******************************************************************************/
+
+void sha1_init(sha1_ctx *ctx);
+
+void sha1_update(sha1_ctx *ctx, const uint8_t *msg, size_t len);
+
+void sha1_final(sha1_ctx *ctx, uint8_t digest[20]);
+
 /**sha1_sum*******************************************************************
 
   Resume       Computes the sha1 checksum for a given message
 
-  Description  Computes the sha1 checksum for a given message. If an error
-              ocurs, it returns -1 and errno is set.
+  Description  Computes the sha1 checksum for a given message in a single
+              call. It is a wrapper over sha1_init, sha1_update and sha1_final
+              so no memory is allocated. It always returns 0.
 
   Parameters   -uint8_t *initial_msg: The initial message.
                -size_t initial_len: The length of the initial_msg.
@@ -105,12 +426,41 @@ int md5_sum(uint8_t *initial_msg, size_t initial_len, uint8_t digest[16]);
 
 int sha1_sum(uint8_t *initial_msg, size_t initial_len, uint8_t digest[20]);
 
+/**sha224_init****************************************************************
+
+  Resume       Incremental sha224 checksum
+
+  Description  sha224_init sets up ctx, sha224_update feeds it with any number
+              of consecutive pieces of the message and sha224_final pads the
+              last block and writes the checksum. Full blocks are processed
+              straight from the caller's buffer, only a partial block is
+              copied into ctx.
+
+  Parameters   -sha224_ctx *ctx: The state of the computation.
+               -const uint8_t *msg: The next piece of the message.
+               -size_t len: The length of msg.
+               -uint8_t *digest: The result of the sum as an array of uint8_t
+                                of lenght 28. 224 bits in total.
+
+  Colat. Effe. ctx must be initialised again after sha224_final.
+
+  See also     sha224_sum
+
+******************************************************************************/
+
+void sha224_init(sha224_ctx *ctx);
+
+void sha224_update(sha224_ctx *ctx, const uint8_t *msg, size_t len);
+
+void sha224_final(sha224_ctx *ctx, uint8_t digest[28]);
+
 /**sha224_sum*****************************************************************
 
   Resume       Computes the sha224 checksum for a given message
 
-  Description  Computes the sha224 checksum for a given message. If an error
-              ocurs, it returns -1 and errno is set.
+  Description  Computes the sha224 checksum for a given message in a single
+              call. It is a wrapper over sha224_init, sha224_update and sha224_final
+              so no memory is allocated. It always returns 0.
 
   Parameters   -uint8_t *initial_msg: The initial message.
                -size_t initial_len: The length of the initial_msg.
@@ -125,12 +475,41 @@ int sha1_sum(uint8_t *initial_msg, size_t initial_len, uint8_t digest[20]);
 
 int sha224_sum(uint8_t *initial_msg, size_t initial_len, uint8_t digest[28]);
 
+/**sha256_init****************************************************************
+
+  Resume       Incremental sha256 checksum
+
+  Description  sha256_init sets up ctx, sha256_update feeds it with any number
+              of consecutive pieces of the message and sha256_final pads the
+              last block and writes the checksum. Full blocks are processed
+              straight from the caller's buffer, only a partial block is
+              copied into ctx.
+
+  Parameters   -sha256_ctx *ctx: The state of the computation.
+               -const uint8_t *msg: The next piece of the message.
+               -size_t len: The length of msg.
+               -uint8_t *digest: The result of the sum as an array of uint8_t
+                                of lenght 32. 256 bits in total.
+
+  Colat. Effe. ctx must be initialised again after sha256_final.
+
+  See also     sha256_sum
+
+******************************************************************************/
+
+void sha256_init(sha256_ctx *ctx);
+
+void sha256_update(sha256_ctx *ctx, const uint8_t *msg, size_t len);
+
+void sha256_final(sha256_ctx *ctx, uint8_t digest[32]);
+
 /**sha256_sum*****************************************************************
 
   Resume       Computes the sha256 checksum for a given message
 
-  Description  Computes the sha256 checksum for a given message. If an error
-              ocurs, it returns -1 and errno is set.
+  Description  Computes the sha256 checksum for a given message in a single
+              call. It is a wrapper over sha256_init, sha256_update and sha256_final
+              so no memory is allocated. It always returns 0.
 
   Parameters   -uint8_t *initial_msg: The initial message.
                -size_t initial_len: The length of the initial_msg.
@@ -145,12 +524,41 @@ int sha224_sum(uint8_t *initial_msg, size_t initial_len, uint8_t digest[28]);
 
 int sha256_sum(uint8_t *initial_msg, size_t initial_len, uint8_t digest[32]);
 
+/**sha384_init****************************************************************
+
+  Resume       Incremental sha384 checksum
+
+  Description  sha384_init sets up ctx, sha384_update feeds it with any number
+              of consecutive pieces of the message and sha384_final pads the
+              last block and writes the checksum. Full blocks are processed
+              straight from the caller's buffer, only a partial block is
+              copied into ctx.
+
+  Parameters   -sha384_ctx *ctx: The state of the computation.
+               -const uint8_t *msg: The next piece of the message.
+               -size_t len: The length of msg.
+               -uint8_t *digest: The result of the sum as an array of uint8_t
+                                of lenght 48. 384 bits in total.
+
+  Colat. Effe. ctx must be initialised again after sha384_final.
+
+  See also     sha384_sum
+
+******************************************************************************/
+
+void sha384_init(sha384_ctx *ctx);
+
+void sha384_update(sha384_ctx *ctx, const uint8_t *msg, size_t len);
+
+void sha384_final(sha384_ctx *ctx, uint8_t digest[48]);
+
 /**sha384_sum*****************************************************************
 
   Resume       Computes the sha384 checksum for a given message
 
-  Description  Computes the sha384 checksum for a given message. If an error
-              ocurs, it returns -1 and errno is set.
+  Description  Computes the sha384 checksum for a given message in a single
+              call. It is a wrapper over sha384_init, sha384_update and sha384_final
+              so no memory is allocated. It always returns 0.
 
   Parameters   -uint8_t *initial_msg: The initial message.
                -size_t initial_len: The length of the initial_msg.
@@ -165,12 +573,41 @@ int sha256_sum(uint8_t *initial_msg, size_t initial_len, uint8_t digest[32]);
 
 int sha384_sum(uint8_t *initial_msg, size_t initial_len, uint8_t digest[48]);
 
+/**sha512_init****************************************************************
+
+  Resume       Incremental sha512 checksum
+
+  Description  sha512_init sets up ctx, sha512_update feeds it with any number
+              of consecutive pieces of the message and sha512_final pads the
+              last block and writes the checksum. Full blocks are processed
+              straight from the caller's buffer, only a partial block is
+              copied into ctx.
+
+  Parameters   -sha512_ctx *ctx: The state of the computation.
+               -const uint8_t *msg: The next piece of the message.
+               -size_t len: The length of msg.
+               -uint8_t *digest: The result of the sum as an array of uint8_t
+                                of lenght 64. 512 bits in total.
+
+  Colat. Effe. ctx must be initialised again after sha512_final.
+
+  See also     sha512_sum
+
+******************************************************************************/
+
+void sha512_init(sha512_ctx *ctx);
+
+void sha512_update(sha512_ctx *ctx, const uint8_t *msg, size_t len);
+
+void sha512_final(sha512_ctx *ctx, uint8_t digest[64]);
+
 /**sha512_sum*****************************************************************
 
   Resume       Computes the sha512 checksum for a given message
 
-  Description  Computes the sha512 checksum for a given message. If an error
-              ocurs, it returns -1 and errno is set.
+  Description  Computes the sha512 checksum for a given message in a single
+              call. It is a wrapper over sha512_init, sha512_update and sha512_final
+              so no memory is allocated. It always returns 0.
 
   Parameters   -uint8_t *initial_msg: The initial message.
                -size_t initial_len: The length of the initial_msg.
@@ -185,6 +622,1136 @@ int sha384_sum(uint8_t *initial_msg, size_t initial_len, uint8_t digest[48]);
 
 int sha512_sum(uint8_t *initial_msg, size_t initial_len, uint8_t digest[64]);
 
+/**sha512_224_init************************************************************
+
+  Resume       Incremental sha512_224 and sha512_256 checksums
+
+  Description  SHA-512/224 and SHA-512/256: sha512 with their own initial
+              hash values, truncated to 224 or 256 bits. They take the same
+              calls as sha512_init, sha512_update and sha512_final, and on
+              64-bit hosts are faster than sha224 and sha256.
+
+  Parameters   -sha512_224_ctx *ctx: The state of the computation.
+               -const uint8_t *msg: The next piece of the message.
+               -size_t len: The length of msg.
+               -uint8_t *digest: The result of the sum as an array of uint8_t
+                                of lenght 28 or 32.
+
+  Colat. Effe. ctx must be initialised again after the final call.
+
+  See also     sha512_init, sha512_224_sum
+
+******************************************************************************/
+
+void sha512_224_init(sha512_224_ctx *ctx);
+
+void sha512_224_update(sha512_224_ctx *ctx, const uint8_t *msg, size_t len);
+
+void sha512_224_final(sha512_224_ctx *ctx, uint8_t digest[28]);
+
+void sha512_256_init(sha512_256_ctx *ctx);
+
+void sha512_256_update(sha512_256_ctx *ctx, const uint8_t *msg, size_t len);
+
+void sha512_256_final(sha512_256_ctx *ctx, uint8_t digest[32]);
+
+/**sha512_224_sum*************************************************************
+
+  Resume       Computes the sha512_224 or sha512_256 checksum of a message
+
+  Description  Computes the checksum in a single call, like sha512_sum. It
+              always returns 0.
+
+  Parameters   -uint8_t *initial_msg: The initial message.
+               -size_t initial_len: The length of the initial_msg.
+               -uint8_t *digest: The result of the sum as an array of uint8_t
+                                of lenght 28 or 32.
+
+  Colat. Effe. None.
+
+  See also     sha512_224_init
+
+******************************************************************************/
+
+int sha512_224_sum(uint8_t *initial_msg, size_t initial_len,
+                   uint8_t digest[28]);
+
+int sha512_256_sum(uint8_t *initial_msg, size_t initial_len,
+                   uint8_t digest[32]);
+
+/**blake2b_init***************************************************************
+
+  Resume       Incremental blake2b, blake2s, blake2bp and blake2sp checksums
+
+  Description  X_init sets up ctx, X_update feeds it with any number of
+              consecutive pieces of the message and X_final writes the
+              checksum, of 512 bits for blake2b and blake2bp and of 256 for
+              blake2s and blake2sp. They are unkeyed and of full length.
+              blake2bp and blake2sp hash their 4 or 8 leaves in the lanes
+              of the kernel chosen by hash_use_impl and, for pieces of more
+              than 1 MiB, split them between threads if hash_set_threads
+              allows it and there are more leaves than lanes.
+
+  Parameters   -X_ctx *ctx: The state.
+               -const uint8_t *msg: The next bytes of the message.
+               -size_t len: The length of msg.
+               -uint8_t *digest: The result, an array of 64 or 32 uint8_t.
+
+  Colat. Effe. None.
+
+  See also     blake2b_sum, hash_set_threads
+
+******************************************************************************/
+
+void blake2b_init(blake2b_ctx *ctx);
+
+void blake2b_update(blake2b_ctx *ctx, const uint8_t *msg, size_t len);
+
+void blake2b_final(blake2b_ctx *ctx, uint8_t digest[64]);
+
+void blake2s_init(blake2s_ctx *ctx);
+
+void blake2s_update(blake2s_ctx *ctx, const uint8_t *msg, size_t len);
+
+void blake2s_final(blake2s_ctx *ctx, uint8_t digest[32]);
+
+void blake2bp_init(blake2bp_ctx *ctx);
+
+void blake2bp_update(blake2bp_ctx *ctx, const uint8_t *msg, size_t len);
+
+void blake2bp_final(blake2bp_ctx *ctx, uint8_t digest[64]);
+
+void blake2sp_init(blake2sp_ctx *ctx);
+
+void blake2sp_update(blake2sp_ctx *ctx, const uint8_t *msg, size_t len);
+
+void blake2sp_final(blake2sp_ctx *ctx, uint8_t digest[32]);
+
+/**blake2b_sum****************************************************************
+
+  Resume       Computes the blake2b, blake2s, blake2bp or blake2sp checksum
+              of a message
+
+  Description  Computes the checksum in a single call, using the incremental
+              functions. It always returns 0.
+
+  Parameters   -uint8_t *initial_msg: The initial message.
+               -size_t initial_len: The length of the initial_msg.
+               -uint8_t *digest: The result of the sum as an array of uint8_t
+                                of lenght 64 or 32.
+
+  Colat. Effe. None.
+
+  See also     blake2b_init
+
+******************************************************************************/
+
+int blake2b_sum(uint8_t *initial_msg, size_t initial_len, uint8_t digest[64]);
+
+int blake2s_sum(uint8_t *initial_msg, size_t initial_len, uint8_t digest[32]);
+
+int blake2bp_sum(uint8_t *initial_msg, size_t initial_len,
+                 uint8_t digest[64]);
+
+int blake2sp_sum(uint8_t *initial_msg, size_t initial_len,
+                 uint8_t digest[32]);
+
+/**sha3_224_init**************************************************************
+
+  Resume       Incremental sha3 checksums and shake outputs
+
+  Description  X_init sets up ctx, X_update feeds it with any number of
+              consecutive pieces of the message and X_final writes the
+              checksum: of 224 to 512 bits as the name says for sha3, of
+              256 bits for shake128 and of 512 for shake256. Full blocks are
+              absorbed straight from the caller's buffer.
+
+  Parameters   -X_ctx *ctx: The state.
+               -const uint8_t *msg: The next bytes of the message.
+               -size_t len: The length of msg.
+               -uint8_t *digest: The result, an array of 28 to 64 uint8_t.
+
+  Colat. Effe. ctx must be initialised again after X_final.
+
+  See also     sha3_224_sum, shake_squeeze
+
+******************************************************************************/
+
+void sha3_224_init(sha3_224_ctx *ctx);
+
+void sha3_224_update(sha3_224_ctx *ctx, const uint8_t *msg, size_t len);
+
+void sha3_224_final(sha3_224_ctx *ctx, uint8_t digest[28]);
+
+void sha3_256_init(sha3_256_ctx *ctx);
+
+void sha3_256_update(sha3_256_ctx *ctx, const uint8_t *msg, size_t len);
+
+void sha3_256_final(sha3_256_ctx *ctx, uint8_t digest[32]);
+
+void sha3_384_init(sha3_384_ctx *ctx);
+
+void sha3_384_update(sha3_384_ctx *ctx, const uint8_t *msg, size_t len);
+
+void sha3_384_final(sha3_384_ctx *ctx, uint8_t digest[48]);
+
+void sha3_512_init(sha3_512_ctx *ctx);
+
+void sha3_512_update(sha3_512_ctx *ctx, const uint8_t *msg, size_t len);
+
+void sha3_512_final(sha3_512_ctx *ctx, uint8_t digest[64]);
+
+void shake128_init(shake128_ctx *ctx);
+
+void shake128_update(shake128_ctx *ctx, const uint8_t *msg, size_t len);
+
+void shake128_final(shake128_ctx *ctx, uint8_t digest[32]);
+
+void shake256_init(shake256_ctx *ctx);
+
+void shake256_update(shake256_ctx *ctx, const uint8_t *msg, size_t len);
+
+void shake256_final(shake256_ctx *ctx, uint8_t digest[64]);
+
+/**shake_squeeze**************************************************************
+
+  Resume       Output of any length of shake128 or shake256
+
+  Description  Instead of X_final, finishes ctx and writes len bytes of
+              output. A shorter output is the beginning of a longer one,
+              and the default ones are those of X_final.
+
+  Parameters   -sha3_ctx *ctx: The state of shake128 or shake256.
+               -uint8_t *out: The result.
+               -size_t len: The length of out.
+
+  Colat. Effe. ctx must be initialised again after shake_squeeze.
+
+  See also     shake128_init
+
+******************************************************************************/
+
+void shake_squeeze(sha3_ctx *ctx, uint8_t *out, size_t len);
+
+/**sha3_224_sum***************************************************************
+
+  Resume       Computes the sha3 checksum or the shake output of a message
+
+  Description  Computes the checksum in a single call, using the incremental
+              functions. It always returns 0.
+
+  Parameters   -uint8_t *initial_msg: The initial message.
+               -size_t initial_len: The length of the initial_msg.
+               -uint8_t *digest: The result of the sum as an array of uint8_t
+                                of lenght 28 to 64.
+
+  Colat. Effe. None.
+
+  See also     sha3_224_init
+
+******************************************************************************/
+
+int sha3_224_sum(uint8_t *initial_msg, size_t initial_len,
+                 uint8_t digest[28]);
+
+int sha3_256_sum(uint8_t *initial_msg, size_t initial_len,
+                 uint8_t digest[32]);
+
+int sha3_384_sum(uint8_t *initial_msg, size_t initial_len,
+                 uint8_t digest[48]);
+
+int sha3_512_sum(uint8_t *initial_msg, size_t initial_len,
+                 uint8_t digest[64]);
+
+int shake128_sum(uint8_t *initial_msg, size_t initial_len,
+                 uint8_t digest[32]);
+
+int shake256_sum(uint8_t *initial_msg, size_t initial_len,
+                 uint8_t digest[64]);
+
+/**blake3_init****************************************************************
+
+  Resume       Incremental blake3 checksum
+
+  Description  blake3_init sets up ctx, blake3_update feeds it with any
+              number of consecutive pieces of the message and blake3_final
+              writes the 256-bit checksum. Pieces of more than 2 KiB are
+              hashed as whole subtrees, many chunks at once in the lanes of
+              the kernel chosen by hash_use_impl and, from 1 MiB, split
+              between threads if hash_set_threads allows it. Bigger pieces
+              hash faster.
+
+  Parameters   -blake3_ctx *ctx: The state.
+               -const uint8_t *msg: The next bytes of the message.
+               -size_t len: The length of msg.
+               -uint8_t *digest: The result, an array of 32 uint8_t.
+
+  Colat. Effe. None.
+
+  See also     blake3_sum, hash_set_threads
+
+******************************************************************************/
+
+void blake3_init(blake3_ctx *ctx);
+
+void blake3_update(blake3_ctx *ctx, const uint8_t *msg, size_t len);
+
+void blake3_final(blake3_ctx *ctx, uint8_t digest[32]);
+
+/**blake3_sum*****************************************************************
+
+  Resume       Computes the blake3 checksum of a message
+
+  Description  Computes the checksum in a single call, using the incremental
+              functions. It always returns 0.
+
+  Parameters   -uint8_t *initial_msg: The initial message.
+               -size_t initial_len: The length of the initial_msg.
+               -uint8_t *digest: The result of the sum as an array of uint8_t
+                                of lenght 32.
+
+  Colat. Effe. None.
+
+  See also     blake3_init
+
+******************************************************************************/
+
+int blake3_sum(uint8_t *initial_msg, size_t initial_len, uint8_t digest[32]);
+
+/**xxh64_init*****************************************************************
+
+  Resume       Incremental xxh64, xxh3 and xxh128 checksums
+
+  Description  X_init sets up ctx, X_update feeds it with any number of
+              consecutive pieces of the message and X_final writes the
+              checksum, of 64 bits for xxh64 and xxh3 and of 128 for
+              xxh128, in the canonical big-endian order. They are not
+              cryptographic: they detect accidental corruption only. Full
+              stripes are hashed straight from the caller's buffer, by the
+              kernel chosen by hash_use_impl for xxh3 and xxh128.
+
+  Parameters   -X_ctx *ctx: The state.
+               -const uint8_t *msg: The next bytes of the message.
+               -size_t len: The length of msg.
+               -uint8_t *digest: The result, an array of 8 or 16 uint8_t.
+
+  Colat. Effe. ctx must be initialised again after X_final.
+
+  See also     xxh64_sum
+
+******************************************************************************/
+
+void xxh64_init(xxh64_ctx *ctx);
+
+void xxh64_update(xxh64_ctx *ctx, const uint8_t *msg, size_t len);
+
+void xxh64_final(xxh64_ctx *ctx, uint8_t digest[8]);
+
+void xxh3_init(xxh3_ctx *ctx);
+
+void xxh3_update(xxh3_ctx *ctx, const uint8_t *msg, size_t len);
+
+void xxh3_final(xxh3_ctx *ctx, uint8_t digest[8]);
+
+void xxh128_init(xxh128_ctx *ctx);
+
+void xxh128_update(xxh128_ctx *ctx, const uint8_t *msg, size_t len);
+
+void xxh128_final(xxh128_ctx *ctx, uint8_t digest[16]);
+
+/**xxh64_sum******************************************************************
+
+  Resume       Computes the xxh64, xxh3 or xxh128 checksum of a message
+
+  Description  Computes the checksum in a single call, using the incremental
+              functions. It always returns 0.
+
+  Parameters   -uint8_t *initial_msg: The initial message.
+               -size_t initial_len: The length of the initial_msg.
+               -uint8_t *digest: The result of the sum as an array of uint8_t
+                                of lenght 8 or 16.
+
+  Colat. Effe. None.
+
+  See also     xxh64_init
+
+******************************************************************************/
+
+int xxh64_sum(uint8_t *initial_msg, size_t initial_len, uint8_t digest[8]);
+
+int xxh3_sum(uint8_t *initial_msg, size_t initial_len, uint8_t digest[8]);
+
+int xxh128_sum(uint8_t *initial_msg, size_t initial_len, uint8_t digest[16]);
+
+/**crc32c_init****************************************************************
+
+  Resume       Incremental crc32c, crc32 and cksum checksums
+
+  Description  X_init sets up ctx, X_update feeds it with any number of
+              consecutive pieces of the message and X_final writes the
+              32-bit checksum, most significant byte first, so its hex is
+              that of the number: the one of zlib for crc32, and the one of
+              the POSIX cksum utility, printed there in decimal, for cksum.
+              They are not cryptographic: they detect accidental corruption
+              only. The bytes are run by the kernel chosen by hash_use_impl.
+
+  Parameters   -X_ctx *ctx: The state.
+               -const uint8_t *msg: The next bytes of the message.
+               -size_t len: The length of msg.
+               -uint8_t *digest: The result, an array of 4 uint8_t.
+
+  Colat. Effe. ctx must be initialised again after X_final.
+
+  See also     crc32c_sum
+
+******************************************************************************/
+
+void crc32c_init(crc32c_ctx *ctx);
+
+void crc32c_update(crc32c_ctx *ctx, const uint8_t *msg, size_t len);
+
+void crc32c_final(crc32c_ctx *ctx, uint8_t digest[4]);
+
+void crc32_init(crc32_ctx *ctx);
+
+void crc32_update(crc32_ctx *ctx, const uint8_t *msg, size_t len);
+
+void crc32_final(crc32_ctx *ctx, uint8_t digest[4]);
+
+void cksum_init(cksum_ctx *ctx);
+
+void cksum_update(cksum_ctx *ctx, const uint8_t *msg, size_t len);
+
+void cksum_final(cksum_ctx *ctx, uint8_t digest[4]);
+
+/**crc32c_sum*****************************************************************
+
+  Resume       Computes the crc32c, crc32 or cksum checksum of a message
+
+  Description  Computes the checksum in a single call, using the incremental
+              functions. It always returns 0.
+
+  Parameters   -uint8_t *initial_msg: The initial message.
+               -size_t initial_len: The length of the initial_msg.
+               -uint8_t *digest: The result of the sum as an array of uint8_t
+                                of lenght 4.
+
+  Colat. Effe. None.
+
+  See also     crc32c_init
+
+******************************************************************************/
+
+int crc32c_sum(uint8_t *initial_msg, size_t initial_len, uint8_t digest[4]);
+
+int crc32_sum(uint8_t *initial_msg, size_t initial_len, uint8_t digest[4]);
+
+int cksum_sum(uint8_t *initial_msg, size_t initial_len, uint8_t digest[4]);
+
+/**hash_find******************************************************************
+
+  Resume       Looks up an algorithm by its command name
+
+  Description  Searches hash_algos for name and returns its description, or
+              NULL if there is no algorithm with that name.
+
+  Parameters   -const char *name: The command name, e.g. "md5" or "sha256".
+
+  Colat. Effe. None.
+
+  See also     hash_algos
+
+******************************************************************************/
+
+const hash_algo *hash_find(const char *name);
+
+/**hash_use_impl**************************************************************
+
+  Resume       Chooses the implementations every algorithm runs
+
+  Description  With "auto" each algorithm runs, from its impls, every one
+              the host supports, each of them replacing what the previous
+              ones do slower: e.g. sha256 hashes single files with SHA-NI
+              and batches with AVX-512. Any other name pins that
+              implementation, and the algorithms without it run "scalar".
+              "auto" is already chosen when the program starts, after the
+              quick hash_selftest.
+
+  Parameters   -const char *name: "auto" or the name of an implementation.
+
+  Colat. Effe. Not thread safe, call it before hashing anything. Returns -1,
+              changing nothing, if no algorithm has name or the host lacks
+              the features it needs or it was demoted.
+
+  See also     hash_algos, cpu_features, hash_demote
+
+******************************************************************************/
+
+int hash_use_impl(const char *name);
+
+/**hash_impl_usable***********************************************************
+
+  Resume       Tells whether an implementation can be chosen
+
+  Description  Returns 1 if the host has every feature impl needs and it was
+              not demoted, 0 otherwise.
+
+  Parameters   -const hash_impl *impl: An entry of the impls of an algorithm.
+
+  Colat. Effe. None.
+
+  See also     hash_use_impl, hash_demote
+
+******************************************************************************/
+
+int hash_impl_usable(const hash_impl *impl);
+
+/**hash_demote****************************************************************
+
+  Resume       Stops choosing an implementation
+
+  Description  From now on hash_use_impl skips impl with "auto" and refuses
+              its name, as if the host could not run it. It is meant for
+              implementations that give wrong results.
+
+  Parameters   -const hash_impl *impl: An entry of the impls of an algorithm,
+                                      not the first one, "scalar".
+
+  Colat. Effe. Not thread safe. Takes effect on the next hash_use_impl.
+
+  See also     hash_selftest
+
+******************************************************************************/
+
+void hash_demote(const hash_impl *impl);
+
+/**hash_set_threads***********************************************************
+
+  Resume       Lets a single message be hashed with several threads
+
+  Description  Up to threads - 1 extra threads are started, in total among
+              every update running at once, by the algorithms that can
+              split a big message: blake3 hashes the halves of big subtrees,
+              blake2bp and blake2sp groups of leaves in them and
+              tree_hash_fd chunks of a file. With 1, the default, every
+              message is hashed by the thread that calls the update.
+              hash_take_thread takes one of those threads from the budget,
+              it returns 0 if there are none left, and hash_give_thread
+              returns it once it is joined.
+
+  Parameters   -unsigned threads: Threads in total, including the callers.
+
+  Colat. Effe. hash_set_threads is not thread safe, call it before hashing
+              anything. The other two are.
+
+  See also     blake3_update, blake2bp_update, tree_hash_fd
+
+******************************************************************************/
+
+void hash_set_threads(unsigned threads);
+
+int hash_take_thread(void);
+
+void hash_give_thread(void);
+
+/**hash_selftest**************************************************************
+
+  Resume       Checks every implementation and demotes the wrong ones
+
+  Description  Each implementation of each algorithm the host can run,
+              demoted or not, is checked against known answers and against
+              the "scalar" one, with messages of pseudorandom bytes and of
+              every alignment hashed in a single call, fed in random pieces
+              and in batches. Quick checks lengths around the 55/56/64 and
+              111/112/128-byte padding edges and a few more, and compares a
+              family's kernels through only one of its algorithms; it is
+              what runs when the program starts. Full checks every length
+              from 0 to 1024, and 2, 17 and 64 KiB plus a byte, on every
+              algorithm. The first failure of an
+              implementation is passed to fail and the implementation is
+              demoted. Returns how many failed, or -1 if there is not enough
+              memory.
+
+  Parameters   -int full: 0 for the quick test, 1 for the full one.
+               -selftest_fail_fn fail: Called for every failure, may be
+                                      NULL.
+               -void *arg: Passed to fail.
+
+  Colat. Effe. Not thread safe. Leaves "auto" chosen, see hash_use_impl.
+
+  See also     hash_demote
+
+******************************************************************************/
+
+int hash_selftest(int full, selftest_fail_fn fail, void *arg);
+
+/**pool_create****************************************************************
+
+  Resume       Starts a pool of worker threads
+
+  Description  Starts workers threads that run work on the submitted jobs.
+              Finished jobs are passed to emit in the same order they were
+              submitted, from the thread calling pool_submit or pool_finish,
+              so results can be printed as they arrive. At most window jobs
+              are in the pool at once, including the finished ones waiting
+              for an older one, so the caller can keep its jobs in a ring
+              of window + 1 entries. With less than two workers no thread is
+              started and each job runs inside pool_submit. Returns NULL if
+              there is not enough memory.
+
+  Parameters   -unsigned workers: Number of threads.
+               -size_t window: Jobs that can be pending at once.
+               -pool_work_fn work: Called by the workers for every job.
+               -pool_done_fn emit: Called in order for every finished job.
+               -void *arg: Passed to work and emit.
+
+  Colat. Effe. Starts threads, pool_finish must be called to stop them.
+
+  See also     pool_submit, pool_finish
+
+******************************************************************************/
+
+pool_t *pool_create(unsigned workers, size_t window, pool_work_fn work,
+                    pool_done_fn emit, void *arg);
+
+/**pool_submit****************************************************************
+
+  Resume       Queues a job in the pool
+
+  Description  Queues job for the workers. If window jobs are already
+              pending it blocks until the oldest one has been emitted. Jobs
+              that are already finished are emitted meanwhile.
+
+  Parameters   -pool_t *pool: The pool.
+               -void *job: The job, it must stay valid until emitted.
+
+  Colat. Effe. May call emit.
+
+  See also     pool_create
+
+******************************************************************************/
+
+void pool_submit(pool_t *pool, void *job);
+
+/**pool_finish****************************************************************
+
+  Resume       Waits for every job and destroys the pool
+
+  Description  Emits the jobs still pending, stops the threads and frees the
+              pool.
+
+  Parameters   -pool_t *pool: The pool.
+
+  Colat. Effe. May call emit.
+
+  See also     pool_create
+
+******************************************************************************/
+
+void pool_finish(pool_t *pool);
+
+/**walk_tree******************************************************************
+
+  Resume       Passes every file below a directory, sorted, as it is found
+
+  Description  Lists the directories below root with up to threads threads,
+              counting the caller, reading them with getdents64. Every
+              listing is sorted by name and its files are passed to file
+              from the calling thread, depth first: a subdirectory comes in
+              its place among the files of its parent. So the order does
+              not depend on the threads, and the first files arrive once
+              their directory is listed, not after the whole tree. Listings
+              wait for their turn, the threads stop at 256 of them ahead.
+              Every directory is opened relative to its parent, so paths
+              longer than PATH_MAX are walked too. Symbolic links to regular
+              files are passed, links to directories are not followed.
+              Directories that cannot be read are passed to error in their
+              place in the order and skipped. Returns -1 and sets errno if
+              there was not enough memory for part of the tree.
+
+  Parameters   -const char *root: The directory to walk.
+               -unsigned threads: Threads listing at once.
+               -walk_file_fn file: Called for every file, in order.
+               -walk_error_fn error: Called for every unreadable directory,
+                                     in order.
+               -void *arg: Passed to file and error.
+
+  Colat. Effe. file and error are only called from the calling thread. file
+              may block, the threads only list ahead meanwhile. Every
+              directory keeps a descriptor open until its files are
+              released.
+
+  See also     walk_file_fn, walk_release
+
+******************************************************************************/
+
+int walk_tree(const char *root, unsigned threads, walk_file_fn file,
+              walk_error_fn error, void *arg);
+
+/**walk_release***************************************************************
+
+  Resume       Releases the directory of a file passed by walk_tree
+
+  Description  Once every file of a directory was released, and the walk is
+              done with it, the directory is closed and freed.
+
+  Parameters   -walk_dir_t *dir: The dir passed with the file.
+
+  Colat. Effe. The dir_fd passed with the file may be closed.
+
+  See also     walk_tree, walk_file_fn
+
+******************************************************************************/
+
+void walk_release(walk_dir_t *dir);
+
+/**tree_hash_fd***************************************************************
+
+  Resume       Merkle tree hash of a file, its chunks hashed in parallel
+
+  Description  Hashes fd from its current offset to its end as a tree:
+              the input is split in chunks of chunk bytes, the last one
+              may be shorter and an empty input is one empty chunk. Leaf i
+              is H(0x00 || chunk i) and the parent of two nodes is
+              H(0x01 || left || right), with H the algorithm and || the
+              concatenation. Each level pairs its nodes from the left and
+              the last node of an odd level moves up unchanged, the root
+              is the digest. Regular files are read with pread by the
+              caller and by threads from the budget of hash_set_threads,
+              other inputs are read in order by the caller.
+
+  Parameters   -const hash_algo *algo: H, its digest_len bytes are used.
+               -int fd: The input.
+               -size_t chunk: Bytes of every chunk but the last, not 0.
+               -uint8_t *digest: The result, digest_len bytes.
+
+  Colat. Effe. Returns -1 and sets errno if fd cannot be read or there is
+              not enough memory, EIO if a regular file shrinks meanwhile.
+
+  See also     hash_set_threads
+
+******************************************************************************/
+
+int tree_hash_fd(const hash_algo *algo, int fd, size_t chunk,
+                 uint8_t *digest);
+
+/**cpu_features***************************************************************
+
+  Resume       Instruction set extensions of the host
+
+  Description  Returns the CPU_* flags of the extensions that both the
+              processor and the operating system support. Always 0 when
+              HASH_X86 is not defined.
+
+  Parameters   None.
+
+  Colat. Effe. Only the first call runs cpuid, the next ones return the
+              flags it found.
+
+  See also     HASH_X86
+
+******************************************************************************/
+
+unsigned cpu_features(void);
+
+/**md5_blocks_scalar**********************************************************
+
+  Resume       Block functions of md5, sha1, sha256 and sha512
+
+  Description  Process blocks consecutive blocks of data, of 128 bytes for
+              sha512 and of 64 for the rest, updating the state h. The
+              scalar versions run everywhere, the shani ones need CPU_SHA
+              and CPU_SSE41 and sha512_blocks_avx2 needs CPU_AVX2 and
+              CPU_BMI2. The updates pick the fastest one the host supports.
+
+  Parameters   -h: The state, 4 words for md5, 5 for sha1 and 8 for sha256
+                   and sha512.
+               -const uint8_t *data: The blocks, no alignment is needed.
+               -size_t blocks: Number of blocks.
+
+  Colat. Effe. None.
+
+  See also     cpu_features
+
+******************************************************************************/
+
+void md5_blocks_scalar(uint32_t h[4], const uint8_t *data, size_t blocks);
+
+void sha1_blocks_scalar(uint32_t h[5], const uint8_t *data, size_t blocks);
+
+void sha256_blocks_scalar(uint32_t h[8], const uint8_t *data, size_t blocks);
+
+void sha512_blocks_scalar(uint64_t h[8], const uint8_t *data, size_t blocks);
+
+#ifdef HASH_X86
+void sha1_blocks_shani(uint32_t h[5], const uint8_t *data, size_t blocks);
+
+void sha256_blocks_shani(uint32_t h[8], const uint8_t *data, size_t blocks);
+
+void sha512_blocks_avx2(uint64_t h[8], const uint8_t *data, size_t blocks);
+#endif
+
+/**md5_sum_batch**************************************************************
+
+  Resume       Computes the md5, sha2 or sha3 checksum of many messages
+
+  Description  Same digests as calling X_sum for every message, but the
+              messages are hashed side by side in the SIMD lanes of the
+              widest multi-buffer kernel the host supports, or one after
+              another if there is none. The sha3 and shake ones use
+              keccak_x4_avx2.
+
+  Parameters   -const uint8_t *const *msgs: The messages.
+               -const size_t *lens: Length in bytes of every message.
+               -size_t count: Number of messages.
+               -uint8_t *digests: count times the digest length bytes.
+
+  Colat. Effe. None.
+
+  See also     X_sum, mb_hash
+
+******************************************************************************/
+
+void md5_sum_batch(const uint8_t *const *msgs, const size_t *lens,
+                   size_t count, uint8_t *digests);
+
+void sha224_sum_batch(const uint8_t *const *msgs, const size_t *lens,
+                      size_t count, uint8_t *digests);
+
+void sha256_sum_batch(const uint8_t *const *msgs, const size_t *lens,
+                      size_t count, uint8_t *digests);
+
+void sha384_sum_batch(const uint8_t *const *msgs, const size_t *lens,
+                      size_t count, uint8_t *digests);
+
+void sha512_sum_batch(const uint8_t *const *msgs, const size_t *lens,
+                      size_t count, uint8_t *digests);
+
+void sha512_224_sum_batch(const uint8_t *const *msgs, const size_t *lens,
+                          size_t count, uint8_t *digests);
+
+void sha512_256_sum_batch(const uint8_t *const *msgs, const size_t *lens,
+                          size_t count, uint8_t *digests);
+
+void sha3_224_sum_batch(const uint8_t *const *msgs, const size_t *lens,
+                        size_t count, uint8_t *digests);
+
+void sha3_256_sum_batch(const uint8_t *const *msgs, const size_t *lens,
+                        size_t count, uint8_t *digests);
+
+void sha3_384_sum_batch(const uint8_t *const *msgs, const size_t *lens,
+                        size_t count, uint8_t *digests);
+
+void sha3_512_sum_batch(const uint8_t *const *msgs, const size_t *lens,
+                        size_t count, uint8_t *digests);
+
+void shake128_sum_batch(const uint8_t *const *msgs, const size_t *lens,
+                        size_t count, uint8_t *digests);
+
+void shake256_sum_batch(const uint8_t *const *msgs, const size_t *lens,
+                        size_t count, uint8_t *digests);
+
+/**mb_hash********************************************************************
+
+  Resume       Runs many messages through a multi-buffer kernel
+
+  Description  Pads every message and feeds kernel one block per lane until
+              every message is done. A lane that finishes its message takes
+              the next one at once, so the lanes stay busy when messages
+              have different lengths. When a single message is left it is
+              finished with the single stream function of the kernel.
+
+  Parameters   -const mb_kernel *kernel: The kernel.
+               -const uint8_t *const *msgs: The messages.
+               -const size_t *lens: Length in bytes of every message.
+               -size_t count: Number of messages.
+               -uint8_t *digests: count * kernel->digest_len bytes.
+
+  Colat. Effe. None.
+
+  See also     mb_kernel
+
+******************************************************************************/
+
+void mb_hash(const mb_kernel *kernel, const uint8_t *const *msgs,
+             const size_t *lens, size_t count, uint8_t *digests);
+
+/**md5_x4_sse2****************************************************************
+
+  Resume       Multi-buffer kernels of md5, sha256 and sha512
+
+  Description  Compress one block of as many messages as the name says, in
+              the layout described in mb_kernel. They are used through the
+              X_sum_batch functions.
+
+  Parameters   -void *lanes: The state of every lane.
+               -const void *block: The 16 words of the block of every lane.
+
+  Colat. Effe. None.
+
+  See also     mb_kernel, cpu_features
+
+******************************************************************************/
+
+#ifdef HASH_X86
+void md5_x4_sse2(void *lanes, const void *block);
+
+void md5_x8_avx2(void *lanes, const void *block);
+
+void md5_x16_avx512(void *lanes, const void *block);
+
+void sha256_x8_avx2(void *lanes, const void *block);
+
+void sha256_x16_avx512(void *lanes, const void *block);
+
+void sha512_x4_avx2(void *lanes, const void *block);
+
+void sha512_x8_avx512(void *lanes, const void *block);
+#endif
+
+/**mb_gather_le32*************************************************************
+
+  Resume       Transposes a block of 16 little-endian words of many inputs
+
+  Description  Word w of the block of lane l is stored at w * lanes + l,
+              the layout of the multi-buffer kernels. mb_gather_le32 uses
+              AVX2 or SSE2 when the host has them and lanes is a multiple
+              of 8 or 4, mb_gather_le64 AVX2 when lanes is a multiple of 4.
+
+  Parameters   -unsigned lanes: Number of inputs.
+               -const uint8_t *const *blocks: 64 or 128 bytes of every
+                                             input, no alignment is needed.
+               -msg: 16 * lanes words.
+
+  Colat. Effe. None.
+
+  See also     mb_kernel
+
+******************************************************************************/
+
+void mb_gather_le32(unsigned lanes, const uint8_t *const *blocks,
+                    uint32_t *msg);
+
+void mb_gather_le64(unsigned lanes, const uint8_t *const *blocks,
+                    uint64_t *msg);
+
+/**blake2b_blocks_scalar******************************************************
+
+  Resume       Block functions of a single blake2b or blake2s message
+
+  Description  Compress blocks consecutive blocks of data, of 128 bytes for
+              blake2b and of 64 for blake2s, into the state h. counter is
+              the length of the message up to the end of the first block,
+              every next block adds its length. f0 and f1 are the final
+              flags of the blocks, all ones or 0. The scalar versions run
+              everywhere, blake2b_blocks_avx2 needs CPU_AVX2 and
+              blake2s_blocks_sse41 CPU_SSE41.
+
+  Parameters   -h: The state, 8 words.
+               -const uint8_t *data: The blocks, no alignment is needed.
+               -size_t blocks: Number of blocks.
+               -counter: The message length at the end of the first block.
+               -f0: Last block flag.
+               -f1: Last node flag.
+
+  Colat. Effe. None.
+
+  See also     blake2b_update, cpu_features
+
+******************************************************************************/
+
+void blake2b_blocks_scalar(uint64_t h[8], const uint8_t *data, size_t blocks,
+                           uint128_t counter, uint64_t f0, uint64_t f1);
+
+void blake2s_blocks_scalar(uint32_t h[8], const uint8_t *data, size_t blocks,
+                           uint64_t counter, uint32_t f0, uint32_t f1);
+
+#ifdef HASH_X86
+void blake2b_blocks_avx2(uint64_t h[8], const uint8_t *data, size_t blocks,
+                         uint128_t counter, uint64_t f0, uint64_t f1);
+
+void blake2s_blocks_sse41(uint32_t h[8], const uint8_t *data, size_t blocks,
+                          uint64_t counter, uint32_t f0, uint32_t f1);
+#endif
+
+/**blake2bp_x4_avx2***********************************************************
+
+  Resume       Leaf-parallel kernels of blake2bp and blake2sp
+
+  Description  Hash blocks blocks of as many leaves as the name says, one
+              per lane, none of them final. The state of leaf l is the 8
+              words at h + 8 * l and its block b is at
+              msg + l * block_len + b * stride; every leaf hashed counter
+              bytes before msg, and the high word of the counter is 0 for
+              blake2bp. The bp kernels need CPU_SSE41 or CPU_AVX2, the sp
+              ones as well.
+
+  Parameters   -void *h: The states of the leaves, 64-bit words for blake2bp
+                        and 32-bit ones for blake2sp.
+               -const uint8_t *msg: The first block of the first leaf.
+               -size_t stride: Bytes from a block of a leaf to its next one.
+               -size_t blocks: Blocks of every leaf.
+               -uint64_t counter: Bytes every leaf hashed before msg.
+
+  Colat. Effe. None.
+
+  See also     blake2bp_update, cpu_features
+
+******************************************************************************/
+
+#ifdef HASH_X86
+void blake2bp_x2_sse41(void *h, const uint8_t *msg, size_t stride,
+                       size_t blocks, uint64_t counter);
+
+void blake2bp_x4_avx2(void *h, const uint8_t *msg, size_t stride,
+                      size_t blocks, uint64_t counter);
+
+void blake2sp_x4_sse41(void *h, const uint8_t *msg, size_t stride,
+                       size_t blocks, uint64_t counter);
+
+void blake2sp_x8_avx2(void *h, const uint8_t *msg, size_t stride,
+                      size_t blocks, uint64_t counter);
+#endif
+
+/**keccak_f1600_scalar********************************************************
+
+  Resume       Keccak-f[1600] permutations of sha3 and shake
+
+  Description  keccak_f1600_scalar runs the 24 rounds on the 25 lanes of a,
+              of which lanes 1, 2, 8, 12, 17 and 20 are kept complemented:
+              they start as all ones and are complemented again when the
+              output is read. keccak_x4_avx2 permutes four states at once,
+              without complemented lanes, lane w of state l at
+              w * 4 + l, and needs CPU_AVX2.
+
+  Parameters   -uint64_t *a, *state: The state or states, in host order.
+
+  Colat. Effe. None.
+
+  See also     sha3_224_sum_batch, cpu_features
+
+******************************************************************************/
+
+void keccak_f1600_scalar(uint64_t a[25]);
+
+#ifdef HASH_X86
+void keccak_x4_avx2(uint64_t state[100]);
+#endif
+
+/**blake3_x4_sse41************************************************************
+
+  Resume       Chunk-parallel kernels of blake3
+
+  Description  Hash blocks blocks of as many inputs as the name says, one
+              per lane, from the initial value, and store the 32-byte
+              chaining value of each. Input l uses counter, plus l if
+              increment is set; the first block also gets flags_start and
+              the last one flags_end. They hash 16 blocks of whole chunks
+              and the single block of parent nodes.
+
+  Parameters   -const uint8_t *const *inputs: blocks * 64 bytes of every
+                                             lane.
+               -size_t blocks: Blocks of every input.
+               -uint64_t counter: Counter of the first lane.
+               -int increment: Whether each lane counts one more.
+               -uint8_t flags: Flags of every block.
+               -uint8_t flags_start: More flags of the first block.
+               -uint8_t flags_end: More flags of the last block.
+               -uint8_t *out: 32 bytes per lane.
+
+  Colat. Effe. None.
+
+  See also     blake3_update, cpu_features
+
+******************************************************************************/
+
+#ifdef HASH_X86
+void blake3_x4_sse41(const uint8_t *const *inputs, size_t blocks,
+                     uint64_t counter, int increment, uint8_t flags,
+                     uint8_t flags_start, uint8_t flags_end, uint8_t *out);
+
+void blake3_x8_avx2(const uint8_t *const *inputs, size_t blocks,
+                    uint64_t counter, int increment, uint8_t flags,
+                    uint8_t flags_start, uint8_t flags_end, uint8_t *out);
+
+void blake3_x16_avx512(const uint8_t *const *inputs, size_t blocks,
+                       uint64_t counter, int increment, uint8_t flags,
+                       uint8_t flags_start, uint8_t flags_end, uint8_t *out);
+#endif
+
+/**xxh3_stripes_scalar********************************************************
+
+  Resume       Stripe kernels of xxh3 and xxh128
+
+  Description  Add stripes stripes of 64 bytes of input to the eight
+              accumulators, keyed with the default secret from stripe done
+              of the current block, and scramble the accumulators after the
+              last stripe of every block of 16. done is updated. The SSE2,
+              AVX2 and AVX-512 ones hold the accumulators in 2, 4 or 8
+              lanes of a vector.
+
+  Parameters   -uint64_t *acc: The accumulators, in host order.
+               -const uint8_t *input: stripes * 64 bytes.
+               -size_t stripes: Stripes of input.
+               -unsigned *done: Stripes of the current block hashed before.
+
+  Colat. Effe. None.
+
+  See also     xxh3_update, cpu_features
+
+******************************************************************************/
+
+void xxh3_stripes_scalar(uint64_t acc[8], const uint8_t *input,
+                         size_t stripes, unsigned *done);
+
+#ifdef HASH_X86
+void xxh3_stripes_sse2(uint64_t acc[8], const uint8_t *input,
+                       size_t stripes, unsigned *done);
+
+void xxh3_stripes_avx2(uint64_t acc[8], const uint8_t *input,
+                       size_t stripes, unsigned *done);
+
+void xxh3_stripes_avx512(uint64_t acc[8], const uint8_t *input,
+                         size_t stripes, unsigned *done);
+#endif
+
+/**crc32c_scalar**************************************************************
+
+  Resume       Kernels of crc32c, crc32 and cksum
+
+  Description  Run the register crc over len bytes of data and return it,
+              without the initial value nor the final complement. The
+              scalar ones look up 8 bytes at once in tables and run
+              everywhere, crc32c_sse42 runs the crc32 instruction on three
+              streams and needs CPU_SSE42, crc32_pclmul folds 64 bytes at
+              once with carry-less multiplications and needs CPU_PCLMUL, and
+              cksum_pclmul also needs CPU_SSSE3.
+
+  Parameters   -uint32_t crc: The register before data.
+               -const uint8_t *data: The bytes.
+               -size_t len: The length of data.
+
+  Colat. Effe. The tables are built by hash_use_impl, which runs before
+              main.
+
+  See also     crc32c_update, cpu_features
+
+******************************************************************************/
+
+uint32_t crc32c_scalar(uint32_t crc, const uint8_t *data, size_t len);
+
+uint32_t crc32_scalar(uint32_t crc, const uint8_t *data, size_t len);
+
+uint32_t cksum_scalar(uint32_t crc, const uint8_t *data, size_t len);
+
+#ifdef HASH_X86
+uint32_t crc32c_sse42(uint32_t crc, const uint8_t *data, size_t len);
+
+uint32_t crc32_pclmul(uint32_t crc, const uint8_t *data, size_t len);
+
+uint32_t cksum_pclmul(uint32_t crc, const uint8_t *data, size_t len);
+#endif
+
 /**Function*******************************************************************
 
   Resume       [obligatorio]
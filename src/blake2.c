@@ -0,0 +1,1034 @@
+/**HashCheck********************************************************************
+
+  File        blake2.c
+
+  Resume      Compute the blake2b, blake2s, blake2bp and blake2sp checksums
+              of a message.
+
+  Description blake2b works on 64-bit words and blocks of 128 bytes and
+              blake2s on 32-bit words and blocks of 64 bytes. The parallel
+              blake2bp and blake2sp deal the blocks of the message in turn
+              to 4 or 8 leaves and hash the digests of the leaves in a root
+              node. The leaves are hashed side by side in the lanes of the
+              SIMD kernels, and split between threads for big messages.
+
+  See also    HashCheck.h
+
+  Autor       Raúl San Martín Aniceto
+
+  Copyright (c) 2018 Raúl San Martín Aniceto
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+******************************************************************************/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "HashCheck.h"
+
+#ifdef HASH_X86
+#include <immintrin.h>
+#endif
+
+/*---------------------------------------------------------------------------*/
+/* Constant declarations                                                     */
+/*---------------------------------------------------------------------------*/
+
+#define BLAKE2B_BLOCK_LEN 128
+#define BLAKE2S_BLOCK_LEN 64
+#define BLAKE2B_OUT_LEN 64
+#define BLAKE2S_OUT_LEN 32
+#define BLAKE2BP_LEAVES 4
+#define BLAKE2SP_LEAVES 8
+
+//Least bytes of a group of leaves worth splitting between two threads
+#define BLAKE2_THREAD_MIN (1 << 20)
+
+//Same as the initial hash values of sha512 and sha256
+static const uint64_t blake2b_iv[8] = {
+  0x6A09E667F3BCC908, 0xBB67AE8584CAA73B, 0x3C6EF372FE94F82B,
+  0xA54FF53A5F1D36F1, 0x510E527FADE682D1, 0x9B05688C2B3E6C1F,
+  0x1F83D9ABFB41BD6B, 0x5BE0CD19137E2179
+};
+
+static const uint32_t blake2s_iv[8] = {
+  0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+  0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+};
+
+/*---------------------------------------------------------------------------*/
+/* Type declarations                                                         */
+/*---------------------------------------------------------------------------*/
+
+//Hashes blocks blocks of lanes leaves at once, see blake2bp_x4_avx2
+typedef void (*blake2_leaves_fn)(void *h, const uint8_t *msg, size_t stride,
+                                 size_t blocks, uint64_t counter);
+
+/*---------------------------------------------------------------------------*/
+/* Structure declarations                                                    */
+/*---------------------------------------------------------------------------*/
+
+typedef struct{//Some leaves of blake2bp or blake2sp, see blake2_leaves
+  blake2_leaves_fn kernel;
+  unsigned lanes;         //Leaves of each call to kernel
+  size_t state_len;       //Bytes of the state of a leaf
+  size_t block_len;
+  uint8_t *h;             //State of the first leaf
+  const uint8_t *msg;     //First block of the first leaf
+  size_t stride;          //Bytes from a block of a leaf to its next one
+  size_t blocks;          //Blocks of every leaf
+  uint64_t counter;       //Bytes every leaf hashed before msg
+  unsigned leaves;
+}blake2_job_t;
+
+/*---------------------------------------------------------------------------*/
+/* Macro declarations                                                        */
+/*---------------------------------------------------------------------------*/
+
+#define RIGHTROTATE(x, c) (((x) >> (c)) | ((x) << (32 - (c))))
+#define RIGHTROTATE64(x, c) (((x) >> (c)) | ((x) << (64 - (c))))
+
+//Little-endian words at p, whatever its alignment
+#define LOAD32_LE(p) ((uint32_t)(p)[0] | (uint32_t)(p)[1] << 8 | \
+                      (uint32_t)(p)[2] << 16 | (uint32_t)(p)[3] << 24)
+#define LOAD64_LE(p) ((uint64_t)LOAD32_LE(p) | \
+                      (uint64_t)LOAD32_LE((p) + 4) << 32)
+
+#define STORE32_LE(p, x) \
+  do{ \
+    (p)[0] = (uint8_t)(x); \
+    (p)[1] = (uint8_t)((x) >> 8); \
+    (p)[2] = (uint8_t)((x) >> 16); \
+    (p)[3] = (uint8_t)((x) >> 24); \
+  }while(0)
+
+#define STORE64_LE(p, x) \
+  do{ \
+    STORE32_LE(p, (uint32_t)(x)); \
+    STORE32_LE((p) + 4, (uint32_t)((x) >> 32)); \
+  }while(0)
+
+//Operations on one word, X1 for blake2s and Q1 for blake2b, with the same
+//names as the vector ones of the kernels so all share the rounds below. R1
+//to R4 are the four rotations of G.
+#define X1_T uint32_t
+#define X1_LOAD(p) (*(p))
+#define X1_STORE(p, x) (*(p) = (x))
+#define X1_SET1(k) ((uint32_t)(k))
+#define X1_ADD(x, y) ((x) + (y))
+#define X1_XOR(x, y) ((x) ^ (y))
+#define X1_R1(x) RIGHTROTATE(x, 16)
+#define X1_R2(x) RIGHTROTATE(x, 12)
+#define X1_R3(x) RIGHTROTATE(x, 8)
+#define X1_R4(x) RIGHTROTATE(x, 7)
+
+#define Q1_T uint64_t
+#define Q1_LOAD(p) X1_LOAD(p)
+#define Q1_STORE(p, x) X1_STORE(p, x)
+#define Q1_SET1(k) ((uint64_t)(k))
+#define Q1_ADD(x, y) X1_ADD(x, y)
+#define Q1_XOR(x, y) X1_XOR(x, y)
+#define Q1_R1(x) RIGHTROTATE64(x, 32)
+#define Q1_R2(x) RIGHTROTATE64(x, 24)
+#define Q1_R3(x) RIGHTROTATE64(x, 16)
+#define Q1_R4(x) RIGHTROTATE64(x, 63)
+
+#ifdef HASH_X86
+//X4 and Q2 for SSE4.1, X8 and Q4 for AVX2. The rotations by whole bytes
+//are shuffles. X4 and Q4 also hold the four rows of the state of a single
+//message: TURN1 to TURN3 move word i of a row to word i - 1 to i - 3, to
+//line up the diagonals, and MSG packs four message words.
+#define X4_T __m128i
+#define X4_LOAD(p) _mm_loadu_si128((const __m128i *)(p))
+#define X4_STORE(p, x) _mm_storeu_si128((__m128i *)(p), x)
+#define X4_SET1(k) _mm_set1_epi32((int)(k))
+#define X4_ADD(x, y) _mm_add_epi32(x, y)
+#define X4_XOR(x, y) _mm_xor_si128(x, y)
+#define X4_R1(x) _mm_shuffle_epi8(x, _mm_setr_epi8(2, 3, 0, 1, \
+  6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13))
+#define X4_R2(x) _mm_or_si128(_mm_srli_epi32(x, 12), _mm_slli_epi32(x, 20))
+#define X4_R3(x) _mm_shuffle_epi8(x, _mm_setr_epi8(1, 2, 3, 0, \
+  5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12))
+#define X4_R4(x) _mm_or_si128(_mm_srli_epi32(x, 7), _mm_slli_epi32(x, 25))
+#define X4_TURN1(x) _mm_shuffle_epi32(x, _MM_SHUFFLE(0, 3, 2, 1))
+#define X4_TURN2(x) _mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2))
+#define X4_TURN3(x) _mm_shuffle_epi32(x, _MM_SHUFFLE(2, 1, 0, 3))
+#define X4_MSG(a, b, c, d) \
+  _mm_set_epi32((int)m[d], (int)m[c], (int)m[b], (int)m[a])
+
+#define X8_T __m256i
+#define X8_LOAD(p) _mm256_loadu_si256((const __m256i *)(p))
+#define X8_STORE(p, x) _mm256_storeu_si256((__m256i *)(p), x)
+#define X8_SET1(k) _mm256_set1_epi32((int)(k))
+#define X8_ADD(x, y) _mm256_add_epi32(x, y)
+#define X8_XOR(x, y) _mm256_xor_si256(x, y)
+#define X8_R1(x) _mm256_shuffle_epi8(x, _mm256_setr_epi8(2, 3, 0, 1, \
+  6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13, 2, 3, 0, 1, 6, 7, 4, 5, \
+  10, 11, 8, 9, 14, 15, 12, 13))
+#define X8_R2(x) \
+  _mm256_or_si256(_mm256_srli_epi32(x, 12), _mm256_slli_epi32(x, 20))
+#define X8_R3(x) _mm256_shuffle_epi8(x, _mm256_setr_epi8(1, 2, 3, 0, \
+  5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12, 1, 2, 3, 0, 5, 6, 7, 4, \
+  9, 10, 11, 8, 13, 14, 15, 12))
+#define X8_R4(x) \
+  _mm256_or_si256(_mm256_srli_epi32(x, 7), _mm256_slli_epi32(x, 25))
+
+#define Q2_T __m128i
+#define Q2_LOAD(p) X4_LOAD(p)
+#define Q2_STORE(p, x) X4_STORE(p, x)
+#define Q2_SET1(k) _mm_set1_epi64x((long long)(k))
+#define Q2_ADD(x, y) _mm_add_epi64(x, y)
+#define Q2_XOR(x, y) X4_XOR(x, y)
+#define Q2_R1(x) _mm_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1))
+#define Q2_R2(x) _mm_shuffle_epi8(x, _mm_setr_epi8(3, 4, 5, 6, 7, 0, 1, 2, \
+  11, 12, 13, 14, 15, 8, 9, 10))
+#define Q2_R3(x) _mm_shuffle_epi8(x, _mm_setr_epi8(2, 3, 4, 5, 6, 7, 0, 1, \
+  10, 11, 12, 13, 14, 15, 8, 9))
+#define Q2_R4(x) _mm_xor_si128(_mm_srli_epi64(x, 63), _mm_add_epi64(x, x))
+
+#define Q4_T __m256i
+#define Q4_LOAD(p) X8_LOAD(p)
+#define Q4_STORE(p, x) X8_STORE(p, x)
+#define Q4_SET1(k) _mm256_set1_epi64x((long long)(k))
+#define Q4_ADD(x, y) _mm256_add_epi64(x, y)
+#define Q4_XOR(x, y) X8_XOR(x, y)
+#define Q4_R1(x) _mm256_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1))
+#define Q4_R2(x) _mm256_shuffle_epi8(x, _mm256_setr_epi8(3, 4, 5, 6, 7, \
+  0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10, 3, 4, 5, 6, 7, 0, 1, 2, \
+  11, 12, 13, 14, 15, 8, 9, 10))
+#define Q4_R3(x) _mm256_shuffle_epi8(x, _mm256_setr_epi8(2, 3, 4, 5, 6, 7, \
+  0, 1, 10, 11, 12, 13, 14, 15, 8, 9, 2, 3, 4, 5, 6, 7, 0, 1, \
+  10, 11, 12, 13, 14, 15, 8, 9))
+#define Q4_R4(x) \
+  _mm256_xor_si256(_mm256_srli_epi64(x, 63), _mm256_add_epi64(x, x))
+#define Q4_TURN1(x) _mm256_permute4x64_epi64(x, _MM_SHUFFLE(0, 3, 2, 1))
+#define Q4_TURN2(x) _mm256_permute4x64_epi64(x, _MM_SHUFFLE(1, 0, 3, 2))
+#define Q4_TURN3(x) _mm256_permute4x64_epi64(x, _MM_SHUFFLE(2, 1, 0, 3))
+#define Q4_MSG(a, b, c, d) _mm256_set_epi64x((long long)m[d], \
+  (long long)m[c], (long long)m[b], (long long)m[a])
+#endif
+
+//Mixes a column or a diagonal of the state v with two words of m
+#define B2_G(V, a, b, c, d, x, y) \
+  do{ \
+    v[a] = V##_ADD(V##_ADD(v[a], v[b]), m[x]); \
+    v[d] = V##_R1(V##_XOR(v[d], v[a])); \
+    v[c] = V##_ADD(v[c], v[d]); \
+    v[b] = V##_R2(V##_XOR(v[b], v[c])); \
+    v[a] = V##_ADD(V##_ADD(v[a], v[b]), m[y]); \
+    v[d] = V##_R3(V##_XOR(v[d], v[a])); \
+    v[c] = V##_ADD(v[c], v[d]); \
+    v[b] = V##_R4(V##_XOR(v[b], v[c])); \
+  }while(0)
+
+//One round, s0 to s15 are the message words in the order of that round
+#define B2_ROUND(V, s0, s1, s2, s3, s4, s5, s6, s7, \
+                 s8, s9, s10, s11, s12, s13, s14, s15) \
+  do{ \
+    B2_G(V, 0, 4,  8, 12,  s0,  s1); \
+    B2_G(V, 1, 5,  9, 13,  s2,  s3); \
+    B2_G(V, 2, 6, 10, 14,  s4,  s5); \
+    B2_G(V, 3, 7, 11, 15,  s6,  s7); \
+    B2_G(V, 0, 5, 10, 15,  s8,  s9); \
+    B2_G(V, 1, 6, 11, 12, s10, s11); \
+    B2_G(V, 2, 7,  8, 13, s12, s13); \
+    B2_G(V, 3, 4,  9, 14, s14, s15); \
+  }while(0)
+
+//G on the four columns of the rows r0 to r3 at once
+#define B2_ROWS_G(V, x, y) \
+  do{ \
+    r0 = V##_ADD(V##_ADD(r0, r1), x); \
+    r3 = V##_R1(V##_XOR(r3, r0)); \
+    r2 = V##_ADD(r2, r3); \
+    r1 = V##_R2(V##_XOR(r1, r2)); \
+    r0 = V##_ADD(V##_ADD(r0, r1), y); \
+    r3 = V##_R3(V##_XOR(r3, r0)); \
+    r2 = V##_ADD(r2, r3); \
+    r1 = V##_R4(V##_XOR(r1, r2)); \
+  }while(0)
+
+//Same round on rows, the diagonals are turned into columns and back
+#define B2_ROWS_ROUND(V, s0, s1, s2, s3, s4, s5, s6, s7, \
+                      s8, s9, s10, s11, s12, s13, s14, s15) \
+  do{ \
+    B2_ROWS_G(V, V##_MSG(s0, s2, s4, s6), V##_MSG(s1, s3, s5, s7)); \
+    r1 = V##_TURN1(r1); \
+    r2 = V##_TURN2(r2); \
+    r3 = V##_TURN3(r3); \
+    B2_ROWS_G(V, V##_MSG(s8, s10, s12, s14), V##_MSG(s9, s11, s13, s15)); \
+    r1 = V##_TURN3(r1); \
+    r2 = V##_TURN2(r2); \
+    r3 = V##_TURN1(r3); \
+  }while(0)
+
+//The ten rounds of blake2s with ROUND, B2_ROUND or B2_ROWS_ROUND. The
+//permutations of the message are unrolled so every index is an immediate
+#define B2S_ROUNDS(ROUND, V) \
+  do{ \
+    ROUND(V, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15); \
+    ROUND(V, 14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3); \
+    ROUND(V, 11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4); \
+    ROUND(V, 7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8); \
+    ROUND(V, 9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13); \
+    ROUND(V, 2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9); \
+    ROUND(V, 12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11); \
+    ROUND(V, 13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10); \
+    ROUND(V, 6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5); \
+    ROUND(V, 10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0); \
+  }while(0)
+
+//blake2b runs two more, with the permutations of the first two
+#define B2B_ROUNDS(ROUND, V) \
+  do{ \
+    B2S_ROUNDS(ROUND, V); \
+    ROUND(V, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15); \
+    ROUND(V, 14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3); \
+  }while(0)
+
+//Body of a single message blocks function on the rows of the state: r0
+//and r1 start from h, r2 and r3 from the initial value, with the counter
+//and the final flags in r3. load reads a little-endian word
+#define B2_ROWS_BLOCKS(V, W, block_len, iv, ROUNDS, load, row3) \
+  do{ \
+    V##_T h0 = V##_LOAD(h), h1 = V##_LOAD(h + 4); \
+    V##_T r0, r1, r2, r3; \
+    W m[16]; \
+    int i; \
+    for(; blocks; blocks--, data += (block_len), counter += (block_len)){ \
+      for(i = 0; i < 16; i++){ \
+        m[i] = load(data + sizeof(W) * i); \
+      } \
+      r0 = h0; \
+      r1 = h1; \
+      r2 = V##_LOAD(iv); \
+      r3 = row3; \
+      ROUNDS(B2_ROWS_ROUND, V); \
+      h0 = V##_XOR(h0, V##_XOR(r0, r2)); \
+      h1 = V##_XOR(h1, V##_XOR(r1, r3)); \
+    } \
+    V##_STORE(h, h0); \
+    V##_STORE(h + 4, h1); \
+  }while(0)
+
+//Body of a leaf kernel: blocks blocks of lanes leaves, one per lane, from
+//the states at h and the message at msg, see blake2bp_x4_avx2. The message
+//words are transposed with gather
+#define B2_LEAVES(V, W, lanes, block_len, iv, ROUNDS, gather) \
+  do{ \
+    W words[16 * (lanes)]; \
+    W *state = h; \
+    const uint8_t *at[lanes]; \
+    V##_T hv[8], v[16], m[16]; \
+    size_t b; \
+    unsigned i, l; \
+    for(i = 0; i < 8; i++){ \
+      for(l = 0; l < (lanes); l++){ \
+        words[i * (lanes) + l] = state[8 * l + i]; \
+      } \
+      hv[i] = V##_LOAD(&words[i * (lanes)]); \
+    } \
+    for(b = 0; b < blocks; b++){ \
+      counter += (block_len); \
+      for(l = 0; l < (lanes); l++){ \
+        at[l] = msg + l * (block_len) + b * stride; \
+      } \
+      gather(lanes, at, words); \
+      for(i = 0; i < 16; i++){ \
+        m[i] = V##_LOAD(&words[i * (lanes)]); \
+      } \
+      for(i = 0; i < 8; i++){ \
+        v[i] = hv[i]; \
+        v[i + 8] = V##_SET1(iv[i]); \
+      } \
+      /*The high word of the counter is 0 for blake2b*/ \
+      v[12] = V##_SET1(iv[4] ^ (W)counter); \
+      v[13] = V##_SET1(iv[5] ^ (W)(counter >> 4 * sizeof(W) \
+                                           >> 4 * sizeof(W))); \
+      ROUNDS(B2_ROUND, V); \
+      for(i = 0; i < 8; i++){ \
+        hv[i] = V##_XOR(hv[i], V##_XOR(v[i], v[i + 8])); \
+      } \
+    } \
+    for(i = 0; i < 8; i++){ \
+      V##_STORE(&words[i * (lanes)], hv[i]); \
+      for(l = 0; l < (lanes); l++){ \
+        state[8 * l + i] = words[i * (lanes) + l]; \
+      } \
+    } \
+  }while(0)
+
+/*---------------------------------------------------------------------------*/
+/* Static function prototypes                                                */
+/*---------------------------------------------------------------------------*/
+
+static void blake2b_use_scalar(void);
+
+static void blake2s_use_scalar(void);
+
+static void blake2bp_use_scalar(void);
+
+static void blake2sp_use_scalar(void);
+
+#ifdef HASH_X86
+static void blake2b_use_avx2(void);
+
+static void blake2s_use_sse41(void);
+
+static void blake2bp_use_sse41(void);
+
+static void blake2bp_use_avx2(void);
+
+static void blake2sp_use_sse41(void);
+
+static void blake2sp_use_avx2(void);
+#endif
+
+static void blake2b_start(blake2b_ctx *ctx, uint8_t fanout, uint8_t depth,
+                          uint64_t offset, uint8_t node_depth);
+
+static void blake2s_start(blake2s_ctx *ctx, uint8_t fanout, uint8_t depth,
+                          uint64_t offset, uint8_t node_depth);
+
+static void blake2bp_x1_scalar(void *h, const uint8_t *msg, size_t stride,
+                               size_t blocks, uint64_t counter);
+
+static void blake2sp_x1_scalar(void *h, const uint8_t *msg, size_t stride,
+                               size_t blocks, uint64_t counter);
+
+static size_t blake2_parallel_update(uint8_t *tail, uint16_t *tail_len,
+                                     blake2_job_t *job, const uint8_t *msg,
+                                     size_t len);
+
+static void *blake2_leaves(void *arg);
+
+/*---------------------------------------------------------------------------*/
+/* Variable declarations                                                     */
+/*---------------------------------------------------------------------------*/
+
+//Single message block functions and leaf kernels, chosen by the
+//implementations
+static void (*blake2b_blocks)(uint64_t h[8], const uint8_t *data,
+                              size_t blocks, uint128_t counter, uint64_t f0,
+                              uint64_t f1) = blake2b_blocks_scalar;
+static void (*blake2s_blocks)(uint32_t h[8], const uint8_t *data,
+                              size_t blocks, uint64_t counter, uint32_t f0,
+                              uint32_t f1) = blake2s_blocks_scalar;
+static blake2_leaves_fn blake2bp_kernel = blake2bp_x1_scalar;
+static unsigned blake2bp_lanes = 1;
+static blake2_leaves_fn blake2sp_kernel = blake2sp_x1_scalar;
+static unsigned blake2sp_lanes = 1;
+
+//Row-wise rounds gain little on 64-bit words without AVX2, and with 32-bit
+//ones AVX2 gains nothing on SSE4.1
+const hash_impl blake2b_impls[] = {
+  {"scalar", 0, blake2b_use_scalar},
+#ifdef HASH_X86
+  {"avx2", CPU_AVX2, blake2b_use_avx2},
+#endif
+  {NULL, 0, NULL}
+};
+
+const hash_impl blake2s_impls[] = {
+  {"scalar", 0, blake2s_use_scalar},
+#ifdef HASH_X86
+  {"sse41", CPU_SSE41, blake2s_use_sse41},
+#endif
+  {NULL, 0, NULL}
+};
+
+const hash_impl blake2bp_impls[] = {
+  {"scalar", 0, blake2bp_use_scalar},
+#ifdef HASH_X86
+  {"sse41", CPU_SSE41, blake2bp_use_sse41},
+  {"avx2", CPU_AVX2, blake2bp_use_avx2},
+#endif
+  {NULL, 0, NULL}
+};
+
+const hash_impl blake2sp_impls[] = {
+  {"scalar", 0, blake2sp_use_scalar},
+#ifdef HASH_X86
+  {"sse41", CPU_SSE41, blake2sp_use_sse41},
+  {"avx2", CPU_AVX2, blake2sp_use_avx2},
+#endif
+  {NULL, 0, NULL}
+};
+
+/*---------------------------------------------------------------------------*/
+/* Function definitions                                                      */
+/*---------------------------------------------------------------------------*/
+
+void blake2b_init(blake2b_ctx *ctx){
+  blake2b_start(ctx, 1, 1, 0, 0);
+}
+
+void blake2b_update(blake2b_ctx *ctx, const uint8_t *msg, size_t len){
+  size_t blocks;
+
+  //The last block is kept even if it is full, it gets the final flag
+  if(ctx->block_len + len <= BLAKE2B_BLOCK_LEN){
+    memcpy(ctx->block + ctx->block_len, msg, len);
+    ctx->block_len += len;
+    return;
+  }
+
+  if(ctx->block_len){//Complete the pending block first
+    size_t fill = BLAKE2B_BLOCK_LEN - ctx->block_len;
+    memcpy(ctx->block + ctx->block_len, msg, fill);
+    ctx->len += BLAKE2B_BLOCK_LEN;
+    blake2b_blocks(ctx->h, ctx->block, 1, ctx->len, 0, 0);
+    msg += fill;
+    len -= fill;
+  }
+
+  //Full blocks are hashed in place
+  blocks = (len - 1) / BLAKE2B_BLOCK_LEN;
+  blake2b_blocks(ctx->h, msg, blocks, ctx->len + BLAKE2B_BLOCK_LEN, 0, 0);
+  ctx->len += blocks * BLAKE2B_BLOCK_LEN;
+  msg += blocks * BLAKE2B_BLOCK_LEN;
+  len -= blocks * BLAKE2B_BLOCK_LEN;
+
+  memcpy(ctx->block, msg, len);
+  ctx->block_len = len;
+}
+
+void blake2b_final(blake2b_ctx *ctx, uint8_t digest[64]){
+  int i;
+
+  memset(ctx->block + ctx->block_len, 0,
+         BLAKE2B_BLOCK_LEN - ctx->block_len);
+  blake2b_blocks(ctx->h, ctx->block, 1, ctx->len + ctx->block_len, ~0ULL,
+                 ctx->last_node ? ~0ULL : 0);
+  for(i = 0; i < 8; i++){
+    STORE64_LE(digest + 8 * i, ctx->h[i]);
+  }
+}
+
+int blake2b_sum(uint8_t *initial_msg, size_t initial_len, uint8_t digest[64]){
+  blake2b_ctx ctx;
+
+  blake2b_init(&ctx);
+  blake2b_update(&ctx, initial_msg, initial_len);
+  blake2b_final(&ctx, digest);
+
+  return 0;
+}
+
+void blake2s_init(blake2s_ctx *ctx){
+  blake2s_start(ctx, 1, 1, 0, 0);
+}
+
+void blake2s_update(blake2s_ctx *ctx, const uint8_t *msg, size_t len){
+  size_t blocks;
+
+  if(ctx->block_len + len <= BLAKE2S_BLOCK_LEN){
+    memcpy(ctx->block + ctx->block_len, msg, len);
+    ctx->block_len += len;
+    return;
+  }
+
+  if(ctx->block_len){
+    size_t fill = BLAKE2S_BLOCK_LEN - ctx->block_len;
+    memcpy(ctx->block + ctx->block_len, msg, fill);
+    ctx->len += BLAKE2S_BLOCK_LEN;
+    blake2s_blocks(ctx->h, ctx->block, 1, ctx->len, 0, 0);
+    msg += fill;
+    len -= fill;
+  }
+
+  blocks = (len - 1) / BLAKE2S_BLOCK_LEN;
+  blake2s_blocks(ctx->h, msg, blocks, ctx->len + BLAKE2S_BLOCK_LEN, 0, 0);
+  ctx->len += blocks * BLAKE2S_BLOCK_LEN;
+  msg += blocks * BLAKE2S_BLOCK_LEN;
+  len -= blocks * BLAKE2S_BLOCK_LEN;
+
+  memcpy(ctx->block, msg, len);
+  ctx->block_len = len;
+}
+
+void blake2s_final(blake2s_ctx *ctx, uint8_t digest[32]){
+  int i;
+
+  memset(ctx->block + ctx->block_len, 0,
+         BLAKE2S_BLOCK_LEN - ctx->block_len);
+  blake2s_blocks(ctx->h, ctx->block, 1, ctx->len + ctx->block_len, ~0U,
+                 ctx->last_node ? ~0U : 0);
+  for(i = 0; i < 8; i++){
+    STORE32_LE(digest + 4 * i, ctx->h[i]);
+  }
+}
+
+int blake2s_sum(uint8_t *initial_msg, size_t initial_len, uint8_t digest[32]){
+  blake2s_ctx ctx;
+
+  blake2s_init(&ctx);
+  blake2s_update(&ctx, initial_msg, initial_len);
+  blake2s_final(&ctx, digest);
+
+  return 0;
+}
+
+void blake2bp_init(blake2bp_ctx *ctx){
+  blake2b_ctx leaf;
+  int i;
+
+  for(i = 0; i < BLAKE2BP_LEAVES; i++){
+    blake2b_start(&leaf, BLAKE2BP_LEAVES, 2, i, 0);
+    memcpy(ctx->h[i], leaf.h, sizeof(leaf.h));
+  }
+  ctx->len = 0;
+  ctx->tail_len = 0;
+}
+
+void blake2bp_update(blake2bp_ctx *ctx, const uint8_t *msg, size_t len){
+  blake2_job_t job;
+
+  job.kernel = blake2bp_kernel;
+  job.lanes = blake2bp_lanes;
+  job.state_len = sizeof(ctx->h[0]);
+  job.block_len = BLAKE2B_BLOCK_LEN;
+  job.h = (uint8_t *)ctx->h;
+  job.counter = ctx->len;
+  job.leaves = BLAKE2BP_LEAVES;
+  ctx->len += blake2_parallel_update(ctx->tail, &ctx->tail_len, &job, msg,
+                                     len);
+}
+
+void blake2bp_final(blake2bp_ctx *ctx, uint8_t digest[64]){
+  uint8_t leaves[BLAKE2BP_LEAVES * BLAKE2B_OUT_LEN];
+  blake2b_ctx leaf;
+  size_t at;
+  int i;
+
+  //Each leaf takes its blocks of the tail, the last one is final
+  for(i = 0; i < BLAKE2BP_LEAVES; i++){
+    memcpy(leaf.h, ctx->h[i], sizeof(leaf.h));
+    leaf.len = ctx->len;
+    leaf.block_len = 0;
+    leaf.last_node = (i == BLAKE2BP_LEAVES - 1);
+    for(at = i * BLAKE2B_BLOCK_LEN; at < ctx->tail_len;
+        at += BLAKE2BP_LEAVES * BLAKE2B_BLOCK_LEN){
+      size_t take = ctx->tail_len - at;
+      blake2b_update(&leaf, ctx->tail + at,
+                     take < BLAKE2B_BLOCK_LEN ? take : BLAKE2B_BLOCK_LEN);
+    }
+    blake2b_final(&leaf, leaves + i * BLAKE2B_OUT_LEN);
+  }
+
+  blake2b_start(&leaf, BLAKE2BP_LEAVES, 2, 0, 1);
+  leaf.last_node = 1;
+  blake2b_update(&leaf, leaves, sizeof(leaves));
+  blake2b_final(&leaf, digest);
+}
+
+int blake2bp_sum(uint8_t *initial_msg, size_t initial_len,
+                 uint8_t digest[64]){
+  blake2bp_ctx ctx;
+
+  blake2bp_init(&ctx);
+  blake2bp_update(&ctx, initial_msg, initial_len);
+  blake2bp_final(&ctx, digest);
+
+  return 0;
+}
+
+void blake2sp_init(blake2sp_ctx *ctx){
+  blake2s_ctx leaf;
+  int i;
+
+  for(i = 0; i < BLAKE2SP_LEAVES; i++){
+    blake2s_start(&leaf, BLAKE2SP_LEAVES, 2, i, 0);
+    memcpy(ctx->h[i], leaf.h, sizeof(leaf.h));
+  }
+  ctx->len = 0;
+  ctx->tail_len = 0;
+}
+
+void blake2sp_update(blake2sp_ctx *ctx, const uint8_t *msg, size_t len){
+  blake2_job_t job;
+
+  job.kernel = blake2sp_kernel;
+  job.lanes = blake2sp_lanes;
+  job.state_len = sizeof(ctx->h[0]);
+  job.block_len = BLAKE2S_BLOCK_LEN;
+  job.h = (uint8_t *)ctx->h;
+  job.counter = ctx->len;
+  job.leaves = BLAKE2SP_LEAVES;
+  ctx->len += blake2_parallel_update(ctx->tail, &ctx->tail_len, &job, msg,
+                                     len);
+}
+
+void blake2sp_final(blake2sp_ctx *ctx, uint8_t digest[32]){
+  uint8_t leaves[BLAKE2SP_LEAVES * BLAKE2S_OUT_LEN];
+  blake2s_ctx leaf;
+  size_t at;
+  int i;
+
+  for(i = 0; i < BLAKE2SP_LEAVES; i++){
+    memcpy(leaf.h, ctx->h[i], sizeof(leaf.h));
+    leaf.len = ctx->len;
+    leaf.block_len = 0;
+    leaf.last_node = (i == BLAKE2SP_LEAVES - 1);
+    for(at = i * BLAKE2S_BLOCK_LEN; at < ctx->tail_len;
+        at += BLAKE2SP_LEAVES * BLAKE2S_BLOCK_LEN){
+      size_t take = ctx->tail_len - at;
+      blake2s_update(&leaf, ctx->tail + at,
+                     take < BLAKE2S_BLOCK_LEN ? take : BLAKE2S_BLOCK_LEN);
+    }
+    blake2s_final(&leaf, leaves + i * BLAKE2S_OUT_LEN);
+  }
+
+  blake2s_start(&leaf, BLAKE2SP_LEAVES, 2, 0, 1);
+  leaf.last_node = 1;
+  blake2s_update(&leaf, leaves, sizeof(leaves));
+  blake2s_final(&leaf, digest);
+}
+
+int blake2sp_sum(uint8_t *initial_msg, size_t initial_len,
+                 uint8_t digest[32]){
+  blake2sp_ctx ctx;
+
+  blake2sp_init(&ctx);
+  blake2sp_update(&ctx, initial_msg, initial_len);
+  blake2sp_final(&ctx, digest);
+
+  return 0;
+}
+
+void blake2b_blocks_scalar(uint64_t h[8], const uint8_t *data, size_t blocks,
+                           uint128_t counter, uint64_t f0, uint64_t f1){
+  uint64_t v[16], m[16];
+  int i;
+
+  for(; blocks; blocks--, data += BLAKE2B_BLOCK_LEN,
+      counter += BLAKE2B_BLOCK_LEN){
+    for(i = 0; i < 16; i++){
+      m[i] = LOAD64_LE(data + 8 * i);
+    }
+    for(i = 0; i < 8; i++){
+      v[i] = h[i];
+      v[i + 8] = blake2b_iv[i];
+    }
+    v[12] ^= (uint64_t)counter;
+    v[13] ^= (uint64_t)(counter >> 64);
+    v[14] ^= f0;
+    v[15] ^= f1;
+
+    B2B_ROUNDS(B2_ROUND, Q1);
+
+    for(i = 0; i < 8; i++){
+      h[i] ^= v[i] ^ v[i + 8];
+    }
+  }
+}
+
+#ifdef HASH_X86
+__attribute__((target("avx2")))
+void blake2b_blocks_avx2(uint64_t h[8], const uint8_t *data, size_t blocks,
+                         uint128_t counter, uint64_t f0, uint64_t f1){
+  B2_ROWS_BLOCKS(Q4, uint64_t, BLAKE2B_BLOCK_LEN, blake2b_iv, B2B_ROUNDS,
+    LOAD64_LE,
+    Q4_XOR(Q4_LOAD(blake2b_iv + 4),
+           _mm256_set_epi64x((long long)f1, (long long)f0,
+                             (long long)(uint64_t)(counter >> 64),
+                             (long long)(uint64_t)counter)));
+}
+
+__attribute__((target("sse4.1")))
+void blake2bp_x2_sse41(void *h, const uint8_t *msg, size_t stride,
+                       size_t blocks, uint64_t counter){
+  B2_LEAVES(Q2, uint64_t, 2, BLAKE2B_BLOCK_LEN, blake2b_iv, B2B_ROUNDS,
+            mb_gather_le64);
+}
+
+__attribute__((target("avx2")))
+void blake2bp_x4_avx2(void *h, const uint8_t *msg, size_t stride,
+                      size_t blocks, uint64_t counter){
+  B2_LEAVES(Q4, uint64_t, 4, BLAKE2B_BLOCK_LEN, blake2b_iv, B2B_ROUNDS,
+            mb_gather_le64);
+}
+#endif
+
+void blake2s_blocks_scalar(uint32_t h[8], const uint8_t *data, size_t blocks,
+                           uint64_t counter, uint32_t f0, uint32_t f1){
+  uint32_t v[16], m[16];
+  int i;
+
+  for(; blocks; blocks--, data += BLAKE2S_BLOCK_LEN,
+      counter += BLAKE2S_BLOCK_LEN){
+    for(i = 0; i < 16; i++){
+      m[i] = LOAD32_LE(data + 4 * i);
+    }
+    for(i = 0; i < 8; i++){
+      v[i] = h[i];
+      v[i + 8] = blake2s_iv[i];
+    }
+    v[12] ^= (uint32_t)counter;
+    v[13] ^= (uint32_t)(counter >> 32);
+    v[14] ^= f0;
+    v[15] ^= f1;
+
+    B2S_ROUNDS(B2_ROUND, X1);
+
+    for(i = 0; i < 8; i++){
+      h[i] ^= v[i] ^ v[i + 8];
+    }
+  }
+}
+
+#ifdef HASH_X86
+__attribute__((target("sse4.1")))
+void blake2s_blocks_sse41(uint32_t h[8], const uint8_t *data, size_t blocks,
+                          uint64_t counter, uint32_t f0, uint32_t f1){
+  B2_ROWS_BLOCKS(X4, uint32_t, BLAKE2S_BLOCK_LEN, blake2s_iv, B2S_ROUNDS,
+    LOAD32_LE,
+    X4_XOR(X4_LOAD(blake2s_iv + 4),
+           _mm_set_epi32((int)f1, (int)f0, (int)(uint32_t)(counter >> 32),
+                         (int)(uint32_t)counter)));
+}
+
+__attribute__((target("sse4.1")))
+void blake2sp_x4_sse41(void *h, const uint8_t *msg, size_t stride,
+                       size_t blocks, uint64_t counter){
+  B2_LEAVES(X4, uint32_t, 4, BLAKE2S_BLOCK_LEN, blake2s_iv, B2S_ROUNDS,
+            mb_gather_le32);
+}
+
+__attribute__((target("avx2")))
+void blake2sp_x8_avx2(void *h, const uint8_t *msg, size_t stride,
+                      size_t blocks, uint64_t counter){
+  B2_LEAVES(X8, uint32_t, 8, BLAKE2S_BLOCK_LEN, blake2s_iv, B2S_ROUNDS,
+            mb_gather_le32);
+}
+#endif
+
+/*---------------------------------------------------------------------------*/
+/* Static function definitions                                               */
+/*---------------------------------------------------------------------------*/
+
+static void blake2b_use_scalar(void){
+  blake2b_blocks = blake2b_blocks_scalar;
+}
+
+static void blake2s_use_scalar(void){
+  blake2s_blocks = blake2s_blocks_scalar;
+}
+
+static void blake2bp_use_scalar(void){
+  blake2bp_kernel = blake2bp_x1_scalar;
+  blake2bp_lanes = 1;
+}
+
+static void blake2sp_use_scalar(void){
+  blake2sp_kernel = blake2sp_x1_scalar;
+  blake2sp_lanes = 1;
+}
+
+#ifdef HASH_X86
+static void blake2b_use_avx2(void){
+  blake2b_blocks = blake2b_blocks_avx2;
+}
+
+static void blake2s_use_sse41(void){
+  blake2s_blocks = blake2s_blocks_sse41;
+}
+
+static void blake2bp_use_sse41(void){
+  blake2bp_kernel = blake2bp_x2_sse41;
+  blake2bp_lanes = 2;
+}
+
+static void blake2bp_use_avx2(void){
+  blake2bp_kernel = blake2bp_x4_avx2;
+  blake2bp_lanes = 4;
+}
+
+static void blake2sp_use_sse41(void){
+  blake2sp_kernel = blake2sp_x4_sse41;
+  blake2sp_lanes = 4;
+}
+
+static void blake2sp_use_avx2(void){
+  blake2sp_kernel = blake2sp_x8_avx2;
+  blake2sp_lanes = 8;
+}
+#endif
+
+//Initial state of a node of a tree of fanout and depth, as the parameter
+//block gives it. A single message is the tree of fanout and depth 1.
+static void blake2b_start(blake2b_ctx *ctx, uint8_t fanout, uint8_t depth,
+                          uint64_t offset, uint8_t node_depth){
+  uint64_t inner = depth > 1 ? BLAKE2B_OUT_LEN : 0;
+
+  memcpy(ctx->h, blake2b_iv, sizeof(ctx->h));
+  ctx->h[0] ^= BLAKE2B_OUT_LEN | (uint64_t)fanout << 16
+               | (uint64_t)depth << 24;
+  ctx->h[1] ^= offset;
+  ctx->h[2] ^= node_depth | inner << 8;
+  ctx->len = 0;
+  ctx->block_len = 0;
+  ctx->last_node = 0;
+}
+
+static void blake2s_start(blake2s_ctx *ctx, uint8_t fanout, uint8_t depth,
+                          uint64_t offset, uint8_t node_depth){
+  uint32_t inner = depth > 1 ? BLAKE2S_OUT_LEN : 0;
+
+  memcpy(ctx->h, blake2s_iv, sizeof(ctx->h));
+  ctx->h[0] ^= BLAKE2S_OUT_LEN | (uint32_t)fanout << 16
+               | (uint32_t)depth << 24;
+  ctx->h[2] ^= (uint32_t)offset;
+  ctx->h[3] ^= (uint32_t)(offset >> 32 & 0xFFFF) | (uint32_t)node_depth << 16
+               | inner << 24;
+  ctx->len = 0;
+  ctx->block_len = 0;
+  ctx->last_node = 0;
+}
+
+//Kernels of a single leaf, on the block function of the single message
+static void blake2bp_x1_scalar(void *h, const uint8_t *msg, size_t stride,
+                               size_t blocks, uint64_t counter){
+  size_t b;
+
+  for(b = 0; b < blocks; b++){
+    counter += BLAKE2B_BLOCK_LEN;
+    blake2b_blocks(h, msg + b * stride, 1, counter, 0, 0);
+  }
+}
+
+static void blake2sp_x1_scalar(void *h, const uint8_t *msg, size_t stride,
+                               size_t blocks, uint64_t counter){
+  size_t b;
+
+  for(b = 0; b < blocks; b++){
+    counter += BLAKE2S_BLOCK_LEN;
+    blake2s_blocks(h, msg + b * stride, 1, counter, 0, 0);
+  }
+}
+
+//Update of blake2bp and blake2sp. A round is a block for every leaf; the
+//tail keeps the rounds not yet hashed, which always start on a leaf 0. A
+//round is hashed only once more than a block for every leaf but the last
+//follows it, so the last block of each leaf is kept until final, as it
+//gets the final flag. The tail holds twice the leaves minus one blocks.
+//job has the kernel and the leaves, the rest is filled in. Returns how
+//many bytes every leaf hashed.
+static size_t blake2_parallel_update(uint8_t *tail, uint16_t *tail_len,
+                                     blake2_job_t *job, const uint8_t *msg,
+                                     size_t len){
+  size_t round = job->leaves * job->block_len;
+  size_t keep = round - job->block_len;
+  size_t hashed = 0;
+
+  job->stride = round;
+  job->blocks = 1;
+
+  //A round in the tail can be hashed if the rest plus msg is enough
+  if(*tail_len > round){
+    if(*tail_len - round + len <= keep){
+      memcpy(tail + *tail_len, msg, len);
+      *tail_len += len;
+      return 0;
+    }
+    job->msg = tail;
+    blake2_leaves(job);
+    job->counter += job->block_len;
+    hashed += job->block_len;
+    *tail_len -= round;
+    memmove(tail, tail + round, *tail_len);
+  }
+
+  if(*tail_len > 0){//Complete the round of the tail
+    size_t take = round - *tail_len;
+    if(take > len){
+      take = len;
+    }
+    memcpy(tail + *tail_len, msg, take);
+    *tail_len += take;
+    msg += take;
+    len -= take;
+    if(len <= keep){
+      memcpy(tail + *tail_len, msg, len);
+      *tail_len += len;
+      return hashed;
+    }
+    job->msg = tail;
+    blake2_leaves(job);
+    job->counter += job->block_len;
+    hashed += job->block_len;
+    *tail_len = 0;
+  }
+
+  //Whole rounds are hashed in place
+  if(len > round + keep){
+    job->msg = msg;
+    job->blocks = (len - keep - 1) / round;
+    blake2_leaves(job);
+    hashed += job->blocks * job->block_len;
+    msg += job->blocks * round;
+    len -= job->blocks * round;
+  }
+
+  memcpy(tail, msg, len);
+  *tail_len = len;
+  return hashed;
+}
+
+//Hashes the leaves of job, lanes at a time. Big groups of leaves are split
+//in halves, the first one hashed by a thread from the budget of
+//hash_set_threads. Leaves and lanes are powers of two, so are the halves.
+static void *blake2_leaves(void *arg){
+  blake2_job_t *job = arg;
+  blake2_job_t first, second;
+  pthread_t thread;
+  int threaded = 0;
+  unsigned l;
+
+  if((job->leaves > job->lanes)
+     && (job->blocks * job->block_len * job->leaves >= BLAKE2_THREAD_MIN)
+     && hash_take_thread()){
+    first = *job;
+    first.leaves /= 2;
+    second = first;
+    second.h += first.leaves * job->state_len;
+    second.msg += first.leaves * job->block_len;
+
+    threaded = !pthread_create(&thread, NULL, blake2_leaves, &first);
+    if(!threaded){
+      hash_give_thread();
+      blake2_leaves(&first);
+    }
+    blake2_leaves(&second);
+    if(threaded){
+      pthread_join(thread, NULL);
+      hash_give_thread();
+    }
+    return NULL;
+  }
+
+  for(l = 0; l < job->leaves; l += job->lanes){
+    job->kernel(job->h + l * job->state_len, job->msg + l * job->block_len,
+                job->stride, job->blocks, job->counter);
+  }
+  return NULL;
+}
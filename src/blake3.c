@@ -0,0 +1,827 @@
+/**HashCheck********************************************************************
+
+  File        blake3.c
+
+  Resume      Compute the blake3 checksum of a message.
+
+  Description The message is split in chunks of 1 KiB that are the leaves
+              of a binary tree. Whole subtrees are hashed many chunks at
+              once by the SIMD kernels, one chunk per lane, and the largest
+              ones are split between threads, so a single big file is hashed
+              by every core.
+
+  See also    HashCheck.h
+
+  Autor       Raúl San Martín Aniceto
+
+  Copyright (c) 2018 Raúl San Martín Aniceto
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+******************************************************************************/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "HashCheck.h"
+
+#ifdef HASH_X86
+#include <immintrin.h>
+#endif
+
+/*---------------------------------------------------------------------------*/
+/* Constant declarations                                                     */
+/*---------------------------------------------------------------------------*/
+
+#define BLAKE3_BLOCK_LEN 64
+#define BLAKE3_CHUNK_LEN 1024
+#define BLAKE3_OUT_LEN 32
+#define BLAKE3_MAX_LANES 16 //Most chunks a kernel hashes at once
+
+//Least bytes of a subtree worth splitting between two threads
+#define BLAKE3_THREAD_MIN (1 << 20)
+
+//Domain separation flags of the compression function
+#define BLAKE3_CHUNK_START 1
+#define BLAKE3_CHUNK_END   2
+#define BLAKE3_PARENT      4
+#define BLAKE3_ROOT        8
+
+//Same as the initial hash value of sha256
+static const uint32_t blake3_iv[8] = {
+  0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+  0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+};
+
+/*---------------------------------------------------------------------------*/
+/* Type declarations                                                         */
+/*---------------------------------------------------------------------------*/
+
+//Hashes the same number of blocks of lanes inputs, see blake3_x4_sse41
+typedef void (*blake3_kernel_fn)(const uint8_t *const *inputs, size_t blocks,
+                                 uint64_t counter, int increment,
+                                 uint8_t flags, uint8_t flags_start,
+                                 uint8_t flags_end, uint8_t *out);
+
+/*---------------------------------------------------------------------------*/
+/* Structure declarations                                                    */
+/*---------------------------------------------------------------------------*/
+
+typedef struct{//Last block of a node, compressed when its output is needed
+  uint32_t cv[8];
+  uint8_t block[BLAKE3_BLOCK_LEN];
+  uint8_t block_len;
+  uint64_t counter;
+  uint8_t flags;
+}blake3_output_t;
+
+typedef struct{//Left half of a subtree, hashed by another thread
+  const uint8_t *input;
+  size_t len;
+  uint64_t chunk;
+  uint8_t *out;
+  size_t count;   //Chaining values written to out
+}blake3_job_t;
+
+/*---------------------------------------------------------------------------*/
+/* Macro declarations                                                        */
+/*---------------------------------------------------------------------------*/
+
+#define RIGHTROTATE(x, c) (((x) >> (c)) | ((x) << (32 - (c))))
+
+//Little-endian word at p, whatever its alignment
+#define LOAD32_LE(p) ((uint32_t)(p)[0] | (uint32_t)(p)[1] << 8 | \
+                      (uint32_t)(p)[2] << 16 | (uint32_t)(p)[3] << 24)
+
+#define STORE32_LE(p, x) \
+  do{ \
+    (p)[0] = (uint8_t)(x); \
+    (p)[1] = (uint8_t)((x) >> 8); \
+    (p)[2] = (uint8_t)((x) >> 16); \
+    (p)[3] = (uint8_t)((x) >> 24); \
+  }while(0)
+
+//Operations on one word: X1 for the scalar code, with the same names as the
+//vector ones of the kernels so all share the rounds below
+#define X1_T uint32_t
+#define X1_LOAD(p) (*(p))
+#define X1_STORE(p, x) (*(p) = (x))
+#define X1_SET1(k) ((uint32_t)(k))
+#define X1_ADD(x, y) ((x) + (y))
+#define X1_XOR(x, y) ((x) ^ (y))
+#define X1_ROR16(x) RIGHTROTATE(x, 16)
+#define X1_ROR12(x) RIGHTROTATE(x, 12)
+#define X1_ROR8(x) RIGHTROTATE(x, 8)
+#define X1_ROR7(x) RIGHTROTATE(x, 7)
+
+#ifdef HASH_X86
+//X4 for SSE4.1, X8 for AVX2 and X16 for AVX-512. The rotations by whole
+//bytes are shuffles
+#define X4_T __m128i
+#define X4_LOAD(p) _mm_loadu_si128((const __m128i *)(p))
+#define X4_STORE(p, x) _mm_storeu_si128((__m128i *)(p), x)
+#define X4_SET1(k) _mm_set1_epi32((int)(k))
+#define X4_ADD(x, y) _mm_add_epi32(x, y)
+#define X4_XOR(x, y) _mm_xor_si128(x, y)
+#define X4_ROR16(x) _mm_shuffle_epi8(x, _mm_set_epi8(13, 12, 15, 14, \
+  9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2))
+#define X4_ROR12(x) _mm_or_si128(_mm_srli_epi32(x, 12), _mm_slli_epi32(x, 20))
+#define X4_ROR8(x) _mm_shuffle_epi8(x, _mm_set_epi8(12, 15, 14, 13, \
+  8, 11, 10, 9, 4, 7, 6, 5, 0, 3, 2, 1))
+#define X4_ROR7(x) _mm_or_si128(_mm_srli_epi32(x, 7), _mm_slli_epi32(x, 25))
+
+#define X8_T __m256i
+#define X8_LOAD(p) _mm256_loadu_si256((const __m256i *)(p))
+#define X8_STORE(p, x) _mm256_storeu_si256((__m256i *)(p), x)
+#define X8_SET1(k) _mm256_set1_epi32((int)(k))
+#define X8_ADD(x, y) _mm256_add_epi32(x, y)
+#define X8_XOR(x, y) _mm256_xor_si256(x, y)
+#define X8_ROR16(x) _mm256_shuffle_epi8(x, _mm256_set_epi8(13, 12, 15, 14, \
+  9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2, 13, 12, 15, 14, 9, 8, 11, 10, \
+  5, 4, 7, 6, 1, 0, 3, 2))
+#define X8_ROR12(x) \
+  _mm256_or_si256(_mm256_srli_epi32(x, 12), _mm256_slli_epi32(x, 20))
+#define X8_ROR8(x) _mm256_shuffle_epi8(x, _mm256_set_epi8(12, 15, 14, 13, \
+  8, 11, 10, 9, 4, 7, 6, 5, 0, 3, 2, 1, 12, 15, 14, 13, 8, 11, 10, 9, \
+  4, 7, 6, 5, 0, 3, 2, 1))
+#define X8_ROR7(x) \
+  _mm256_or_si256(_mm256_srli_epi32(x, 7), _mm256_slli_epi32(x, 25))
+
+#define X16_T __m512i
+#define X16_LOAD(p) _mm512_loadu_si512((const void *)(p))
+#define X16_STORE(p, x) _mm512_storeu_si512((void *)(p), x)
+#define X16_SET1(k) _mm512_set1_epi32((int)(k))
+#define X16_ADD(x, y) _mm512_add_epi32(x, y)
+#define X16_XOR(x, y) _mm512_xor_si512(x, y)
+#define X16_ROR16(x) _mm512_ror_epi32(x, 16)
+#define X16_ROR12(x) _mm512_ror_epi32(x, 12)
+#define X16_ROR8(x) _mm512_ror_epi32(x, 8)
+#define X16_ROR7(x) _mm512_ror_epi32(x, 7)
+#endif
+
+//Mixes a column or a diagonal of the state v with two words of m
+#define B3_G(V, a, b, c, d, x, y) \
+  do{ \
+    v[a] = V##_ADD(V##_ADD(v[a], v[b]), m[x]); \
+    v[d] = V##_ROR16(V##_XOR(v[d], v[a])); \
+    v[c] = V##_ADD(v[c], v[d]); \
+    v[b] = V##_ROR12(V##_XOR(v[b], v[c])); \
+    v[a] = V##_ADD(V##_ADD(v[a], v[b]), m[y]); \
+    v[d] = V##_ROR8(V##_XOR(v[d], v[a])); \
+    v[c] = V##_ADD(v[c], v[d]); \
+    v[b] = V##_ROR7(V##_XOR(v[b], v[c])); \
+  }while(0)
+
+//One round, s0 to s15 are the message words in the order of that round
+#define B3_ROUND(V, s0, s1, s2, s3, s4, s5, s6, s7, \
+                 s8, s9, s10, s11, s12, s13, s14, s15) \
+  do{ \
+    B3_G(V, 0, 4,  8, 12,  s0,  s1); \
+    B3_G(V, 1, 5,  9, 13,  s2,  s3); \
+    B3_G(V, 2, 6, 10, 14,  s4,  s5); \
+    B3_G(V, 3, 7, 11, 15,  s6,  s7); \
+    B3_G(V, 0, 5, 10, 15,  s8,  s9); \
+    B3_G(V, 1, 6, 11, 12, s10, s11); \
+    B3_G(V, 2, 7,  8, 13, s12, s13); \
+    B3_G(V, 3, 4,  9, 14, s14, s15); \
+  }while(0)
+
+//The seven rounds on the state v and the message words m. The permutations
+//of the message are unrolled so every index is an immediate
+#define B3_ROUNDS(V) \
+  do{ \
+    B3_ROUND(V, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15); \
+    B3_ROUND(V, 2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8); \
+    B3_ROUND(V, 3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1); \
+    B3_ROUND(V, 10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6); \
+    B3_ROUND(V, 12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4); \
+    B3_ROUND(V, 9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7); \
+    B3_ROUND(V, 11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13); \
+  }while(0)
+
+//Whole body of a kernel: blocks blocks of every input, lanes words wide
+//vectors, one input per lane. The message words are transposed with
+//mb_gather_le32
+#define B3_KERNEL(V, lanes) \
+  do{ \
+    uint32_t msg[16 * (lanes)], words[8 * (lanes)]; \
+    uint32_t lo[lanes], hi[lanes]; \
+    const uint8_t *at[lanes]; \
+    V##_T h[8], v[16], m[16]; \
+    size_t b; \
+    unsigned i, l; \
+    for(l = 0; l < (lanes); l++){ \
+      uint64_t c = counter + (increment ? l : 0); \
+      lo[l] = (uint32_t)c; \
+      hi[l] = (uint32_t)(c >> 32); \
+    } \
+    for(i = 0; i < 8; i++){ \
+      h[i] = V##_SET1(blake3_iv[i]); \
+    } \
+    for(b = 0; b < blocks; b++){ \
+      uint8_t f = flags; \
+      if(b == 0){ \
+        f |= flags_start; \
+      } \
+      if(b + 1 == blocks){ \
+        f |= flags_end; \
+      } \
+      for(l = 0; l < (lanes); l++){ \
+        at[l] = inputs[l] + b * BLAKE3_BLOCK_LEN; \
+        __builtin_prefetch(at[l] + 4 * BLAKE3_BLOCK_LEN); \
+      } \
+      mb_gather_le32(lanes, at, msg); \
+      for(i = 0; i < 16; i++){ \
+        m[i] = V##_LOAD(&msg[i * (lanes)]); \
+      } \
+      for(i = 0; i < 8; i++){ \
+        v[i] = h[i]; \
+      } \
+      for(i = 0; i < 4; i++){ \
+        v[i + 8] = V##_SET1(blake3_iv[i]); \
+      } \
+      v[12] = V##_LOAD(lo); \
+      v[13] = V##_LOAD(hi); \
+      v[14] = V##_SET1(BLAKE3_BLOCK_LEN); \
+      v[15] = V##_SET1(f); \
+      B3_ROUNDS(V); \
+      for(i = 0; i < 8; i++){ \
+        h[i] = V##_XOR(v[i], v[i + 8]); \
+      } \
+    } \
+    for(i = 0; i < 8; i++){ \
+      V##_STORE(&words[i * (lanes)], h[i]); \
+    } \
+    for(l = 0; l < (lanes); l++){ \
+      for(i = 0; i < 8; i++){ \
+        STORE32_LE(out + l * BLAKE3_OUT_LEN + 4 * i, words[i * (lanes) + l]); \
+      } \
+    } \
+  }while(0)
+
+/*---------------------------------------------------------------------------*/
+/* Static function prototypes                                                */
+/*---------------------------------------------------------------------------*/
+
+static void blake3_use_scalar(void);
+
+#ifdef HASH_X86
+static void blake3_use_sse41(void);
+
+static void blake3_use_avx2(void);
+
+static void blake3_use_avx512(void);
+#endif
+
+static void blake3_compress(uint32_t cv[8], const uint8_t *block,
+                            uint8_t block_len, uint64_t counter,
+                            uint8_t flags);
+
+static void blake3_x1_scalar(const uint8_t *const *inputs, size_t blocks,
+                             uint64_t counter, int increment, uint8_t flags,
+                             uint8_t flags_start, uint8_t flags_end,
+                             uint8_t *out);
+
+static void blake3_many(const uint8_t *const *inputs, size_t count,
+                        size_t blocks, uint64_t counter, int increment,
+                        uint8_t flags, uint8_t flags_start, uint8_t flags_end,
+                        uint8_t *out);
+
+static void blake3_output_cv(const blake3_output_t *output, uint8_t *cv);
+
+static void blake3_parent_output(blake3_output_t *output,
+                                 const uint8_t *block);
+
+static size_t blake3_chunk_len(const blake3_ctx *ctx);
+
+static void blake3_chunk_reset(blake3_ctx *ctx, uint64_t chunk);
+
+static void blake3_chunk_update(blake3_ctx *ctx, const uint8_t *msg,
+                                size_t len);
+
+static void blake3_chunk_output(const blake3_ctx *ctx,
+                                blake3_output_t *output);
+
+static size_t blake3_chunks(const uint8_t *input, size_t len, uint64_t chunk,
+                            uint8_t *out);
+
+static size_t blake3_parents(const uint8_t *cvs, size_t count, uint8_t *out);
+
+static size_t blake3_subtree(const uint8_t *input, size_t len, uint64_t chunk,
+                             uint8_t *out);
+
+static void *blake3_subtree_thread(void *arg);
+
+static void blake3_subtree_pair(const uint8_t *input, size_t len,
+                                uint64_t chunk, uint8_t *out);
+
+static void blake3_push_cv(blake3_ctx *ctx, const uint8_t *cv,
+                           uint64_t chunk);
+
+static void blake3_merge_cvs(blake3_ctx *ctx, uint64_t chunks);
+
+/*---------------------------------------------------------------------------*/
+/* Variable declarations                                                     */
+/*---------------------------------------------------------------------------*/
+
+//Kernel used for whole chunks and parents, chosen by the implementations
+static blake3_kernel_fn blake3_kernel = blake3_x1_scalar;
+static unsigned blake3_lanes = 1;
+
+const hash_impl blake3_impls[] = {
+  {"scalar", 0, blake3_use_scalar},
+#ifdef HASH_X86
+  {"sse41", CPU_SSE41, blake3_use_sse41},
+  {"avx2", CPU_AVX2, blake3_use_avx2},
+  {"avx512", CPU_AVX512F, blake3_use_avx512},
+#endif
+  {NULL, 0, NULL}
+};
+
+/*---------------------------------------------------------------------------*/
+/* Function definitions                                                      */
+/*---------------------------------------------------------------------------*/
+
+void blake3_init(blake3_ctx *ctx){
+  ctx->stack_len = 0;
+  blake3_chunk_reset(ctx, 0);
+}
+
+void blake3_update(blake3_ctx *ctx, const uint8_t *msg, size_t len){
+  if(len == 0){
+    return;
+  }
+
+  //Complete the pending chunk first
+  if(blake3_chunk_len(ctx) > 0){
+    size_t take = BLAKE3_CHUNK_LEN - blake3_chunk_len(ctx);
+    if(take > len){
+      take = len;
+    }
+    blake3_chunk_update(ctx, msg, take);
+    msg += take;
+    len -= take;
+    if(len == 0){
+      return;
+    }
+
+    blake3_output_t output;
+    uint8_t cv[BLAKE3_OUT_LEN];
+    blake3_chunk_output(ctx, &output);
+    blake3_output_cv(&output, cv);
+    blake3_push_cv(ctx, cv, ctx->chunk);
+    blake3_chunk_reset(ctx, ctx->chunk + 1);
+  }
+
+  //The largest subtrees that fit in what is left and that start at a
+  //multiple of their size are hashed in place. The last chunk is always
+  //kept, it may be the root.
+  while(len > BLAKE3_CHUNK_LEN){
+    uint64_t done = ctx->chunk * BLAKE3_CHUNK_LEN;
+    size_t subtree = (size_t)1 << (63 - __builtin_clzll(len));
+    while((subtree - 1) & done){
+      subtree /= 2;
+    }
+    uint64_t chunks = subtree / BLAKE3_CHUNK_LEN;
+
+    if(chunks <= 1){
+      blake3_ctx single;
+      blake3_output_t output;
+      uint8_t cv[BLAKE3_OUT_LEN];
+
+      blake3_chunk_reset(&single, ctx->chunk);
+      blake3_chunk_update(&single, msg, subtree);
+      blake3_chunk_output(&single, &output);
+      blake3_output_cv(&output, cv);
+      blake3_push_cv(ctx, cv, ctx->chunk);
+    }else{
+      //Pushed as two halves, the merge waits for more input
+      uint8_t pair[2 * BLAKE3_OUT_LEN];
+      blake3_subtree_pair(msg, subtree, ctx->chunk, pair);
+      blake3_push_cv(ctx, pair, ctx->chunk);
+      blake3_push_cv(ctx, pair + BLAKE3_OUT_LEN, ctx->chunk + chunks / 2);
+    }
+    ctx->chunk += chunks;
+    msg += subtree;
+    len -= subtree;
+  }
+
+  if(len > 0){
+    blake3_chunk_update(ctx, msg, len);
+    blake3_merge_cvs(ctx, ctx->chunk);
+  }
+}
+
+void blake3_final(blake3_ctx *ctx, uint8_t digest[32]){
+  blake3_output_t output;
+  uint8_t block[BLAKE3_BLOCK_LEN];
+  size_t left;
+  int i;
+
+  //The root is the current chunk, or the parent of the two last values
+  if((ctx->stack_len == 0) || (blake3_chunk_len(ctx) > 0)){
+    left = ctx->stack_len;
+    blake3_chunk_output(ctx, &output);
+  }else{
+    left = ctx->stack_len - 2;
+    blake3_parent_output(&output, ctx->stack + left * BLAKE3_OUT_LEN);
+  }
+  while(left > 0){
+    left--;
+    memcpy(block, ctx->stack + left * BLAKE3_OUT_LEN, BLAKE3_OUT_LEN);
+    blake3_output_cv(&output, block + BLAKE3_OUT_LEN);
+    blake3_parent_output(&output, block);
+  }
+
+  blake3_compress(output.cv, output.block, output.block_len, 0,
+                  output.flags | BLAKE3_ROOT);
+  for(i = 0; i < 8; i++){
+    STORE32_LE(digest + 4 * i, output.cv[i]);
+  }
+}
+
+int blake3_sum(uint8_t *initial_msg, size_t initial_len, uint8_t digest[32]){
+  blake3_ctx ctx;
+
+  blake3_init(&ctx);
+  blake3_update(&ctx, initial_msg, initial_len);
+  blake3_final(&ctx, digest);
+
+  return 0;
+}
+
+#ifdef HASH_X86
+__attribute__((target("sse4.1")))
+void blake3_x4_sse41(const uint8_t *const *inputs, size_t blocks,
+                     uint64_t counter, int increment, uint8_t flags,
+                     uint8_t flags_start, uint8_t flags_end, uint8_t *out){
+  B3_KERNEL(X4, 4);
+}
+
+__attribute__((target("avx2")))
+void blake3_x8_avx2(const uint8_t *const *inputs, size_t blocks,
+                    uint64_t counter, int increment, uint8_t flags,
+                    uint8_t flags_start, uint8_t flags_end, uint8_t *out){
+  B3_KERNEL(X8, 8);
+}
+
+__attribute__((target("avx512f")))
+void blake3_x16_avx512(const uint8_t *const *inputs, size_t blocks,
+                       uint64_t counter, int increment, uint8_t flags,
+                       uint8_t flags_start, uint8_t flags_end, uint8_t *out){
+  B3_KERNEL(X16, 16);
+}
+#endif
+
+/*---------------------------------------------------------------------------*/
+/* Static function definitions                                               */
+/*---------------------------------------------------------------------------*/
+
+static void blake3_use_scalar(void){
+  blake3_kernel = blake3_x1_scalar;
+  blake3_lanes = 1;
+}
+
+#ifdef HASH_X86
+static void blake3_use_sse41(void){
+  blake3_kernel = blake3_x4_sse41;
+  blake3_lanes = 4;
+}
+
+static void blake3_use_avx2(void){
+  blake3_kernel = blake3_x8_avx2;
+  blake3_lanes = 8;
+}
+
+static void blake3_use_avx512(void){
+  blake3_kernel = blake3_x16_avx512;
+  blake3_lanes = 16;
+}
+#endif
+
+//Compression function, cv becomes the first half of its output
+static void blake3_compress(uint32_t cv[8], const uint8_t *block,
+                            uint8_t block_len, uint64_t counter,
+                            uint8_t flags){
+  uint32_t v[16], m[16];
+  int i;
+
+  for(i = 0; i < 16; i++){
+    m[i] = LOAD32_LE(block + 4 * i);
+  }
+  for(i = 0; i < 8; i++){
+    v[i] = cv[i];
+  }
+  for(i = 0; i < 4; i++){
+    v[i + 8] = blake3_iv[i];
+  }
+  v[12] = (uint32_t)counter;
+  v[13] = (uint32_t)(counter >> 32);
+  v[14] = block_len;
+  v[15] = flags;
+
+  B3_ROUNDS(X1);
+
+  for(i = 0; i < 8; i++){
+    cv[i] = v[i] ^ v[i + 8];
+  }
+}
+
+//Kernel of a single lane
+static void blake3_x1_scalar(const uint8_t *const *inputs, size_t blocks,
+                             uint64_t counter, int increment, uint8_t flags,
+                             uint8_t flags_start, uint8_t flags_end,
+                             uint8_t *out){
+  uint32_t cv[8];
+  size_t b;
+  int i;
+
+  (void)increment;
+  memcpy(cv, blake3_iv, sizeof(cv));
+  for(b = 0; b < blocks; b++){
+    uint8_t f = flags;
+    if(b == 0){
+      f |= flags_start;
+    }
+    if(b + 1 == blocks){
+      f |= flags_end;
+    }
+    blake3_compress(cv, inputs[0] + b * BLAKE3_BLOCK_LEN, BLAKE3_BLOCK_LEN,
+                    counter, f);
+  }
+  for(i = 0; i < 8; i++){
+    STORE32_LE(out + 4 * i, cv[i]);
+  }
+}
+
+//Hashes count inputs of blocks blocks each, a kernel call per group of
+//lanes. The last group is completed repeating its last input.
+static void blake3_many(const uint8_t *const *inputs, size_t count,
+                        size_t blocks, uint64_t counter, int increment,
+                        uint8_t flags, uint8_t flags_start, uint8_t flags_end,
+                        uint8_t *out){
+  const uint8_t *group[BLAKE3_MAX_LANES];
+  uint8_t cvs[BLAKE3_MAX_LANES * BLAKE3_OUT_LEN];
+  unsigned lanes = blake3_lanes;
+  size_t i;
+
+  while(count >= lanes){
+    blake3_kernel(inputs, blocks, counter, increment, flags, flags_start,
+                  flags_end, out);
+    inputs += lanes;
+    count -= lanes;
+    counter += increment ? lanes : 0;
+    out += lanes * BLAKE3_OUT_LEN;
+  }
+  if(count){
+    for(i = 0; i < lanes; i++){
+      group[i] = inputs[i < count ? i : count - 1];
+    }
+    blake3_kernel(group, blocks, counter, increment, flags, flags_start,
+                  flags_end, cvs);
+    memcpy(out, cvs, count * BLAKE3_OUT_LEN);
+  }
+}
+
+static void blake3_output_cv(const blake3_output_t *output, uint8_t *cv){
+  uint32_t words[8];
+  int i;
+
+  memcpy(words, output->cv, sizeof(words));
+  blake3_compress(words, output->block, output->block_len, output->counter,
+                  output->flags);
+  for(i = 0; i < 8; i++){
+    STORE32_LE(cv + 4 * i, words[i]);
+  }
+}
+
+//Node whose block is the chaining values of its two children
+static void blake3_parent_output(blake3_output_t *output,
+                                 const uint8_t *block){
+  memcpy(output->cv, blake3_iv, sizeof(output->cv));
+  memcpy(output->block, block, BLAKE3_BLOCK_LEN);
+  output->block_len = BLAKE3_BLOCK_LEN;
+  output->counter = 0;
+  output->flags = BLAKE3_PARENT;
+}
+
+//Bytes of the current chunk seen so far
+static size_t blake3_chunk_len(const blake3_ctx *ctx){
+  return BLAKE3_BLOCK_LEN * (size_t)ctx->blocks + ctx->block_len;
+}
+
+static void blake3_chunk_reset(blake3_ctx *ctx, uint64_t chunk){
+  memcpy(ctx->cv, blake3_iv, sizeof(ctx->cv));
+  ctx->chunk = chunk;
+  memset(ctx->block, 0, BLAKE3_BLOCK_LEN);
+  ctx->block_len = 0;
+  ctx->blocks = 0;
+}
+
+//Feeds the current chunk, len must fit in it. The last block is always
+//kept in ctx->block, it gets the CHUNK_END flag.
+static void blake3_chunk_update(blake3_ctx *ctx, const uint8_t *msg,
+                                size_t len){
+  size_t take;
+
+  if(ctx->block_len > 0){
+    take = BLAKE3_BLOCK_LEN - ctx->block_len;
+    if(take > len){
+      take = len;
+    }
+    memcpy(ctx->block + ctx->block_len, msg, take);
+    ctx->block_len += take;
+    msg += take;
+    len -= take;
+    if(len == 0){
+      return;
+    }
+    blake3_compress(ctx->cv, ctx->block, BLAKE3_BLOCK_LEN, ctx->chunk,
+                    ctx->blocks ? 0 : BLAKE3_CHUNK_START);
+    ctx->blocks++;
+    ctx->block_len = 0;
+    memset(ctx->block, 0, BLAKE3_BLOCK_LEN);
+  }
+
+  while(len > BLAKE3_BLOCK_LEN){
+    blake3_compress(ctx->cv, msg, BLAKE3_BLOCK_LEN, ctx->chunk,
+                    ctx->blocks ? 0 : BLAKE3_CHUNK_START);
+    ctx->blocks++;
+    msg += BLAKE3_BLOCK_LEN;
+    len -= BLAKE3_BLOCK_LEN;
+  }
+
+  memcpy(ctx->block + ctx->block_len, msg, len);
+  ctx->block_len += len;
+}
+
+static void blake3_chunk_output(const blake3_ctx *ctx,
+                                blake3_output_t *output){
+  memcpy(output->cv, ctx->cv, sizeof(output->cv));
+  memcpy(output->block, ctx->block, BLAKE3_BLOCK_LEN);
+  output->block_len = ctx->block_len;
+  output->counter = ctx->chunk;
+  output->flags = BLAKE3_CHUNK_END | (ctx->blocks ? 0 : BLAKE3_CHUNK_START);
+}
+
+//Chaining values of the chunks of input, at most lanes of them, the last
+//one may be partial. Returns how many.
+static size_t blake3_chunks(const uint8_t *input, size_t len, uint64_t chunk,
+                            uint8_t *out){
+  const uint8_t *chunks[BLAKE3_MAX_LANES];
+  size_t count = 0;
+
+  while(len - count * BLAKE3_CHUNK_LEN >= BLAKE3_CHUNK_LEN){
+    chunks[count] = input + count * BLAKE3_CHUNK_LEN;
+    count++;
+  }
+  blake3_many(chunks, count, BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN, chunk, 1,
+              0, BLAKE3_CHUNK_START, BLAKE3_CHUNK_END, out);
+
+  if(len > count * BLAKE3_CHUNK_LEN){
+    blake3_ctx last;
+    blake3_output_t output;
+
+    blake3_chunk_reset(&last, chunk + count);
+    blake3_chunk_update(&last, input + count * BLAKE3_CHUNK_LEN,
+                        len - count * BLAKE3_CHUNK_LEN);
+    blake3_chunk_output(&last, &output);
+    blake3_output_cv(&output, out + count * BLAKE3_OUT_LEN);
+    count++;
+  }
+  return count;
+}
+
+//Chaining values of the parents of count values, the odd one is carried
+//up as is. out may be cvs. Returns how many.
+static size_t blake3_parents(const uint8_t *cvs, size_t count, uint8_t *out){
+  const uint8_t *parents[BLAKE3_MAX_LANES];
+  size_t pairs = count / 2;
+  size_t i;
+
+  for(i = 0; i < pairs; i++){
+    parents[i] = cvs + 2 * i * BLAKE3_OUT_LEN;
+  }
+  blake3_many(parents, pairs, 1, 0, 0, BLAKE3_PARENT, 0, 0, out);
+
+  if(count % 2){
+    memmove(out + pairs * BLAKE3_OUT_LEN, cvs + 2 * pairs * BLAKE3_OUT_LEN,
+            BLAKE3_OUT_LEN);
+    pairs++;
+  }
+  return pairs;
+}
+
+//Hashes a subtree of more than one chunk down to at most lanes chaining
+//values, or two with a single lane, so they are compressed together. The
+//left half holds the largest power of two of chunks, big halves are hashed
+//by a thread from the budget of hash_set_threads. Returns how many.
+static size_t blake3_subtree(const uint8_t *input, size_t len, uint64_t chunk,
+                             uint8_t *out){
+  uint8_t cvs[2 * BLAKE3_MAX_LANES * BLAKE3_OUT_LEN];
+  unsigned lanes = blake3_lanes;
+  blake3_job_t left;
+  pthread_t thread;
+  int threaded = 0;
+  size_t count;
+
+  if(len <= lanes * BLAKE3_CHUNK_LEN){
+    return blake3_chunks(input, len, chunk, out);
+  }
+
+  left.input = input;
+  left.len = (size_t)BLAKE3_CHUNK_LEN
+             << (63 - __builtin_clzll((len - 1) / BLAKE3_CHUNK_LEN));
+  left.chunk = chunk;
+  left.out = cvs;
+  if((left.len > BLAKE3_CHUNK_LEN) && (lanes == 1)){
+    lanes = 2;
+  }
+
+  if((len >= BLAKE3_THREAD_MIN) && hash_take_thread()){
+    threaded = !pthread_create(&thread, NULL, blake3_subtree_thread, &left);
+    if(!threaded){
+      hash_give_thread();
+    }
+  }
+  if(!threaded){
+    blake3_subtree_thread(&left);
+  }
+
+  count = blake3_subtree(input + left.len, len - left.len,
+                         chunk + left.len / BLAKE3_CHUNK_LEN,
+                         cvs + lanes * BLAKE3_OUT_LEN);
+
+  if(threaded){
+    pthread_join(thread, NULL);
+    hash_give_thread();
+  }
+
+  //With a single lane each half gives one value, they are the pair
+  if(left.count == 1){
+    memcpy(out, cvs, 2 * BLAKE3_OUT_LEN);
+    return 2;
+  }
+  return blake3_parents(cvs, left.count + count, out);
+}
+
+static void *blake3_subtree_thread(void *arg){
+  blake3_job_t *job = arg;
+
+  job->count = blake3_subtree(job->input, job->len, job->chunk, job->out);
+  return NULL;
+}
+
+//Chaining values of the two children of the root of a subtree
+static void blake3_subtree_pair(const uint8_t *input, size_t len,
+                                uint64_t chunk, uint8_t *out){
+  uint8_t cvs[2 * BLAKE3_MAX_LANES * BLAKE3_OUT_LEN];
+  size_t count;
+
+  count = blake3_subtree(input, len, chunk, cvs);
+  while(count > 2){
+    count = blake3_parents(cvs, count, cvs);
+  }
+  memcpy(out, cvs, 2 * BLAKE3_OUT_LEN);
+}
+
+static void blake3_push_cv(blake3_ctx *ctx, const uint8_t *cv,
+                           uint64_t chunk){
+  blake3_merge_cvs(ctx, chunk);
+  memcpy(ctx->stack + ctx->stack_len * BLAKE3_OUT_LEN, cv, BLAKE3_OUT_LEN);
+  ctx->stack_len++;
+}
+
+//After chunks chunks, the stack holds one value per bit set in chunks.
+//The merge is done lazily, when more input arrives, so the root is never
+//compressed as an inner node.
+static void blake3_merge_cvs(blake3_ctx *ctx, uint64_t chunks){
+  size_t keep = __builtin_popcountll(chunks);
+
+  while(ctx->stack_len > keep){
+    uint8_t *parent = ctx->stack + (ctx->stack_len - 2) * BLAKE3_OUT_LEN;
+    blake3_output_t output;
+
+    blake3_parent_output(&output, parent);
+    blake3_output_cv(&output, parent);
+    ctx->stack_len--;
+  }
+}
@@ -0,0 +1,137 @@
+/**HashCheck********************************************************************
+
+  File        cpu.c
+
+  Resume      Detection of the instruction set extensions of the host.
+
+  See also    HashCheck.h
+
+  Autor       Raúl San Martín Aniceto
+
+  Copyright (c) 2018 Raúl San Martín Aniceto
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+******************************************************************************/
+
+
+#include <stdint.h>
+
+#include "HashCheck.h"
+
+#ifdef HASH_X86
+#include <cpuid.h>
+#endif
+
+/*---------------------------------------------------------------------------*/
+/* Constant declarations                                                     */
+/*---------------------------------------------------------------------------*/
+
+//XCR0 bits of the register state the OS saves on context switches
+#define XCR0_AVX    0x06  //XMM and YMM
+#define XCR0_AVX512 0xe6  //XMM, YMM, opmask and ZMM
+
+/*---------------------------------------------------------------------------*/
+/* Variable declarations                                                     */
+/*---------------------------------------------------------------------------*/
+
+//Result of cpu_detect, cpuid is slow to run again, above all in a VM
+static unsigned cpu_found = 0;
+static int cpu_known = 0;
+
+/*---------------------------------------------------------------------------*/
+/* Static function prototypes                                                */
+/*---------------------------------------------------------------------------*/
+
+static unsigned cpu_detect(void);
+
+/*---------------------------------------------------------------------------*/
+/* Function definitions                                                      */
+/*---------------------------------------------------------------------------*/
+
+unsigned cpu_features(void){
+  if(!cpu_known){
+    cpu_found = cpu_detect();
+    cpu_known = 1;
+  }
+  return cpu_found;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Static function definitions                                               */
+/*---------------------------------------------------------------------------*/
+
+static unsigned cpu_detect(void){
+  unsigned features = 0;
+#ifdef HASH_X86
+  unsigned eax, ebx, ecx, edx;
+  uint32_t xcr0 = 0;
+
+  if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx)){
+    return 0;
+  }
+  if(edx & bit_SSE2){
+    features |= CPU_SSE2;
+  }
+  if(ecx & bit_SSSE3){
+    features |= CPU_SSSE3;
+  }
+  if(ecx & bit_SSE4_1){
+    features |= CPU_SSE41;
+  }
+  if(ecx & bit_SSE4_2){
+    features |= CPU_SSE42;
+  }
+  if(ecx & bit_PCLMUL){
+    features |= CPU_PCLMUL;
+  }
+  if(ecx & bit_OSXSAVE){//The OS must also save the wider registers
+    uint32_t high;
+    __asm__ volatile("xgetbv" : "=a"(xcr0), "=d"(high) : "c"(0));
+  }
+  int avx = (ecx & bit_AVX) && ((xcr0 & XCR0_AVX) == XCR0_AVX);
+  if(avx){
+    features |= CPU_AVX;
+  }
+
+  if(__get_cpuid_max(0, NULL) < 7){
+    return features;
+  }
+  __cpuid_count(7, 0, eax, ebx, ecx, edx);
+  if(avx && (ebx & bit_AVX2)){
+    features |= CPU_AVX2;
+  }
+  if(ebx & bit_BMI2){
+    features |= CPU_BMI2;
+  }
+  if(ebx & bit_SHA){
+    features |= CPU_SHA;
+  }
+  if((ebx & bit_AVX512F) && ((xcr0 & XCR0_AVX512) == XCR0_AVX512)){
+    features |= CPU_AVX512F;
+    if(ebx & bit_AVX512BW){
+      features |= CPU_AVX512BW;
+    }
+    if(ebx & bit_AVX512VL){
+      features |= CPU_AVX512VL;
+    }
+  }
+#endif
+  return features;
+}
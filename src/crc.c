@@ -0,0 +1,561 @@
+/**HashCheck********************************************************************
+
+  File        crc.c
+
+  Resume      Compute the crc32c, crc32 and cksum checksums of a message.
+
+  Description The cyclic redundancy checks are not cryptographic, they catch
+              accidental corruption. crc32c is the Castagnoli one of iSCSI
+              and of most storage systems, crc32 the one of zlib, gzip and
+              Ethernet and cksum the one of the POSIX cksum utility, which
+              also hashes the length of the message. The scalar versions
+              look up eight bytes at once in tables, crc32c runs the SSE4.2
+              crc32 instruction on three streams and crc32 and cksum fold
+              the message with carry-less multiplications.
+
+  See also    HashCheck.h
+
+  Autor       Raúl San Martín Aniceto
+
+  Copyright (c) 2018 Raúl San Martín Aniceto
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+******************************************************************************/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "HashCheck.h"
+
+#ifdef HASH_X86
+#include <immintrin.h>
+#endif
+
+/*---------------------------------------------------------------------------*/
+/* Constant declarations                                                     */
+/*---------------------------------------------------------------------------*/
+
+//Polynomials, bit-reflected for crc32c and crc32, whose first bit is the
+//lowest one, and as is for cksum, whose first bit is the highest one
+#define CRC32C_POLY 0x82F63B78
+#define CRC32_POLY 0xEDB88320
+#define CKSUM_POLY 0x04C11DB7
+
+//Bytes of each of the three streams of crc32c_sse42, long ones first
+#define CRC32C_LONG 8192
+#define CRC32C_SHORT 256
+
+/*---------------------------------------------------------------------------*/
+/* Type declarations                                                         */
+/*---------------------------------------------------------------------------*/
+
+//Runs the register crc over len bytes of data, see crc32c_scalar
+typedef uint32_t (*crc_fn)(uint32_t crc, const uint8_t *data, size_t len);
+
+/*---------------------------------------------------------------------------*/
+/* Structure declarations                                                    */
+/*---------------------------------------------------------------------------*/
+
+
+/*---------------------------------------------------------------------------*/
+/* Macro declarations                                                        */
+/*---------------------------------------------------------------------------*/
+
+#define LOAD32_LE(p) ((uint32_t)(p)[0] | (uint32_t)(p)[1] << 8 | \
+                      (uint32_t)(p)[2] << 16 | (uint32_t)(p)[3] << 24)
+#define LOAD32_BE(p) ((uint32_t)(p)[0] << 24 | (uint32_t)(p)[1] << 16 | \
+                      (uint32_t)(p)[2] << 8 | (uint32_t)(p)[3])
+
+#define STORE32_BE(p, x) \
+  do{ \
+    (p)[0] = (uint8_t)((x) >> 24); \
+    (p)[1] = (uint8_t)((x) >> 16); \
+    (p)[2] = (uint8_t)((x) >> 8); \
+    (p)[3] = (uint8_t)(x); \
+  }while(0)
+
+//Eight bytes of a bit-reflected crc with its slicing tables t, first the
+//four that were xored with the register and then the next four
+#define CRC_SLICE_LE(t, c, d) \
+  (t[7][(c) & 0xff] ^ t[6][((c) >> 8) & 0xff] ^ t[5][((c) >> 16) & 0xff] ^ \
+   t[4][(c) >> 24] ^ t[3][(d) & 0xff] ^ t[2][((d) >> 8) & 0xff] ^ \
+   t[1][((d) >> 16) & 0xff] ^ t[0][(d) >> 24])
+
+//Same for cksum, whose bytes enter from the top of the register
+#define CRC_SLICE_BE(t, c, d) \
+  (t[7][(c) >> 24] ^ t[6][((c) >> 16) & 0xff] ^ t[5][((c) >> 8) & 0xff] ^ \
+   t[4][(c) & 0xff] ^ t[3][(d) >> 24] ^ t[2][((d) >> 16) & 0xff] ^ \
+   t[1][((d) >> 8) & 0xff] ^ t[0][(d) & 0xff])
+
+#ifdef HASH_X86
+//Folds the 128 bits of x over the next 128 of y, at the distance the
+//constants k stand for
+#define CRC_FOLD(x, k, y) \
+  _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00), \
+                              _mm_clmulepi64_si128(x, k, 0x11)), y)
+
+//Body of a folding kernel: the message, of 64 bytes or more, is folded in
+//four vectors 64 bytes apart, those in one and the rest of its 16-byte
+//blocks in that one, left in x0. load reads 16 bytes in the order of the
+//polynomial, and start holds the register to xor with the first of them
+#define CRC_FOLDS(load, start, k4, k1) \
+  do{ \
+    x0 = _mm_xor_si128(load(data), start); \
+    x1 = load(data + 16); \
+    x2 = load(data + 32); \
+    x3 = load(data + 48); \
+    for(data += 64, len -= 64; len >= 64; data += 64, len -= 64){ \
+      x0 = CRC_FOLD(x0, k4, load(data)); \
+      x1 = CRC_FOLD(x1, k4, load(data + 16)); \
+      x2 = CRC_FOLD(x2, k4, load(data + 32)); \
+      x3 = CRC_FOLD(x3, k4, load(data + 48)); \
+    } \
+    x0 = CRC_FOLD(x0, k1, x1); \
+    x0 = CRC_FOLD(x0, k1, x2); \
+    x0 = CRC_FOLD(x0, k1, x3); \
+    for(; len >= 16; data += 16, len -= 16){ \
+      x0 = CRC_FOLD(x0, k1, load(data)); \
+    } \
+  }while(0)
+
+//Widest crc32 instruction, i386 only has the one of 32 bits
+#ifdef __x86_64__
+typedef uint64_t crc32c_word;
+#define CRC32C_WORD(c, w) _mm_crc32_u64(c, w)
+#else
+typedef uint32_t crc32c_word;
+#define CRC32C_WORD(c, w) _mm_crc32_u32(c, w)
+#endif
+
+#define CRC_LOAD_LE(p) _mm_loadu_si128((const __m128i *)(p))
+#define CRC_LOAD_BE(p) _mm_shuffle_epi8(CRC_LOAD_LE(p), \
+  _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0))
+#endif
+
+/*---------------------------------------------------------------------------*/
+/* Static function prototypes                                                */
+/*---------------------------------------------------------------------------*/
+
+static void crc32c_use_scalar(void);
+
+static void crc32_use_scalar(void);
+
+static void cksum_use_scalar(void);
+
+#ifdef HASH_X86
+static void crc32c_use_sse42(void);
+
+static void crc32_use_pclmul(void);
+
+static void cksum_use_pclmul(void);
+#endif
+
+static void crc_tables(void);
+
+static void crc_gf2_square(uint32_t square[32], const uint32_t mat[32]);
+
+static uint32_t crc_gf2_times(const uint32_t mat[32], uint32_t vec);
+
+static void crc32c_zeros(uint32_t zeros[4][256], size_t len);
+
+static uint32_t crc32c_shift(const uint32_t zeros[4][256], uint32_t crc);
+
+/*---------------------------------------------------------------------------*/
+/* Variable declarations                                                     */
+/*---------------------------------------------------------------------------*/
+
+//Slicing tables: entry n of table k is the register after byte n followed
+//by k zero bytes
+static uint32_t crc32c_table[8][256];
+static uint32_t crc32_table[8][256];
+static uint32_t cksum_table[8][256];
+
+//Registers after CRC32C_LONG and CRC32C_SHORT zero bytes, byte by byte
+static uint32_t crc32c_long[4][256];
+static uint32_t crc32c_short[4][256];
+
+static int crc_ready = 0;
+
+//Kernels, chosen by the implementations
+static crc_fn crc32c_kernel = crc32c_scalar;
+static crc_fn crc32_kernel = crc32_scalar;
+static crc_fn cksum_kernel = cksum_scalar;
+
+const hash_impl crc32c_impls[] = {
+  {"scalar", 0, crc32c_use_scalar},
+#ifdef HASH_X86
+  {"sse42", CPU_SSE42, crc32c_use_sse42},
+#endif
+  {NULL, 0, NULL}
+};
+
+const hash_impl crc32_impls[] = {
+  {"scalar", 0, crc32_use_scalar},
+#ifdef HASH_X86
+  {"pclmul", CPU_PCLMUL, crc32_use_pclmul},
+#endif
+  {NULL, 0, NULL}
+};
+
+//The bytes are reversed with pshufb before folding
+const hash_impl cksum_impls[] = {
+  {"scalar", 0, cksum_use_scalar},
+#ifdef HASH_X86
+  {"pclmul", CPU_PCLMUL | CPU_SSSE3, cksum_use_pclmul},
+#endif
+  {NULL, 0, NULL}
+};
+
+/*---------------------------------------------------------------------------*/
+/* Function definitions                                                      */
+/*---------------------------------------------------------------------------*/
+
+void crc32c_init(crc32c_ctx *ctx){
+  ctx->crc = 0xFFFFFFFF;
+  ctx->len = 0;
+}
+
+void crc32c_update(crc32c_ctx *ctx, const uint8_t *msg, size_t len){
+  ctx->crc = crc32c_kernel(ctx->crc, msg, len);
+  ctx->len += len;
+}
+
+void crc32c_final(crc32c_ctx *ctx, uint8_t digest[4]){
+  STORE32_BE(digest, ~ctx->crc);
+}
+
+int crc32c_sum(uint8_t *initial_msg, size_t initial_len, uint8_t digest[4]){
+  crc32c_ctx ctx;
+
+  crc32c_init(&ctx);
+  crc32c_update(&ctx, initial_msg, initial_len);
+  crc32c_final(&ctx, digest);
+
+  return 0;
+}
+
+void crc32_init(crc32_ctx *ctx){
+  ctx->crc = 0xFFFFFFFF;
+  ctx->len = 0;
+}
+
+void crc32_update(crc32_ctx *ctx, const uint8_t *msg, size_t len){
+  ctx->crc = crc32_kernel(ctx->crc, msg, len);
+  ctx->len += len;
+}
+
+void crc32_final(crc32_ctx *ctx, uint8_t digest[4]){
+  STORE32_BE(digest, ~ctx->crc);
+}
+
+int crc32_sum(uint8_t *initial_msg, size_t initial_len, uint8_t digest[4]){
+  crc32_ctx ctx;
+
+  crc32_init(&ctx);
+  crc32_update(&ctx, initial_msg, initial_len);
+  crc32_final(&ctx, digest);
+
+  return 0;
+}
+
+void cksum_init(cksum_ctx *ctx){
+  ctx->crc = 0;
+  ctx->len = 0;
+}
+
+void cksum_update(cksum_ctx *ctx, const uint8_t *msg, size_t len){
+  ctx->crc = cksum_kernel(ctx->crc, msg, len);
+  ctx->len += len;
+}
+
+void cksum_final(cksum_ctx *ctx, uint8_t digest[4]){
+  uint32_t crc = ctx->crc;
+  uint64_t len;
+
+  //The length follows, lowest byte first and without leading zero bytes
+  for(len = ctx->len; len; len >>= 8){
+    crc = (crc << 8) ^ cksum_table[0][((crc >> 24) ^ len) & 0xff];
+  }
+  STORE32_BE(digest, ~crc);
+}
+
+int cksum_sum(uint8_t *initial_msg, size_t initial_len, uint8_t digest[4]){
+  cksum_ctx ctx;
+
+  cksum_init(&ctx);
+  cksum_update(&ctx, initial_msg, initial_len);
+  cksum_final(&ctx, digest);
+
+  return 0;
+}
+
+uint32_t crc32c_scalar(uint32_t crc, const uint8_t *data, size_t len){
+  uint32_t next;
+
+  for(; len >= 8; len -= 8, data += 8){
+    crc ^= LOAD32_LE(data);
+    next = LOAD32_LE(data + 4);
+    crc = CRC_SLICE_LE(crc32c_table, crc, next);
+  }
+  for(; len; len--, data++){
+    crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *data) & 0xff];
+  }
+  return crc;
+}
+
+uint32_t crc32_scalar(uint32_t crc, const uint8_t *data, size_t len){
+  uint32_t next;
+
+  for(; len >= 8; len -= 8, data += 8){
+    crc ^= LOAD32_LE(data);
+    next = LOAD32_LE(data + 4);
+    crc = CRC_SLICE_LE(crc32_table, crc, next);
+  }
+  for(; len; len--, data++){
+    crc = (crc >> 8) ^ crc32_table[0][(crc ^ *data) & 0xff];
+  }
+  return crc;
+}
+
+uint32_t cksum_scalar(uint32_t crc, const uint8_t *data, size_t len){
+  uint32_t next;
+
+  for(; len >= 8; len -= 8, data += 8){
+    crc ^= LOAD32_BE(data);
+    next = LOAD32_BE(data + 4);
+    crc = CRC_SLICE_BE(cksum_table, crc, next);
+  }
+  for(; len; len--, data++){
+    crc = (crc << 8) ^ cksum_table[0][((crc >> 24) ^ *data) & 0xff];
+  }
+  return crc;
+}
+
+#ifdef HASH_X86
+__attribute__((target("sse4.2")))
+uint32_t crc32c_sse42(uint32_t crc, const uint8_t *data, size_t len){
+  crc32c_word c0 = crc, c1, c2, w;
+  const uint8_t *end;
+
+  //Each crc32 takes three cycles but one starts every cycle, so three
+  //streams run side by side and are joined by shifting the first two over
+  //the bytes of the rest
+  while(len >= 3 * CRC32C_LONG){
+    c1 = c2 = 0;
+    for(end = data + CRC32C_LONG; data < end; data += sizeof(w)){
+      memcpy(&w, data, sizeof(w));
+      c0 = CRC32C_WORD(c0, w);
+      memcpy(&w, data + CRC32C_LONG, sizeof(w));
+      c1 = CRC32C_WORD(c1, w);
+      memcpy(&w, data + 2 * CRC32C_LONG, sizeof(w));
+      c2 = CRC32C_WORD(c2, w);
+    }
+    c0 = crc32c_shift(crc32c_long, (uint32_t)c0) ^ c1;
+    c0 = crc32c_shift(crc32c_long, (uint32_t)c0) ^ c2;
+    data += 2 * CRC32C_LONG;
+    len -= 3 * CRC32C_LONG;
+  }
+  while(len >= 3 * CRC32C_SHORT){
+    c1 = c2 = 0;
+    for(end = data + CRC32C_SHORT; data < end; data += sizeof(w)){
+      memcpy(&w, data, sizeof(w));
+      c0 = CRC32C_WORD(c0, w);
+      memcpy(&w, data + CRC32C_SHORT, sizeof(w));
+      c1 = CRC32C_WORD(c1, w);
+      memcpy(&w, data + 2 * CRC32C_SHORT, sizeof(w));
+      c2 = CRC32C_WORD(c2, w);
+    }
+    c0 = crc32c_shift(crc32c_short, (uint32_t)c0) ^ c1;
+    c0 = crc32c_shift(crc32c_short, (uint32_t)c0) ^ c2;
+    data += 2 * CRC32C_SHORT;
+    len -= 3 * CRC32C_SHORT;
+  }
+
+  for(; len >= sizeof(w); len -= sizeof(w), data += sizeof(w)){
+    memcpy(&w, data, sizeof(w));
+    c0 = CRC32C_WORD(c0, w);
+  }
+  for(; len; len--, data++){
+    c0 = _mm_crc32_u8((uint32_t)c0, *data);
+  }
+  return (uint32_t)c0;
+}
+
+__attribute__((target("pclmul,sse2")))
+uint32_t crc32_pclmul(uint32_t crc, const uint8_t *data, size_t len){
+  uint8_t folded[16];
+  __m128i x0, x1, x2, x3;
+
+  if(len < 64){
+    return crc32_scalar(crc, data, len);
+  }
+  //The constants are x^(512 + 32) and x^(512 - 32), then x^(128 + 32) and
+  //x^(128 - 32), modulo the polynomial and bit-reflected
+  CRC_FOLDS(CRC_LOAD_LE, _mm_cvtsi32_si128((int)crc),
+            _mm_set_epi64x(0x1C6E41596, 0x154442BD4),
+            _mm_set_epi64x(0x0CCAA009E, 0x1751997D0));
+
+  //The folded block has the same remainder as every byte before it
+  _mm_storeu_si128((__m128i *)folded, x0);
+  crc = crc32_scalar(0, folded, sizeof(folded));
+  return crc32_scalar(crc, data, len);
+}
+
+__attribute__((target("pclmul,ssse3")))
+uint32_t cksum_pclmul(uint32_t crc, const uint8_t *data, size_t len){
+  uint8_t folded[16];
+  __m128i x0, x1, x2, x3;
+
+  if(len < 64){
+    return cksum_scalar(crc, data, len);
+  }
+  CRC_FOLDS(CRC_LOAD_BE, _mm_set_epi32((int)crc, 0, 0, 0),
+            _mm_set_epi64x(0x8833794C, 0xE6228B11),
+            _mm_set_epi64x(0xC5B9CD4C, 0xE8A45605));
+
+  _mm_storeu_si128((__m128i *)folded, _mm_shuffle_epi8(x0,
+    _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)));
+  crc = cksum_scalar(0, folded, sizeof(folded));
+  return cksum_scalar(crc, data, len);
+}
+#endif
+
+/*---------------------------------------------------------------------------*/
+/* Static function definitions                                               */
+/*---------------------------------------------------------------------------*/
+
+//hash_use_impl runs the scalar one before any checksum, see hash_select,
+//so the tables are ready when they are needed
+static void crc32c_use_scalar(void){
+  crc_tables();
+  crc32c_kernel = crc32c_scalar;
+}
+
+static void crc32_use_scalar(void){
+  crc_tables();
+  crc32_kernel = crc32_scalar;
+}
+
+static void cksum_use_scalar(void){
+  crc_tables();
+  cksum_kernel = cksum_scalar;
+}
+
+#ifdef HASH_X86
+static void crc32c_use_sse42(void){
+  crc32c_kernel = crc32c_sse42;
+}
+
+static void crc32_use_pclmul(void){
+  crc32_kernel = crc32_pclmul;
+}
+
+static void cksum_use_pclmul(void){
+  cksum_kernel = cksum_pclmul;
+}
+#endif
+
+static void crc_tables(void){
+  uint32_t c, r, k;
+  int n, i;
+
+  if(crc_ready){
+    return;
+  }
+
+  for(n = 0; n < 256; n++){
+    c = r = n;
+    k = (uint32_t)n << 24;
+    for(i = 0; i < 8; i++){
+      c = (c >> 1) ^ (c & 1 ? CRC32C_POLY : 0);
+      r = (r >> 1) ^ (r & 1 ? CRC32_POLY : 0);
+      k = (k << 1) ^ (k >> 31 ? CKSUM_POLY : 0);
+    }
+    crc32c_table[0][n] = c;
+    crc32_table[0][n] = r;
+    cksum_table[0][n] = k;
+  }
+  for(i = 1; i < 8; i++){
+    for(n = 0; n < 256; n++){
+      c = crc32c_table[i - 1][n];
+      crc32c_table[i][n] = (c >> 8) ^ crc32c_table[0][c & 0xff];
+      r = crc32_table[i - 1][n];
+      crc32_table[i][n] = (r >> 8) ^ crc32_table[0][r & 0xff];
+      k = cksum_table[i - 1][n];
+      cksum_table[i][n] = (k << 8) ^ cksum_table[0][k >> 24];
+    }
+  }
+
+  crc32c_zeros(crc32c_long, CRC32C_LONG);
+  crc32c_zeros(crc32c_short, CRC32C_SHORT);
+  crc_ready = 1;
+}
+
+//A 32x32 matrix over GF(2) is a row per bit of the register, the register
+//it gives for that bit alone. square is mat times itself
+static void crc_gf2_square(uint32_t square[32], const uint32_t mat[32]){
+  int n;
+
+  for(n = 0; n < 32; n++){
+    square[n] = crc_gf2_times(mat, mat[n]);
+  }
+}
+
+static uint32_t crc_gf2_times(const uint32_t mat[32], uint32_t vec){
+  uint32_t sum = 0;
+
+  for(; vec; vec >>= 1, mat++){
+    if(vec & 1){
+      sum ^= *mat;
+    }
+  }
+  return sum;
+}
+
+//Tables of the register after len zero bytes, a power of two, one per byte
+//of the register before them
+static void crc32c_zeros(uint32_t zeros[4][256], size_t len){
+  uint32_t op[32], sq[32];
+  size_t bits;
+  int n;
+
+  //One zero bit, then squared to two, four and so on up to 8 * len
+  op[0] = CRC32C_POLY;
+  for(n = 1; n < 32; n++){
+    op[n] = 1u << (n - 1);
+  }
+  for(bits = 1; bits < 8 * len; bits *= 2){
+    crc_gf2_square(sq, op);
+    memcpy(op, sq, sizeof(op));
+  }
+
+  for(n = 0; n < 256; n++){
+    zeros[0][n] = crc_gf2_times(op, (uint32_t)n);
+    zeros[1][n] = crc_gf2_times(op, (uint32_t)n << 8);
+    zeros[2][n] = crc_gf2_times(op, (uint32_t)n << 16);
+    zeros[3][n] = crc_gf2_times(op, (uint32_t)n << 24);
+  }
+}
+
+static uint32_t crc32c_shift(const uint32_t zeros[4][256], uint32_t crc){
+  return zeros[0][crc & 0xff] ^ zeros[1][(crc >> 8) & 0xff] ^
+         zeros[2][(crc >> 16) & 0xff] ^ zeros[3][crc >> 24];
+}
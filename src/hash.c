@@ -0,0 +1,261 @@
+/**HashCheck********************************************************************
+
+  File        hash.c
+
+  Resume      Generic access to every algorithm of the library.
+
+  See also    HashCheck.h
+
+  Autor       Raúl San Martín Aniceto
+
+  Copyright (c) 2018 Raúl San Martín Aniceto
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+******************************************************************************/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "HashCheck.h"
+
+/*---------------------------------------------------------------------------*/
+/* Constant declarations                                                     */
+/*---------------------------------------------------------------------------*/
+
+#define HASH_MAX_DEMOTED 64 //Implementations hash_demote can hold
+
+/*---------------------------------------------------------------------------*/
+/* Type declarations                                                         */
+/*---------------------------------------------------------------------------*/
+
+
+/*---------------------------------------------------------------------------*/
+/* Structure declarations                                                    */
+/*---------------------------------------------------------------------------*/
+
+
+/*---------------------------------------------------------------------------*/
+/* Macro declarations                                                        */
+/*---------------------------------------------------------------------------*/
+
+//Adapts the typed functions of an algorithm to the generic hash_ctx
+#define HASH_WRAPPERS(name, field)                                            \
+  static void name##_init_any(hash_ctx *ctx){                                 \
+    name##_init(&ctx->field);                                                 \
+  }                                                                           \
+  static void name##_update_any(hash_ctx *ctx, const uint8_t *msg,            \
+                                size_t len){                                  \
+    name##_update(&ctx->field, msg, len);                                     \
+  }                                                                           \
+  static void name##_final_any(hash_ctx *ctx, uint8_t *digest){               \
+    name##_final(&ctx->field, digest);                                        \
+  }
+
+#define HASH_ALGO(name, digest_len, impls)                                    \
+  {#name, digest_len, name##_init_any, name##_update_any, name##_final_any,   \
+   NULL, NULL, impls}
+
+//Same for algorithms with a name##_sum_batch function
+#define HASH_ALGO_BATCH(name, digest_len, impls)                              \
+  {#name, digest_len, name##_init_any, name##_update_any, name##_final_any,   \
+   name##_sum_batch, NULL, impls}
+
+//Same for extendable output functions, which also have a batch function
+#define HASH_ALGO_XOF(name, digest_len, impls)                                \
+  {#name, digest_len, name##_init_any, name##_update_any, name##_final_any,   \
+   name##_sum_batch, shake_xof_any, impls}
+
+/*---------------------------------------------------------------------------*/
+/* Static function prototypes                                                */
+/*---------------------------------------------------------------------------*/
+
+static void hash_select(void) __attribute__((constructor));
+
+static void shake_xof_any(hash_ctx *ctx, uint8_t *out, size_t len);
+
+/*---------------------------------------------------------------------------*/
+/* Static function definitions                                               */
+/*---------------------------------------------------------------------------*/
+
+HASH_WRAPPERS(md5, md5)
+HASH_WRAPPERS(sha1, sha1)
+HASH_WRAPPERS(sha224, sha256)
+HASH_WRAPPERS(sha256, sha256)
+HASH_WRAPPERS(sha384, sha512)
+HASH_WRAPPERS(sha512, sha512)
+HASH_WRAPPERS(sha512_224, sha512)
+HASH_WRAPPERS(sha512_256, sha512)
+HASH_WRAPPERS(sha3_224, sha3)
+HASH_WRAPPERS(sha3_256, sha3)
+HASH_WRAPPERS(sha3_384, sha3)
+HASH_WRAPPERS(sha3_512, sha3)
+HASH_WRAPPERS(shake128, sha3)
+HASH_WRAPPERS(shake256, sha3)
+HASH_WRAPPERS(blake2b, blake2b)
+HASH_WRAPPERS(blake2s, blake2s)
+HASH_WRAPPERS(blake2bp, blake2bp)
+HASH_WRAPPERS(blake2sp, blake2sp)
+HASH_WRAPPERS(blake3, blake3)
+HASH_WRAPPERS(xxh64, xxh64)
+HASH_WRAPPERS(xxh3, xxh3)
+HASH_WRAPPERS(xxh128, xxh3)
+HASH_WRAPPERS(crc32c, crc)
+HASH_WRAPPERS(crc32, crc)
+HASH_WRAPPERS(cksum, crc)
+
+//shake128 and shake256 share their state and its squeeze
+static void shake_xof_any(hash_ctx *ctx, uint8_t *out, size_t len){
+  shake_squeeze(&ctx->sha3, out, len);
+}
+
+//Library users get the fastest right implementations without calling
+//anything
+static void hash_select(void){
+  if(hash_selftest(0, NULL, NULL) < 0){
+    hash_use_impl("auto");
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+/* Variable declarations                                                     */
+/*---------------------------------------------------------------------------*/
+
+//Implementations that gave wrong results, see hash_demote
+static const hash_impl *hash_demoted[HASH_MAX_DEMOTED];
+static size_t hash_num_demoted = 0;
+
+//Threads that may still be started to split a message, see hash_set_threads
+static int hash_spare = 0;
+
+const hash_algo hash_algos[] = {
+  HASH_ALGO_BATCH(md5, 16, md5_impls),
+  HASH_ALGO(sha1, 20, sha1_impls),
+  HASH_ALGO_BATCH(sha224, 28, sha256_impls),
+  HASH_ALGO_BATCH(sha256, 32, sha256_impls),
+  HASH_ALGO_BATCH(sha384, 48, sha512_impls),
+  HASH_ALGO_BATCH(sha512, 64, sha512_impls),
+  HASH_ALGO_BATCH(sha512_224, 28, sha512_impls),
+  HASH_ALGO_BATCH(sha512_256, 32, sha512_impls),
+  HASH_ALGO_BATCH(sha3_224, 28, sha3_impls),
+  HASH_ALGO_BATCH(sha3_256, 32, sha3_impls),
+  HASH_ALGO_BATCH(sha3_384, 48, sha3_impls),
+  HASH_ALGO_BATCH(sha3_512, 64, sha3_impls),
+  HASH_ALGO_XOF(shake128, 32, sha3_impls),
+  HASH_ALGO_XOF(shake256, 64, sha3_impls),
+  HASH_ALGO(blake2b, 64, blake2b_impls),
+  HASH_ALGO(blake2s, 32, blake2s_impls),
+  HASH_ALGO(blake2bp, 64, blake2bp_impls),
+  HASH_ALGO(blake2sp, 32, blake2sp_impls),
+  HASH_ALGO(blake3, 32, blake3_impls),
+  HASH_ALGO(xxh64, 8, xxh64_impls),
+  HASH_ALGO(xxh3, 8, xxh3_impls),
+  HASH_ALGO(xxh128, 16, xxh3_impls),
+  HASH_ALGO(crc32c, 4, crc32c_impls),
+  HASH_ALGO(crc32, 4, crc32_impls),
+  HASH_ALGO(cksum, 4, cksum_impls),
+  {NULL, 0, NULL, NULL, NULL, NULL, NULL, NULL}
+};
+
+/*---------------------------------------------------------------------------*/
+/* Function definitions                                                      */
+/*---------------------------------------------------------------------------*/
+
+const hash_algo *hash_find(const char *name){
+  const hash_algo *algo;
+
+  for(algo = hash_algos; algo->name != NULL; algo++){
+    if(!strcmp(algo->name, name)){
+      return algo;
+    }
+  }
+  return NULL;
+}
+
+int hash_use_impl(const char *name){
+  const hash_algo *algo;
+  const hash_impl *impl;
+  int found = 0;
+
+  if(strcmp(name, "auto")){
+    for(algo = hash_algos; algo->name != NULL; algo++){
+      for(impl = algo->impls; impl->name != NULL; impl++){
+        if(!strcmp(impl->name, name)){
+          if(!hash_impl_usable(impl)){
+            return -1;
+          }
+          found = 1;
+        }
+      }
+    }
+    if(!found){
+      return -1;
+    }
+  }
+
+  //Each implementation replaces what the ones before do slower
+  for(algo = hash_algos; algo->name != NULL; algo++){
+    algo->impls[0].use();
+    for(impl = algo->impls + 1; impl->name != NULL; impl++){
+      if(hash_impl_usable(impl)
+         && (!strcmp(name, "auto") || !strcmp(impl->name, name))){
+        impl->use();
+      }
+    }
+  }
+  return 0;
+}
+
+int hash_impl_usable(const hash_impl *impl){
+  size_t i;
+
+  if((impl->features & cpu_features()) != impl->features){
+    return 0;
+  }
+  for(i = 0; i < hash_num_demoted; i++){
+    if(hash_demoted[i] == impl){
+      return 0;
+    }
+  }
+  return 1;
+}
+
+void hash_demote(const hash_impl *impl){
+  if(hash_impl_usable(impl) && (hash_num_demoted < HASH_MAX_DEMOTED)){
+    hash_demoted[hash_num_demoted++] = impl;
+  }
+}
+
+void hash_set_threads(unsigned threads){
+  __atomic_store_n(&hash_spare, threads > 1 ? (int)threads - 1 : 0,
+                   __ATOMIC_RELAXED);
+}
+
+int hash_take_thread(void){
+  if(__atomic_sub_fetch(&hash_spare, 1, __ATOMIC_RELAXED) >= 0){
+    return 1;
+  }
+  hash_give_thread();
+  return 0;
+}
+
+void hash_give_thread(void){
+  __atomic_add_fetch(&hash_spare, 1, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,467 @@
+/**HashCheck********************************************************************
+
+  File        cpu.c
+
+  Resume      Scheduler of the multi-buffer kernels.
+
+  See also    HashCheck.h
+
+  Autor       Raúl San Martín Aniceto
+
+  Copyright (c) 2018 Raúl San Martín Aniceto
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+******************************************************************************/
+
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "HashCheck.h"
+
+#ifdef HASH_X86
+#include <immintrin.h>
+#endif
+
+/*---------------------------------------------------------------------------*/
+/* Constant declarations                                                     */
+/*---------------------------------------------------------------------------*/
+
+
+/*---------------------------------------------------------------------------*/
+/* Structure declarations                                                    */
+/*---------------------------------------------------------------------------*/
+
+typedef struct{//A message being hashed in a lane
+  int busy;
+  size_t msg;              //Index of the message
+  const uint8_t *data;     //Next full block of the message
+  size_t full;             //Full blocks left at data
+  const uint8_t *tail;     //Next block of pad
+  size_t tail_blocks;      //Blocks left at tail
+  uint8_t pad[2 * MB_MAX_BLOCK]; //Last bytes of the message and the padding
+}mb_lane_t;
+
+/*---------------------------------------------------------------------------*/
+/* Variable declarations                                                     */
+/*---------------------------------------------------------------------------*/
+
+static int mb_sse2 = 0; //Blocks can be transposed with SSE2
+static int mb_avx2 = 0; //Blocks can be transposed with AVX2
+
+/*---------------------------------------------------------------------------*/
+/* Static function prototypes                                                */
+/*---------------------------------------------------------------------------*/
+
+//Before the selftest of hash.c, so it checks the gathers that will run
+static void mb_select(void) __attribute__((constructor(101)));
+
+static void mb_start(const mb_kernel *kernel, mb_lane_t *lane, void *state,
+                     unsigned l, size_t msg, const uint8_t *data, size_t len);
+
+static void mb_digest(const mb_kernel *kernel, const void *state, unsigned l,
+                      uint8_t *digest);
+
+static void mb_finish(const mb_kernel *kernel, mb_lane_t *lane, void *state,
+                      unsigned l, uint8_t *digest);
+
+static void mb_gather(const mb_kernel *kernel, const uint8_t **blocks,
+                      void *msg);
+
+static uint64_t mb_get(const mb_kernel *kernel, const void *words, size_t i);
+
+static void mb_put(const mb_kernel *kernel, void *words, size_t i,
+                   uint64_t value);
+
+#ifdef HASH_X86
+static void mb_gather32_sse2(unsigned lanes, const uint8_t *const *blocks,
+                             uint32_t *msg);
+
+static void mb_gather32_avx2(unsigned lanes, const uint8_t *const *blocks,
+                             uint32_t *msg, int big_endian);
+
+static void mb_gather64_avx2(unsigned lanes, const uint8_t *const *blocks,
+                             uint64_t *msg, int big_endian);
+#endif
+
+/*---------------------------------------------------------------------------*/
+/* Function definitions                                                      */
+/*---------------------------------------------------------------------------*/
+
+void mb_hash(const mb_kernel *kernel, const uint8_t *const *msgs,
+             const size_t *lens, size_t count, uint8_t *digests){
+  static const uint8_t idle[MB_MAX_BLOCK]; //Hashed by lanes with no message
+  uint64_t state[MB_MAX_LANES * MB_MAX_WORDS];
+  uint64_t msg[MB_MAX_LANES * 16];
+  const uint8_t *blocks[MB_MAX_LANES];
+  mb_lane_t lanes[MB_MAX_LANES];
+  size_t next = 0;
+  unsigned busy = 0;
+  unsigned l;
+
+  for(l = 0; l < kernel->lanes; l++){
+    lanes[l].busy = 0;
+    if(next < count){
+      mb_start(kernel, &lanes[l], state, l, next, msgs[next], lens[next]);
+      next++;
+      busy++;
+    }
+  }
+
+  while(busy){
+    //Alone, the last message is faster in a single stream
+    if((busy == 1) && (next == count)){
+      for(l = 0; !lanes[l].busy; l++);
+      mb_finish(kernel, &lanes[l], state, l,
+                digests + lanes[l].msg * kernel->digest_len);
+      break;
+    }
+
+    for(l = 0; l < kernel->lanes; l++){
+      mb_lane_t *lane = &lanes[l];
+
+      if(!lane->busy){
+        blocks[l] = idle;
+      }else if(lane->full){
+        blocks[l] = lane->data;
+        lane->data += kernel->block_len;
+        lane->full--;
+      }else{
+        blocks[l] = lane->tail;
+        lane->tail += kernel->block_len;
+        lane->tail_blocks--;
+      }
+    }
+    mb_gather(kernel, blocks, msg);
+    kernel->blocks(state, msg);
+
+    //Lanes done with their message take the next one
+    for(l = 0; l < kernel->lanes; l++){
+      mb_lane_t *lane = &lanes[l];
+
+      if(!lane->busy || lane->full || lane->tail_blocks){
+        continue;
+      }
+      mb_digest(kernel, state, l, digests + lane->msg * kernel->digest_len);
+      lane->busy = 0;
+      busy--;
+      if(next < count){
+        mb_start(kernel, lane, state, l, next, msgs[next], lens[next]);
+        next++;
+        busy++;
+      }
+    }
+  }
+}
+
+void mb_gather_le32(unsigned lanes, const uint8_t *const *blocks,
+                    uint32_t *msg){
+  unsigned l, t;
+
+#ifdef HASH_X86
+  if(mb_avx2 && !(lanes % 8)){
+    mb_gather32_avx2(lanes, blocks, msg, 0);
+    return;
+  }
+  if(mb_sse2 && !(lanes % 4)){
+    mb_gather32_sse2(lanes, blocks, msg);
+    return;
+  }
+#endif
+  for(l = 0; l < lanes; l++){
+    const uint8_t *p = blocks[l];
+
+    for(t = 0; t < 16; t++, p += 4){
+      msg[t * lanes + l] = (uint32_t)p[0] | (uint32_t)p[1] << 8
+                           | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+    }
+  }
+}
+
+void mb_gather_le64(unsigned lanes, const uint8_t *const *blocks,
+                    uint64_t *msg){
+  unsigned l, t;
+
+#ifdef HASH_X86
+  if(mb_avx2 && !(lanes % 4)){
+    mb_gather64_avx2(lanes, blocks, msg, 0);
+    return;
+  }
+#endif
+  for(l = 0; l < lanes; l++){
+    const uint8_t *p = blocks[l];
+
+    for(t = 0; t < 16; t++, p += 8){
+      msg[t * lanes + l] = (uint64_t)p[0] | (uint64_t)p[1] << 8
+                           | (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24
+                           | (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40
+                           | (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+    }
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+/* Static function definitions                                               */
+/*---------------------------------------------------------------------------*/
+
+static void mb_select(void){
+#ifdef HASH_X86
+  mb_sse2 = (cpu_features() & CPU_SSE2) != 0;
+  mb_avx2 = (cpu_features() & CPU_AVX2) != 0;
+#endif
+}
+
+//Loads message number msg into lane l and prepares its padding
+static void mb_start(const mb_kernel *kernel, mb_lane_t *lane, void *state,
+                     unsigned l, size_t msg, const uint8_t *data, size_t len){
+  size_t block = kernel->block_len;
+  size_t used = len % block;
+  uint64_t bits = (uint64_t)len * 8;
+  unsigned w;
+  int i;
+
+  for(w = 0; w < kernel->words; w++){
+    mb_put(kernel, state, w * kernel->lanes + l,
+           mb_get(kernel, kernel->iv, w));
+  }
+
+  lane->busy = 1;
+  lane->msg = msg;
+  lane->data = data;
+  lane->full = len / block;
+  lane->tail = lane->pad;
+  lane->tail_blocks = (used < block - kernel->length_size) ? 1 : 2;
+
+  size_t end = lane->tail_blocks * block;
+  if(used){
+    memcpy(lane->pad, data + len - used, used);
+  }
+  lane->pad[used] = 0x80;
+  memset(lane->pad + used + 1, 0, end - used - 1);
+  for(i = 0; i < 8; i++){
+    if(kernel->big_endian){
+      lane->pad[end - 1 - i] = (uint8_t)(bits >> (8 * i));
+    }else{
+      lane->pad[end - kernel->length_size + i] = (uint8_t)(bits >> (8 * i));
+    }
+  }
+}
+
+static void mb_digest(const mb_kernel *kernel, const void *state, unsigned l,
+                      uint8_t *digest){
+  uint8_t bytes[8 * MB_MAX_WORDS];
+  size_t size = kernel->word_size;
+  unsigned w;
+  size_t i;
+
+  for(w = 0; w < kernel->words; w++){
+    uint64_t word = mb_get(kernel, state, w * kernel->lanes + l);
+    for(i = 0; i < size; i++){
+      size_t shift = 8 * (kernel->big_endian ? size - 1 - i : i);
+      bytes[size * w + i] = (uint8_t)(word >> shift);
+    }
+  }
+  memcpy(digest, bytes, kernel->digest_len);
+}
+
+//Hashes the rest of the message of lane l alone
+static void mb_finish(const mb_kernel *kernel, mb_lane_t *lane, void *state,
+                      unsigned l, uint8_t *digest){
+  uint64_t h[MB_MAX_WORDS];
+  unsigned w;
+
+  for(w = 0; w < kernel->words; w++){
+    mb_put(kernel, h, w, mb_get(kernel, state, w * kernel->lanes + l));
+  }
+  kernel->single(h, lane->data, lane->full);
+  kernel->single(h, lane->tail, lane->tail_blocks);
+  for(w = 0; w < kernel->words; w++){
+    mb_put(kernel, state, w * kernel->lanes + l, mb_get(kernel, h, w));
+  }
+  mb_digest(kernel, state, l, digest);
+  lane->busy = 0;
+}
+
+//Transposes one block of every lane into the layout of mb_kernel
+static void mb_gather(const mb_kernel *kernel, const uint8_t **blocks,
+                      void *msg){
+  size_t size = kernel->word_size;
+  unsigned lanes = kernel->lanes;
+  unsigned l, t;
+  size_t i;
+
+#ifdef HASH_X86
+  if(mb_avx2 && (size == 4) && !(lanes % 8)){
+    mb_gather32_avx2(lanes, blocks, msg, kernel->big_endian);
+    return;
+  }
+  if(mb_avx2 && (size == 8) && kernel->big_endian && !(lanes % 4)){
+    mb_gather64_avx2(lanes, blocks, msg, 1);
+    return;
+  }
+  if(mb_sse2 && (size == 4) && !kernel->big_endian && !(lanes % 4)){
+    mb_gather32_sse2(lanes, blocks, msg);
+    return;
+  }
+#endif
+  for(l = 0; l < lanes; l++){
+    const uint8_t *p = blocks[l];
+
+    for(t = 0; t < 16; t++, p += size){
+      uint64_t word = 0;
+      for(i = 0; i < size; i++){
+        size_t shift = 8 * (kernel->big_endian ? size - 1 - i : i);
+        word |= (uint64_t)p[i] << shift;
+      }
+      mb_put(kernel, msg, t * lanes + l, word);
+    }
+  }
+}
+
+//Word i of an array of words of the size of those of kernel
+static uint64_t mb_get(const mb_kernel *kernel, const void *words, size_t i){
+  if(kernel->word_size == 8){
+    return ((const uint64_t *)words)[i];
+  }
+  return ((const uint32_t *)words)[i];
+}
+
+static void mb_put(const mb_kernel *kernel, void *words, size_t i,
+                   uint64_t value){
+  if(kernel->word_size == 8){
+    ((uint64_t *)words)[i] = value;
+  }else{
+    ((uint32_t *)words)[i] = (uint32_t)value;
+  }
+}
+
+#ifdef HASH_X86
+//4x4 transposes of 32-bit little endian words, 4 lanes and 4 words at a time
+__attribute__((target("sse2")))
+static void mb_gather32_sse2(unsigned lanes, const uint8_t *const *blocks,
+                             uint32_t *msg){
+  unsigned g, quarter, i;
+
+  for(g = 0; g < lanes; g += 4){
+    for(quarter = 0; quarter < 4; quarter++){
+      __m128i r[4], t[4];
+
+      for(i = 0; i < 4; i++){
+        r[i] = _mm_loadu_si128((const __m128i *)(blocks[g + i]
+                                                 + quarter * 16));
+      }
+      t[0] = _mm_unpacklo_epi32(r[0], r[1]);
+      t[1] = _mm_unpackhi_epi32(r[0], r[1]);
+      t[2] = _mm_unpacklo_epi32(r[2], r[3]);
+      t[3] = _mm_unpackhi_epi32(r[2], r[3]);
+      for(i = 0; i < 2; i++){
+        size_t w = quarter * 4 + 2 * i;
+        _mm_storeu_si128((__m128i *)&msg[w * lanes + g],
+                         _mm_unpacklo_epi64(t[i], t[i + 2]));
+        _mm_storeu_si128((__m128i *)&msg[(w + 1) * lanes + g],
+                         _mm_unpackhi_epi64(t[i], t[i + 2]));
+      }
+    }
+  }
+}
+
+//8x8 transposes of 32-bit words, a group of 8 lanes and 8 words at a time
+__attribute__((target("avx2")))
+static void mb_gather32_avx2(unsigned lanes, const uint8_t *const *blocks,
+                             uint32_t *msg, int big_endian){
+  const __m256i swap = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11,
+                                       4, 5, 6, 7, 0, 1, 2, 3,
+                                       12, 13, 14, 15, 8, 9, 10, 11,
+                                       4, 5, 6, 7, 0, 1, 2, 3);
+  unsigned g, half, i;
+
+  for(g = 0; g < lanes; g += 8){
+    for(half = 0; half < 2; half++){
+      __m256i r[8], t[8], u[8];
+
+      for(i = 0; i < 8; i++){
+        r[i] = _mm256_loadu_si256((const __m256i *)(blocks[g + i]
+                                                    + half * 32));
+      }
+      for(i = 0; i < 8; i += 2){
+        t[i] = _mm256_unpacklo_epi32(r[i], r[i + 1]);
+        t[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]);
+      }
+      for(i = 0; i < 8; i += 4){
+        u[i] = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+        u[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+        u[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+        u[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+      }
+      //u[i] holds words i and i + 4 of lanes g to g + 3, u[i + 4] the same
+      //words of lanes g + 4 to g + 7
+      for(i = 0; i < 4; i++){
+        __m256i lo = _mm256_permute2x128_si256(u[i], u[i + 4], 0x20);
+        __m256i hi = _mm256_permute2x128_si256(u[i], u[i + 4], 0x31);
+        if(big_endian){
+          lo = _mm256_shuffle_epi8(lo, swap);
+          hi = _mm256_shuffle_epi8(hi, swap);
+        }
+        _mm256_storeu_si256((__m256i *)&msg[(half * 8 + i) * lanes + g], lo);
+        _mm256_storeu_si256((__m256i *)&msg[(half * 8 + i + 4) * lanes + g],
+                            hi);
+      }
+    }
+  }
+}
+
+//4x4 transposes of 64-bit words, 4 lanes and 4 words at a time
+__attribute__((target("avx2")))
+static void mb_gather64_avx2(unsigned lanes, const uint8_t *const *blocks,
+                             uint64_t *msg, int big_endian){
+  const __m256i swap = _mm256_set_epi8(8, 9, 10, 11, 12, 13, 14, 15,
+                                       0, 1, 2, 3, 4, 5, 6, 7,
+                                       8, 9, 10, 11, 12, 13, 14, 15,
+                                       0, 1, 2, 3, 4, 5, 6, 7);
+  unsigned g, quarter, i;
+
+  for(g = 0; g < lanes; g += 4){
+    for(quarter = 0; quarter < 4; quarter++){
+      __m256i r[4], t[4];
+
+      for(i = 0; i < 4; i++){
+        r[i] = _mm256_loadu_si256(
+          (const __m256i *)(blocks[g + i] + quarter * 32));
+        if(big_endian){
+          r[i] = _mm256_shuffle_epi8(r[i], swap);
+        }
+      }
+      //t[0] holds words 0 and 2 of lanes g and g + 1, t[1] words 1 and 3
+      t[0] = _mm256_unpacklo_epi64(r[0], r[1]);
+      t[1] = _mm256_unpackhi_epi64(r[0], r[1]);
+      t[2] = _mm256_unpacklo_epi64(r[2], r[3]);
+      t[3] = _mm256_unpackhi_epi64(r[2], r[3]);
+      for(i = 0; i < 2; i++){
+        size_t w = quarter * 4 + i;
+        _mm256_storeu_si256((__m256i *)&msg[w * lanes + g],
+                            _mm256_permute2x128_si256(t[i], t[i + 2], 0x20));
+        _mm256_storeu_si256((__m256i *)&msg[(w + 2) * lanes + g],
+                            _mm256_permute2x128_si256(t[i], t[i + 2], 0x31));
+      }
+    }
+  }
+}
+#endif
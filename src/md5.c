@@ -38,10 +38,34 @@ SOFTWARE.
 
 #include "HashCheck.h"
 
+#ifdef HASH_X86
+#include <immintrin.h>
+#endif
+
 /*---------------------------------------------------------------------------*/
 /* Constant declarations                                                     */
 /*---------------------------------------------------------------------------*/
 
+//Initial hash value of md5
+static const uint32_t md5_iv[4] = {
+  0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476
+};
+
+//Use binary integer part of the sines of integers (Radians) as constants:
+static const uint32_t md5_k[64] = {
+  0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf,
+  0x4787c62a, 0xa8304613, 0xfd469501, 0x698098d8, 0x8b44f7af,
+  0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e,
+  0x49b40821, 0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa,
+  0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8, 0x21e1cde6,
+  0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8,
+  0x676f02d9, 0x8d2a4c8a, 0xfffa3942, 0x8771f681, 0x6d9d6122,
+  0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+  0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039,
+  0xe6db99e5, 0x1fa27cf8, 0xc4ac5665, 0xf4292244, 0x432aff97,
+  0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d,
+  0x85845dd1, 0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+  0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391};
 
 /*---------------------------------------------------------------------------*/
 /* Type declarations                                                         */
@@ -54,128 +78,322 @@ SOFTWARE.
 
 
 /*---------------------------------------------------------------------------*/
-/* Variable declarations                                                     */
+/* Macro declarations                                                        */
 /*---------------------------------------------------------------------------*/
 
+#define LEFTROTATE(x, c) (((x) << (c)) | ((x) >> (32 - (c))))
+
+//Little-endian word at p, whatever its alignment
+#define LOAD32_LE(p) ((uint32_t)(p)[0] | (uint32_t)(p)[1] << 8 | \
+                      (uint32_t)(p)[2] << 16 | (uint32_t)(p)[3] << 24)
+
+//Operations on one word: X1 for md5_blocks_scalar, with the same names as
+//the vector ones of the multi-buffer kernels so all share the rounds below
+#define X1_T uint32_t
+#define X1_LOAD(p) (*(p))
+#define X1_STORE(p, x) (*(p) = (x))
+#define X1_ADD(x, y) ((x) + (y))
+#define X1_SET1(k) (k)
+#define X1_ROL(x, n) LEFTROTATE(x, n)
+#define X1_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define X1_G(x, y, z) ((y) ^ ((z) & ((x) ^ (y))))
+#define X1_H(x, y, z) ((x) ^ (y) ^ (z))
+#define X1_I(x, y, z) ((y) ^ ((x) | ~(z)))
+
+#ifdef HASH_X86
+//X4 for SSE2, X8 for AVX2 and X16 for AVX-512
+#define X4_T __m128i
+#define X4_LOAD(p) _mm_loadu_si128((const __m128i *)(p))
+#define X4_STORE(p, x) _mm_storeu_si128((__m128i *)(p), x)
+#define X4_ADD(x, y) _mm_add_epi32(x, y)
+#define X4_SET1(k) _mm_set1_epi32((int)(k))
+#define X4_ROL(x, n) \
+  _mm_or_si128(_mm_slli_epi32(x, n), _mm_srli_epi32(x, 32 - (n)))
+#define X4_F(x, y, z) \
+  _mm_or_si128(_mm_and_si128(x, y), _mm_andnot_si128(x, z))
+#define X4_G(x, y, z) \
+  _mm_or_si128(_mm_and_si128(z, x), _mm_andnot_si128(z, y))
+#define X4_H(x, y, z) _mm_xor_si128(_mm_xor_si128(x, y), z)
+#define X4_I(x, y, z) \
+  _mm_xor_si128(y, _mm_or_si128(x, _mm_xor_si128(z, _mm_set1_epi32(-1))))
+
+#define X8_T __m256i
+#define X8_LOAD(p) _mm256_loadu_si256((const __m256i *)(p))
+#define X8_STORE(p, x) _mm256_storeu_si256((__m256i *)(p), x)
+#define X8_ADD(x, y) _mm256_add_epi32(x, y)
+#define X8_SET1(k) _mm256_set1_epi32((int)(k))
+#define X8_ROL(x, n) \
+  _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - (n)))
+#define X8_F(x, y, z) \
+  _mm256_or_si256(_mm256_and_si256(x, y), _mm256_andnot_si256(x, z))
+#define X8_G(x, y, z) \
+  _mm256_or_si256(_mm256_and_si256(z, x), _mm256_andnot_si256(z, y))
+#define X8_H(x, y, z) _mm256_xor_si256(_mm256_xor_si256(x, y), z)
+#define X8_I(x, y, z) _mm256_xor_si256(y, \
+  _mm256_or_si256(x, _mm256_xor_si256(z, _mm256_set1_epi32(-1))))
+
+#define X16_T __m512i
+#define X16_LOAD(p) _mm512_loadu_si512((const void *)(p))
+#define X16_STORE(p, x) _mm512_storeu_si512((void *)(p), x)
+#define X16_ADD(x, y) _mm512_add_epi32(x, y)
+#define X16_SET1(k) _mm512_set1_epi32((int)(k))
+#define X16_ROL(x, n) _mm512_rol_epi32(x, n)
+#define X16_F(x, y, z) _mm512_ternarylogic_epi32(x, y, z, 0xca)
+#define X16_G(x, y, z) _mm512_ternarylogic_epi32(z, x, y, 0xca)
+#define X16_H(x, y, z) _mm512_ternarylogic_epi32(x, y, z, 0x96)
+#define X16_I(x, y, z) _mm512_ternarylogic_epi32(x, y, z, 0x39)
+#endif
+
+#define MB_STEP(V, FN, a, b, c, d, i, g, s) \
+  a = V##_ADD(b, V##_ROL(V##_ADD(V##_ADD(a, V##_##FN(b, c, d)), \
+                                 V##_ADD(V##_SET1(md5_k[i]), m[g])), s))
+
+//Four steps, after them the variables are back in their places
+#define MB_STEP4(V, FN, i, g0, g1, g2, g3, s0, s1, s2, s3) \
+  do{ \
+    MB_STEP(V, FN, a, b, c, d, (i) + 0, g0, s0); \
+    MB_STEP(V, FN, d, a, b, c, (i) + 1, g1, s1); \
+    MB_STEP(V, FN, c, d, a, b, (i) + 2, g2, s2); \
+    MB_STEP(V, FN, b, c, d, a, (i) + 3, g3, s3); \
+  }while(0)
+
+//Whole compression of a block of every lane, lanes words wide vectors. The
+//steps are unrolled so the shifts, constants and word indexes are immediates
+#define MB_COMPRESS(V, lanes) \
+  do{ \
+    V##_T a = V##_LOAD(&state[0 * (lanes)]); \
+    V##_T b = V##_LOAD(&state[1 * (lanes)]); \
+    V##_T c = V##_LOAD(&state[2 * (lanes)]); \
+    V##_T d = V##_LOAD(&state[3 * (lanes)]); \
+    V##_T m[16]; \
+    int i; \
+    for(i = 0; i < 16; i++){ \
+      m[i] = V##_LOAD(&msg[i * (lanes)]); \
+    } \
+    MB_STEP4(V, F,  0,  0,  1,  2,  3, 7, 12, 17, 22); \
+    MB_STEP4(V, F,  4,  4,  5,  6,  7, 7, 12, 17, 22); \
+    MB_STEP4(V, F,  8,  8,  9, 10, 11, 7, 12, 17, 22); \
+    MB_STEP4(V, F, 12, 12, 13, 14, 15, 7, 12, 17, 22); \
+    MB_STEP4(V, G, 16,  1,  6, 11,  0, 5,  9, 14, 20); \
+    MB_STEP4(V, G, 20,  5, 10, 15,  4, 5,  9, 14, 20); \
+    MB_STEP4(V, G, 24,  9, 14,  3,  8, 5,  9, 14, 20); \
+    MB_STEP4(V, G, 28, 13,  2,  7, 12, 5,  9, 14, 20); \
+    MB_STEP4(V, H, 32,  5,  8, 11, 14, 4, 11, 16, 23); \
+    MB_STEP4(V, H, 36,  1,  4,  7, 10, 4, 11, 16, 23); \
+    MB_STEP4(V, H, 40, 13,  0,  3,  6, 4, 11, 16, 23); \
+    MB_STEP4(V, H, 44,  9, 12, 15,  2, 4, 11, 16, 23); \
+    MB_STEP4(V, I, 48,  0,  7, 14,  5, 6, 10, 15, 21); \
+    MB_STEP4(V, I, 52, 12,  3, 10,  1, 6, 10, 15, 21); \
+    MB_STEP4(V, I, 56,  8, 15,  6, 13, 6, 10, 15, 21); \
+    MB_STEP4(V, I, 60,  4, 11,  2,  9, 6, 10, 15, 21); \
+    V##_STORE(&state[0 * (lanes)], V##_ADD(a, V##_LOAD(&state[0 * (lanes)]))); \
+    V##_STORE(&state[1 * (lanes)], V##_ADD(b, V##_LOAD(&state[1 * (lanes)]))); \
+    V##_STORE(&state[2 * (lanes)], V##_ADD(c, V##_LOAD(&state[2 * (lanes)]))); \
+    V##_STORE(&state[3 * (lanes)], V##_ADD(d, V##_LOAD(&state[3 * (lanes)]))); \
+  }while(0)
 
 /*---------------------------------------------------------------------------*/
-/* Macro declarations                                                        */
+/* Static function prototypes                                                */
 /*---------------------------------------------------------------------------*/
 
-#define LEFTROTATE(x, c) (((x) << (c)) | ((x) >> (32 - (c))))
+static void md5_use_scalar(void);
+
+#ifdef HASH_X86
+static void md5_use_sse2(void);
+
+static void md5_use_avx2(void);
+
+static void md5_use_avx512(void);
+#endif
+
+static void md5_sum_each(const uint8_t *const *msgs, const size_t *lens,
+                         size_t count, uint8_t *digests);
+
+static void md5_blocks_any(void *h, const uint8_t *data, size_t blocks);
 
 /*---------------------------------------------------------------------------*/
-/* Static function prototypes                                                */
+/* Variable declarations                                                     */
 /*---------------------------------------------------------------------------*/
 
+//Multi-buffer kernel used by md5_sum_batch, without lanes if there is none
+static mb_kernel md5_mb = {
+  NULL, 0, 4, 4, 64, 8, 16, 0, md5_iv, NULL, NULL
+};
+
+const hash_impl md5_impls[] = {
+  {"scalar", 0, md5_use_scalar},
+#ifdef HASH_X86
+  {"sse2", CPU_SSE2, md5_use_sse2},
+  {"avx2", CPU_AVX2, md5_use_avx2},
+  {"avx512", CPU_AVX512F, md5_use_avx512},
+#endif
+  {NULL, 0, NULL}
+};
 
 /*---------------------------------------------------------------------------*/
 /* Function definitions                                                      */
 /*---------------------------------------------------------------------------*/
 
-int md5_sum(uint8_t *initial_msg, size_t initial_len, uint8_t digest[16]){
+void md5_init(md5_ctx *ctx){
   //Initialize variables:
-  uint32_t h0 = 0x67452301; //A
-  uint32_t h1 = 0xEFCDAB89; //B
-  uint32_t h2 = 0x98BADCFE; //C
-  uint32_t h3 = 0x10325476; //D
-
-  //s specifies the per-round shift amounts
-  uint32_t s[64] = {7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
-                    5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20,
-                    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
-                    6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21};
-
-  //Use binary integer part of the sines of integers (Radians) as constants:
-  uint32_t k[64] = {0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf,
-                    0x4787c62a, 0xa8304613, 0xfd469501, 0x698098d8, 0x8b44f7af,
-                    0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e,
-                    0x49b40821, 0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa,
-                    0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8, 0x21e1cde6,
-                    0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8,
-                    0x676f02d9, 0x8d2a4c8a, 0xfffa3942, 0x8771f681, 0x6d9d6122,
-                    0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
-                    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039,
-                    0xe6db99e5, 0x1fa27cf8, 0xc4ac5665, 0xf4292244, 0x432aff97,
-                    0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d,
-                    0x85845dd1, 0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
-                    0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391};
-
-  //Pre-processing:
-  uint8_t *msg = NULL;
-
-  size_t new_len;
-  new_len = initial_len*8 + 1;
-  new_len += (512-((new_len+64)%512))%512;
-  new_len /= 8;
-
-  msg = calloc(new_len + sizeof(uint64_t), sizeof(uint8_t));
-  if(msg == NULL){//calloc failed
-    return -1;
+  ctx->h[0] = 0x67452301; //A
+  ctx->h[1] = 0xEFCDAB89; //B
+  ctx->h[2] = 0x98BADCFE; //C
+  ctx->h[3] = 0x10325476; //D
+  ctx->len = 0;
+}
+
+void md5_update(md5_ctx *ctx, const uint8_t *msg, size_t len){
+  size_t used = ctx->len % 64;
+  ctx->len += len;
+
+  if(used){//Complete the pending block first
+    size_t fill = 64 - used;
+    if(len < fill){
+      memcpy(ctx->block + used, msg, len);
+      return;
+    }
+    memcpy(ctx->block + used, msg, fill);
+    md5_blocks_scalar(ctx->h, ctx->block, 1);
+    msg += fill;
+    len -= fill;
   }
 
-  memcpy(msg, initial_msg, initial_len);
-  msg[initial_len] = 0x80; // appending single bit to the message
+  //Full blocks are hashed in place
+  md5_blocks_scalar(ctx->h, msg, len / 64);
+  msg += len - len % 64;
+  len %= 64;
+
+  memcpy(ctx->block, msg, len);
+}
 
-  uint64_t bits_len = 8*initial_len; //append original length in bits mod 2^64
-  memcpy(msg + new_len, &bits_len, sizeof(uint64_t));
+void md5_final(md5_ctx *ctx, uint8_t digest[16]){
+  size_t used = ctx->len % 64;
 
-  //Process the message in successive 512-bit chunks:
-  int offset;
-  //for each 512-bit chunk of padded message
-  for(offset = 0; offset < new_len; offset += (512/8)){
-    //break chunk into sixteen 32-bit words M[j], 0 ≤ j ≤ 15
-    uint32_t *m = (uint32_t *)(msg + offset);
+  ctx->block[used++] = 0x80; // appending single bit to the message
+  if(used > 56){//No room left for the length
+    memset(ctx->block + used, 0, 64 - used);
+    md5_blocks_scalar(ctx->h, ctx->block, 1);
+    used = 0;
+  }
+  memset(ctx->block + used, 0, 56 - used);
+
+  uint64_t bits_len = 8*ctx->len; //append original length in bits mod 2^64
+  int i;
+  for(i = 0; i < 8; i++){
+    ctx->block[56 + i] = (bits_len >> (8*i)) & 0xff;
+  }
+  md5_blocks_scalar(ctx->h, ctx->block, 1);
+
+  for(i = 0; i < 4; i++){
+    digest[4*i + 0] = (ctx->h[i]      ) & 0xff;
+    digest[4*i + 1] = (ctx->h[i] >>  8) & 0xff;
+    digest[4*i + 2] = (ctx->h[i] >> 16) & 0xff;
+    digest[4*i + 3] = (ctx->h[i] >> 24) & 0xff;
+  }
+}
+
+int md5_sum(uint8_t *initial_msg, size_t initial_len, uint8_t digest[16]){
+  md5_ctx ctx;
 
-    // Initialize hash value for this chunk:
-    uint32_t a = h0;
-    uint32_t b = h1;
-    uint32_t c = h2;
-    uint32_t d = h3;
+  md5_init(&ctx);
+  md5_update(&ctx, initial_msg, initial_len);
+  md5_final(&ctx, digest);
 
-    //Main loop:
+  return 0;
+}
+
+void md5_sum_batch(const uint8_t *const *msgs, const size_t *lens,
+                   size_t count, uint8_t *digests){
+  if(md5_mb.lanes){
+    mb_hash(&md5_mb, msgs, lens, count, digests);
+  }else{
+    md5_sum_each(msgs, lens, count, digests);
+  }
+}
+
+void md5_blocks_scalar(uint32_t h[4], const uint8_t *data, size_t blocks){
+  uint32_t *state = h;
+
+  //for each 512-bit chunk of the message
+  for(; blocks; blocks--, data += (512/8)){
+    //break chunk into sixteen little-endian 32-bit words M[j], 0 ≤ j ≤ 15
+    uint32_t msg[16];
     int i;
-    for(i = 0; i < 64; i++){
-      int f, g;
-
-      if(i < 16){
-        f = (b & c) | ((~b) & d);
-        g = i;
-      }else if(i < 32){
-        f = (d & b) | ((~d) & c);
-        g = (5*i + 1) % 16;
-      }else if(i < 48){
-        f = b ^ c ^ d;
-        g = (3*i + 5) % 16;
-      }else{
-        f = c ^ (b | (~d));
-        g = (7*i) % 16;
-      }
-
-      //Be wary of the below definitions of a,b,c,d
-      uint32_t tmp = d;
-      d = c;
-      c = b;
-      b = b + LEFTROTATE((a + f + k[i] + m[g]), s[i]);
-      a = tmp;
+    for(i = 0; i < 16; i++){
+      msg[i] = LOAD32_LE(data + 4 * i);
     }
-    //Add this chunk's hash to result so far:
-    h0 += a;
-    h1 += b;
-    h2 += c;
-    h3 += d;
+
+    MB_COMPRESS(X1, 1);
   }
+}
+
+#ifdef HASH_X86
+__attribute__((target("sse2")))
+void md5_x4_sse2(void *lanes, const void *block){
+  uint32_t *state = lanes;
+  const uint32_t *msg = block;
 
-  memcpy(digest     , &h0, sizeof(uint32_t));
-  memcpy(digest +  4, &h1, sizeof(uint32_t));
-  memcpy(digest +  8, &h2, sizeof(uint32_t));
-  memcpy(digest + 12, &h3, sizeof(uint32_t));
+  MB_COMPRESS(X4, 4);
+}
 
-  free(msg);
+__attribute__((target("avx2")))
+void md5_x8_avx2(void *lanes, const void *block){
+  uint32_t *state = lanes;
+  const uint32_t *msg = block;
 
-  return 0;
+  MB_COMPRESS(X8, 8);
+}
+
+__attribute__((target("avx512f")))
+void md5_x16_avx512(void *lanes, const void *block){
+  uint32_t *state = lanes;
+  const uint32_t *msg = block;
+
+  MB_COMPRESS(X16, 16);
 }
+#endif
 
 /*---------------------------------------------------------------------------*/
 /* Static function definitions                                               */
 /*---------------------------------------------------------------------------*/
+
+static void md5_use_scalar(void){
+  md5_mb.name = NULL;
+  md5_mb.lanes = 0;
+  md5_mb.blocks = NULL;
+  md5_mb.single = md5_blocks_any;
+}
+
+#ifdef HASH_X86
+static void md5_use_sse2(void){
+  md5_mb.name = "sse2";
+  md5_mb.lanes = 4;
+  md5_mb.blocks = md5_x4_sse2;
+}
+
+static void md5_use_avx2(void){
+  md5_mb.name = "avx2";
+  md5_mb.lanes = 8;
+  md5_mb.blocks = md5_x8_avx2;
+}
+
+static void md5_use_avx512(void){
+  md5_mb.name = "avx512";
+  md5_mb.lanes = 16;
+  md5_mb.blocks = md5_x16_avx512;
+}
+#endif
+
+static void md5_sum_each(const uint8_t *const *msgs, const size_t *lens,
+                         size_t count, uint8_t *digests){
+  size_t i;
+
+  for(i = 0; i < count; i++){
+    md5_sum((uint8_t *)msgs[i], lens[i], digests + i * 16);
+  }
+}
+
+static void md5_blocks_any(void *h, const uint8_t *data, size_t blocks){
+  md5_blocks_scalar(h, data, blocks);
+}
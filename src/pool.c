@@ -0,0 +1,251 @@
+/**HashCheck********************************************************************
+
+  File        pool.c
+
+  Resume      Pool of worker threads that keeps the results in order.
+
+  See also    HashCheck.h
+
+  Autor       Raúl San Martín Aniceto
+
+  Copyright (c) 2018 Raúl San Martín Aniceto
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+******************************************************************************/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "HashCheck.h"
+
+/*---------------------------------------------------------------------------*/
+/* Constant declarations                                                     */
+/*---------------------------------------------------------------------------*/
+
+
+/*---------------------------------------------------------------------------*/
+/* Type declarations                                                         */
+/*---------------------------------------------------------------------------*/
+
+
+/*---------------------------------------------------------------------------*/
+/* Structure declarations                                                    */
+/*---------------------------------------------------------------------------*/
+
+//Jobs live in a ring of window slots. Counters only grow, a job with
+//counter n is in slot n % window and it is:
+//  - waiting for a worker if next <= n < tail
+//  - being hashed or finished if head <= n < next
+struct pool{
+  pthread_mutex_t lock;
+  pthread_cond_t submitted; //A job was submitted or the pool is stopping
+  pthread_cond_t finished;  //A worker finished a job
+  pthread_t *threads;
+  struct pool_worker *args;
+  unsigned workers;   //Threads running, 0 if jobs run in the caller
+
+  void **jobs;
+  uint8_t *done;
+  size_t window;
+  size_t head;  //Oldest job not handed back yet
+  size_t next;  //Next job for the workers
+  size_t tail;  //Next free slot
+  int stop;
+
+  pool_work_fn work;
+  pool_done_fn emit;
+  void *arg;
+};
+
+struct pool_worker{
+  pool_t *pool;
+  unsigned id;
+};
+
+/*---------------------------------------------------------------------------*/
+/* Variable declarations                                                     */
+/*---------------------------------------------------------------------------*/
+
+
+/*---------------------------------------------------------------------------*/
+/* Macro declarations                                                        */
+/*---------------------------------------------------------------------------*/
+
+
+/*---------------------------------------------------------------------------*/
+/* Static function prototypes                                                */
+/*---------------------------------------------------------------------------*/
+
+static void *pool_worker(void *arg);
+
+static void pool_emit(pool_t *pool);
+
+/*---------------------------------------------------------------------------*/
+/* Function definitions                                                      */
+/*---------------------------------------------------------------------------*/
+
+pool_t *pool_create(unsigned workers, size_t window, pool_work_fn work,
+                    pool_done_fn emit, void *arg){
+  pool_t *pool = calloc(1, sizeof(pool_t));
+  if(pool == NULL){
+    return NULL;
+  }
+
+  pool->window = window;
+  pool->work = work;
+  pool->emit = emit;
+  pool->arg = arg;
+
+  if(workers <= 1){//Jobs run in the caller, no threads needed
+    return pool;
+  }
+
+  pool->jobs = calloc(window, sizeof(void *));
+  pool->done = calloc(window, sizeof(uint8_t));
+  pool->threads = calloc(workers, sizeof(pthread_t));
+  pool->args = calloc(workers, sizeof(struct pool_worker));
+  if((pool->jobs == NULL) || (pool->done == NULL) || (pool->threads == NULL)
+     || (pool->args == NULL)){
+    pool_finish(pool);
+    return NULL;
+  }
+
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->submitted, NULL);
+  pthread_cond_init(&pool->finished, NULL);
+
+  unsigned i;
+  for(i = 0; i < workers; i++){
+    pool->args[i].pool = pool;
+    pool->args[i].id = i;
+    if(pthread_create(&pool->threads[i], NULL, pool_worker, &pool->args[i])){
+      break; //Go on with the threads already running
+    }
+    pool->workers++;
+  }
+
+  if(pool->workers == 0){
+    pthread_cond_destroy(&pool->finished);
+    pthread_cond_destroy(&pool->submitted);
+    pthread_mutex_destroy(&pool->lock);
+  }
+
+  return pool;
+}
+
+void pool_submit(pool_t *pool, void *job){
+  if(pool->workers == 0){
+    pool->work(job, 0, pool->arg);
+    pool->emit(job, pool->arg);
+    return;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool_emit(pool);
+  while(pool->tail - pool->head == pool->window){//Ring full
+    pthread_cond_wait(&pool->finished, &pool->lock);
+    pool_emit(pool);
+  }
+
+  pool->jobs[pool->tail % pool->window] = job;
+  pool->done[pool->tail % pool->window] = 0;
+  pool->tail++;
+  pthread_cond_signal(&pool->submitted);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_finish(pool_t *pool){
+  if(pool->workers > 0){
+    unsigned i;
+
+    pthread_mutex_lock(&pool->lock);
+    pool_emit(pool);
+    while(pool->head != pool->tail){
+      pthread_cond_wait(&pool->finished, &pool->lock);
+      pool_emit(pool);
+    }
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->submitted);
+    pthread_mutex_unlock(&pool->lock);
+
+    for(i = 0; i < pool->workers; i++){
+      pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&pool->finished);
+    pthread_cond_destroy(&pool->submitted);
+    pthread_mutex_destroy(&pool->lock);
+  }
+
+  free(pool->args);
+  free(pool->threads);
+  free(pool->done);
+  free(pool->jobs);
+  free(pool);
+}
+
+/*---------------------------------------------------------------------------*/
+/* Static function definitions                                               */
+/*---------------------------------------------------------------------------*/
+
+static void *pool_worker(void *arg){
+  struct pool_worker *self = arg;
+  pool_t *pool = self->pool;
+  unsigned id = self->id;
+  size_t n;
+
+  pthread_mutex_lock(&pool->lock);
+  for(;;){
+    while((pool->next == pool->tail) && !pool->stop){
+      pthread_cond_wait(&pool->submitted, &pool->lock);
+    }
+    if(pool->next == pool->tail){//Stopping and nothing left
+      break;
+    }
+
+    n = pool->next++;
+    void *job = pool->jobs[n % pool->window];
+    pthread_mutex_unlock(&pool->lock);
+
+    pool->work(job, id, pool->arg);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->done[n % pool->window] = 1;
+    pthread_cond_broadcast(&pool->finished);
+  }
+
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+//Hands back, in order, every finished job at the head of the ring. Called
+//with the lock held, released meanwhile so workers keep going.
+static void pool_emit(pool_t *pool){
+  while((pool->head != pool->tail) && pool->done[pool->head % pool->window]){
+    void *job = pool->jobs[pool->head % pool->window];
+    pool->head++;
+
+    pthread_mutex_unlock(&pool->lock);
+    pool->emit(job, pool->arg);
+    pthread_mutex_lock(&pool->lock);
+  }
+}
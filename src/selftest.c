@@ -0,0 +1,477 @@
+/**HashCheck********************************************************************
+
+  File        selftest.c
+
+  Resume      Checks every implementation of the algorithms before use.
+
+  Description Each implementation the host can run is compared with the
+              known answers of its algorithm and, message by message, with
+              the scalar implementation: in a single call, fed in pieces and
+              in batches. The scalar one is only trusted once it gives the
+              known answers.
+
+  See also    hash.c
+
+  Autor       Raúl San Martín Aniceto
+
+  Copyright (c) 2018 Raúl San Martín Aniceto
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+******************************************************************************/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "HashCheck.h"
+
+/*---------------------------------------------------------------------------*/
+/* Constant declarations                                                     */
+/*---------------------------------------------------------------------------*/
+
+#define SELFTEST_MAX_LEN 1024 //Every length up to this one is tested in full
+
+#define SELFTEST_LONGS 3      //Longer messages of the full test
+
+#define SELFTEST_DATA (64 * 1024 + 16) //Bytes the messages are taken from
+
+#define SELFTEST_KATS 4       //Known answers of each algorithm
+
+/*---------------------------------------------------------------------------*/
+/* Type declarations                                                         */
+/*---------------------------------------------------------------------------*/
+
+
+/*---------------------------------------------------------------------------*/
+/* Structure declarations                                                    */
+/*---------------------------------------------------------------------------*/
+
+typedef struct{//Known answers of an algorithm to selftest_msgs
+  const char *algo;
+  const char *digests[SELFTEST_KATS];
+}selftest_kat_t;
+
+typedef struct{//Messages of the differential tests and their right digests
+  const hash_algo *algo;
+  const size_t *lens;
+  size_t count;
+  const uint8_t **msgs;
+  uint8_t *digests;      //count digests, by the scalar implementation
+  uint8_t *out;          //count digests, by the implementation tested
+  uint64_t seed;         //Of the pieces the messages are fed in
+}selftest_run_t;
+
+/*---------------------------------------------------------------------------*/
+/* Variable declarations                                                     */
+/*---------------------------------------------------------------------------*/
+
+//Empty, one block, and the padding edges of 64 and 128-byte blocks
+static const char *selftest_msgs[SELFTEST_KATS] = {
+  "",
+  "abc",
+  "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+  "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmno"
+  "ijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu"
+};
+
+static const selftest_kat_t selftest_kats[] = {
+  {"md5", {
+    "d41d8cd98f00b204e9800998ecf8427e",
+    "900150983cd24fb0d6963f7d28e17f72",
+    "8215ef0796a20bcaaae116d3876c664a",
+    "03dd8807a93175fb062dfb55dc7d359c"}},
+  {"sha1", {
+    "da39a3ee5e6b4b0d3255bfef95601890afd80709",
+    "a9993e364706816aba3e25717850c26c9cd0d89d",
+    "84983e441c3bd26ebaae4aa1f95129e5e54670f1",
+    "a49b2446a02c645bf419f995b67091253a04a259"}},
+  {"sha224", {
+    "d14a028c2a3a2bc9476102bb288234c415a2b01f828ea62ac5b3e42f",
+    "23097d223405d8228642a477bda255b32aadbce4bda0b3f7e36c9da7",
+    "75388b16512776cc5dba5da1fd890150b0c6455cb4f58b1952522525",
+    "c97ca9a559850ce97a04a96def6d99a9e0e0e2ab14e6b8df265fc0b3"}},
+  {"sha256", {
+    "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855",
+    "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+    "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1",
+    "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1"}},
+  {"sha384", {
+    "38b060a751ac96384cd9327eb1b1e36a21fdb71114be0743"
+    "4c0cc7bf63f6e1da274edebfe76f65fbd51ad2f14898b95b",
+    "cb00753f45a35e8bb5a03d699ac65007272c32ab0eded163"
+    "1a8b605a43ff5bed8086072ba1e7cc2358baeca134c825a7",
+    "3391fdddfc8dc7393707a65b1b4709397cf8b1d162af05ab"
+    "fe8f450de5f36bc6b0455a8520bc4e6f5fe95b1fe3c8452b",
+    "09330c33f71147e83d192fc782cd1b4753111b173b3b05d2"
+    "2fa08086e3b0f712fcc7c71a557e2db966c3e9fa91746039"}},
+  {"sha512", {
+    "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
+    "47d0d13c5d85f2b0ff8318d2877eec2f63b931bd47417a81a538327af927da3e",
+    "ddaf35a193617abacc417349ae20413112e6fa4e89a97ea20a9eeee64b55d39a"
+    "2192992a274fc1a836ba3c23a3feebbd454d4423643ce80e2a9ac94fa54ca49f",
+    "204a8fc6dda82f0a0ced7beb8e08a41657c16ef468b228a8279be331a703c335"
+    "96fd15c13b1b07f9aa1d3bea57789ca031ad85c7a71dd70354ec631238ca3445",
+    "8e959b75dae313da8cf4f72814fc143f8f7779c6eb9f7fa17299aeadb6889018"
+    "501d289e4900f7e4331b99dec4b5433ac7d329eeb6dd26545e96e55b874be909"}},
+  {"sha512_224", {
+    "6ed0dd02806fa89e25de060c19d3ac86cabb87d6a0ddd05c333b84f4",
+    "4634270f707b6a54daae7530460842e20e37ed265ceee9a43e8924aa",
+    "e5302d6d54bb242275d1e7622d68df6eb02dedd13f564c13dbda2174",
+    "23fec5bb94d60b23308192640b0c453335d664734fe40e7268674af9"}},
+  {"sha512_256", {
+    "c672b8d1ef56ed28ab87c3622c5114069bdd3ad7b8f9737498d0c01ecef0967a",
+    "53048e2681941ef99b2e29b76b4c7dabe4c2d0c634fc6d46e0e2f13107e7af23",
+    "bde8e1f9f19bb9fd3406c90ec6bc47bd36d8ada9f11880dbc8a22a7078b6a461",
+    "3928e184fb8690f840da3988121d31be65cb9d3ef83ee6146feac861e19b563a"}},
+  {"sha3_224", {
+    "6b4e03423667dbb73b6e15454f0eb1abd4597f9a1b078e3f5b5a6bc7",
+    "e642824c3f8cf24ad09234ee7d3c766fc9a3a5168d0c94ad73b46fdf",
+    "8a24108b154ada21c9fd5574494479ba5c7e7ab76ef264ead0fcce33",
+    "543e6868e1666c1a643630df77367ae5a62a85070a51c14cbf665cbc"}},
+  {"sha3_256", {
+    "a7ffc6f8bf1ed76651c14756a061d662f580ff4de43b49fa82d80a4b80f8434a",
+    "3a985da74fe225b2045c172d6bd390bd855f086e3e9d525b46bfe24511431532",
+    "41c0dba2a9d6240849100376a8235e2c82e1b9998a999e21db32dd97496d3376",
+    "916f6061fe879741ca6469b43971dfdb28b1a32dc36cb3254e812be27aad1d18"}},
+  {"sha3_384", {
+    "0c63a75b845e4f7d01107d852e4c2485c51a50aaaa94fc61"
+    "995e71bbee983a2ac3713831264adb47fb6bd1e058d5f004",
+    "ec01498288516fc926459f58e2c6ad8df9b473cb0fc08c25"
+    "96da7cf0e49be4b298d88cea927ac7f539f1edf228376d25",
+    "991c665755eb3a4b6bbdfb75c78a492e8c56a22c5c4d7e42"
+    "9bfdbc32b9d4ad5aa04a1f076e62fea19eef51acd0657c22",
+    "79407d3b5916b59c3e30b09822974791c313fb9ecc849e40"
+    "6f23592d04f625dc8c709b98b43b3852b337216179aa7fc7"}},
+  {"sha3_512", {
+    "a69f73cca23a9ac5c8b567dc185a756e97c982164fe25859e0d1dcc1475c80a6"
+    "15b2123af1f5f94c11e3e9402c3ac558f500199d95b6d3e301758586281dcd26",
+    "b751850b1a57168a5693cd924b6b096e08f621827444f70d884f5d0240d2712e"
+    "10e116e9192af3c91a7ec57647e3934057340b4cf408d5a56592f8274eec53f0",
+    "04a371e84ecfb5b8b77cb48610fca8182dd457ce6f326a0fd3d7ec2f1e91636d"
+    "ee691fbe0c985302ba1b0d8dc78c086346b533b49c030d99a27daf1139d6e75e",
+    "afebb2ef542e6579c50cad06d2e578f9f8dd6881d7dc824d26360feebf18a4fa"
+    "73e3261122948efcfd492e74e82e2189ed0fb440d187f382270cb455f21dd185"}},
+  {"shake128", {
+    "7f9c2ba4e88f827d616045507605853ed73b8093f6efbc88eb1a6eacfa66ef26",
+    "5881092dd818bf5cf8a3ddb793fbcba74097d5c526a6d35f97b83351940f2cc8",
+    "1a96182b50fb8c7e74e0a707788f55e98209b8d91fade8f32f8dd5cff7bf21f5",
+    "7b6df6ff181173b6d7898d7ff63fb07b7c237daf471a5ae5602adbccef9ccf4b"}},
+  {"shake256", {
+    "46b9dd2b0ba88d13233b3feb743eeb243fcd52ea62b81b82b50c27646ed5762f"
+    "d75dc4ddd8c0f200cb05019d67b592f6fc821c49479ab48640292eacb3b7c4be",
+    "483366601360a8771c6863080cc4114d8db44530f8f1e1ee4f94ea37e78b5739"
+    "d5a15bef186a5386c75744c0527e1faa9f8726e462a12a4feb06bd8801e751e4",
+    "4d8c2dd2435a0128eefbb8c36f6f87133a7911e18d979ee1ae6be5d4fd2e3329"
+    "40d8688a4e6a59aa8060f1f9bc996c05aca3c696a8b66279dc672c740bb224ec",
+    "98be04516c04cc73593fef3ed0352ea9f6443942d6950e29a372a681c3deaf45"
+    "35423709b02843948684e029010badcc0acd8303fc85fdad3eabf4f78cae1656"}},
+  {"blake2b", {
+    "786a02f742015903c6c6fd852552d272912f4740e15847618a86e217f71f5419"
+    "d25e1031afee585313896444934eb04b903a685b1448b755d56f701afe9be2ce",
+    "ba80a53f981c4d0d6a2797b69f12f6e94c212f14685ac4b74b12bb6fdbffa2d1"
+    "7d87c5392aab792dc252d5de4533cc9518d38aa8dbf1925ab92386edd4009923",
+    "7285ff3e8bd768d69be62b3bf18765a325917fa9744ac2f582a20850bc2b1141"
+    "ed1b3e4528595acc90772bdf2d37dc8a47130b44f33a02e8730e5ad8e166e888",
+    "ce741ac5930fe346811175c5227bb7bfcd47f42612fae46c0809514f9e0e3a11"
+    "ee1773287147cdeaeedff50709aa716341fe65240f4ad6777d6bfaf9726e5e52"}},
+  {"blake2s", {
+    "69217a3079908094e11121d042354a7c1f55b6482ca1a51e1b250dfd1ed0eef9",
+    "508c5e8c327c14e2e1a72ba34eeb452f37458b209ed63a294d999b4c86675982",
+    "6f4df5116a6f332edab1d9e10ee87df6557beab6259d7663f3bcd5722c13f189",
+    "358dd2ed0780d4054e76cb6f3a5bce2841e8e2f547431d4d09db21b66d941fc7"}},
+  {"blake2bp", {
+    "b5ef811a8038f70b628fa8b294daae7492b1ebe343a80eaabbf1f6ae664dd67b"
+    "9d90b0120791eab81dc96985f28849f6a305186a85501b405114bfa678df9380",
+    "b91a6b66ae87526c400b0a8b53774dc65284ad8f6575f8148ff93dff943a6ecd"
+    "8362130f22d6dae633aa0f91df4ac89aaff31d0f1b923c898e82025dedbdad6e",
+    "c5a0341eebb615503e229330e06a3dce8805b434ca758e899e72ac40bac36e63"
+    "7b70098a24ae5c3c4d39a183a43eb974823e3ddb5b09e07ad1e526e905f65bc4",
+    "ba148fde74a1392b3498e204fd60123b20c31e8c7e1b73c05400a46d31fc947c"
+    "27643c8350ea62b4aad424675cd0370eaab0fe73ed1f1962e3b1390d0bf9c045"}},
+  {"blake2sp", {
+    "dd0e891776933f43c7d032b08a917e25741f8aa9a12c12e1cac8801500f2ca4f",
+    "70f75b58f1fecab821db43c88ad84edde5a52600616cd22517b7bb14d440a7d5",
+    "3d107e42f17c13c82b436ebb651a48def67e7772fa06f4738ee968c7f4d8b48b",
+    "b2e3f1eec25bf8897a33a3a6f234a0a589ff21cf342785189875b5a98899127d"}},
+  {"blake3", {
+    "af1349b9f5f9a1a6a0404dea36dcc9499bcb25c9adc112b7cc9a93cae41f3262",
+    "6437b3ac38465133ffb63b75273a8db548c558465d79db03fd359c6cd5bd9d85",
+    "c19012cc2aaf0dc3d8e5c45a1b79114d2df42abb2a410bf54be09e891af06ff8",
+    "553e1aa2a477cb3166e6ab38c12d59f6c5017f0885aaf079f217da00cfca363f"}},
+  {"xxh64", {
+    "ef46db3751d8e999",
+    "44bc2cf5ad770999",
+    "f06103773e8585df",
+    "bafc02122ded1d21"}},
+  {"xxh3", {
+    "2d06800538d394c2",
+    "78af5f94892f3950",
+    "5bbcbbabcdcc3d3f",
+    "458619cd5260aa9a"}},
+  {"xxh128", {
+    "99aa06d3014798d86001c324468d497f",
+    "06b05ab6733a618578af5f94892f3950",
+    "3d62d22a5169b016c0d894fd4828a1a7",
+    "97d535cb0c62bf199c12d0b7e499edb8"}},
+  {"crc32c", {
+    "00000000",
+    "364b3fb7",
+    "071325f5",
+    "3f60a4b9"}},
+  {"crc32", {
+    "00000000",
+    "352441c2",
+    "171a3f5f",
+    "191f3349"}},
+  {"cksum", {
+    "ffffffff",
+    "48aa78a2",
+    "97d32c84",
+    "80edd7ce"}},
+  {NULL, {NULL}}
+};
+
+//Lengths of the quick test: short, around the padding edges of 64 and
+//128-byte blocks, several blocks and the smallest blake3 subtree, two
+//chunks of 1 KiB and a byte, which also fill the leaves of blake2bp and
+//blake2sp twice. It runs at every start, so it is kept to a couple of
+//milliseconds.
+static const size_t selftest_quick[] = {
+  0, 1, 3, 55, 56, 57, 63, 64, 65, 111, 112, 113, 127, 128, 129, 191, 2049
+};
+
+//Lengths the full test adds after 0 to SELFTEST_MAX_LEN: subtrees that
+//fill and overflow every lane of the blake3 kernels
+static const size_t selftest_long[SELFTEST_LONGS] = {
+  2049, 17 * 1024 + 1, 64 * 1024 + 1
+};
+
+/*---------------------------------------------------------------------------*/
+/* Static function prototypes                                                */
+/*---------------------------------------------------------------------------*/
+
+static uint64_t selftest_random(uint64_t *seed);
+
+static const selftest_kat_t *selftest_find_kat(const hash_algo *algo);
+
+static const char *selftest_impl(const selftest_run_t *run, size_t *len);
+
+static unsigned selftest_algo(selftest_run_t *run, selftest_fail_fn fail,
+                              void *arg);
+
+/*---------------------------------------------------------------------------*/
+/* Function definitions                                                      */
+/*---------------------------------------------------------------------------*/
+
+int hash_selftest(int full, selftest_fail_fn fail, void *arg){
+  size_t all[SELFTEST_MAX_LEN + 1 + SELFTEST_LONGS];
+  const uint8_t *msgs[SELFTEST_MAX_LEN + 1 + SELFTEST_LONGS];
+  selftest_run_t run;
+  uint8_t *data;
+  const hash_algo *algo, *other;
+  size_t count;
+  uint64_t seed = 0x9e3779b97f4a7c15;
+  unsigned failures = 0;
+  size_t i;
+
+  if(full){
+    for(i = 0; i <= SELFTEST_MAX_LEN; i++){
+      all[i] = i;
+    }
+    for(i = 0; i < SELFTEST_LONGS; i++){
+      all[SELFTEST_MAX_LEN + 1 + i] = selftest_long[i];
+    }
+    run.lens = all;
+    run.count = SELFTEST_MAX_LEN + 1 + SELFTEST_LONGS;
+  }else{
+    run.lens = selftest_quick;
+    run.count = sizeof(selftest_quick) / sizeof(selftest_quick[0]);
+  }
+
+  run.digests = malloc(2 * run.count * HASH_MAX_DIGEST + SELFTEST_DATA);
+  if(run.digests == NULL){
+    return -1;
+  }
+  run.out = run.digests + run.count * HASH_MAX_DIGEST;
+  data = run.out + run.count * HASH_MAX_DIGEST;
+  for(i = 0; i < SELFTEST_DATA; i++){
+    data[i] = (uint8_t)selftest_random(&seed);
+  }
+
+  //Messages start at every alignment
+  for(i = 0; i < run.count; i++){
+    msgs[i] = data + run.lens[i] % 8;
+  }
+  run.msgs = msgs;
+  run.seed = seed;
+
+  count = run.count;
+  for(algo = hash_algos; algo->name != NULL; algo++){
+    //The quick test compares the kernels of a family only once, the other
+    //members just get the known answers
+    for(other = hash_algos; other->impls != algo->impls; other++);
+    run.algo = algo;
+    run.count = (full || (other == algo)) ? count : 0;
+    failures += selftest_algo(&run, fail, arg);
+  }
+
+  free(run.digests);
+  hash_use_impl("auto");
+
+  return failures;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Static function definitions                                               */
+/*---------------------------------------------------------------------------*/
+
+//xorshift64*, enough to make up messages
+static uint64_t selftest_random(uint64_t *seed){
+  *seed ^= *seed >> 12;
+  *seed ^= *seed << 25;
+  *seed ^= *seed >> 27;
+  return (*seed * 0x2545f4914f6cdd1d) >> 32;
+}
+
+static const selftest_kat_t *selftest_find_kat(const hash_algo *algo){
+  const selftest_kat_t *kat;
+
+  for(kat = selftest_kats; kat->algo != NULL; kat++){
+    if(!strcmp(kat->algo, algo->name)){
+      return kat;
+    }
+  }
+  return NULL;
+}
+
+//Tests the implementations in use of run->algo. Returns the name of the
+//first test that fails, with the length of its message in len, or NULL.
+static const char *selftest_impl(const selftest_run_t *run, size_t *len){
+  static const char hex[] = "0123456789abcdef";
+  const hash_algo *algo = run->algo;
+  const selftest_kat_t *kat = selftest_find_kat(algo);
+  size_t digest_len = algo->digest_len;
+  uint8_t digest[HASH_MAX_DIGEST];
+  char text[2 * HASH_MAX_DIGEST + 1];
+  uint64_t seed = run->seed;
+  hash_ctx ctx;
+  size_t i, j;
+  int k;
+
+  for(k = 0; (kat != NULL) && (k < SELFTEST_KATS); k++){
+    *len = strlen(selftest_msgs[k]);
+    algo->init(&ctx);
+    algo->update(&ctx, (const uint8_t *)selftest_msgs[k], *len);
+    algo->final(&ctx, digest);
+    for(j = 0; j < digest_len; j++){
+      text[2 * j] = hex[digest[j] >> 4];
+      text[2 * j + 1] = hex[digest[j] & 0xf];
+    }
+    text[2 * digest_len] = '\0';
+    if(strcmp(text, kat->digests[k])){
+      return "known answer";
+    }
+  }
+
+  for(i = 0; i < run->count; i++){
+    *len = run->lens[i];
+    algo->init(&ctx);
+    algo->update(&ctx, run->msgs[i], *len);
+    algo->final(&ctx, run->out + i * digest_len);
+    if(memcmp(run->out + i * digest_len, run->digests + i * digest_len,
+              digest_len)){
+      return "single call";
+    }
+  }
+
+  for(i = 0; i < run->count; i++){
+    size_t done, piece;
+
+    *len = run->lens[i];
+    algo->init(&ctx);
+    for(done = 0; done < *len; done += piece){
+      piece = selftest_random(&seed) % (*len - done) + 1;
+      algo->update(&ctx, run->msgs[i] + done, piece);
+    }
+    algo->final(&ctx, digest);
+    if(memcmp(digest, run->digests + i * digest_len, digest_len)){
+      return "pieces";
+    }
+  }
+
+  if((algo->batch != NULL) && run->count){
+    //All at once, so every lane gets messages of every length
+    algo->batch(run->msgs, run->lens, run->count, run->out);
+    for(i = 0; i < run->count; i++){
+      *len = run->lens[i];
+      if(memcmp(run->out + i * digest_len, run->digests + i * digest_len,
+                digest_len)){
+        return "batch";
+      }
+    }
+  }
+
+  return NULL;
+}
+
+//Tests every implementation of run->algo the host can run, the scalar one
+//first to find the right digests. Returns how many failed.
+static unsigned selftest_algo(selftest_run_t *run, selftest_fail_fn fail,
+                              void *arg){
+  const hash_algo *algo = run->algo;
+  const hash_impl *impl;
+  const char *test;
+  hash_ctx ctx;
+  unsigned failures = 0;
+  size_t i, len;
+
+  algo->impls[0].use();
+  for(i = 0; i < run->count; i++){
+    algo->init(&ctx);
+    algo->update(&ctx, run->msgs[i], run->lens[i]);
+    algo->final(&ctx, run->digests + i * algo->digest_len);
+  }
+
+  //Also those demoted before, so every failure is reported
+  for(impl = algo->impls; impl->name != NULL; impl++){
+    if((impl->features & cpu_features()) != impl->features){
+      continue;
+    }
+    algo->impls[0].use();
+    if(impl != algo->impls){
+      impl->use();
+    }
+
+    test = selftest_impl(run, &len);
+    if(test != NULL){
+      failures++;
+      if(fail != NULL){
+        fail(algo, impl, test, len, arg);
+      }
+      //Without a right scalar result the others cannot be compared
+      if(impl == algo->impls){
+        break;
+      }
+      hash_demote(impl);
+    }
+  }
+  return failures;
+}
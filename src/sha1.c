@@ -39,6 +39,10 @@ SOFTWARE.
 
 #include "HashCheck.h"
 
+#ifdef HASH_X86
+#include <immintrin.h>
+#endif
+
 /*---------------------------------------------------------------------------*/
 /* Constant declarations                                                     */
 /*---------------------------------------------------------------------------*/
@@ -55,141 +59,283 @@ SOFTWARE.
 
 
 /*---------------------------------------------------------------------------*/
-/* Variable declarations                                                     */
+/* Macro declarations                                                        */
 /*---------------------------------------------------------------------------*/
 
+#define LEFTROTATE(x, c) (((x) << (c)) | ((x) >> (32 - (c))))
+
+//Big-endian word at p, whatever its alignment
+#define LOAD32_BE(p) ((uint32_t)(p)[0] << 24 | (uint32_t)(p)[1] << 16 | \
+                      (uint32_t)(p)[2] << 8 | (uint32_t)(p)[3])
+
+//Round functions, without branches
+#define SHA1_CH(b, c, d) ((d) ^ ((b) & ((c) ^ (d))))
+#define SHA1_PARITY(b, c, d) ((b) ^ (c) ^ (d))
+#define SHA1_MAJ(b, c, d) (((b) & (c)) | ((d) & ((b) | (c))))
+
+//Word i of the schedule, kept in a rolling window of sixteen words
+#define SHA1_W(i) \
+  ((i) < 16 ? w[(i) & 15] : \
+   (w[(i) & 15] = LEFTROTATE(w[((i) + 13) & 15] ^ w[((i) + 8) & 15] ^ \
+                             w[((i) + 2) & 15] ^ w[(i) & 15], 1)))
+
+//One round, the variables rotate through the arguments instead of moving
+#define SHA1_ROUND(a, b, c, d, e, F, k, i) \
+  do{ \
+    e += LEFTROTATE(a, 5) + F(b, c, d) + (k) + SHA1_W(i); \
+    b = LEFTROTATE(b, 30); \
+  }while(0)
+
+//Five rounds, after them the variables are back in their places
+#define SHA1_ROUNDS5(F, k, i) \
+  do{ \
+    SHA1_ROUND(a, b, c, d, e, F, k, (i) + 0); \
+    SHA1_ROUND(e, a, b, c, d, F, k, (i) + 1); \
+    SHA1_ROUND(d, e, a, b, c, F, k, (i) + 2); \
+    SHA1_ROUND(c, d, e, a, b, F, k, (i) + 3); \
+    SHA1_ROUND(b, c, d, e, a, F, k, (i) + 4); \
+  }while(0)
+
+//Twenty rounds sharing function and constant
+#define SHA1_ROUNDS20(F, k, i) \
+  do{ \
+    SHA1_ROUNDS5(F, k, (i) + 0); \
+    SHA1_ROUNDS5(F, k, (i) + 5); \
+    SHA1_ROUNDS5(F, k, (i) + 10); \
+    SHA1_ROUNDS5(F, k, (i) + 15); \
+  }while(0)
+
+#ifdef HASH_X86
+//Four rounds of SHA-NI, i selects the round function and constant
+#define SHA1_ROUNDS4(i, e_next, e, m0, m1, m2, m3) \
+  do{ \
+    e_next = abcd; \
+    e = _mm_sha1nexte_epu32(e, m0); \
+    m1 = _mm_sha1msg2_epu32(m1, m0); \
+    abcd = _mm_sha1rnds4_epu32(abcd, e, i); \
+    m3 = _mm_sha1msg1_epu32(m3, m0); \
+    m2 = _mm_xor_si128(m2, m0); \
+  }while(0)
+#endif
 
 /*---------------------------------------------------------------------------*/
-/* Macro declarations                                                        */
+/* Static function prototypes                                                */
 /*---------------------------------------------------------------------------*/
 
-#define LEFTROTATE(x, c) (((x) << (c)) | ((x) >> (32 - (c))))
+static void sha1_use_scalar(void);
+
+#ifdef HASH_X86
+static void sha1_use_shani(void);
+#endif
 
 /*---------------------------------------------------------------------------*/
-/* Static function prototypes                                                */
+/* Variable declarations                                                     */
 /*---------------------------------------------------------------------------*/
 
+//Block function used by sha1_update, chosen by the implementations below
+static void (*sha1_blocks)(uint32_t h[5], const uint8_t *data, size_t blocks) =
+  sha1_blocks_scalar;
+
+const hash_impl sha1_impls[] = {
+  {"scalar", 0, sha1_use_scalar},
+#ifdef HASH_X86
+  {"shani", CPU_SHA | CPU_SSE41, sha1_use_shani},
+#endif
+  {NULL, 0, NULL}
+};
 
 /*---------------------------------------------------------------------------*/
 /* Function definitions                                                      */
 /*---------------------------------------------------------------------------*/
 
-int sha1_sum(uint8_t *initial_msg, size_t initial_len, uint8_t *digest){
+void sha1_init(sha1_ctx *ctx){
   //Initialize variables:
-  uint32_t h0 = 0x67452301; //A
-  uint32_t h1 = 0xEFCDAB89; //B
-  uint32_t h2 = 0x98BADCFE; //C
-  uint32_t h3 = 0x10325476; //D
-  uint32_t h4 = 0xC3D2E1F0; //E
-
-  //Pre-processing:
-  uint8_t *msg = NULL;
-
-  size_t new_len;
-  new_len = initial_len*8 + 1;
-  new_len += (512-((new_len+64)%512))%512;
-  new_len /= 8;
-
-  msg = calloc(new_len + sizeof(uint64_t), sizeof(uint8_t));
-  if(msg == NULL){//calloc failed
-    return -1;
+  ctx->h[0] = 0x67452301; //A
+  ctx->h[1] = 0xEFCDAB89; //B
+  ctx->h[2] = 0x98BADCFE; //C
+  ctx->h[3] = 0x10325476; //D
+  ctx->h[4] = 0xC3D2E1F0; //E
+  ctx->len = 0;
+}
+
+void sha1_update(sha1_ctx *ctx, const uint8_t *msg, size_t len){
+  size_t used = ctx->len % 64;
+  ctx->len += len;
+
+  if(used){//Complete the pending block first
+    size_t fill = 64 - used;
+    if(len < fill){
+      memcpy(ctx->block + used, msg, len);
+      return;
+    }
+    memcpy(ctx->block + used, msg, fill);
+    sha1_blocks(ctx->h, ctx->block, 1);
+    msg += fill;
+    len -= fill;
   }
 
-  memcpy(msg, initial_msg, initial_len);
-  msg[initial_len] = 0x80; // appending single bit to the message
+  //Full blocks are hashed in place
+  sha1_blocks(ctx->h, msg, len / 64);
+  msg += len - len % 64;
+  len %= 64;
+
+  memcpy(ctx->block, msg, len);
+}
+
+void sha1_final(sha1_ctx *ctx, uint8_t digest[20]){
+  size_t used = ctx->len % 64;
+
+  ctx->block[used++] = 0x80; // appending single bit to the message
+  if(used > 56){//No room left for the length
+    memset(ctx->block + used, 0, 64 - used);
+    sha1_blocks(ctx->h, ctx->block, 1);
+    used = 0;
+  }
+  memset(ctx->block + used, 0, 56 - used);
 
   //append original length in bits mod 2^64
-  uint64_t bits_len = __bswap_64(8*initial_len);
-  memcpy(msg + new_len, &bits_len, sizeof(uint64_t));
+  uint64_t bits_len = __bswap_64(8*ctx->len);
+  memcpy(ctx->block + 56, &bits_len, sizeof(uint64_t));
+  sha1_blocks(ctx->h, ctx->block, 1);
+
+  int i;
+  for(i = 0; i < 5; i++){
+    digest[4*i + 0] = (ctx->h[i] >> 24) & 0xff;
+    digest[4*i + 1] = (ctx->h[i] >> 16) & 0xff;
+    digest[4*i + 2] = (ctx->h[i] >>  8) & 0xff;
+    digest[4*i + 3] = (ctx->h[i]      ) & 0xff;
+  }
+}
+
+int sha1_sum(uint8_t *initial_msg, size_t initial_len, uint8_t *digest){
+  sha1_ctx ctx;
+
+  sha1_init(&ctx);
+  sha1_update(&ctx, initial_msg, initial_len);
+  sha1_final(&ctx, digest);
 
-  //Process the message in successive 512-bit chunks:
-  size_t offset;
-  //for each 512-bit chunk of padded message
-  for(offset = 0; offset < new_len; offset += (512/8)){
+  return 0;
+}
+
+void sha1_blocks_scalar(uint32_t h[5], const uint8_t *data, size_t blocks){
+  //for each 512-bit chunk of the message
+  for(; blocks; blocks--, data += (512/8)){
     int i;
-    uint32_t temp;
     //break chunk into sixteen 32-bit words w[j], 0 ≤ j ≤ 15
-    uint32_t w[80] = {0};
+    uint32_t w[16];
     for(i = 0; i < 16; i++){
-      w[i]  = msg[i * 4 + 0 + offset] << 24;
-      w[i] |= msg[i * 4 + 1 + offset] << 16;
-      w[i] |= msg[i * 4 + 2 + offset] << 8;
-      w[i] |= msg[i * 4 + 3 + offset];
-    }
-
-    //Extend the sixteen 32-bit words into eighty 32-bit words:
-    for(i = 16; i< 80; i++){
-      w[i] = LEFTROTATE((w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16]), 1);
+      w[i] = LOAD32_BE(data + 4 * i);
     }
 
     // Initialize hash value for this chunk:
-    uint32_t a = h0;
-    uint32_t b = h1;
-    uint32_t c = h2;
-    uint32_t d = h3;
-    uint32_t e = h4;
-
-    //Main loop:
-    for(i = 0; i < 80; i++){
-      int f, k;
-
-      if(i < 20){
-        f = (b & c) | ((~b) & d);
-        k = 0x5A827999;
-      }else if(i < 40){
-        f = b ^ c ^ d;
-        k = 0x6ED9EBA1;
-      }else if(i < 60){
-        f = (b & c) | (b & d) | (c & d);
-        k = 0x8F1BBCDC;
-      }else{
-        f = b ^ c ^ d;
-        k = 0xCA62C1D6;
-      }
-
-      //Be wary of the below definitions of a,b,c,d
-      temp = LEFTROTATE(a, 5) + f + e + k + w[i];
-      e = d;
-      d = c;
-      c = LEFTROTATE(b, 30);
-      b = a;
-      a = temp;
-    }
+    uint32_t a = h[0];
+    uint32_t b = h[1];
+    uint32_t c = h[2];
+    uint32_t d = h[3];
+    uint32_t e = h[4];
+
+    //Main loop, the words past the sixteenth are computed as they are used:
+    SHA1_ROUNDS20(SHA1_CH, 0x5A827999, 0);
+    SHA1_ROUNDS20(SHA1_PARITY, 0x6ED9EBA1, 20);
+    SHA1_ROUNDS20(SHA1_MAJ, 0x8F1BBCDC, 40);
+    SHA1_ROUNDS20(SHA1_PARITY, 0xCA62C1D6, 60);
 
     //Add this chunk's hash to result so far:
-    h0 += a;
-    h1 += b;
-    h2 += c;
-    h3 += d;
-    h4 += e;
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
   }
+}
 
-  digest[ 0] = (h0 >> 24) & 0xff;
-  digest[ 1] = (h0 >> 16) & 0xff;
-  digest[ 2] = (h0 >>  8) & 0xff;
-  digest[ 3] = (h0      ) & 0xff;
-  digest[ 4] = (h1 >> 24) & 0xff;
-  digest[ 5] = (h1 >> 16) & 0xff;
-  digest[ 6] = (h1 >>  8) & 0xff;
-  digest[ 7] = (h1      ) & 0xff;
-  digest[ 8] = (h2 >> 24) & 0xff;
-  digest[ 9] = (h2 >> 16) & 0xff;
-  digest[10] = (h2 >>  8) & 0xff;
-  digest[11] = (h2      ) & 0xff;
-  digest[12] = (h3 >> 24) & 0xff;
-  digest[13] = (h3 >> 16) & 0xff;
-  digest[14] = (h3 >>  8) & 0xff;
-  digest[15] = (h3      ) & 0xff;
-  digest[16] = (h4 >> 24) & 0xff;
-  digest[17] = (h4 >> 16) & 0xff;
-  digest[18] = (h4 >>  8) & 0xff;
-  digest[19] = (h4      ) & 0xff;
-
-  free(msg);
+#ifdef HASH_X86
+__attribute__((target("sha,sse4.1")))
+void sha1_blocks_shani(uint32_t h[5], const uint8_t *data, size_t blocks){
+  const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL,
+                                      0x08090a0b0c0d0e0fULL);
+  __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)h), 0x1b);
+  __m128i e0 = _mm_set_epi32((int)h[4], 0, 0, 0);
+
+  for(; blocks; blocks--, data += (512/8)){
+    __m128i abcd_save = abcd;
+    __m128i e0_save = e0;
+    __m128i e1;
+    __m128i m0, m1, m2, m3;
+
+    //Rounds 0-11 start the schedule as the message words are loaded
+    m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 0)), mask);
+    e0 = _mm_add_epi32(e0, m0);
+    e1 = abcd;
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+    m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)), mask);
+    e1 = _mm_sha1nexte_epu32(e1, m1);
+    e0 = abcd;
+    abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+    m0 = _mm_sha1msg1_epu32(m0, m1);
+
+    m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)), mask);
+    e0 = _mm_sha1nexte_epu32(e0, m2);
+    e1 = abcd;
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+    m1 = _mm_sha1msg1_epu32(m1, m2);
+    m0 = _mm_xor_si128(m0, m2);
+
+    m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)), mask);
+
+    //Rounds 12-67 extend the schedule four words at a time
+    SHA1_ROUNDS4(0, e0, e1, m3, m0, m1, m2);
+    SHA1_ROUNDS4(0, e1, e0, m0, m1, m2, m3);
+    SHA1_ROUNDS4(1, e0, e1, m1, m2, m3, m0);
+    SHA1_ROUNDS4(1, e1, e0, m2, m3, m0, m1);
+    SHA1_ROUNDS4(1, e0, e1, m3, m0, m1, m2);
+    SHA1_ROUNDS4(1, e1, e0, m0, m1, m2, m3);
+    SHA1_ROUNDS4(1, e0, e1, m1, m2, m3, m0);
+    SHA1_ROUNDS4(2, e1, e0, m2, m3, m0, m1);
+    SHA1_ROUNDS4(2, e0, e1, m3, m0, m1, m2);
+    SHA1_ROUNDS4(2, e1, e0, m0, m1, m2, m3);
+    SHA1_ROUNDS4(2, e0, e1, m1, m2, m3, m0);
+    SHA1_ROUNDS4(2, e1, e0, m2, m3, m0, m1);
+    SHA1_ROUNDS4(3, e0, e1, m3, m0, m1, m2);
+    SHA1_ROUNDS4(3, e1, e0, m0, m1, m2, m3);
+
+    //Rounds 68-79 only finish the schedule
+    e1 = _mm_sha1nexte_epu32(e1, m1);
+    e0 = abcd;
+    m2 = _mm_sha1msg2_epu32(m2, m1);
+    abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+    m3 = _mm_xor_si128(m3, m1);
+
+    e0 = _mm_sha1nexte_epu32(e0, m2);
+    e1 = abcd;
+    m3 = _mm_sha1msg2_epu32(m3, m2);
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+
+    e1 = _mm_sha1nexte_epu32(e1, m3);
+    e0 = abcd;
+    abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
 
-  return 0;
+    //Add this chunk's hash to result so far:
+    e0 = _mm_sha1nexte_epu32(e0, e0_save);
+    abcd = _mm_add_epi32(abcd, abcd_save);
+  }
+
+  _mm_storeu_si128((__m128i *)h, _mm_shuffle_epi32(abcd, 0x1b));
+  h[4] = (uint32_t)_mm_extract_epi32(e0, 3);
 }
+#endif
 
 /*---------------------------------------------------------------------------*/
 /* Static function definitions                                               */
 /*---------------------------------------------------------------------------*/
+
+static void sha1_use_scalar(void){
+  sha1_blocks = sha1_blocks_scalar;
+}
+
+#ifdef HASH_X86
+static void sha1_use_shani(void){
+  sha1_blocks = sha1_blocks_shani;
+}
+#endif
@@ -38,10 +38,89 @@ SOFTWARE.
 
 #include "HashCheck.h"
 
+#ifdef HASH_X86
+#include <immintrin.h>
+#endif
+
 /*---------------------------------------------------------------------------*/
 /* Constant declarations                                                     */
 /*---------------------------------------------------------------------------*/
 
+//First 32 bits of the fractional parts of the cube roots of the first 64 primes
+static const uint32_t k256[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+  0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+  0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+  0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+  0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+  0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+//Initial hash values of sha224 and sha256
+static const uint32_t iv224[8] = {
+  0xc1059ed8, 0x367cd507, 0x3070dd17, 0xf70e5939,
+  0xffc00b31, 0x68581511, 0x64f98fa7, 0xbefa4fa4
+};
+
+static const uint32_t iv256[8] = {
+  0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+  0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+//Initial hash values of sha384, sha512, sha512_224 and sha512_256
+static const uint64_t iv384[8] = {
+  0xcbbb9d5dc1059ed8, 0x629a292a367cd507, 0x9159015a3070dd17,
+  0x152fecd8f70e5939, 0x67332667ffc00b31, 0x8eb44a8768581511,
+  0xdb0c2e0d64f98fa7, 0x47b5481dbefa4fa4
+};
+
+static const uint64_t iv512[8] = {
+  0x6a09e667f3bcc908, 0xbb67ae8584caa73b, 0x3c6ef372fe94f82b,
+  0xa54ff53a5f1d36f1, 0x510e527fade682d1, 0x9b05688c2b3e6c1f,
+  0x1f83d9abfb41bd6b, 0x5be0cd19137e2179
+};
+
+static const uint64_t iv512_224[8] = {
+  0x8c3d37c819544da2, 0x73e1996689dcd4d6, 0x1dfab7ae32ff9c82,
+  0x679dd514582f9fcf, 0x0f6d2b697bd44da8, 0x77e36f7304c48942,
+  0x3f9d85a86a1d36c8, 0x1112e6ad91d692a1
+};
+
+static const uint64_t iv512_256[8] = {
+  0x22312194fc2bf72c, 0x9f555fa3c84c64c2, 0x2393b86b6f53b151,
+  0x963877195940eabd, 0x96283ee2a88effe3, 0xbe5e1e2553863992,
+  0x2b0199fc2c85b8aa, 0x0eb72ddc81c52ca2
+};
+
+//First 64 bits of the fractional parts of the cube roots of the first 80 primes
+static const uint64_t k512[80] = {
+  0x428a2f98d728ae22, 0x7137449123ef65cd, 0xb5c0fbcfec4d3b2f, 0xe9b5dba58189dbbc,
+  0x3956c25bf348b538, 0x59f111f1b605d019, 0x923f82a4af194f9b, 0xab1c5ed5da6d8118,
+  0xd807aa98a3030242, 0x12835b0145706fbe, 0x243185be4ee4b28c, 0x550c7dc3d5ffb4e2,
+  0x72be5d74f27b896f, 0x80deb1fe3b1696b1, 0x9bdc06a725c71235, 0xc19bf174cf692694,
+  0xe49b69c19ef14ad2, 0xefbe4786384f25e3, 0x0fc19dc68b8cd5b5, 0x240ca1cc77ac9c65,
+  0x2de92c6f592b0275, 0x4a7484aa6ea6e483, 0x5cb0a9dcbd41fbd4, 0x76f988da831153b5,
+  0x983e5152ee66dfab, 0xa831c66d2db43210, 0xb00327c898fb213f, 0xbf597fc7beef0ee4,
+  0xc6e00bf33da88fc2, 0xd5a79147930aa725, 0x06ca6351e003826f, 0x142929670a0e6e70,
+  0x27b70a8546d22ffc, 0x2e1b21385c26c926, 0x4d2c6dfc5ac42aed, 0x53380d139d95b3df,
+  0x650a73548baf63de, 0x766a0abb3c77b2a8, 0x81c2c92e47edaee6, 0x92722c851482353b,
+  0xa2bfe8a14cf10364, 0xa81a664bbc423001, 0xc24b8b70d0f89791, 0xc76c51a30654be30,
+  0xd192e819d6ef5218, 0xd69906245565a910, 0xf40e35855771202a, 0x106aa07032bbd1b8,
+  0x19a4c116b8d2d0c8, 0x1e376c085141ab53, 0x2748774cdf8eeb99, 0x34b0bcb5e19b48a8,
+  0x391c0cb3c5c95a63, 0x4ed8aa4ae3418acb, 0x5b9cca4f7763e373, 0x682e6ff3d6b2b8a3,
+  0x748f82ee5defb2fc, 0x78a5636f43172f60, 0x84c87814a1f0ab72, 0x8cc702081a6439ec,
+  0x90befffa23631e28, 0xa4506cebde82bde9, 0xbef9a3f7b2c67915, 0xc67178f2e372532b,
+  0xca273eceea26619c, 0xd186b8c721c0c207, 0xeada7dd6cde0eb1e, 0xf57d4f7fee6ed178,
+  0x06f067aa72176fba, 0x0a637dc5a2c898a6, 0x113f9804bef90dae, 0x1b710b35131c471b,
+  0x28db77f523047d84, 0x32caab7b40c72493, 0x3c9ebe0a15c9bebc, 0x431d67c49c100d4c,
+  0x4cc5d4becb3e42b6, 0x597f299cfc657e2a, 0x5fcb6fab3ad6faec, 0x6c44198c4a475817
+};
+
 
 /*---------------------------------------------------------------------------*/
 /* Type declarations                                                         */
@@ -54,727 +133,724 @@ SOFTWARE.
 
 
 /*---------------------------------------------------------------------------*/
-/* Variable declarations                                                     */
+/* Macro declarations                                                        */
 /*---------------------------------------------------------------------------*/
 
+#define RIGHTROTATE(x,c) (((x) >> (c)) | ((x) << (32 - (c))))
+#define RIGHTROTATE64(x,c) (((x) >> (c)) | ((x) << (64 - (c))))
+
+//Big-endian words at p, whatever its alignment
+#define LOAD32_BE(p) ((uint32_t)(p)[0] << 24 | (uint32_t)(p)[1] << 16 | \
+                      (uint32_t)(p)[2] << 8 | (uint32_t)(p)[3])
+#define LOAD64_BE(p) ((uint64_t)LOAD32_BE(p) << 32 | LOAD32_BE((p) + 4))
+
+//Operations on one word, X1 for sha256 and Q1 for sha512, with the same
+//names as the vector ones of the multi-buffer kernels so all share the
+//rounds below
+#define X1_T uint32_t
+#define X1_LOAD(p) (*(p))
+#define X1_STORE(p, x) (*(p) = (x))
+#define X1_ADD(x, y) ((x) + (y))
+#define X1_SET1(k) (k)
+#define X1_ROR(x, n) RIGHTROTATE(x, n)
+#define X1_XOR3(x, y, z) ((x) ^ (y) ^ (z))
+#define X1_CH(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define X1_MAJ(x, y, z) (((x) & (y)) | ((z) & ((x) | (y))))
+#define X1_SHR(x, n) ((x) >> (n))
+
+#define Q1_T uint64_t
+#define Q1_LOAD(p) X1_LOAD(p)
+#define Q1_STORE(p, x) X1_STORE(p, x)
+#define Q1_ADD(x, y) X1_ADD(x, y)
+#define Q1_SET1(k) (k)
+#define Q1_ROR(x, n) RIGHTROTATE64(x, n)
+#define Q1_XOR3(x, y, z) X1_XOR3(x, y, z)
+#define Q1_CH(x, y, z) X1_CH(x, y, z)
+#define Q1_MAJ(x, y, z) X1_MAJ(x, y, z)
+#define Q1_SHR(x, n) X1_SHR(x, n)
+
+#ifdef HASH_X86
+//X8 and Q4 for AVX2, X16 and Q8 for AVX-512
+#define X8_T __m256i
+#define X8_ADD(x, y) _mm256_add_epi32(x, y)
+#define X8_SET1(k) _mm256_set1_epi32((int)(k))
+#define X8_ROR(x, n) \
+  _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define X8_XOR3(x, y, z) _mm256_xor_si256(_mm256_xor_si256(x, y), z)
+#define X8_CH(x, y, z) \
+  _mm256_xor_si256(_mm256_and_si256(x, y), _mm256_andnot_si256(x, z))
+#define X8_MAJ(x, y, z) _mm256_or_si256(_mm256_and_si256(x, y), \
+  _mm256_and_si256(z, _mm256_or_si256(x, y)))
+#define X8_SHR(x, n) _mm256_srli_epi32(x, n)
+
+#define X16_T __m512i
+#define X16_ADD(x, y) _mm512_add_epi32(x, y)
+#define X16_SET1(k) _mm512_set1_epi32((int)(k))
+#define X16_ROR(x, n) _mm512_ror_epi32(x, n)
+#define X16_XOR3(x, y, z) _mm512_ternarylogic_epi32(x, y, z, 0x96)
+#define X16_CH(x, y, z) _mm512_ternarylogic_epi32(x, y, z, 0xca)
+#define X16_MAJ(x, y, z) _mm512_ternarylogic_epi32(x, y, z, 0xe8)
+#define X16_SHR(x, n) _mm512_srli_epi32(x, n)
+
+#define Q4_T __m256i
+#define Q4_ADD(x, y) _mm256_add_epi64(x, y)
+#define Q4_SET1(k) _mm256_set1_epi64x((long long)(k))
+#define Q4_ROR(x, n) \
+  _mm256_or_si256(_mm256_srli_epi64(x, n), _mm256_slli_epi64(x, 64 - (n)))
+#define Q4_XOR3(x, y, z) _mm256_xor_si256(_mm256_xor_si256(x, y), z)
+#define Q4_CH(x, y, z) X8_CH(x, y, z)
+#define Q4_MAJ(x, y, z) X8_MAJ(x, y, z)
+#define Q4_SHR(x, n) _mm256_srli_epi64(x, n)
+
+#define Q8_T __m512i
+#define Q8_ADD(x, y) _mm512_add_epi64(x, y)
+#define Q8_SET1(k) _mm512_set1_epi64((long long)(k))
+#define Q8_ROR(x, n) _mm512_ror_epi64(x, n)
+#define Q8_XOR3(x, y, z) _mm512_ternarylogic_epi64(x, y, z, 0x96)
+#define Q8_CH(x, y, z) _mm512_ternarylogic_epi64(x, y, z, 0xca)
+#define Q8_MAJ(x, y, z) _mm512_ternarylogic_epi64(x, y, z, 0xe8)
+#define Q8_SHR(x, n) _mm512_srli_epi64(x, n)
+
+#define X8_LOAD(p) _mm256_loadu_si256((const __m256i *)(p))
+#define X8_STORE(p, x) _mm256_storeu_si256((__m256i *)(p), x)
+#define X16_LOAD(p) _mm512_loadu_si512((const void *)(p))
+#define X16_STORE(p, x) _mm512_storeu_si512((void *)(p), x)
+#define Q4_LOAD(p) X8_LOAD(p)
+#define Q4_STORE(p, x) X8_STORE(p, x)
+#define Q8_LOAD(p) X16_LOAD(p)
+#define Q8_STORE(p, x) X16_STORE(p, x)
+#endif
+
+//Rotations and constants of every width: sha256 for X, sha512 for Q
+#define MB_X1_EP0 2, 13, 22
+#define MB_X1_EP1 6, 11, 25
+#define MB_X1_SIG0 7, 18, 3
+#define MB_X1_SIG1 17, 19, 10
+#define MB_X1_K k256
+#define MB_X8_EP0 MB_X1_EP0
+#define MB_X8_EP1 MB_X1_EP1
+#define MB_X8_SIG0 MB_X1_SIG0
+#define MB_X8_SIG1 MB_X1_SIG1
+#define MB_X8_K k256
+#define MB_X16_EP0 MB_X1_EP0
+#define MB_X16_EP1 MB_X1_EP1
+#define MB_X16_SIG0 MB_X1_SIG0
+#define MB_X16_SIG1 MB_X1_SIG1
+#define MB_X16_K k256
+#define MB_Q1_EP0 28, 34, 39
+#define MB_Q1_EP1 14, 18, 41
+#define MB_Q1_SIG0 1, 8, 7
+#define MB_Q1_SIG1 19, 61, 6
+#define MB_Q1_K k512
+#define MB_Q4_EP0 MB_Q1_EP0
+#define MB_Q4_EP1 MB_Q1_EP1
+#define MB_Q4_SIG0 MB_Q1_SIG0
+#define MB_Q4_SIG1 MB_Q1_SIG1
+#define MB_Q4_K k512
+#define MB_Q8_EP0 MB_Q1_EP0
+#define MB_Q8_EP1 MB_Q1_EP1
+#define MB_Q8_SIG0 MB_Q1_SIG0
+#define MB_Q8_SIG1 MB_Q1_SIG1
+#define MB_Q8_K k512
+
+#define MB_ROTS(V, x, r0, r1, r2) \
+  V##_XOR3(V##_ROR(x, r0), V##_ROR(x, r1), V##_ROR(x, r2))
+#define MB_SIG(V, x, r0, r1, s) V##_XOR3(V##_ROR(x, r0), V##_ROR(x, r1), \
+                                         V##_SHR(x, s))
+#define MB_CALL(M, ...) M(__VA_ARGS__)
+
+//Message word i plus its round constant, of rounds 0-15 and of the later
+//rounds computed in place
+#define MB_LOAD(V, i) V##_ADD(V##_SET1(MB_##V##_K[i]), w[i])
+#define MB_EXPAND(V, i) V##_ADD(V##_SET1(MB_##V##_K[i]), \
+  (w[(i) & 15] = V##_ADD(V##_ADD(w[(i) & 15], w[((i) + 9) & 15]), \
+    V##_ADD(MB_CALL(MB_SIG, V, w[((i) + 1) & 15], MB_##V##_SIG0), \
+            MB_CALL(MB_SIG, V, w[((i) + 14) & 15], MB_##V##_SIG1)))))
+
+#define MB_ROUND(V, a, b, c, d, e, f, g, h, i, W) \
+  do{ \
+    V##_T t1 = V##_ADD(V##_ADD(h, MB_CALL(MB_ROTS, V, e, MB_##V##_EP1)), \
+                       V##_ADD(V##_CH(e, f, g), W(V, i))); \
+    V##_T t2 = V##_ADD(MB_CALL(MB_ROTS, V, a, MB_##V##_EP0), \
+                       V##_MAJ(a, b, c)); \
+    d = V##_ADD(d, t1); \
+    h = V##_ADD(t1, t2); \
+  }while(0)
+
+//Eight rounds, after them the variables are back in their places
+#define MB_ROUNDS8(V, i, W) \
+  do{ \
+    MB_ROUND(V, a, b, c, d, e, f, g, h, (i) + 0, W); \
+    MB_ROUND(V, h, a, b, c, d, e, f, g, (i) + 1, W); \
+    MB_ROUND(V, g, h, a, b, c, d, e, f, (i) + 2, W); \
+    MB_ROUND(V, f, g, h, a, b, c, d, e, (i) + 3, W); \
+    MB_ROUND(V, e, f, g, h, a, b, c, d, (i) + 4, W); \
+    MB_ROUND(V, d, e, f, g, h, a, b, c, (i) + 5, W); \
+    MB_ROUND(V, c, d, e, f, g, h, a, b, (i) + 6, W); \
+    MB_ROUND(V, b, c, d, e, f, g, h, a, (i) + 7, W); \
+  }while(0)
+
+//Whole compression of a block of every lane, lanes words wide vectors,
+//rounds is 64 for sha256 and 80 for sha512. The scalar cores use it with
+//one lane, so every width runs the same unrolled rounds
+#define MB_COMPRESS(V, lanes, rounds, LOAD, STORE) \
+  do{ \
+    V##_T a = LOAD(&state[0 * (lanes)]), b = LOAD(&state[1 * (lanes)]); \
+    V##_T c = LOAD(&state[2 * (lanes)]), d = LOAD(&state[3 * (lanes)]); \
+    V##_T e = LOAD(&state[4 * (lanes)]), f = LOAD(&state[5 * (lanes)]); \
+    V##_T g = LOAD(&state[6 * (lanes)]), h = LOAD(&state[7 * (lanes)]); \
+    V##_T w[16]; \
+    int i; \
+    for(i = 0; i < 16; i++){ \
+      w[i] = LOAD(&msg[i * (lanes)]); \
+    } \
+    MB_ROUNDS8(V, 0, MB_LOAD); \
+    MB_ROUNDS8(V, 8, MB_LOAD); \
+    MB_ROUNDS8(V, 16, MB_EXPAND); \
+    MB_ROUNDS8(V, 24, MB_EXPAND); \
+    MB_ROUNDS8(V, 32, MB_EXPAND); \
+    MB_ROUNDS8(V, 40, MB_EXPAND); \
+    MB_ROUNDS8(V, 48, MB_EXPAND); \
+    MB_ROUNDS8(V, 56, MB_EXPAND); \
+    if((rounds) == 80){ \
+      MB_ROUNDS8(V, 64, MB_EXPAND); \
+      MB_ROUNDS8(V, 72, MB_EXPAND); \
+    } \
+    STORE(&state[0 * (lanes)], V##_ADD(a, LOAD(&state[0 * (lanes)]))); \
+    STORE(&state[1 * (lanes)], V##_ADD(b, LOAD(&state[1 * (lanes)]))); \
+    STORE(&state[2 * (lanes)], V##_ADD(c, LOAD(&state[2 * (lanes)]))); \
+    STORE(&state[3 * (lanes)], V##_ADD(d, LOAD(&state[3 * (lanes)]))); \
+    STORE(&state[4 * (lanes)], V##_ADD(e, LOAD(&state[4 * (lanes)]))); \
+    STORE(&state[5 * (lanes)], V##_ADD(f, LOAD(&state[5 * (lanes)]))); \
+    STORE(&state[6 * (lanes)], V##_ADD(g, LOAD(&state[6 * (lanes)]))); \
+    STORE(&state[7 * (lanes)], V##_ADD(h, LOAD(&state[7 * (lanes)]))); \
+  }while(0)
+
+#ifdef HASH_X86
+//Message word i plus its constant, for sha512_blocks_avx2
+#define SHA512_WK(V, i) wk[i]
+
+//Round constants i*4 to i*4+3 in one register
+#define SHA256_K(i) _mm_loadu_si128((const __m128i *)&k256[4 * (i)])
+
+//Four rounds of SHA-NI over cur, which also extend the schedule into next
+#define SHA256_ROUNDS4(i, cur, prev, next) \
+  do{ \
+    msg = _mm_add_epi32(cur, SHA256_K(i)); \
+    state1 = _mm_sha256rnds2_epu32(state1, state0, msg); \
+    next = _mm_add_epi32(next, _mm_alignr_epi8(cur, prev, 4)); \
+    next = _mm_sha256msg2_epu32(next, cur); \
+    msg = _mm_shuffle_epi32(msg, 0x0e); \
+    state0 = _mm_sha256rnds2_epu32(state0, state1, msg); \
+    prev = _mm_sha256msg1_epu32(prev, cur); \
+  }while(0)
+
+//Four rounds of SHA-NI that leave the schedule alone
+#define SHA256_ROUNDS4_LAST(i, cur) \
+  do{ \
+    msg = _mm_add_epi32(cur, SHA256_K(i)); \
+    state1 = _mm_sha256rnds2_epu32(state1, state0, msg); \
+    msg = _mm_shuffle_epi32(msg, 0x0e); \
+    state0 = _mm_sha256rnds2_epu32(state0, state1, msg); \
+  }while(0)
+#endif
 
 /*---------------------------------------------------------------------------*/
-/* Macro declarations                                                        */
+/* Static function prototypes                                                */
 /*---------------------------------------------------------------------------*/
 
-#define LEFTROTATE(x, c) (((x) << (c)) | ((x) >> (32 - (c))))
-#define RIGHTROTATE(x,c) (((x) >> (c)) | ((x) << (32 - (c))))
+uint128_t __bswap_128(uint128_t num);
 
-#define SHFL(x, n) (x << n)
-#define SHFR(x, n) (x >> n)
+static void sha256_use_scalar(void);
 
-#define LEFTROTATE64(x, c) (((x) << (c)) | ((x) >> (64 - (c))))
-#define RIGHTROTATE64(x,c) (((x) >> (c)) | ((x) << (64 - (c))))
+static void sha512_use_scalar(void);
+
+#ifdef HASH_X86
+static void sha256_use_avx2(void);
+
+static void sha256_use_shani(void);
+
+static void sha256_use_avx512(void);
+
+static void sha512_use_avx2(void);
+
+static void sha512_use_avx512(void);
+#endif
+
+static void sha2_sum_batch(const mb_kernel *kernel,
+                           int (*sum)(uint8_t *, size_t, uint8_t *),
+                           const uint8_t *const *msgs, const size_t *lens,
+                           size_t count, uint8_t *digests);
+
+static void sha256_blocks_any(void *h, const uint8_t *data, size_t blocks);
+
+static void sha512_blocks_any(void *h, const uint8_t *data, size_t blocks);
+
+static void sha256_start(sha256_ctx *ctx, const uint32_t iv[8]);
+
+static void sha512_start(sha512_ctx *ctx, const uint64_t iv[8]);
 
-#define CH(x,y,z) (((x) & (y)) ^ (~(x) & (z)))
-#define MAJ(x,y,z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+static void sha256_finish(sha256_ctx *ctx, uint8_t *digest, size_t len);
 
-#define EP0(x) (RIGHTROTATE(x, 2) ^ RIGHTROTATE(x,13) ^ RIGHTROTATE(x,22))
-#define EP1(x) (RIGHTROTATE(x, 6) ^ RIGHTROTATE(x,11) ^ RIGHTROTATE(x,25))
-#define SIG0(x) (RIGHTROTATE(x, 7) ^ RIGHTROTATE(x,18) ^ SHFR(x,3))
-#define SIG1(x) (RIGHTROTATE(x,17) ^ RIGHTROTATE(x,19) ^ SHFR(x,10))
+static void sha512_finish(sha512_ctx *ctx, uint8_t *digest, size_t len);
 
-#define EP0_512(x) (RIGHTROTATE64(x, 28) ^ RIGHTROTATE64(x,34)\
-            ^ RIGHTROTATE64(x, 39))
-#define EP1_512(x) (RIGHTROTATE64(x, 14) ^ RIGHTROTATE64(x,18)\
-            ^ RIGHTROTATE64(x, 41))
-#define SIG0_512(x) (RIGHTROTATE64(x, 1) ^ RIGHTROTATE64(x, 8) ^ SHFR(x,7))
-#define SIG1_512(x) (RIGHTROTATE64(x,19) ^ RIGHTROTATE64(x,61) ^ SHFR(x,6))
+static void sha2_share(mb_kernel *kernel, const mb_kernel *from);
 
 /*---------------------------------------------------------------------------*/
-/* Static function prototypes                                                */
+/* Variable declarations                                                     */
 /*---------------------------------------------------------------------------*/
 
-uint128_t __bswap_128(uint128_t num);
+//Block functions used by the updates, chosen by the implementations below
+static void (*sha256_blocks)(uint32_t h[8], const uint8_t *data,
+                             size_t blocks) = sha256_blocks_scalar;
+
+static void (*sha512_blocks)(uint64_t h[8], const uint8_t *data,
+                             size_t blocks) = sha512_blocks_scalar;
+
+//Multi-buffer kernels used by the batches, without lanes if there is none
+static mb_kernel sha224_mb = {
+  NULL, 0, 8, 4, 64, 8, 28, 1, iv224, NULL, NULL
+};
+
+static mb_kernel sha256_mb = {
+  NULL, 0, 8, 4, 64, 8, 32, 1, iv256, NULL, NULL
+};
+
+static mb_kernel sha384_mb = {
+  NULL, 0, 8, 8, 128, 16, 48, 1, iv384, NULL, NULL
+};
+
+static mb_kernel sha512_mb = {
+  NULL, 0, 8, 8, 128, 16, 64, 1, iv512, NULL, NULL
+};
+
+static mb_kernel sha512_224_mb = {
+  NULL, 0, 8, 8, 128, 16, 28, 1, iv512_224, NULL, NULL
+};
+
+static mb_kernel sha512_256_mb = {
+  NULL, 0, 8, 8, 128, 16, 32, 1, iv512_256, NULL, NULL
+};
+
+//Implementations of every member of the sha256 and of the sha512 family
+const hash_impl sha256_impls[] = {
+  {"scalar", 0, sha256_use_scalar},
+#ifdef HASH_X86
+  {"avx2", CPU_AVX2, sha256_use_avx2},
+  {"shani", CPU_SHA | CPU_SSE41, sha256_use_shani},
+  {"avx512", CPU_AVX512F, sha256_use_avx512},
+#endif
+  {NULL, 0, NULL}
+};
+
+const hash_impl sha512_impls[] = {
+  {"scalar", 0, sha512_use_scalar},
+#ifdef HASH_X86
+  {"avx2", CPU_AVX2 | CPU_BMI2, sha512_use_avx2},
+  {"avx512", CPU_AVX512F, sha512_use_avx512},
+#endif
+  {NULL, 0, NULL}
+};
 
 /*---------------------------------------------------------------------------*/
 /* Function definitions                                                      */
 /*---------------------------------------------------------------------------*/
 
+void sha224_init(sha224_ctx *ctx){
+  sha256_start(ctx, iv224);
+}
+
+void sha224_update(sha224_ctx *ctx, const uint8_t *msg, size_t len){
+  sha256_update(ctx, msg, len);
+}
+
+void sha224_final(sha224_ctx *ctx, uint8_t digest[28]){
+  sha256_finish(ctx, digest, 28);
+}
+
 int sha224_sum(uint8_t *initial_msg, size_t initial_len, uint8_t *digest){
-  //Initialize variables:
-  uint32_t h0 = 0xc1059ed8; //A
-  uint32_t h1 = 0x367cd507; //B
-  uint32_t h2 = 0x3070dd17; //C
-  uint32_t h3 = 0xf70e5939; //D
-  uint32_t h4 = 0xffc00b31; //E
-  uint32_t h5 = 0x68581511; //F
-  uint32_t h6 = 0x64f98fa7; //G
-  uint32_t h7 = 0xbefa4fa4; //H
-
-  uint32_t k[64] = {0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b,
-                    0x59f111f1, 0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01,
-                    0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7,
-                    0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
-                    0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152,
-                    0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
-                    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc,
-                    0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
-                    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819,
-                    0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116, 0x1e376c08,
-                    0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f,
-                    0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
-                    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
-
-  //Pre-processing:
-  uint8_t *msg = NULL;
-
-  size_t new_len;
-  new_len = initial_len*8 + 1 + sizeof(uint64_t)*8;
-  new_len += (512-((new_len)%512))%512;
-  new_len /= 8;
-
-  msg = calloc(new_len, sizeof(uint8_t));
-  if(msg == NULL){//calloc failed
-    return -1;
-  }
+  sha224_ctx ctx;
 
-  memcpy(msg, initial_msg, initial_len);
-  msg[initial_len] = 0x80; // appending single bit to the message
+  sha224_init(&ctx);
+  sha224_update(&ctx, initial_msg, initial_len);
+  sha224_final(&ctx, digest);
 
-  //append original length in bits mod 2^64
-  uint64_t bits_len = __bswap_64(8*initial_len);
-  memcpy(msg + new_len - sizeof(uint64_t), &bits_len, sizeof(uint64_t));
+  return 0;
+}
 
-  //Process the message in successive 512-bit chunks:
-  size_t offset;
-  //for each 512-bit chunk of padded message
-  for(offset = 0; offset < new_len; offset += (512/8)){
-    int i;
-    uint32_t t1;
-    uint32_t t2;
-    //break chunk into sixteen 32-bit words w[j], 0 ≤ j ≤ 15
-    uint32_t w[64] = {0};
-    for(i = 0; i < 16; i++){
-      w[i]  = msg[i * 4 + 0 + offset] << 24;
-      w[i] |= msg[i * 4 + 1 + offset] << 16;
-      w[i] |= msg[i * 4 + 2 + offset] << 8;
-      w[i] |= msg[i * 4 + 3 + offset];
-    }
+void sha224_sum_batch(const uint8_t *const *msgs, const size_t *lens,
+                      size_t count, uint8_t *digests){
+  sha2_sum_batch(&sha224_mb, sha224_sum, msgs, lens, count, digests);
+}
 
-    //Extend the sixteen 32-bit words into eighty 32-bit words:
-    for(i = 16 ; i< 64; i++){
-      w[i] = SIG1(w[i - 2]) + w[i - 7] + SIG0(w[i - 15]) + w[i - 16];
-    }
+void sha256_init(sha256_ctx *ctx){
+  sha256_start(ctx, iv256);
+}
 
-    // Initialize hash value for this chunk:
-    uint32_t a = h0;
-    uint32_t b = h1;
-    uint32_t c = h2;
-    uint32_t d = h3;
-    uint32_t e = h4;
-    uint32_t f = h5;
-    uint32_t g = h6;
-    uint32_t h = h7;
-
-    //Main loop:
-    for(i = 0; i < 64; i++){
-      t1 = h + EP1(e) + CH(e,f,g) + k[i] + w[i];
-		  t2 = EP0(a) + MAJ(a, b, c);
-      h = g;
-		  g = f;
-		  f = e;
-		  e = d + t1;
-		  d = c;
-		  c = b;
-		  b = a;
-		  a = t1 + t2;
-    }
+void sha256_update(sha256_ctx *ctx, const uint8_t *msg, size_t len){
+  size_t used = ctx->len % 64;
+  ctx->len += len;
 
-    //Add this chunk's hash to result so far:
-    h0 += a;
-    h1 += b;
-    h2 += c;
-    h3 += d;
-    h4 += e;
-    h5 += f;
-    h6 += g;
-    h7 += h;
+  if(used){//Complete the pending block first
+    size_t fill = 64 - used;
+    if(len < fill){
+      memcpy(ctx->block + used, msg, len);
+      return;
+    }
+    memcpy(ctx->block + used, msg, fill);
+    sha256_blocks(ctx->h, ctx->block, 1);
+    msg += fill;
+    len -= fill;
   }
 
-  digest[ 0] = (h0 >> 24) & 0xff;
-  digest[ 1] = (h0 >> 16) & 0xff;
-  digest[ 2] = (h0 >>  8) & 0xff;
-  digest[ 3] = (h0      ) & 0xff;
+  //Full blocks are hashed in place
+  sha256_blocks(ctx->h, msg, len / 64);
+  msg += len - len % 64;
+  len %= 64;
+
+  memcpy(ctx->block, msg, len);
+}
+
+void sha256_final(sha256_ctx *ctx, uint8_t digest[32]){
+  sha256_finish(ctx, digest, 32);
+}
 
-  digest[ 4] = (h1 >> 24) & 0xff;
-  digest[ 5] = (h1 >> 16) & 0xff;
-  digest[ 6] = (h1 >>  8) & 0xff;
-  digest[ 7] = (h1      ) & 0xff;
+int sha256_sum(uint8_t *initial_msg, size_t initial_len, uint8_t *digest){
+  sha256_ctx ctx;
+
+  sha256_init(&ctx);
+  sha256_update(&ctx, initial_msg, initial_len);
+  sha256_final(&ctx, digest);
+
+  return 0;
+}
 
-  digest[ 8] = (h2 >> 24) & 0xff;
-  digest[ 9] = (h2 >> 16) & 0xff;
-  digest[10] = (h2 >>  8) & 0xff;
-  digest[11] = (h2      ) & 0xff;
+void sha256_sum_batch(const uint8_t *const *msgs, const size_t *lens,
+                      size_t count, uint8_t *digests){
+  sha2_sum_batch(&sha256_mb, sha256_sum, msgs, lens, count, digests);
+}
 
-  digest[12] = (h3 >> 24) & 0xff;
-  digest[13] = (h3 >> 16) & 0xff;
-  digest[14] = (h3 >>  8) & 0xff;
-  digest[15] = (h3      ) & 0xff;
+void sha384_init(sha384_ctx *ctx){
+  sha512_start(ctx, iv384);
+}
 
-  digest[16] = (h4 >> 24) & 0xff;
-  digest[17] = (h4 >> 16) & 0xff;
-  digest[18] = (h4 >>  8) & 0xff;
-  digest[19] = (h4      ) & 0xff;
+void sha384_update(sha384_ctx *ctx, const uint8_t *msg, size_t len){
+  sha512_update(ctx, msg, len);
+}
 
-  digest[20] = (h5 >> 24) & 0xff;
-  digest[21] = (h5 >> 16) & 0xff;
-  digest[22] = (h5 >>  8) & 0xff;
-  digest[23] = (h5      ) & 0xff;
+void sha384_final(sha384_ctx *ctx, uint8_t digest[48]){
+  sha512_finish(ctx, digest, 48);
+}
 
-  digest[24] = (h6 >> 24) & 0xff;
-  digest[25] = (h6 >> 16) & 0xff;
-  digest[26] = (h6 >>  8) & 0xff;
-  digest[27] = (h6      ) & 0xff;
+int sha384_sum(uint8_t *initial_msg, size_t initial_len, uint8_t *digest){
+  sha384_ctx ctx;
 
-  free(msg);
+  sha384_init(&ctx);
+  sha384_update(&ctx, initial_msg, initial_len);
+  sha384_final(&ctx, digest);
 
   return 0;
 }
 
-int sha256_sum(uint8_t *initial_msg, size_t initial_len, uint8_t *digest){
-  //Initialize variables:
-  uint32_t h0 = 0x6a09e667; //A
-  uint32_t h1 = 0xbb67ae85; //B
-  uint32_t h2 = 0x3c6ef372; //C
-  uint32_t h3 = 0xa54ff53a; //D
-  uint32_t h4 = 0x510e527f; //E
-  uint32_t h5 = 0x9b05688c; //F
-  uint32_t h6 = 0x1f83d9ab; //G
-  uint32_t h7 = 0x5be0cd19; //H
-
-  uint32_t k[64] = {0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b,
-                    0x59f111f1, 0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01,
-                    0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7,
-                    0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
-                    0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152,
-                    0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
-                    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc,
-                    0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
-                    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819,
-                    0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116, 0x1e376c08,
-                    0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f,
-                    0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
-                    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
-
-  //Pre-processing:
-  uint8_t *msg = NULL;
-
-  size_t new_len;
-  new_len = initial_len*8 + 1 + sizeof(uint64_t)*8;
-  new_len += (512-((new_len)%512))%512;
-  new_len /= 8;
-
-  msg = calloc(new_len, sizeof(uint8_t));
-  if(msg == NULL){//calloc failed
-    return -1;
-  }
+void sha384_sum_batch(const uint8_t *const *msgs, const size_t *lens,
+                      size_t count, uint8_t *digests){
+  sha2_sum_batch(&sha384_mb, sha384_sum, msgs, lens, count, digests);
+}
 
-  memcpy(msg, initial_msg, initial_len);
-  msg[initial_len] = 0x80; // appending single bit to the message
+void sha512_init(sha512_ctx *ctx){
+  sha512_start(ctx, iv512);
+}
 
-  //append original length in bits mod 2^64
-  uint64_t bits_len = __bswap_64(8*initial_len);
-  memcpy(msg + new_len - sizeof(uint64_t), &bits_len, sizeof(uint64_t));
+void sha512_update(sha512_ctx *ctx, const uint8_t *msg, size_t len){
+  size_t used = ctx->len % 128;
+  ctx->len += len;
 
-  //Process the message in successive 512-bit chunks:
-  size_t offset;
-  //for each 512-bit chunk of padded message
-  for(offset = 0; offset < new_len; offset += (512/8)){
-    int i;
-    uint32_t t1;
-    uint32_t t2;
-    //break chunk into sixteen 32-bit words w[j], 0 ≤ j ≤ 15
-    uint32_t w[64] = {0};
-    for(i = 0; i < 16; i++){
-      w[i]  = msg[i * 4 + 0 + offset] << 24;
-      w[i] |= msg[i * 4 + 1 + offset] << 16;
-      w[i] |= msg[i * 4 + 2 + offset] << 8;
-      w[i] |= msg[i * 4 + 3 + offset];
+  if(used){//Complete the pending block first
+    size_t fill = 128 - used;
+    if(len < fill){
+      memcpy(ctx->block + used, msg, len);
+      return;
     }
+    memcpy(ctx->block + used, msg, fill);
+    sha512_blocks(ctx->h, ctx->block, 1);
+    msg += fill;
+    len -= fill;
+  }
 
-    //Extend the sixteen 32-bit words into eighty 32-bit words:
-    for(i = 16 ; i< 64; i++){
-      w[i] = SIG1(w[i - 2]) + w[i - 7] + SIG0(w[i - 15]) + w[i - 16];
-    }
+  //Full blocks are hashed in place
+  sha512_blocks(ctx->h, msg, len / 128);
+  msg += len - len % 128;
+  len %= 128;
 
-    // Initialize hash value for this chunk:
-    uint32_t a = h0;
-    uint32_t b = h1;
-    uint32_t c = h2;
-    uint32_t d = h3;
-    uint32_t e = h4;
-    uint32_t f = h5;
-    uint32_t g = h6;
-    uint32_t h = h7;
-
-    //Main loop:
-    for(i = 0; i < 64; i++){
-      t1 = h + EP1(e) + CH(e,f,g) + k[i] + w[i];
-		  t2 = EP0(a) + MAJ(a, b, c);
-      h = g;
-		  g = f;
-		  f = e;
-		  e = d + t1;
-		  d = c;
-		  c = b;
-		  b = a;
-		  a = t1 + t2;
-    }
+  memcpy(ctx->block, msg, len);
+}
 
-    //Add this chunk's hash to result so far:
-    h0 += a;
-    h1 += b;
-    h2 += c;
-    h3 += d;
-    h4 += e;
-    h5 += f;
-    h6 += g;
-    h7 += h;
-  }
+void sha512_final(sha512_ctx *ctx, uint8_t digest[64]){
+  sha512_finish(ctx, digest, 64);
+}
 
-  digest[ 0] = (h0 >> 24) & 0xff;
-  digest[ 1] = (h0 >> 16) & 0xff;
-  digest[ 2] = (h0 >>  8) & 0xff;
-  digest[ 3] = (h0      ) & 0xff;
+int sha512_sum(uint8_t *initial_msg, size_t initial_len, uint8_t *digest){
+  sha512_ctx ctx;
 
-  digest[ 4] = (h1 >> 24) & 0xff;
-  digest[ 5] = (h1 >> 16) & 0xff;
-  digest[ 6] = (h1 >>  8) & 0xff;
-  digest[ 7] = (h1      ) & 0xff;
+  sha512_init(&ctx);
+  sha512_update(&ctx, initial_msg, initial_len);
+  sha512_final(&ctx, digest);
 
-  digest[ 8] = (h2 >> 24) & 0xff;
-  digest[ 9] = (h2 >> 16) & 0xff;
-  digest[10] = (h2 >>  8) & 0xff;
-  digest[11] = (h2      ) & 0xff;
+  return 0;
+}
 
-  digest[12] = (h3 >> 24) & 0xff;
-  digest[13] = (h3 >> 16) & 0xff;
-  digest[14] = (h3 >>  8) & 0xff;
-  digest[15] = (h3      ) & 0xff;
+void sha512_sum_batch(const uint8_t *const *msgs, const size_t *lens,
+                      size_t count, uint8_t *digests){
+  sha2_sum_batch(&sha512_mb, sha512_sum, msgs, lens, count, digests);
+}
 
-  digest[16] = (h4 >> 24) & 0xff;
-  digest[17] = (h4 >> 16) & 0xff;
-  digest[18] = (h4 >>  8) & 0xff;
-  digest[19] = (h4      ) & 0xff;
+void sha512_224_init(sha512_224_ctx *ctx){
+  sha512_start(ctx, iv512_224);
+}
 
-  digest[20] = (h5 >> 24) & 0xff;
-  digest[21] = (h5 >> 16) & 0xff;
-  digest[22] = (h5 >>  8) & 0xff;
-  digest[23] = (h5      ) & 0xff;
+void sha512_224_update(sha512_224_ctx *ctx, const uint8_t *msg, size_t len){
+  sha512_update(ctx, msg, len);
+}
 
-  digest[24] = (h6 >> 24) & 0xff;
-  digest[25] = (h6 >> 16) & 0xff;
-  digest[26] = (h6 >>  8) & 0xff;
-  digest[27] = (h6      ) & 0xff;
+void sha512_224_final(sha512_224_ctx *ctx, uint8_t digest[28]){
+  sha512_finish(ctx, digest, 28);
+}
 
-  digest[28] = (h7 >> 24) & 0xff;
-  digest[29] = (h7 >> 16) & 0xff;
-  digest[30] = (h7 >>  8) & 0xff;
-  digest[31] = (h7      ) & 0xff;
+int sha512_224_sum(uint8_t *initial_msg, size_t initial_len,
+                   uint8_t digest[28]){
+  sha512_224_ctx ctx;
 
-  free(msg);
+  sha512_224_init(&ctx);
+  sha512_224_update(&ctx, initial_msg, initial_len);
+  sha512_224_final(&ctx, digest);
 
   return 0;
 }
 
-int sha384_sum(uint8_t *initial_msg, size_t initial_len, uint8_t *digest){
-  //Initialize variables:
-  uint64_t h0 = 0xcbbb9d5dc1059ed8; //A
-  uint64_t h1 = 0x629a292a367cd507; //B
-  uint64_t h2 = 0x9159015a3070dd17; //C
-  uint64_t h3 = 0x152fecd8f70e5939; //D
-  uint64_t h4 = 0x67332667ffc00b31; //E
-  uint64_t h5 = 0x8eb44a8768581511; //F
-  uint64_t h6 = 0xdb0c2e0d64f98fa7; //G
-  uint64_t h7 = 0x47b5481dbefa4fa4; //H
-
-  uint64_t k[80] = {0x428a2f98d728ae22, 0x7137449123ef65cd, 0xb5c0fbcfec4d3b2f,
-                    0xe9b5dba58189dbbc, 0x3956c25bf348b538, 0x59f111f1b605d019,
-                    0x923f82a4af194f9b, 0xab1c5ed5da6d8118, 0xd807aa98a3030242,
-                    0x12835b0145706fbe, 0x243185be4ee4b28c, 0x550c7dc3d5ffb4e2,
-                    0x72be5d74f27b896f, 0x80deb1fe3b1696b1, 0x9bdc06a725c71235,
-                    0xc19bf174cf692694, 0xe49b69c19ef14ad2, 0xefbe4786384f25e3,
-                    0x0fc19dc68b8cd5b5, 0x240ca1cc77ac9c65, 0x2de92c6f592b0275,
-                    0x4a7484aa6ea6e483, 0x5cb0a9dcbd41fbd4, 0x76f988da831153b5,
-                    0x983e5152ee66dfab, 0xa831c66d2db43210, 0xb00327c898fb213f,
-                    0xbf597fc7beef0ee4, 0xc6e00bf33da88fc2, 0xd5a79147930aa725,
-                    0x06ca6351e003826f, 0x142929670a0e6e70, 0x27b70a8546d22ffc,
-                    0x2e1b21385c26c926, 0x4d2c6dfc5ac42aed, 0x53380d139d95b3df,
-                    0x650a73548baf63de, 0x766a0abb3c77b2a8, 0x81c2c92e47edaee6,
-                    0x92722c851482353b, 0xa2bfe8a14cf10364, 0xa81a664bbc423001,
-                    0xc24b8b70d0f89791, 0xc76c51a30654be30, 0xd192e819d6ef5218,
-                    0xd69906245565a910, 0xf40e35855771202a, 0x106aa07032bbd1b8,
-                    0x19a4c116b8d2d0c8, 0x1e376c085141ab53, 0x2748774cdf8eeb99,
-                    0x34b0bcb5e19b48a8, 0x391c0cb3c5c95a63, 0x4ed8aa4ae3418acb,
-                    0x5b9cca4f7763e373, 0x682e6ff3d6b2b8a3, 0x748f82ee5defb2fc,
-                    0x78a5636f43172f60, 0x84c87814a1f0ab72, 0x8cc702081a6439ec,
-                    0x90befffa23631e28, 0xa4506cebde82bde9, 0xbef9a3f7b2c67915,
-                    0xc67178f2e372532b, 0xca273eceea26619c, 0xd186b8c721c0c207,
-                    0xeada7dd6cde0eb1e, 0xf57d4f7fee6ed178, 0x06f067aa72176fba,
-                    0x0a637dc5a2c898a6, 0x113f9804bef90dae, 0x1b710b35131c471b,
-                    0x28db77f523047d84, 0x32caab7b40c72493, 0x3c9ebe0a15c9bebc,
-                    0x431d67c49c100d4c, 0x4cc5d4becb3e42b6, 0x597f299cfc657e2a,
-                    0x5fcb6fab3ad6faec, 0x6c44198c4a475817};
-
-  //Pre-processing:
-  uint8_t *msg = NULL;
-
-  size_t new_len;
-  new_len = initial_len*8 + 1 + sizeof(uint128_t)*8;
-  new_len += (1024-(new_len%1024))%1024;
-  new_len /= 8;
-
-  msg = calloc(new_len, sizeof(uint8_t));
-  if(msg == NULL){//calloc failed
-    return -1;
-  }
+void sha512_224_sum_batch(const uint8_t *const *msgs, const size_t *lens,
+                          size_t count, uint8_t *digests){
+  sha2_sum_batch(&sha512_224_mb, sha512_224_sum, msgs, lens, count, digests);
+}
 
-  memcpy(msg, initial_msg, initial_len);
-  msg[initial_len] = 0x80; // appending single bit to the message
+void sha512_256_init(sha512_256_ctx *ctx){
+  sha512_start(ctx, iv512_256);
+}
 
-  //append original length in bits mod 2^128
-  uint128_t bits_len = __bswap_128(8*(uint128_t)initial_len);
-  memcpy(msg + new_len - sizeof(uint128_t), &bits_len, sizeof(uint128_t));
+void sha512_256_update(sha512_256_ctx *ctx, const uint8_t *msg, size_t len){
+  sha512_update(ctx, msg, len);
+}
+
+void sha512_256_final(sha512_256_ctx *ctx, uint8_t digest[32]){
+  sha512_finish(ctx, digest, 32);
+}
+
+int sha512_256_sum(uint8_t *initial_msg, size_t initial_len,
+                   uint8_t digest[32]){
+  sha512_256_ctx ctx;
+
+  sha512_256_init(&ctx);
+  sha512_256_update(&ctx, initial_msg, initial_len);
+  sha512_256_final(&ctx, digest);
+
+  return 0;
+}
+
+void sha512_256_sum_batch(const uint8_t *const *msgs, const size_t *lens,
+                          size_t count, uint8_t *digests){
+  sha2_sum_batch(&sha512_256_mb, sha512_256_sum, msgs, lens, count, digests);
+}
 
-  //Process the message in successive 1024-bit chunks:
-  size_t offset;
-  //for each 1024-bit chunk of padded message
-  for(offset = 0; offset < new_len; offset += (1024/8)){
+void sha256_blocks_scalar(uint32_t state[8], const uint8_t *data,
+                          size_t blocks){
+  //for each 512-bit chunk of the message
+  for(; blocks; blocks--, data += (512/8)){
+    //break chunk into sixteen 32-bit words w[j], 0 ≤ j ≤ 15
+    uint32_t msg[16];
     int i;
-    uint64_t t1;
-    uint64_t t2;
-    //break chunk into sixteen 64-bit words w[j], 0 ≤ j ≤ 15
-    uint64_t w[80] = {0};
     for(i = 0; i < 16; i++){
-      w[i]  = (0xFFFFFFFFFFFFFFFF & msg[i * 8 + 0 + offset]) << 56;
-      w[i] |= (0xFFFFFFFFFFFFFFFF & msg[i * 8 + 1 + offset]) << 48;
-      w[i] |= (0xFFFFFFFFFFFFFFFF & msg[i * 8 + 2 + offset]) << 40;
-      w[i] |= (0xFFFFFFFFFFFFFFFF & msg[i * 8 + 3 + offset]) << 32;
-      w[i] |= (0xFFFFFFFFFFFFFFFF & msg[i * 8 + 4 + offset]) << 24;
-      w[i] |= (0xFFFFFFFFFFFFFFFF & msg[i * 8 + 5 + offset]) << 16;
-      w[i] |= (0xFFFFFFFFFFFFFFFF & msg[i * 8 + 6 + offset]) << 8;
-      w[i] |= (0xFFFFFFFFFFFFFFFF & msg[i * 8 + 7 + offset]);
+      msg[i] = LOAD32_BE(data + 4 * i);
     }
 
-    //Extend the sixteen 64-bit words into eighty 64-bit words:
-    for(i = 16 ; i< 80; i++){
-      w[i] = SIG1_512(w[i - 2]) + w[i - 7] + SIG0_512(w[i - 15]) + w[i - 16];
-    }
+    MB_COMPRESS(X1, 1, 64, X1_LOAD, X1_STORE);
+  }
+}
 
-    // Initialize hash value for this chunk:
-    uint64_t a = h0;
-    uint64_t b = h1;
-    uint64_t c = h2;
-    uint64_t d = h3;
-    uint64_t e = h4;
-    uint64_t f = h5;
-    uint64_t g = h6;
-    uint64_t h = h7;
-
-    //Main loop:
-    for(i = 0; i < 80; i++){
-      t1 = h + EP1_512(e) + CH(e,f,g) + k[i] + w[i];
-		  t2 = EP0_512(a) + MAJ(a, b, c);
-      h = g;
-		  g = f;
-		  f = e;
-		  e = d + t1;
-		  d = c;
-		  c = b;
-		  b = a;
-      a = t1 + t2;
-    }
+#ifdef HASH_X86
+__attribute__((target("sha,sse4.1")))
+void sha256_blocks_shani(uint32_t h[8], const uint8_t *data, size_t blocks){
+  const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+                                      0x0405060700010203ULL);
+  __m128i tmp, msg, state0, state1;
+
+  //The instructions want the state as ABEF and CDGH
+  tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&h[0]), 0xb1);
+  state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&h[4]), 0x1b);
+  state0 = _mm_alignr_epi8(tmp, state1, 8);
+  state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+
+  for(; blocks; blocks--, data += (512/8)){
+    __m128i abef_save = state0;
+    __m128i cdgh_save = state1;
+    __m128i m0, m1, m2, m3;
+
+    m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 0)), mask);
+    m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)), mask);
+    m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)), mask);
+    m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)), mask);
+
+    SHA256_ROUNDS4_LAST(0, m0);
+    SHA256_ROUNDS4_LAST(1, m1);
+    m0 = _mm_sha256msg1_epu32(m0, m1);
+    SHA256_ROUNDS4_LAST(2, m2);
+    m1 = _mm_sha256msg1_epu32(m1, m2);
+
+    SHA256_ROUNDS4(3, m3, m2, m0);
+    SHA256_ROUNDS4(4, m0, m3, m1);
+    SHA256_ROUNDS4(5, m1, m0, m2);
+    SHA256_ROUNDS4(6, m2, m1, m3);
+    SHA256_ROUNDS4(7, m3, m2, m0);
+    SHA256_ROUNDS4(8, m0, m3, m1);
+    SHA256_ROUNDS4(9, m1, m0, m2);
+    SHA256_ROUNDS4(10, m2, m1, m3);
+    SHA256_ROUNDS4(11, m3, m2, m0);
+    SHA256_ROUNDS4(12, m0, m3, m1);
+
+    //The last two extensions have no msg1 step left to do
+    m2 = _mm_add_epi32(m2, _mm_alignr_epi8(m1, m0, 4));
+    m2 = _mm_sha256msg2_epu32(m2, m1);
+    SHA256_ROUNDS4_LAST(13, m1);
+    m3 = _mm_add_epi32(m3, _mm_alignr_epi8(m2, m1, 4));
+    m3 = _mm_sha256msg2_epu32(m3, m2);
+    SHA256_ROUNDS4_LAST(14, m2);
+    SHA256_ROUNDS4_LAST(15, m3);
 
     //Add this chunk's hash to result so far:
-    h0 += a;
-    h1 += b;
-    h2 += c;
-    h3 += d;
-    h4 += e;
-    h5 += f;
-    h6 += g;
-    h7 += h;
+    state0 = _mm_add_epi32(state0, abef_save);
+    state1 = _mm_add_epi32(state1, cdgh_save);
   }
 
-  digest[ 0] = (h0 >> 56) & 0xff;
-  digest[ 1] = (h0 >> 48) & 0xff;
-  digest[ 2] = (h0 >> 40) & 0xff;
-  digest[ 3] = (h0 >> 32) & 0xff;
-  digest[ 4] = (h0 >> 24) & 0xff;
-  digest[ 5] = (h0 >> 16) & 0xff;
-  digest[ 6] = (h0 >>  8) & 0xff;
-  digest[ 7] = (h0      ) & 0xff;
-
-  digest[ 8] = (h1 >> 56) & 0xff;
-  digest[ 9] = (h1 >> 48) & 0xff;
-  digest[10] = (h1 >> 40) & 0xff;
-  digest[11] = (h1 >> 32) & 0xff;
-  digest[12] = (h1 >> 24) & 0xff;
-  digest[13] = (h1 >> 16) & 0xff;
-  digest[14] = (h1 >>  8) & 0xff;
-  digest[15] = (h1      ) & 0xff;
-
-  digest[16] = (h2 >> 56) & 0xff;
-  digest[17] = (h2 >> 48) & 0xff;
-  digest[18] = (h2 >> 40) & 0xff;
-  digest[19] = (h2 >> 32) & 0xff;
-  digest[20] = (h2 >> 24) & 0xff;
-  digest[21] = (h2 >> 16) & 0xff;
-  digest[22] = (h2 >>  8) & 0xff;
-  digest[23] = (h2      ) & 0xff;
-
-  digest[24] = (h3 >> 56) & 0xff;
-  digest[25] = (h3 >> 48) & 0xff;
-  digest[26] = (h3 >> 40) & 0xff;
-  digest[27] = (h3 >> 32) & 0xff;
-  digest[28] = (h3 >> 24) & 0xff;
-  digest[29] = (h3 >> 16) & 0xff;
-  digest[30] = (h3 >>  8) & 0xff;
-  digest[31] = (h3      ) & 0xff;
-
-  digest[32] = (h4 >> 56) & 0xff;
-  digest[33] = (h4 >> 48) & 0xff;
-  digest[34] = (h4 >> 40) & 0xff;
-  digest[35] = (h4 >> 32) & 0xff;
-  digest[36] = (h4 >> 24) & 0xff;
-  digest[37] = (h4 >> 16) & 0xff;
-  digest[38] = (h4 >>  8) & 0xff;
-  digest[39] = (h4      ) & 0xff;
-
-  digest[40] = (h5 >> 56) & 0xff;
-  digest[41] = (h5 >> 48) & 0xff;
-  digest[42] = (h5 >> 40) & 0xff;
-  digest[43] = (h5 >> 32) & 0xff;
-  digest[44] = (h5 >> 24) & 0xff;
-  digest[45] = (h5 >> 16) & 0xff;
-  digest[46] = (h5 >>  8) & 0xff;
-  digest[47] = (h5      ) & 0xff;
-
-  digest[48] = (h6 >> 56) & 0xff;
-  digest[49] = (h6 >> 48) & 0xff;
-  digest[50] = (h6 >> 40) & 0xff;
-  digest[51] = (h6 >> 32) & 0xff;
-  digest[52] = (h6 >> 24) & 0xff;
-  digest[53] = (h6 >> 16) & 0xff;
-  digest[54] = (h6 >>  8) & 0xff;
-  digest[55] = (h6      ) & 0xff;
-
-  digest[56] = (h7 >> 56) & 0xff;
-  digest[57] = (h7 >> 48) & 0xff;
-  digest[58] = (h7 >> 40) & 0xff;
-  digest[59] = (h7 >> 32) & 0xff;
-  digest[60] = (h7 >> 24) & 0xff;
-  digest[61] = (h7 >> 16) & 0xff;
-  digest[62] = (h7 >>  8) & 0xff;
-  digest[63] = (h7      ) & 0xff;
-
-  free(msg);
-
-  return 0;
+  //Back from ABEF and CDGH to ABCD and EFGH
+  tmp = _mm_shuffle_epi32(state0, 0x1b);
+  state1 = _mm_shuffle_epi32(state1, 0xb1);
+  _mm_storeu_si128((__m128i *)&h[0], _mm_blend_epi16(tmp, state1, 0xf0));
+  _mm_storeu_si128((__m128i *)&h[4], _mm_alignr_epi8(state1, tmp, 8));
 }
 
-int sha512_sum(uint8_t *initial_msg, size_t initial_len, uint8_t *digest){
-  //Initialize variables:
-  uint64_t h0 = 0x6a09e667f3bcc908; //A
-  uint64_t h1 = 0xbb67ae8584caa73b; //B
-  uint64_t h2 = 0x3c6ef372fe94f82b; //C
-  uint64_t h3 = 0xa54ff53a5f1d36f1; //D
-  uint64_t h4 = 0x510e527fade682d1; //E
-  uint64_t h5 = 0x9b05688c2b3e6c1f; //F
-  uint64_t h6 = 0x1f83d9abfb41bd6b; //G
-  uint64_t h7 = 0x5be0cd19137e2179; //H
-
-  uint64_t k[80] = {0x428a2f98d728ae22, 0x7137449123ef65cd, 0xb5c0fbcfec4d3b2f,
-                    0xe9b5dba58189dbbc, 0x3956c25bf348b538, 0x59f111f1b605d019,
-                    0x923f82a4af194f9b, 0xab1c5ed5da6d8118, 0xd807aa98a3030242,
-                    0x12835b0145706fbe, 0x243185be4ee4b28c, 0x550c7dc3d5ffb4e2,
-                    0x72be5d74f27b896f, 0x80deb1fe3b1696b1, 0x9bdc06a725c71235,
-                    0xc19bf174cf692694, 0xe49b69c19ef14ad2, 0xefbe4786384f25e3,
-                    0x0fc19dc68b8cd5b5, 0x240ca1cc77ac9c65, 0x2de92c6f592b0275,
-                    0x4a7484aa6ea6e483, 0x5cb0a9dcbd41fbd4, 0x76f988da831153b5,
-                    0x983e5152ee66dfab, 0xa831c66d2db43210, 0xb00327c898fb213f,
-                    0xbf597fc7beef0ee4, 0xc6e00bf33da88fc2, 0xd5a79147930aa725,
-                    0x06ca6351e003826f, 0x142929670a0e6e70, 0x27b70a8546d22ffc,
-                    0x2e1b21385c26c926, 0x4d2c6dfc5ac42aed, 0x53380d139d95b3df,
-                    0x650a73548baf63de, 0x766a0abb3c77b2a8, 0x81c2c92e47edaee6,
-                    0x92722c851482353b, 0xa2bfe8a14cf10364, 0xa81a664bbc423001,
-                    0xc24b8b70d0f89791, 0xc76c51a30654be30, 0xd192e819d6ef5218,
-                    0xd69906245565a910, 0xf40e35855771202a, 0x106aa07032bbd1b8,
-                    0x19a4c116b8d2d0c8, 0x1e376c085141ab53, 0x2748774cdf8eeb99,
-                    0x34b0bcb5e19b48a8, 0x391c0cb3c5c95a63, 0x4ed8aa4ae3418acb,
-                    0x5b9cca4f7763e373, 0x682e6ff3d6b2b8a3, 0x748f82ee5defb2fc,
-                    0x78a5636f43172f60, 0x84c87814a1f0ab72, 0x8cc702081a6439ec,
-                    0x90befffa23631e28, 0xa4506cebde82bde9, 0xbef9a3f7b2c67915,
-                    0xc67178f2e372532b, 0xca273eceea26619c, 0xd186b8c721c0c207,
-                    0xeada7dd6cde0eb1e, 0xf57d4f7fee6ed178, 0x06f067aa72176fba,
-                    0x0a637dc5a2c898a6, 0x113f9804bef90dae, 0x1b710b35131c471b,
-                    0x28db77f523047d84, 0x32caab7b40c72493, 0x3c9ebe0a15c9bebc,
-                    0x431d67c49c100d4c, 0x4cc5d4becb3e42b6, 0x597f299cfc657e2a,
-                    0x5fcb6fab3ad6faec, 0x6c44198c4a475817};
-
-  //Pre-processing:
-  uint8_t *msg = NULL;
-
-  size_t new_len;
-  new_len = initial_len*8 + 1 + sizeof(uint128_t)*8;
-  new_len += (1024-(new_len%1024))%1024;
-  new_len /= 8;
-
-  msg = calloc(new_len, sizeof(uint8_t));
-  if(msg == NULL){//calloc failed
-    return -1;
-  }
+__attribute__((target("avx2")))
+void sha256_x8_avx2(void *lanes, const void *block){
+  uint32_t *state = lanes;
+  const uint32_t *msg = block;
 
-  memcpy(msg, initial_msg, initial_len);
-  msg[initial_len] = 0x80; // appending single bit to the message
+  MB_COMPRESS(X8, 8, 64, X8_LOAD, X8_STORE);
+}
 
-  //append original length in bits mod 2^128
-  uint128_t bits_len = __bswap_128(8*(uint128_t)initial_len);
-  memcpy(msg + new_len - sizeof(uint128_t), &bits_len, sizeof(uint128_t));
+__attribute__((target("avx512f")))
+void sha256_x16_avx512(void *lanes, const void *block){
+  uint32_t *state = lanes;
+  const uint32_t *msg = block;
 
-  //Process the message in successive 1024-bit chunks:
-  size_t offset;
-  //for each 1024-bit chunk of padded message
-  for(offset = 0; offset < new_len; offset += (1024/8)){
-    int i;
-    uint64_t t1;
-    uint64_t t2;
+  MB_COMPRESS(X16, 16, 64, X16_LOAD, X16_STORE);
+}
+#endif
+
+void sha512_blocks_scalar(uint64_t state[8], const uint8_t *data,
+                          size_t blocks){
+  //for each 1024-bit chunk of the message
+  for(; blocks; blocks--, data += (1024/8)){
     //break chunk into sixteen 64-bit words w[j], 0 ≤ j ≤ 15
-    uint64_t w[80] = {0};
+    uint64_t msg[16];
+    int i;
     for(i = 0; i < 16; i++){
-      w[i]  = (0xFFFFFFFFFFFFFFFF & msg[i * 8 + 0 + offset]) << 56;
-      w[i] |= (0xFFFFFFFFFFFFFFFF & msg[i * 8 + 1 + offset]) << 48;
-      w[i] |= (0xFFFFFFFFFFFFFFFF & msg[i * 8 + 2 + offset]) << 40;
-      w[i] |= (0xFFFFFFFFFFFFFFFF & msg[i * 8 + 3 + offset]) << 32;
-      w[i] |= (0xFFFFFFFFFFFFFFFF & msg[i * 8 + 4 + offset]) << 24;
-      w[i] |= (0xFFFFFFFFFFFFFFFF & msg[i * 8 + 5 + offset]) << 16;
-      w[i] |= (0xFFFFFFFFFFFFFFFF & msg[i * 8 + 6 + offset]) << 8;
-      w[i] |= (0xFFFFFFFFFFFFFFFF & msg[i * 8 + 7 + offset]);
+      msg[i] = LOAD64_BE(data + 8 * i);
+    }
+
+    MB_COMPRESS(Q1, 1, 80, Q1_LOAD, Q1_STORE);
+  }
+}
+
+#ifdef HASH_X86
+//The words are byte swapped with vpshufb and the schedule is computed four
+//words at a time. Of the four, the last two need the sigma1 of the first
+//two, so sigma1 is applied twice.
+__attribute__((target("avx2,bmi2")))
+void sha512_blocks_avx2(uint64_t state[8], const uint8_t *data,
+                        size_t blocks){
+  const __m256i swap = _mm256_set_epi8(8, 9, 10, 11, 12, 13, 14, 15,
+                                       0, 1, 2, 3, 4, 5, 6, 7,
+                                       8, 9, 10, 11, 12, 13, 14, 15,
+                                       0, 1, 2, 3, 4, 5, 6, 7);
+  uint64_t w[80] __attribute__((aligned(32)));
+  uint64_t wk[80] __attribute__((aligned(32))); //w[i] + k512[i]
+
+  for(; blocks; blocks--, data += (1024/8)){
+    int i;
+
+    for(i = 0; i < 16; i += 4){
+      __m256i x = _mm256_loadu_si256((const __m256i *)(data + 8 * i));
+      x = _mm256_shuffle_epi8(x, swap);
+      _mm256_store_si256((__m256i *)&w[i], x);
+      _mm256_store_si256((__m256i *)&wk[i], _mm256_add_epi64(x,
+                         _mm256_loadu_si256((const __m256i *)&k512[i])));
     }
 
     //Extend the sixteen 64-bit words into eighty 64-bit words:
-    for(i = 16 ; i< 80; i++){
-      w[i] = SIG1_512(w[i - 2]) + w[i - 7] + SIG0_512(w[i - 15]) + w[i - 16];
+    for(i = 16; i < 80; i += 4){
+      __m256i x = _mm256_add_epi64(
+        _mm256_add_epi64(_mm256_load_si256((const __m256i *)&w[i - 16]),
+                         _mm256_loadu_si256((const __m256i *)&w[i - 7])),
+        MB_CALL(MB_SIG, Q4,
+                _mm256_loadu_si256((const __m256i *)&w[i - 15]),
+                MB_Q4_SIG0));
+      __m256i lo = MB_CALL(MB_SIG, Q4,
+                           _mm256_load_si256((const __m256i *)&w[i - 4]),
+                           MB_Q4_SIG1);
+      lo = _mm256_permute4x64_epi64(lo, 0xee);
+      __m256i hi = MB_CALL(MB_SIG, Q4, _mm256_add_epi64(x, lo), MB_Q4_SIG1);
+      hi = _mm256_permute4x64_epi64(hi, 0x44);
+      x = _mm256_add_epi64(x, _mm256_blend_epi32(lo, hi, 0xf0));
+      _mm256_store_si256((__m256i *)&w[i], x);
+      _mm256_store_si256((__m256i *)&wk[i], _mm256_add_epi64(x,
+                         _mm256_loadu_si256((const __m256i *)&k512[i])));
     }
 
     // Initialize hash value for this chunk:
-    uint64_t a = h0;
-    uint64_t b = h1;
-    uint64_t c = h2;
-    uint64_t d = h3;
-    uint64_t e = h4;
-    uint64_t f = h5;
-    uint64_t g = h6;
-    uint64_t h = h7;
-
-    //Main loop:
-    for(i = 0; i < 80; i++){
-      t1 = h + EP1_512(e) + CH(e,f,g) + k[i] + w[i];
-		  t2 = EP0_512(a) + MAJ(a, b, c);
-      h = g;
-		  g = f;
-		  f = e;
-		  e = d + t1;
-		  d = c;
-		  c = b;
-		  b = a;
-      a = t1 + t2;
+    uint64_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint64_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+    //Main loop, the constants are already in wk:
+    for(i = 0; i < 80; i += 8){
+      MB_ROUNDS8(Q1, i, SHA512_WK);
     }
 
     //Add this chunk's hash to result so far:
-    h0 += a;
-    h1 += b;
-    h2 += c;
-    h3 += d;
-    h4 += e;
-    h5 += f;
-    h6 += g;
-    h7 += h;
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
   }
+}
 
-  digest[ 0] = (h0 >> 56) & 0xff;
-  digest[ 1] = (h0 >> 48) & 0xff;
-  digest[ 2] = (h0 >> 40) & 0xff;
-  digest[ 3] = (h0 >> 32) & 0xff;
-  digest[ 4] = (h0 >> 24) & 0xff;
-  digest[ 5] = (h0 >> 16) & 0xff;
-  digest[ 6] = (h0 >>  8) & 0xff;
-  digest[ 7] = (h0      ) & 0xff;
-
-  digest[ 8] = (h1 >> 56) & 0xff;
-  digest[ 9] = (h1 >> 48) & 0xff;
-  digest[10] = (h1 >> 40) & 0xff;
-  digest[11] = (h1 >> 32) & 0xff;
-  digest[12] = (h1 >> 24) & 0xff;
-  digest[13] = (h1 >> 16) & 0xff;
-  digest[14] = (h1 >>  8) & 0xff;
-  digest[15] = (h1      ) & 0xff;
-
-  digest[16] = (h2 >> 56) & 0xff;
-  digest[17] = (h2 >> 48) & 0xff;
-  digest[18] = (h2 >> 40) & 0xff;
-  digest[19] = (h2 >> 32) & 0xff;
-  digest[20] = (h2 >> 24) & 0xff;
-  digest[21] = (h2 >> 16) & 0xff;
-  digest[22] = (h2 >>  8) & 0xff;
-  digest[23] = (h2      ) & 0xff;
-
-  digest[24] = (h3 >> 56) & 0xff;
-  digest[25] = (h3 >> 48) & 0xff;
-  digest[26] = (h3 >> 40) & 0xff;
-  digest[27] = (h3 >> 32) & 0xff;
-  digest[28] = (h3 >> 24) & 0xff;
-  digest[29] = (h3 >> 16) & 0xff;
-  digest[30] = (h3 >>  8) & 0xff;
-  digest[31] = (h3      ) & 0xff;
-
-  digest[32] = (h4 >> 56) & 0xff;
-  digest[33] = (h4 >> 48) & 0xff;
-  digest[34] = (h4 >> 40) & 0xff;
-  digest[35] = (h4 >> 32) & 0xff;
-  digest[36] = (h4 >> 24) & 0xff;
-  digest[37] = (h4 >> 16) & 0xff;
-  digest[38] = (h4 >>  8) & 0xff;
-  digest[39] = (h4      ) & 0xff;
-
-  digest[40] = (h5 >> 56) & 0xff;
-  digest[41] = (h5 >> 48) & 0xff;
-  digest[42] = (h5 >> 40) & 0xff;
-  digest[43] = (h5 >> 32) & 0xff;
-  digest[44] = (h5 >> 24) & 0xff;
-  digest[45] = (h5 >> 16) & 0xff;
-  digest[46] = (h5 >>  8) & 0xff;
-  digest[47] = (h5      ) & 0xff;
-
-  digest[48] = (h6 >> 56) & 0xff;
-  digest[49] = (h6 >> 48) & 0xff;
-  digest[50] = (h6 >> 40) & 0xff;
-  digest[51] = (h6 >> 32) & 0xff;
-  digest[52] = (h6 >> 24) & 0xff;
-  digest[53] = (h6 >> 16) & 0xff;
-  digest[54] = (h6 >>  8) & 0xff;
-  digest[55] = (h6      ) & 0xff;
-
-  digest[56] = (h7 >> 56) & 0xff;
-  digest[57] = (h7 >> 48) & 0xff;
-  digest[58] = (h7 >> 40) & 0xff;
-  digest[59] = (h7 >> 32) & 0xff;
-  digest[60] = (h7 >> 24) & 0xff;
-  digest[61] = (h7 >> 16) & 0xff;
-  digest[62] = (h7 >>  8) & 0xff;
-  digest[63] = (h7      ) & 0xff;
-
-  free(msg);
+__attribute__((target("avx2")))
+void sha512_x4_avx2(void *lanes, const void *block){
+  uint64_t *state = lanes;
+  const uint64_t *msg = block;
 
-  return 0;
+  MB_COMPRESS(Q4, 4, 80, Q4_LOAD, Q4_STORE);
 }
 
+__attribute__((target("avx512f")))
+void sha512_x8_avx512(void *lanes, const void *block){
+  uint64_t *state = lanes;
+  const uint64_t *msg = block;
+
+  MB_COMPRESS(Q8, 8, 80, Q8_LOAD, Q8_STORE);
+}
+#endif
+
 /*---------------------------------------------------------------------------*/
 /* Static function definitions                                               */
 /*---------------------------------------------------------------------------*/
@@ -794,3 +870,156 @@ uint128_t __bswap_128(uint128_t num){
 
   return swapped;
 }
+
+//Every member of a family only differs in its initial hash value...
+static void sha256_start(sha256_ctx *ctx, const uint32_t iv[8]){
+  memcpy(ctx->h, iv, sizeof(ctx->h));
+  ctx->len = 0;
+}
+
+static void sha512_start(sha512_ctx *ctx, const uint64_t iv[8]){
+  memcpy(ctx->h, iv, sizeof(ctx->h));
+  ctx->len = 0;
+}
+
+//...and in how much of the state is written as the digest, len bytes
+static void sha256_finish(sha256_ctx *ctx, uint8_t *digest, size_t len){
+  size_t used = ctx->len % 64;
+
+  ctx->block[used++] = 0x80; // appending single bit to the message
+  if(used > 56){//No room left for the length
+    memset(ctx->block + used, 0, 64 - used);
+    sha256_blocks(ctx->h, ctx->block, 1);
+    used = 0;
+  }
+  memset(ctx->block + used, 0, 56 - used);
+
+  //append original length in bits mod 2^64
+  uint64_t bits_len = __bswap_64(8*ctx->len);
+  memcpy(ctx->block + 56, &bits_len, sizeof(uint64_t));
+  sha256_blocks(ctx->h, ctx->block, 1);
+
+  size_t i;
+  for(i = 0; i < len; i++){
+    digest[i] = (ctx->h[i / 4] >> (24 - 8 * (i % 4))) & 0xff;
+  }
+}
+
+static void sha512_finish(sha512_ctx *ctx, uint8_t *digest, size_t len){
+  size_t used = ctx->len % 128;
+
+  ctx->block[used++] = 0x80; // appending single bit to the message
+  if(used > 112){//No room left for the length
+    memset(ctx->block + used, 0, 128 - used);
+    sha512_blocks(ctx->h, ctx->block, 1);
+    used = 0;
+  }
+  memset(ctx->block + used, 0, 112 - used);
+
+  //append original length in bits mod 2^128
+  uint128_t bits_len = __bswap_128(8*ctx->len);
+  memcpy(ctx->block + 112, &bits_len, sizeof(uint128_t));
+  sha512_blocks(ctx->h, ctx->block, 1);
+
+  size_t i;
+  for(i = 0; i < len; i++){
+    digest[i] = (ctx->h[i / 8] >> (56 - 8 * (i % 8))) & 0xff;
+  }
+}
+
+static void sha256_use_scalar(void){
+  sha256_blocks = sha256_blocks_scalar;
+  sha256_mb.name = NULL;
+  sha256_mb.lanes = 0;
+  sha256_mb.blocks = NULL;
+  sha256_mb.single = sha256_blocks_any;
+  sha2_share(&sha224_mb, &sha256_mb);
+}
+
+static void sha512_use_scalar(void){
+  sha512_blocks = sha512_blocks_scalar;
+  sha512_mb.name = NULL;
+  sha512_mb.lanes = 0;
+  sha512_mb.blocks = NULL;
+  sha512_mb.single = sha512_blocks_any;
+  sha2_share(&sha384_mb, &sha512_mb);
+  sha2_share(&sha512_224_mb, &sha512_mb);
+  sha2_share(&sha512_256_mb, &sha512_mb);
+}
+
+#ifdef HASH_X86
+static void sha256_use_avx2(void){
+  sha256_mb.name = "avx2";
+  sha256_mb.lanes = 8;
+  sha256_mb.blocks = sha256_x8_avx2;
+  sha2_share(&sha224_mb, &sha256_mb);
+}
+
+//Eight lanes of AVX2 are slower than a single stream of SHA-NI, so batches
+//go one by one unless AVX-512 comes after
+static void sha256_use_shani(void){
+  sha256_blocks = sha256_blocks_shani;
+  sha256_mb.name = NULL;
+  sha256_mb.lanes = 0;
+  sha256_mb.blocks = NULL;
+  sha2_share(&sha224_mb, &sha256_mb);
+}
+
+static void sha256_use_avx512(void){
+  sha256_mb.name = "avx512";
+  sha256_mb.lanes = 16;
+  sha256_mb.blocks = sha256_x16_avx512;
+  sha2_share(&sha224_mb, &sha256_mb);
+}
+
+static void sha512_use_avx2(void){
+  sha512_blocks = sha512_blocks_avx2;
+  sha512_mb.name = "avx2";
+  sha512_mb.lanes = 4;
+  sha512_mb.blocks = sha512_x4_avx2;
+  sha2_share(&sha384_mb, &sha512_mb);
+  sha2_share(&sha512_224_mb, &sha512_mb);
+  sha2_share(&sha512_256_mb, &sha512_mb);
+}
+
+static void sha512_use_avx512(void){
+  sha512_mb.name = "avx512";
+  sha512_mb.lanes = 8;
+  sha512_mb.blocks = sha512_x8_avx512;
+  sha2_share(&sha384_mb, &sha512_mb);
+  sha2_share(&sha512_224_mb, &sha512_mb);
+  sha2_share(&sha512_256_mb, &sha512_mb);
+}
+#endif
+
+//The rest of a family hashes with the same functions as sha256 or sha512
+static void sha2_share(mb_kernel *kernel, const mb_kernel *from){
+  kernel->name = from->name;
+  kernel->lanes = from->lanes;
+  kernel->blocks = from->blocks;
+  kernel->single = from->single;
+}
+
+//Hashes the messages with kernel if it has lanes, one by one if not
+static void sha2_sum_batch(const mb_kernel *kernel,
+                           int (*sum)(uint8_t *, size_t, uint8_t *),
+                           const uint8_t *const *msgs, const size_t *lens,
+                           size_t count, uint8_t *digests){
+  size_t i;
+
+  if(kernel->lanes){
+    mb_hash(kernel, msgs, lens, count, digests);
+    return;
+  }
+  for(i = 0; i < count; i++){
+    sum((uint8_t *)msgs[i], lens[i], digests + i * kernel->digest_len);
+  }
+}
+
+static void sha256_blocks_any(void *h, const uint8_t *data, size_t blocks){
+  sha256_blocks(h, data, blocks);
+}
+
+static void sha512_blocks_any(void *h, const uint8_t *data, size_t blocks){
+  sha512_blocks(h, data, blocks);
+}
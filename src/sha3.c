@@ -0,0 +1,778 @@
+/**HashCheck********************************************************************
+
+  File        sha3.c
+
+  Resume      Compute the sha3 checksums and the shake128 and shake256
+              extendable outputs of a message.
+
+  Description All of them absorb the message into the 1600-bit Keccak state,
+              a rate of bytes at a time, and differ in the rate, in the bits
+              that separate their domains and in the length of the output.
+              The scalar permutation is fully unrolled and keeps some lanes
+              complemented, so chi needs a single NOT per row. Batches of
+              messages are hashed four at a time with AVX2.
+
+  See also    HashCheck.h
+
+  Autor       Raúl San Martín Aniceto
+
+  Copyright (c) 2018 Raúl San Martín Aniceto
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+******************************************************************************/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "HashCheck.h"
+
+#ifdef HASH_X86
+#include <immintrin.h>
+#endif
+
+/*---------------------------------------------------------------------------*/
+/* Constant declarations                                                     */
+/*---------------------------------------------------------------------------*/
+
+//Bytes absorbed per permutation, 200 minus twice the security level
+#define SHA3_224_RATE 144
+#define SHA3_256_RATE 136
+#define SHA3_384_RATE 104
+#define SHA3_512_RATE 72
+#define SHAKE128_RATE 168
+#define SHAKE256_RATE 136
+#define SHA3_MAX_RATE SHAKE128_RATE
+
+//First byte of the padding: the domain bits, 01 for sha3 and 1111 for
+//shake, followed by the first bit of pad10*1
+#define SHA3_PAD 0x06
+#define SHAKE_PAD 0x1f
+
+#define KECCAK_X4_LANES 4 //Messages keccak_x4_avx2 hashes at once
+
+static const uint64_t keccak_rc[24] = {
+  0x0000000000000001, 0x0000000000008082, 0x800000000000808A,
+  0x8000000080008000, 0x000000000000808B, 0x0000000080000001,
+  0x8000000080008081, 0x8000000000008009, 0x000000000000008A,
+  0x0000000000000088, 0x0000000080008009, 0x000000008000000A,
+  0x000000008000808B, 0x800000000000008B, 0x8000000000008089,
+  0x8000000000008003, 0x8000000000008002, 0x8000000000000080,
+  0x000000000000800A, 0x800000008000000A, 0x8000000080008081,
+  0x8000000000008080, 0x0000000080000001, 0x8000000080008008
+};
+
+//Lanes 1, 2, 8, 12, 17 and 20 of the scalar state are kept complemented,
+//the state of an empty message is this mask
+static const uint64_t keccak_complement[25] = {
+  0, ~0ULL, ~0ULL, 0, 0,
+  0, 0, 0, ~0ULL, 0,
+  0, 0, ~0ULL, 0, 0,
+  0, 0, ~0ULL, 0, 0,
+  ~0ULL, 0, 0, 0, 0
+};
+
+/*---------------------------------------------------------------------------*/
+/* Type declarations                                                         */
+/*---------------------------------------------------------------------------*/
+
+
+/*---------------------------------------------------------------------------*/
+/* Structure declarations                                                    */
+/*---------------------------------------------------------------------------*/
+
+typedef struct{//A message being hashed in a lane of keccak_x4_avx2
+  int busy;
+  size_t msg;                   //Index of the message
+  const uint8_t *data;          //Next full block of the message
+  size_t blocks;                //Blocks left, the last one is at last
+  uint8_t last[SHA3_MAX_RATE];  //Last bytes of the message and the padding
+}sha3_lane_t;
+
+/*---------------------------------------------------------------------------*/
+/* Macro declarations                                                        */
+/*---------------------------------------------------------------------------*/
+
+#define LEFTROTATE64(x, c) (((x) << (c)) | ((x) >> (64 - (c))))
+
+//Little-endian words at p, whatever its alignment
+#define LOAD32_LE(p) ((uint32_t)(p)[0] | (uint32_t)(p)[1] << 8 | \
+                      (uint32_t)(p)[2] << 16 | (uint32_t)(p)[3] << 24)
+#define LOAD64_LE(p) ((uint64_t)LOAD32_LE(p) | \
+                      (uint64_t)LOAD32_LE((p) + 4) << 32)
+
+//Operations on one lane, Q1, or on the same lane of four states, Q4, with
+//the same names so both share the rounds below. CHI_B to CHI_S are chi on
+//the rows b to s of the state, from the lanes b0 to b4 into e0 to e4: the
+//complemented lanes of the scalar state let most of its rows use OR and
+//AND alone, AVX2 has an AND-NOT of its own.
+#define Q1_T uint64_t
+#define Q1_LOAD(p) (*(p))
+#define Q1_STORE(p, x) (*(p) = (x))
+#define Q1_SET1(k) ((uint64_t)(k))
+#define Q1_XOR(x, y) ((x) ^ (y))
+#define Q1_ROL(x, n) LEFTROTATE64(x, n)
+#define Q1_CHI_B(e0, e1, e2, e3, e4, b0, b1, b2, b3, b4) \
+  do{ \
+    e0 = b0 ^ (b1 | b2); \
+    e1 = b1 ^ (~b2 | b3); \
+    e2 = b2 ^ (b3 & b4); \
+    e3 = b3 ^ (b4 | b0); \
+    e4 = b4 ^ (b0 & b1); \
+  }while(0)
+#define Q1_CHI_G(e0, e1, e2, e3, e4, b0, b1, b2, b3, b4) \
+  do{ \
+    e0 = b0 ^ (b1 | b2); \
+    e1 = b1 ^ (b2 & b3); \
+    e2 = b2 ^ (b3 | ~b4); \
+    e3 = b3 ^ (b4 | b0); \
+    e4 = b4 ^ (b0 & b1); \
+  }while(0)
+#define Q1_CHI_K(e0, e1, e2, e3, e4, b0, b1, b2, b3, b4) \
+  do{ \
+    uint64_t n3 = ~b3; \
+    e0 = b0 ^ (b1 | b2); \
+    e1 = b1 ^ (b2 & b3); \
+    e2 = b2 ^ (n3 & b4); \
+    e3 = n3 ^ (b4 | b0); \
+    e4 = b4 ^ (b0 & b1); \
+  }while(0)
+#define Q1_CHI_M(e0, e1, e2, e3, e4, b0, b1, b2, b3, b4) \
+  do{ \
+    uint64_t n3 = ~b3; \
+    e0 = b0 ^ (b1 & b2); \
+    e1 = b1 ^ (b2 | b3); \
+    e2 = b2 ^ (n3 | b4); \
+    e3 = n3 ^ (b4 & b0); \
+    e4 = b4 ^ (b0 | b1); \
+  }while(0)
+#define Q1_CHI_S(e0, e1, e2, e3, e4, b0, b1, b2, b3, b4) \
+  do{ \
+    uint64_t n1 = ~b1; \
+    e0 = b0 ^ (n1 & b2); \
+    e1 = n1 ^ (b2 | b3); \
+    e2 = b2 ^ (b3 & b4); \
+    e3 = b3 ^ (b4 | b0); \
+    e4 = b4 ^ (b0 & b1); \
+  }while(0)
+
+#ifdef HASH_X86
+#define Q4_T __m256i
+#define Q4_LOAD(p) _mm256_loadu_si256((const __m256i *)(p))
+#define Q4_STORE(p, x) _mm256_storeu_si256((__m256i *)(p), x)
+#define Q4_SET1(k) _mm256_set1_epi64x((long long)(k))
+#define Q4_XOR(x, y) _mm256_xor_si256(x, y)
+#define Q4_ROL(x, n) \
+  _mm256_or_si256(_mm256_slli_epi64(x, n), _mm256_srli_epi64(x, 64 - (n)))
+#define Q4_CHI_B(e0, e1, e2, e3, e4, b0, b1, b2, b3, b4) \
+  do{ \
+    e0 = _mm256_xor_si256(b0, _mm256_andnot_si256(b1, b2)); \
+    e1 = _mm256_xor_si256(b1, _mm256_andnot_si256(b2, b3)); \
+    e2 = _mm256_xor_si256(b2, _mm256_andnot_si256(b3, b4)); \
+    e3 = _mm256_xor_si256(b3, _mm256_andnot_si256(b4, b0)); \
+    e4 = _mm256_xor_si256(b4, _mm256_andnot_si256(b0, b1)); \
+  }while(0)
+#define Q4_CHI_G Q4_CHI_B
+#define Q4_CHI_K Q4_CHI_B
+#define Q4_CHI_M Q4_CHI_B
+#define Q4_CHI_S Q4_CHI_B
+#endif
+
+//The 25 lanes of a state, named by row, b to s, and column, a to u. Lane
+//x of row y is word 5 * y + x of the state
+#define KECCAK_DECLARE(V, A) \
+  V##_T A##ba, A##be, A##bi, A##bo, A##bu, A##ga, A##ge, A##gi, A##go, \
+        A##gu, A##ka, A##ke, A##ki, A##ko, A##ku, A##ma, A##me, A##mi, \
+        A##mo, A##mu, A##sa, A##se, A##si, A##so, A##su
+
+//Moves the lanes A from or to the state s, of lanes states side by side
+#define KECCAK_MOVE(OP, A, s, lanes) \
+  do{ \
+    OP(A##ba, &(s)[0 * (lanes)]);  OP(A##be, &(s)[1 * (lanes)]); \
+    OP(A##bi, &(s)[2 * (lanes)]);  OP(A##bo, &(s)[3 * (lanes)]); \
+    OP(A##bu, &(s)[4 * (lanes)]);  OP(A##ga, &(s)[5 * (lanes)]); \
+    OP(A##ge, &(s)[6 * (lanes)]);  OP(A##gi, &(s)[7 * (lanes)]); \
+    OP(A##go, &(s)[8 * (lanes)]);  OP(A##gu, &(s)[9 * (lanes)]); \
+    OP(A##ka, &(s)[10 * (lanes)]); OP(A##ke, &(s)[11 * (lanes)]); \
+    OP(A##ki, &(s)[12 * (lanes)]); OP(A##ko, &(s)[13 * (lanes)]); \
+    OP(A##ku, &(s)[14 * (lanes)]); OP(A##ma, &(s)[15 * (lanes)]); \
+    OP(A##me, &(s)[16 * (lanes)]); OP(A##mi, &(s)[17 * (lanes)]); \
+    OP(A##mo, &(s)[18 * (lanes)]); OP(A##mu, &(s)[19 * (lanes)]); \
+    OP(A##sa, &(s)[20 * (lanes)]); OP(A##se, &(s)[21 * (lanes)]); \
+    OP(A##si, &(s)[22 * (lanes)]); OP(A##so, &(s)[23 * (lanes)]); \
+    OP(A##su, &(s)[24 * (lanes)]); \
+  }while(0)
+
+#define Q1_GET(x, p) ((x) = Q1_LOAD(p))
+#define Q1_PUT(x, p) Q1_STORE(p, x)
+#define Q4_GET(x, p) ((x) = Q4_LOAD(p))
+#define Q4_PUT(x, p) Q4_STORE(p, x)
+
+//Lanes b0 to b4 of a row after theta, rho and pi: lane a of the state A,
+//plus d, rotated by r
+#define KECCAK_B(V, a, d, r) V##_ROL(V##_XOR(a, d), r)
+
+//Round i from the lanes A into the lanes E
+#define KECCAK_ROUND(V, A, E, i) \
+  do{ \
+    V##_T ca, ce, ci, co, cu, da, de, di, d_o, du; \
+    V##_T b0, b1, b2, b3, b4; \
+    ca = V##_XOR(V##_XOR(V##_XOR(A##ba, A##ga), V##_XOR(A##ka, A##ma)), \
+                 A##sa); \
+    ce = V##_XOR(V##_XOR(V##_XOR(A##be, A##ge), V##_XOR(A##ke, A##me)), \
+                 A##se); \
+    ci = V##_XOR(V##_XOR(V##_XOR(A##bi, A##gi), V##_XOR(A##ki, A##mi)), \
+                 A##si); \
+    co = V##_XOR(V##_XOR(V##_XOR(A##bo, A##go), V##_XOR(A##ko, A##mo)), \
+                 A##so); \
+    cu = V##_XOR(V##_XOR(V##_XOR(A##bu, A##gu), V##_XOR(A##ku, A##mu)), \
+                 A##su); \
+    da = V##_XOR(cu, V##_ROL(ce, 1)); \
+    de = V##_XOR(ca, V##_ROL(ci, 1)); \
+    di = V##_XOR(ce, V##_ROL(co, 1)); \
+    d_o = V##_XOR(ci, V##_ROL(cu, 1)); \
+    du = V##_XOR(co, V##_ROL(ca, 1)); \
+    b0 = V##_XOR(A##ba, da); \
+    b1 = KECCAK_B(V, A##ge, de, 44); \
+    b2 = KECCAK_B(V, A##ki, di, 43); \
+    b3 = KECCAK_B(V, A##mo, d_o, 21); \
+    b4 = KECCAK_B(V, A##su, du, 14); \
+    V##_CHI_B(E##ba, E##be, E##bi, E##bo, E##bu, b0, b1, b2, b3, b4); \
+    E##ba = V##_XOR(E##ba, V##_SET1(keccak_rc[i])); \
+    b0 = KECCAK_B(V, A##bo, d_o, 28); \
+    b1 = KECCAK_B(V, A##gu, du, 20); \
+    b2 = KECCAK_B(V, A##ka, da, 3); \
+    b3 = KECCAK_B(V, A##me, de, 45); \
+    b4 = KECCAK_B(V, A##si, di, 61); \
+    V##_CHI_G(E##ga, E##ge, E##gi, E##go, E##gu, b0, b1, b2, b3, b4); \
+    b0 = KECCAK_B(V, A##be, de, 1); \
+    b1 = KECCAK_B(V, A##gi, di, 6); \
+    b2 = KECCAK_B(V, A##ko, d_o, 25); \
+    b3 = KECCAK_B(V, A##mu, du, 8); \
+    b4 = KECCAK_B(V, A##sa, da, 18); \
+    V##_CHI_K(E##ka, E##ke, E##ki, E##ko, E##ku, b0, b1, b2, b3, b4); \
+    b0 = KECCAK_B(V, A##bu, du, 27); \
+    b1 = KECCAK_B(V, A##ga, da, 36); \
+    b2 = KECCAK_B(V, A##ke, de, 10); \
+    b3 = KECCAK_B(V, A##mi, di, 15); \
+    b4 = KECCAK_B(V, A##so, d_o, 56); \
+    V##_CHI_M(E##ma, E##me, E##mi, E##mo, E##mu, b0, b1, b2, b3, b4); \
+    b0 = KECCAK_B(V, A##bi, di, 62); \
+    b1 = KECCAK_B(V, A##go, d_o, 55); \
+    b2 = KECCAK_B(V, A##ku, du, 39); \
+    b3 = KECCAK_B(V, A##ma, da, 41); \
+    b4 = KECCAK_B(V, A##se, de, 2); \
+    V##_CHI_S(E##sa, E##se, E##si, E##so, E##su, b0, b1, b2, b3, b4); \
+  }while(0)
+
+//Keccak-f[1600] on the state s, of lanes states side by side. The 24
+//rounds are unrolled, going from A to E and back, so every round constant
+//is an immediate and no lane is copied
+#define KECCAK_F1600(V, s, lanes) \
+  do{ \
+    KECCAK_DECLARE(V, A); \
+    KECCAK_DECLARE(V, E); \
+    KECCAK_MOVE(V##_GET, A, s, lanes); \
+    KECCAK_ROUND(V, A, E, 0);  KECCAK_ROUND(V, E, A, 1); \
+    KECCAK_ROUND(V, A, E, 2);  KECCAK_ROUND(V, E, A, 3); \
+    KECCAK_ROUND(V, A, E, 4);  KECCAK_ROUND(V, E, A, 5); \
+    KECCAK_ROUND(V, A, E, 6);  KECCAK_ROUND(V, E, A, 7); \
+    KECCAK_ROUND(V, A, E, 8);  KECCAK_ROUND(V, E, A, 9); \
+    KECCAK_ROUND(V, A, E, 10); KECCAK_ROUND(V, E, A, 11); \
+    KECCAK_ROUND(V, A, E, 12); KECCAK_ROUND(V, E, A, 13); \
+    KECCAK_ROUND(V, A, E, 14); KECCAK_ROUND(V, E, A, 15); \
+    KECCAK_ROUND(V, A, E, 16); KECCAK_ROUND(V, E, A, 17); \
+    KECCAK_ROUND(V, A, E, 18); KECCAK_ROUND(V, E, A, 19); \
+    KECCAK_ROUND(V, A, E, 20); KECCAK_ROUND(V, E, A, 21); \
+    KECCAK_ROUND(V, A, E, 22); KECCAK_ROUND(V, E, A, 23); \
+    KECCAK_MOVE(V##_PUT, A, s, lanes); \
+  }while(0)
+
+/*---------------------------------------------------------------------------*/
+/* Static function prototypes                                                */
+/*---------------------------------------------------------------------------*/
+
+static void sha3_use_scalar(void);
+
+#ifdef HASH_X86
+static void sha3_use_avx2(void);
+#endif
+
+static void sha3_start(sha3_ctx *ctx, uint8_t rate, uint8_t pad);
+
+static void sha3_absorb(sha3_ctx *ctx, const uint8_t *msg, size_t len);
+
+static void sha3_finish(sha3_ctx *ctx, uint8_t *out, size_t len);
+
+static void sha3_xor_bytes(uint64_t a[25], size_t at, const uint8_t *msg,
+                           size_t len);
+
+static void sha3_blocks(uint64_t a[25], const uint8_t *data, size_t blocks,
+                        size_t rate);
+
+static void sha3_squeeze(uint64_t a[25], size_t rate, uint8_t *out,
+                         size_t len);
+
+static void sha3_sum_batch(size_t rate, uint8_t pad, size_t digest_len,
+                           const uint8_t *const *msgs, const size_t *lens,
+                           size_t count, uint8_t *digests);
+
+static void sha3_lane_start(sha3_lane_t *lane, uint64_t *state, unsigned l,
+                            size_t rate, uint8_t pad, size_t msg,
+                            const uint8_t *data, size_t len);
+
+static void sha3_lane_finish(sha3_lane_t *lane, const uint64_t *state,
+                             unsigned l, size_t rate, uint8_t *digest,
+                             size_t digest_len);
+
+/*---------------------------------------------------------------------------*/
+/* Variable declarations                                                     */
+/*---------------------------------------------------------------------------*/
+
+//Four state kernel of the batches, NULL to hash them one by one
+static void (*keccak_x4)(uint64_t state[100]) = NULL;
+
+//The permutation of a single message has no SIMD version: its lanes are
+//rotated by different amounts, so only batches use AVX2
+const hash_impl sha3_impls[] = {
+  {"scalar", 0, sha3_use_scalar},
+#ifdef HASH_X86
+  {"avx2", CPU_AVX2, sha3_use_avx2},
+#endif
+  {NULL, 0, NULL}
+};
+
+/*---------------------------------------------------------------------------*/
+/* Function definitions                                                      */
+/*---------------------------------------------------------------------------*/
+
+void sha3_224_init(sha3_224_ctx *ctx){
+  sha3_start(ctx, SHA3_224_RATE, SHA3_PAD);
+}
+
+void sha3_224_update(sha3_224_ctx *ctx, const uint8_t *msg, size_t len){
+  sha3_absorb(ctx, msg, len);
+}
+
+void sha3_224_final(sha3_224_ctx *ctx, uint8_t digest[28]){
+  sha3_finish(ctx, digest, 28);
+}
+
+int sha3_224_sum(uint8_t *initial_msg, size_t initial_len,
+                 uint8_t digest[28]){
+  sha3_224_ctx ctx;
+
+  sha3_224_init(&ctx);
+  sha3_224_update(&ctx, initial_msg, initial_len);
+  sha3_224_final(&ctx, digest);
+
+  return 0;
+}
+
+void sha3_224_sum_batch(const uint8_t *const *msgs, const size_t *lens,
+                        size_t count, uint8_t *digests){
+  sha3_sum_batch(SHA3_224_RATE, SHA3_PAD, 28, msgs, lens, count, digests);
+}
+
+void sha3_256_init(sha3_256_ctx *ctx){
+  sha3_start(ctx, SHA3_256_RATE, SHA3_PAD);
+}
+
+void sha3_256_update(sha3_256_ctx *ctx, const uint8_t *msg, size_t len){
+  sha3_absorb(ctx, msg, len);
+}
+
+void sha3_256_final(sha3_256_ctx *ctx, uint8_t digest[32]){
+  sha3_finish(ctx, digest, 32);
+}
+
+int sha3_256_sum(uint8_t *initial_msg, size_t initial_len,
+                 uint8_t digest[32]){
+  sha3_256_ctx ctx;
+
+  sha3_256_init(&ctx);
+  sha3_256_update(&ctx, initial_msg, initial_len);
+  sha3_256_final(&ctx, digest);
+
+  return 0;
+}
+
+void sha3_256_sum_batch(const uint8_t *const *msgs, const size_t *lens,
+                        size_t count, uint8_t *digests){
+  sha3_sum_batch(SHA3_256_RATE, SHA3_PAD, 32, msgs, lens, count, digests);
+}
+
+void sha3_384_init(sha3_384_ctx *ctx){
+  sha3_start(ctx, SHA3_384_RATE, SHA3_PAD);
+}
+
+void sha3_384_update(sha3_384_ctx *ctx, const uint8_t *msg, size_t len){
+  sha3_absorb(ctx, msg, len);
+}
+
+void sha3_384_final(sha3_384_ctx *ctx, uint8_t digest[48]){
+  sha3_finish(ctx, digest, 48);
+}
+
+int sha3_384_sum(uint8_t *initial_msg, size_t initial_len,
+                 uint8_t digest[48]){
+  sha3_384_ctx ctx;
+
+  sha3_384_init(&ctx);
+  sha3_384_update(&ctx, initial_msg, initial_len);
+  sha3_384_final(&ctx, digest);
+
+  return 0;
+}
+
+void sha3_384_sum_batch(const uint8_t *const *msgs, const size_t *lens,
+                        size_t count, uint8_t *digests){
+  sha3_sum_batch(SHA3_384_RATE, SHA3_PAD, 48, msgs, lens, count, digests);
+}
+
+void sha3_512_init(sha3_512_ctx *ctx){
+  sha3_start(ctx, SHA3_512_RATE, SHA3_PAD);
+}
+
+void sha3_512_update(sha3_512_ctx *ctx, const uint8_t *msg, size_t len){
+  sha3_absorb(ctx, msg, len);
+}
+
+void sha3_512_final(sha3_512_ctx *ctx, uint8_t digest[64]){
+  sha3_finish(ctx, digest, 64);
+}
+
+int sha3_512_sum(uint8_t *initial_msg, size_t initial_len,
+                 uint8_t digest[64]){
+  sha3_512_ctx ctx;
+
+  sha3_512_init(&ctx);
+  sha3_512_update(&ctx, initial_msg, initial_len);
+  sha3_512_final(&ctx, digest);
+
+  return 0;
+}
+
+void sha3_512_sum_batch(const uint8_t *const *msgs, const size_t *lens,
+                        size_t count, uint8_t *digests){
+  sha3_sum_batch(SHA3_512_RATE, SHA3_PAD, 64, msgs, lens, count, digests);
+}
+
+void shake128_init(shake128_ctx *ctx){
+  sha3_start(ctx, SHAKE128_RATE, SHAKE_PAD);
+}
+
+void shake128_update(shake128_ctx *ctx, const uint8_t *msg, size_t len){
+  sha3_absorb(ctx, msg, len);
+}
+
+void shake128_final(shake128_ctx *ctx, uint8_t digest[32]){
+  sha3_finish(ctx, digest, 32);
+}
+
+int shake128_sum(uint8_t *initial_msg, size_t initial_len,
+                 uint8_t digest[32]){
+  shake128_ctx ctx;
+
+  shake128_init(&ctx);
+  shake128_update(&ctx, initial_msg, initial_len);
+  shake128_final(&ctx, digest);
+
+  return 0;
+}
+
+void shake128_sum_batch(const uint8_t *const *msgs, const size_t *lens,
+                        size_t count, uint8_t *digests){
+  sha3_sum_batch(SHAKE128_RATE, SHAKE_PAD, 32, msgs, lens, count, digests);
+}
+
+void shake256_init(shake256_ctx *ctx){
+  sha3_start(ctx, SHAKE256_RATE, SHAKE_PAD);
+}
+
+void shake256_update(shake256_ctx *ctx, const uint8_t *msg, size_t len){
+  sha3_absorb(ctx, msg, len);
+}
+
+void shake256_final(shake256_ctx *ctx, uint8_t digest[64]){
+  sha3_finish(ctx, digest, 64);
+}
+
+int shake256_sum(uint8_t *initial_msg, size_t initial_len,
+                 uint8_t digest[64]){
+  shake256_ctx ctx;
+
+  shake256_init(&ctx);
+  shake256_update(&ctx, initial_msg, initial_len);
+  shake256_final(&ctx, digest);
+
+  return 0;
+}
+
+void shake256_sum_batch(const uint8_t *const *msgs, const size_t *lens,
+                        size_t count, uint8_t *digests){
+  sha3_sum_batch(SHAKE256_RATE, SHAKE_PAD, 64, msgs, lens, count, digests);
+}
+
+void shake_squeeze(sha3_ctx *ctx, uint8_t *out, size_t len){
+  sha3_finish(ctx, out, len);
+}
+
+void keccak_f1600_scalar(uint64_t a[25]){
+  KECCAK_F1600(Q1, a, 1);
+}
+
+#ifdef HASH_X86
+__attribute__((target("avx2")))
+void keccak_x4_avx2(uint64_t state[100]){
+  KECCAK_F1600(Q4, state, KECCAK_X4_LANES);
+}
+#endif
+
+/*---------------------------------------------------------------------------*/
+/* Static function definitions                                               */
+/*---------------------------------------------------------------------------*/
+
+static void sha3_use_scalar(void){
+  keccak_x4 = NULL;
+}
+
+#ifdef HASH_X86
+static void sha3_use_avx2(void){
+  keccak_x4 = keccak_x4_avx2;
+}
+#endif
+
+//Every member differs in its rate and its padding...
+static void sha3_start(sha3_ctx *ctx, uint8_t rate, uint8_t pad){
+  memcpy(ctx->a, keccak_complement, sizeof(ctx->a));
+  ctx->rate = rate;
+  ctx->pos = 0;
+  ctx->pad = pad;
+}
+
+static void sha3_absorb(sha3_ctx *ctx, const uint8_t *msg, size_t len){
+  size_t rate = ctx->rate;
+  size_t blocks;
+
+  if(ctx->pos){//Complete the pending block first
+    size_t fill = rate - ctx->pos;
+    if(fill > len){
+      fill = len;
+    }
+    sha3_xor_bytes(ctx->a, ctx->pos, msg, fill);
+    ctx->pos += fill;
+    msg += fill;
+    len -= fill;
+    if(ctx->pos < rate){
+      return;
+    }
+    keccak_f1600_scalar(ctx->a);
+    ctx->pos = 0;
+  }
+
+  //Full blocks are absorbed in place
+  blocks = len / rate;
+  sha3_blocks(ctx->a, msg, blocks, rate);
+  msg += blocks * rate;
+  len -= blocks * rate;
+
+  sha3_xor_bytes(ctx->a, 0, msg, len);
+  ctx->pos = len;
+}
+
+//...and in how many bytes are squeezed out, len
+static void sha3_finish(sha3_ctx *ctx, uint8_t *out, size_t len){
+  size_t last = ctx->rate - 1;
+
+  ctx->a[ctx->pos / 8] ^= (uint64_t)ctx->pad << (8 * (ctx->pos % 8));
+  ctx->a[last / 8] ^= 0x80ULL << (8 * (last % 8));
+  keccak_f1600_scalar(ctx->a);
+  sha3_squeeze(ctx->a, ctx->rate, out, len);
+}
+
+//XORs len bytes of msg into the state from its byte at on
+static void sha3_xor_bytes(uint64_t a[25], size_t at, const uint8_t *msg,
+                           size_t len){
+  size_t i;
+
+  for(i = 0; i < len; i++, at++){
+    a[at / 8] ^= (uint64_t)msg[i] << (8 * (at % 8));
+  }
+}
+
+static void sha3_blocks(uint64_t a[25], const uint8_t *data, size_t blocks,
+                        size_t rate){
+  size_t i;
+
+  for(; blocks; blocks--, data += rate){
+    for(i = 0; i < rate / 8; i++){
+      a[i] ^= LOAD64_LE(data + 8 * i);
+    }
+    keccak_f1600_scalar(a);
+  }
+}
+
+//Writes len bytes of output of an already padded and permuted state, a
+//rate of bytes per permutation
+static void sha3_squeeze(uint64_t a[25], size_t rate, uint8_t *out,
+                         size_t len){
+  size_t i, w;
+
+  for(;;){
+    for(i = 0; (i < rate) && (i < len); i++){
+      w = i / 8;
+      out[i] = (uint8_t)((a[w] ^ keccak_complement[w]) >> (8 * (i % 8)));
+    }
+    if(len <= rate){
+      return;
+    }
+    out += rate;
+    len -= rate;
+    keccak_f1600_scalar(a);
+  }
+}
+
+//Hashes the messages four at a time with keccak_x4, the same way mb_hash
+//does for the md5 and sha2 kernels, or one by one if there is no kernel
+static void sha3_sum_batch(size_t rate, uint8_t pad, size_t digest_len,
+                           const uint8_t *const *msgs, const size_t *lens,
+                           size_t count, uint8_t *digests){
+  uint64_t state[25 * KECCAK_X4_LANES];
+  sha3_lane_t lanes[KECCAK_X4_LANES];
+  size_t next = 0;
+  unsigned busy = 0;
+  unsigned l;
+  size_t i;
+
+  if(keccak_x4 == NULL){
+    for(i = 0; i < count; i++){
+      sha3_ctx ctx;
+
+      sha3_start(&ctx, rate, pad);
+      sha3_absorb(&ctx, msgs[i], lens[i]);
+      sha3_finish(&ctx, digests + i * digest_len, digest_len);
+    }
+    return;
+  }
+
+  for(l = 0; l < KECCAK_X4_LANES; l++){
+    lanes[l].busy = 0;
+    if(next < count){
+      sha3_lane_start(&lanes[l], state, l, rate, pad, next, msgs[next],
+                      lens[next]);
+      next++;
+      busy++;
+    }
+  }
+
+  while(busy){
+    //Alone, the last message is faster in a single stream
+    if((busy == 1) && (next == count)){
+      for(l = 0; !lanes[l].busy; l++);
+      sha3_lane_finish(&lanes[l], state, l, rate,
+                       digests + lanes[l].msg * digest_len, digest_len);
+      break;
+    }
+
+    for(l = 0; l < KECCAK_X4_LANES; l++){
+      sha3_lane_t *lane = &lanes[l];
+      const uint8_t *block;
+
+      if(!lane->busy){
+        continue;
+      }
+      if(lane->blocks > 1){
+        block = lane->data;
+        lane->data += rate;
+      }else{
+        block = lane->last;
+      }
+      lane->blocks--;
+      for(i = 0; i < rate / 8; i++){
+        state[i * KECCAK_X4_LANES + l] ^= LOAD64_LE(block + 8 * i);
+      }
+    }
+    keccak_x4(state);
+
+    //Lanes done with their message take the next one
+    for(l = 0; l < KECCAK_X4_LANES; l++){
+      sha3_lane_t *lane = &lanes[l];
+      uint8_t *digest = digests + lane->msg * digest_len;
+
+      if(!lane->busy || lane->blocks){
+        continue;
+      }
+      for(i = 0; i < digest_len; i++){
+        digest[i] = (uint8_t)(state[(i / 8) * KECCAK_X4_LANES + l]
+                              >> (8 * (i % 8)));
+      }
+      lane->busy = 0;
+      busy--;
+      if(next < count){
+        sha3_lane_start(lane, state, l, rate, pad, next, msgs[next],
+                        lens[next]);
+        next++;
+        busy++;
+      }
+    }
+  }
+}
+
+//Loads message number msg into lane l, from an empty state, and pads its
+//last block
+static void sha3_lane_start(sha3_lane_t *lane, uint64_t *state, unsigned l,
+                            size_t rate, uint8_t pad, size_t msg,
+                            const uint8_t *data, size_t len){
+  size_t used = len % rate;
+  size_t w;
+
+  for(w = 0; w < 25; w++){
+    state[w * KECCAK_X4_LANES + l] = 0;
+  }
+
+  lane->busy = 1;
+  lane->msg = msg;
+  lane->data = data;
+  lane->blocks = len / rate + 1;
+
+  if(used){
+    memcpy(lane->last, data + len - used, used);
+  }
+  memset(lane->last + used, 0, rate - used);
+  lane->last[used] = pad;
+  lane->last[rate - 1] |= 0x80;
+}
+
+//Absorbs the rest of the message of lane l alone
+static void sha3_lane_finish(sha3_lane_t *lane, const uint64_t *state,
+                             unsigned l, size_t rate, uint8_t *digest,
+                             size_t digest_len){
+  uint64_t a[25];
+  size_t w;
+
+  for(w = 0; w < 25; w++){
+    a[w] = state[w * KECCAK_X4_LANES + l] ^ keccak_complement[w];
+  }
+  sha3_blocks(a, lane->data, lane->blocks - 1, rate);
+  sha3_blocks(a, lane->last, 1, rate);
+  sha3_squeeze(a, rate, digest, digest_len);
+  lane->busy = 0;
+}
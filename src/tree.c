@@ -0,0 +1,330 @@
+/**HashCheck********************************************************************
+
+  File        tree.c
+
+  Resume      Merkle tree hash of the chunks of a file, hashed in parallel.
+
+  See also    HashCheck.h
+
+  Autor       Raúl San Martín Aniceto
+
+  Copyright (c) 2018 Raúl San Martín Aniceto
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+******************************************************************************/
+
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "HashCheck.h"
+
+/*---------------------------------------------------------------------------*/
+/* Constant declarations                                                     */
+/*---------------------------------------------------------------------------*/
+
+#define TREE_BUFFER (1 << 20) //Bytes a thread reads at once
+
+#define TREE_MAX_THREADS 4096 //Same as the most --jobs
+
+//First byte hashed in every node, so a leaf can never pass for a parent
+#define TREE_LEAF 0x00
+#define TREE_PARENT 0x01
+
+/*---------------------------------------------------------------------------*/
+/* Type declarations                                                         */
+/*---------------------------------------------------------------------------*/
+
+
+/*---------------------------------------------------------------------------*/
+/* Structure declarations                                                    */
+/*---------------------------------------------------------------------------*/
+
+typedef struct{//Shared by the threads hashing the chunks of a file
+  const hash_algo *algo;
+  int fd;
+  off_t start;      //Offset of the first chunk
+  uint64_t size;    //Bytes from start to the end of the file
+  size_t chunk;
+  uint64_t chunks;
+  uint64_t next;    //First chunk no thread took yet
+  int err;          //errno of the first failure, 0 if none
+  uint8_t *leaves;  //digest_len bytes per chunk
+}tree_t;
+
+/*---------------------------------------------------------------------------*/
+/* Variable declarations                                                     */
+/*---------------------------------------------------------------------------*/
+
+
+/*---------------------------------------------------------------------------*/
+/* Macro declarations                                                        */
+/*---------------------------------------------------------------------------*/
+
+
+/*---------------------------------------------------------------------------*/
+/* Static function prototypes                                                */
+/*---------------------------------------------------------------------------*/
+
+static void *tree_thread(void *arg);
+
+static int tree_leaf(tree_t *tree, uint64_t index, uint8_t *buf,
+                     size_t buf_size);
+
+static int tree_stream(const hash_algo *algo, int fd, size_t chunk,
+                       uint8_t *digest);
+
+static void tree_root(const hash_algo *algo, uint8_t *nodes, uint64_t count,
+                      uint8_t *digest);
+
+/*---------------------------------------------------------------------------*/
+/* Function definitions                                                      */
+/*---------------------------------------------------------------------------*/
+
+int tree_hash_fd(const hash_algo *algo, int fd, size_t chunk,
+                 uint8_t *digest){
+  struct stat st;
+  tree_t tree;
+  unsigned i;
+
+  if(fstat(fd, &st)){
+    return -1;
+  }
+  //procfs and sysfs files report 0 bytes whatever they hold
+  tree.start = (S_ISREG(st.st_mode) && (st.st_size > 0))
+               ? lseek(fd, 0, SEEK_CUR) : -1;
+  if(tree.start < 0){//Pipes and terminals can only be read in order
+    return tree_stream(algo, fd, chunk, digest);
+  }
+
+  tree.algo = algo;
+  tree.fd = fd;
+  tree.size = (st.st_size > tree.start) ? st.st_size - tree.start : 0;
+  tree.chunk = chunk;
+  tree.chunks = tree.size ? (tree.size - 1) / chunk + 1 : 1;
+  tree.next = 0;
+  tree.err = 0;
+  if(tree.chunks > SIZE_MAX / algo->digest_len){
+    errno = ENOMEM;
+    return -1;
+  }
+  tree.leaves = malloc(tree.chunks * algo->digest_len);
+  if(tree.leaves == NULL){
+    return -1;
+  }
+
+  //The caller hashes chunks too, every other chunk may get a thread from
+  //the budget of hash_set_threads
+  uint64_t wanted = tree.chunks - 1;
+  unsigned threads = (wanted > TREE_MAX_THREADS) ? TREE_MAX_THREADS : wanted;
+  pthread_t *ids = threads ? calloc(threads, sizeof(pthread_t)) : NULL;
+  unsigned started = 0;
+  while((ids != NULL) && (started < threads) && hash_take_thread()){
+    if(pthread_create(&ids[started], NULL, tree_thread, &tree)){
+      hash_give_thread();
+      break;
+    }
+    started++;
+  }
+
+  tree_thread(&tree);
+  for(i = 0; i < started; i++){
+    pthread_join(ids[i], NULL);
+    hash_give_thread();
+  }
+  free(ids);
+
+  if(tree.err){
+    free(tree.leaves);
+    errno = tree.err;
+    return -1;
+  }
+  tree_root(algo, tree.leaves, tree.chunks, digest);
+  free(tree.leaves);
+
+  return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Static function definitions                                               */
+/*---------------------------------------------------------------------------*/
+
+//Takes chunks in order until none is left or a thread failed
+static void *tree_thread(void *arg){
+  tree_t *tree = arg;
+  size_t buf_size = (tree->chunk < TREE_BUFFER) ? tree->chunk : TREE_BUFFER;
+  uint8_t *buf = malloc(buf_size);
+  int err = 0;
+
+  if(buf == NULL){
+    err = ENOMEM;
+  }
+  while(!err && !__atomic_load_n(&tree->err, __ATOMIC_RELAXED)){
+    uint64_t index = __atomic_fetch_add(&tree->next, 1, __ATOMIC_RELAXED);
+    if(index >= tree->chunks){
+      break;
+    }
+    if(tree_leaf(tree, index, buf, buf_size)){
+      err = errno;
+    }
+  }
+  if(err){//Only the first failure is reported
+    int none = 0;
+    __atomic_compare_exchange_n(&tree->err, &none, err, 0, __ATOMIC_RELAXED,
+                                __ATOMIC_RELAXED);
+  }
+  free(buf);
+
+  return NULL;
+}
+
+//Hashes a chunk, read with pread so the threads share no file offset
+static int tree_leaf(tree_t *tree, uint64_t index, uint8_t *buf,
+                     size_t buf_size){
+  const hash_algo *algo = tree->algo;
+  const uint8_t prefix = TREE_LEAF;
+  uint64_t offset = index * tree->chunk;
+  uint64_t end = offset + tree->chunk;
+  hash_ctx ctx;
+
+  if(end > tree->size){
+    end = tree->size;
+  }
+  algo->init(&ctx);
+  algo->update(&ctx, &prefix, 1);
+  while(offset < end){
+    size_t len = (end - offset < buf_size) ? end - offset : buf_size;
+    ssize_t readed = pread(tree->fd, buf, len, tree->start + offset);
+    if(readed == 0){//The file shrank since fstat
+      errno = EIO;
+      return -1;
+    }
+    if(readed < 0){
+      if(errno == EINTR){
+        continue;
+      }
+      return -1;
+    }
+    algo->update(&ctx, buf, readed);
+    offset += readed;
+  }
+  algo->final(&ctx, tree->leaves + index * algo->digest_len);
+
+  return 0;
+}
+
+//Same tree as tree_hash_fd, for inputs of unknown size read in order by a
+//single thread
+static int tree_stream(const hash_algo *algo, int fd, size_t chunk,
+                       uint8_t *digest){
+  const uint8_t prefix = TREE_LEAF;
+  size_t buf_size = (chunk < TREE_BUFFER) ? chunk : TREE_BUFFER;
+  uint8_t *buf = malloc(buf_size);
+  uint8_t *leaves = NULL;
+  uint64_t count = 0;
+  uint64_t size = 0;
+  int eof = 0;
+  hash_ctx ctx;
+
+  if(buf == NULL){
+    return -1;
+  }
+  while(!eof){
+    size_t fed = 0;
+
+    algo->init(&ctx);
+    algo->update(&ctx, &prefix, 1);
+    while(fed < chunk){
+      size_t len = (chunk - fed < buf_size) ? chunk - fed : buf_size;
+      ssize_t readed = read(fd, buf, len);
+      if(readed == 0){//End of file
+        eof = 1;
+        break;
+      }
+      if(readed < 0){
+        if(errno == EINTR){
+          continue;
+        }
+        free(leaves);
+        free(buf);
+        return -1;
+      }
+      algo->update(&ctx, buf, readed);
+      fed += readed;
+    }
+    if((fed == 0) && (count > 0)){//Only an empty input has an empty chunk
+      break;
+    }
+
+    if(count == size){
+      uint64_t grown = size ? size * 2 : 64;
+      uint8_t *more = NULL;
+      if(grown <= SIZE_MAX / algo->digest_len){
+        more = realloc(leaves, grown * algo->digest_len);
+      }
+      if(more == NULL){
+        free(leaves);
+        free(buf);
+        errno = ENOMEM;
+        return -1;
+      }
+      leaves = more;
+      size = grown;
+    }
+    algo->final(&ctx, leaves + count++ * algo->digest_len);
+  }
+
+  tree_root(algo, leaves, count, digest);
+  free(leaves);
+  free(buf);
+
+  return 0;
+}
+
+//Replaces every pair of nodes, from the left, by their parent until a single
+//one is left. The last node of an odd level moves up unchanged.
+static void tree_root(const hash_algo *algo, uint8_t *nodes, uint64_t count,
+                      uint8_t *digest){
+  const uint8_t prefix = TREE_PARENT;
+  size_t len = algo->digest_len;
+  hash_ctx ctx;
+  uint64_t i;
+
+  while(count > 1){
+    for(i = 0; i + 1 < count; i += 2){
+      //The parent goes to slot i / 2, no longer needed once hashed
+      algo->init(&ctx);
+      algo->update(&ctx, &prefix, 1);
+      algo->update(&ctx, nodes + i * len, 2 * len);
+      algo->final(&ctx, nodes + i / 2 * len);
+    }
+    if(count % 2){
+      memmove(nodes + count / 2 * len, nodes + (count - 1) * len, len);
+    }
+    count = (count + 1) / 2;
+  }
+  memcpy(digest, nodes, len);
+}
@@ -0,0 +1,474 @@
+/**HashCheck********************************************************************
+
+  File        walk.c
+
+  Resume      Parallel walk of a directory tree.
+
+  See also    HashCheck.h
+
+  Autor       Raúl San Martín Aniceto
+
+  Copyright (c) 2018 Raúl San Martín Aniceto
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+******************************************************************************/
+
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "HashCheck.h"
+
+/*---------------------------------------------------------------------------*/
+/* Constant declarations                                                     */
+/*---------------------------------------------------------------------------*/
+
+#define DENTS_SIZE (32*1024) //Buffer for getdents64
+
+//Directories the threads may list ahead of the one being emitted, bounds
+//the memory of the listings waiting for their turn and their descriptors
+#define WALK_AHEAD 256
+
+enum{//Progress of a directory
+  DIR_PENDING,  //Queued, nobody took it yet
+  DIR_LISTING,
+  DIR_LISTED
+};
+
+/*---------------------------------------------------------------------------*/
+/* Type declarations                                                         */
+/*---------------------------------------------------------------------------*/
+
+
+/*---------------------------------------------------------------------------*/
+/* Structure declarations                                                    */
+/*---------------------------------------------------------------------------*/
+
+//Record returned by getdents64
+struct linux_dirent64{
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+typedef struct{//A file or a subdirectory of a listing
+  char *path;
+  size_t base;      //Offset of the name in path
+  walk_dir_t *dir;  //NULL for files
+}dirent_t;
+
+//A directory, listed by any thread and emitted by the caller. It is freed,
+//and closed, once the walk emitted it, every subdirectory was opened
+//relative to it and every file passed was released.
+struct walk_dir{
+  char *path;
+  const char *name;    //Last component of path
+  walk_dir_t *parent;  //Until this one is opened, NULL for the root
+  int fd;              //-1 if it could not be opened
+  unsigned refs;
+  int err;             //errno of the failure to list it, 0 if none
+  int state;           //DIR_*, under the lock of the walk
+  dirent_t *entries;   //Sorted by name once listed
+  size_t count;
+  size_t files;        //Entries that are files
+};
+
+typedef struct{
+  pthread_mutex_t lock;
+  pthread_cond_t work;    //A directory was queued or the walk is over
+  pthread_cond_t listed;  //A directory was listed
+  walk_dir_t **pending;   //Stack of the directories nobody took yet
+  size_t num_pending;
+  size_t size_pending;
+  size_t ahead;           //Directories taken and not emitted yet
+  int done;
+  int failed;             //Out of memory
+  walk_file_fn file;
+  walk_error_fn error;
+  void *arg;
+}walk_t;
+
+/*---------------------------------------------------------------------------*/
+/* Variable declarations                                                     */
+/*---------------------------------------------------------------------------*/
+
+
+/*---------------------------------------------------------------------------*/
+/* Macro declarations                                                        */
+/*---------------------------------------------------------------------------*/
+
+
+/*---------------------------------------------------------------------------*/
+/* Static function prototypes                                                */
+/*---------------------------------------------------------------------------*/
+
+static void *walk_thread(void *arg);
+
+static void walk_emit(walk_t *walk, walk_dir_t *dir);
+
+static void walk_list(walk_t *walk, walk_dir_t *dir);
+
+static int walk_read(walk_dir_t *dir);
+
+static walk_dir_t *dir_create(char *path, size_t base, walk_dir_t *parent);
+
+static char *join_path(const char *dir, const char *name, size_t *base);
+
+static int compare_entries(const void *a, const void *b);
+
+/*---------------------------------------------------------------------------*/
+/* Function definitions                                                      */
+/*---------------------------------------------------------------------------*/
+
+int walk_tree(const char *root, unsigned threads, walk_file_fn file,
+              walk_error_fn error, void *arg){
+  walk_t walk;
+  unsigned i;
+
+  memset(&walk, 0, sizeof(walk_t));
+  walk.file = file;
+  walk.error = error;
+  walk.arg = arg;
+  char *path = strdup(root);
+  walk_dir_t *top = (path != NULL) ? dir_create(path, 0, NULL) : NULL;
+  if(top == NULL){
+    free(path);
+    errno = ENOMEM;
+    return -1;
+  }
+  //The caller lists the root itself, threads is the caller and the rest
+  top->state = DIR_LISTING;
+  walk.ahead = 1;
+
+  pthread_mutex_init(&walk.lock, NULL);
+  pthread_cond_init(&walk.work, NULL);
+  pthread_cond_init(&walk.listed, NULL);
+
+  pthread_t *ids = (threads > 1) ? calloc(threads - 1, sizeof(pthread_t))
+                                 : NULL;
+  unsigned started = 0;
+  while((ids != NULL) && (started < threads - 1)){
+    if(pthread_create(&ids[started], NULL, walk_thread, &walk)){
+      break;
+    }
+    started++;
+  }
+
+  walk_list(&walk, top);
+  walk_emit(&walk, top);
+
+  pthread_mutex_lock(&walk.lock);
+  walk.done = 1;
+  pthread_cond_broadcast(&walk.work);
+  pthread_mutex_unlock(&walk.lock);
+  for(i = 0; i < started; i++){
+    pthread_join(ids[i], NULL);
+  }
+  free(ids);
+
+  pthread_cond_destroy(&walk.listed);
+  pthread_cond_destroy(&walk.work);
+  pthread_mutex_destroy(&walk.lock);
+  free(walk.pending);
+
+  if(walk.failed){
+    errno = ENOMEM;
+    return -1;
+  }
+  return 0;
+}
+
+void walk_release(walk_dir_t *dir){
+  if(__atomic_sub_fetch(&dir->refs, 1, __ATOMIC_ACQ_REL)){
+    return;
+  }
+  if(dir->fd >= 0){
+    close(dir->fd);
+  }
+  free(dir->path);
+  free(dir);
+}
+
+/*---------------------------------------------------------------------------*/
+/* Static function definitions                                               */
+/*---------------------------------------------------------------------------*/
+
+//Lists the directories queued most recently, the next ones the caller will
+//emit, while it is not too far ahead
+static void *walk_thread(void *arg){
+  walk_t *walk = arg;
+
+  pthread_mutex_lock(&walk->lock);
+  while(!walk->done){
+    if((walk->num_pending == 0) || (walk->ahead >= WALK_AHEAD)){
+      pthread_cond_wait(&walk->work, &walk->lock);
+      continue;
+    }
+    walk_dir_t *dir = walk->pending[--walk->num_pending];
+    dir->state = DIR_LISTING;
+    walk->ahead++;
+    pthread_mutex_unlock(&walk->lock);
+
+    walk_list(walk, dir);
+
+    pthread_mutex_lock(&walk->lock);
+  }
+  pthread_mutex_unlock(&walk->lock);
+
+  return NULL;
+}
+
+//Reports why dir could not be listed, if so, and passes the files below it
+//to the callback, depth first and in the order of the listings, all from
+//the calling thread. A directory nobody took yet is listed right here, so
+//the walk goes on even when the threads are busy or WALK_AHEAD is reached.
+static void walk_emit(walk_t *walk, walk_dir_t *dir){
+  size_t i;
+
+  if(dir->err){
+    walk->error(dir->path, dir->err, walk->arg);
+  }
+  for(i = 0; i < dir->count; i++){
+    dirent_t *entry = &dir->entries[i];
+
+    if(entry->dir == NULL){
+      __atomic_add_fetch(&dir->refs, 1, __ATOMIC_RELAXED);
+      walk->file(entry->path, entry->path + entry->base, dir->fd, dir,
+                 dir->files, walk->arg);
+      continue;
+    }
+
+    walk_dir_t *child = entry->dir;
+    pthread_mutex_lock(&walk->lock);
+    if(child->state == DIR_PENDING){
+      //It is usually on top, the threads take the newest first. It may
+      //be missing if there was no memory to queue it.
+      size_t j = walk->num_pending;
+      while((j > 0) && (walk->pending[j - 1] != child)){
+        j--;
+      }
+      if(j > 0){
+        memmove(&walk->pending[j - 1], &walk->pending[j],
+                (walk->num_pending - j) * sizeof(walk_dir_t *));
+        walk->num_pending--;
+      }
+      child->state = DIR_LISTING;
+      walk->ahead++;
+      pthread_mutex_unlock(&walk->lock);
+      walk_list(walk, child);
+    }else{
+      while(child->state != DIR_LISTED){
+        pthread_cond_wait(&walk->listed, &walk->lock);
+      }
+      pthread_mutex_unlock(&walk->lock);
+    }
+    walk_emit(walk, child);
+  }
+
+  pthread_mutex_lock(&walk->lock);
+  walk->ahead--;
+  pthread_cond_broadcast(&walk->work);
+  pthread_mutex_unlock(&walk->lock);
+  free(dir->entries); //The paths now belong to the callback and children
+  dir->entries = NULL;
+  walk_release(dir);
+}
+
+//Opens dir relative to its parent, so no path is resolved again and the
+//depth has no limit, lists it, sorts it and queues its subdirectories, the
+//first one on top
+static void walk_list(walk_t *walk, walk_dir_t *dir){
+  size_t i;
+
+  if(dir->parent == NULL){
+    dir->fd = open(dir->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  }else{
+    dir->fd = openat(dir->parent->fd, dir->name, O_RDONLY | O_DIRECTORY
+                     | O_NOFOLLOW | O_CLOEXEC);
+  }
+  if(dir->fd < 0){
+    dir->err = errno;
+  }else if(walk_read(dir)){
+    walk->failed = 1;
+  }
+  if(dir->parent != NULL){
+    walk_release(dir->parent);
+    dir->parent = NULL;
+  }
+  if(dir->count > 1){
+    qsort(dir->entries, dir->count, sizeof(dirent_t), compare_entries);
+  }
+
+  pthread_mutex_lock(&walk->lock);
+  for(i = dir->count; i > 0; i--){
+    walk_dir_t *child = dir->entries[i - 1].dir;
+    if(child == NULL){
+      continue;
+    }
+    if(walk->num_pending == walk->size_pending){
+      size_t size = walk->size_pending ? walk->size_pending * 2 : 64;
+      walk_dir_t **pending = realloc(walk->pending,
+                                     size * sizeof(walk_dir_t *));
+      if(pending == NULL){//Left for the caller, it lists what nobody took
+        walk->failed = 1;
+        break;
+      }
+      walk->pending = pending;
+      walk->size_pending = size;
+    }
+    walk->pending[walk->num_pending++] = child;
+  }
+  dir->state = DIR_LISTED;
+  pthread_cond_broadcast(&walk->listed);
+  pthread_cond_broadcast(&walk->work);
+  pthread_mutex_unlock(&walk->lock);
+}
+
+//Reads the entries of dir with getdents64. Returns -1 if there is not
+//enough memory for all of them.
+static int walk_read(walk_dir_t *dir){
+  char *dents = malloc(DENTS_SIZE);
+  size_t size = 0;
+  long readed;
+  int err = 0;
+
+  if(dents == NULL){
+    return -1;
+  }
+
+  while((readed = syscall(SYS_getdents64, dir->fd, dents, DENTS_SIZE)) > 0){
+    long offset;
+    for(offset = 0; offset < readed; ){
+      struct linux_dirent64 *dent = (struct linux_dirent64 *)(dents + offset);
+      const char *name = dent->d_name;
+      unsigned char type = dent->d_type;
+      offset += dent->d_reclen;
+
+      if(!strcmp(name, ".") || !strcmp(name, "..")){
+        continue;
+      }
+
+      struct stat st;
+      if(type == DT_UNKNOWN){//Not every filesystem fills d_type
+        if(fstatat(dir->fd, name, &st, AT_SYMLINK_NOFOLLOW)){
+          continue; //Removed meanwhile
+        }
+        type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG
+               : S_ISLNK(st.st_mode) ? DT_LNK : DT_UNKNOWN;
+      }
+      if(type == DT_LNK){//Links to files are hashed, never followed to dirs
+        if(fstatat(dir->fd, name, &st, 0) || !S_ISREG(st.st_mode)){
+          continue;
+        }
+        type = DT_REG;
+      }
+      if((type != DT_REG) && (type != DT_DIR)){
+        continue;
+      }
+
+      if(dir->count == size){
+        size_t grown = size ? size * 2 : 64;
+        dirent_t *entries = realloc(dir->entries, grown * sizeof(dirent_t));
+        if(entries == NULL){
+          err = -1;
+          continue;
+        }
+        dir->entries = entries;
+        size = grown;
+      }
+      dirent_t *entry = &dir->entries[dir->count];
+      entry->path = join_path(dir->path, name, &entry->base);
+      entry->dir = NULL;
+      if((entry->path != NULL) && (type == DT_DIR)){
+        entry->dir = dir_create(entry->path, entry->base, dir);
+        if(entry->dir == NULL){
+          free(entry->path);
+          entry->path = NULL;
+        }
+      }
+      if(entry->path == NULL){
+        err = -1;
+        continue;
+      }
+      dir->files += (type == DT_REG);
+      dir->count++;
+    }
+  }
+  if(readed < 0){
+    dir->err = errno;
+  }
+
+  free(dents);
+  return err;
+}
+
+//A directory referenced once, by the walk, that references its parent
+static walk_dir_t *dir_create(char *path, size_t base, walk_dir_t *parent){
+  walk_dir_t *dir = calloc(1, sizeof(walk_dir_t));
+
+  if(dir != NULL){
+    dir->path = path;
+    dir->name = path + base;
+    dir->parent = parent;
+    dir->fd = -1;
+    dir->refs = 1;
+    dir->state = DIR_PENDING;
+    if(parent != NULL){
+      __atomic_add_fetch(&parent->refs, 1, __ATOMIC_RELAXED);
+    }
+  }
+  return dir;
+}
+
+//Sets base to the offset of name in the result
+static char *join_path(const char *dir, const char *name, size_t *base){
+  size_t dir_len = strlen(dir);
+  size_t name_len = strlen(name);
+  int slash = (dir_len > 0) && (dir[dir_len - 1] != '/');
+  char *path = malloc(dir_len + slash + name_len + 1);
+
+  if(path == NULL){
+    return NULL;
+  }
+  memcpy(path, dir, dir_len);
+  if(slash){
+    path[dir_len] = '/';
+  }
+  memcpy(path + dir_len + slash, name, name_len + 1);
+  *base = dir_len + slash;
+  return path;
+}
+
+//Siblings share the path up to their names
+static int compare_entries(const void *a, const void *b){
+  return strcmp(((const dirent_t *)a)->path, ((const dirent_t *)b)->path);
+}
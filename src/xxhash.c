@@ -0,0 +1,790 @@
+/**HashCheck********************************************************************
+
+  File        xxhash.c
+
+  Resume      Compute the xxh64, xxh3 and xxh128 checksums of a message.
+
+  Description The xxHash checksums are not cryptographic: they only catch
+              accidental corruption, at the speed of the memory. xxh64 runs
+              four 64-bit accumulators on stripes of 32 bytes. xxh3 and
+              xxh128 mix messages of up to 240 bytes with the default secret
+              and run eight accumulators on stripes of 64 bytes of longer
+              ones, which the SIMD kernels hold in vectors. Both are computed
+              without a seed, and printed as the big-endian canonical form.
+
+  See also    HashCheck.h
+
+  Autor       Raúl San Martín Aniceto
+
+  Copyright (c) 2018 Raúl San Martín Aniceto
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+******************************************************************************/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "HashCheck.h"
+
+#ifdef HASH_X86
+#include <immintrin.h>
+#endif
+
+/*---------------------------------------------------------------------------*/
+/* Constant declarations                                                     */
+/*---------------------------------------------------------------------------*/
+
+#define XXH64_STRIPE_LEN 32
+#define XXH3_STRIPE_LEN 64
+#define XXH3_SECRET_LEN 192
+#define XXH3_BLOCK_STRIPES 16  //(XXH3_SECRET_LEN - 64) / 8, then a scramble
+#define XXH3_BUFFER_LEN 256    //Bytes xxh3_update keeps
+#define XXH3_MIDSIZE_MAX 240   //Longest message without accumulators
+
+#define XXH_PRIME32_1 0x9E3779B1U
+#define XXH_PRIME32_2 0x85EBCA77U
+#define XXH_PRIME32_3 0xC2B2AE3DU
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+#define XXH_PRIME_MX1 0x165667919E3779F9ULL
+#define XXH_PRIME_MX2 0x9FB21C651E98DF25ULL
+
+//The default secret of xxh3 and xxh128
+static const uint8_t xxh3_secret[XXH3_SECRET_LEN] = {
+  0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c,
+  0xf7, 0x21, 0xad, 0x1c, 0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb,
+  0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f, 0xcb, 0x79, 0xe6, 0x4e,
+  0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+  0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6,
+  0x81, 0x3a, 0x26, 0x4c, 0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb,
+  0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3, 0x71, 0x64, 0x48, 0x97,
+  0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+  0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7,
+  0xc7, 0x0b, 0x4f, 0x1d, 0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31,
+  0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64, 0xea, 0xc5, 0xac, 0x83,
+  0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+  0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26,
+  0x29, 0xd4, 0x68, 0x9e, 0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc,
+  0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce, 0x45, 0xcb, 0x3a, 0x8f,
+  0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e
+};
+
+/*---------------------------------------------------------------------------*/
+/* Type declarations                                                         */
+/*---------------------------------------------------------------------------*/
+
+//Accumulates stripes stripes, see xxh3_stripes_scalar
+typedef void (*xxh3_stripes_fn)(uint64_t acc[8], const uint8_t *input,
+                                size_t stripes, unsigned *done);
+
+/*---------------------------------------------------------------------------*/
+/* Structure declarations                                                    */
+/*---------------------------------------------------------------------------*/
+
+
+/*---------------------------------------------------------------------------*/
+/* Macro declarations                                                        */
+/*---------------------------------------------------------------------------*/
+
+#define LEFTROTATE(x, c) (((x) << (c)) | ((x) >> (32 - (c))))
+#define LEFTROTATE64(x, c) (((x) << (c)) | ((x) >> (64 - (c))))
+
+//Little-endian words at p, whatever its alignment. xxh3 reads every byte
+//once at memory speed, so they are single loads on little-endian hosts
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define LOAD32_LE(p) xxh_load32(p)
+#define LOAD64_LE(p) xxh_load64(p)
+#else
+#define LOAD32_LE(p) ((uint32_t)(p)[0] | (uint32_t)(p)[1] << 8 | \
+                      (uint32_t)(p)[2] << 16 | (uint32_t)(p)[3] << 24)
+#define LOAD64_LE(p) ((uint64_t)LOAD32_LE(p) | \
+                      (uint64_t)LOAD32_LE((p) + 4) << 32)
+#endif
+
+#define STORE64_BE(p, x) \
+  do{ \
+    int b_; \
+    for(b_ = 0; b_ < 8; b_++){ \
+      (p)[b_] = (uint8_t)((x) >> (56 - 8 * b_)); \
+    } \
+  }while(0)
+
+//Operations on 64-bit words, Q2 for SSE2, Q4 for AVX2 and Q8 for AVX-512.
+//MUL32 multiplies the low halves of the words, SWAP exchanges each pair of
+//neighbour words.
+#ifdef HASH_X86
+#define Q2_T __m128i
+#define Q2_LOAD(p) _mm_loadu_si128((const __m128i *)(p))
+#define Q2_STORE(p, x) _mm_storeu_si128((__m128i *)(p), x)
+#define Q2_SET1(k) _mm_set1_epi64x((long long)(k))
+#define Q2_ADD(x, y) _mm_add_epi64(x, y)
+#define Q2_XOR(x, y) _mm_xor_si128(x, y)
+#define Q2_SHR(x, c) _mm_srli_epi64(x, c)
+#define Q2_SHL(x, c) _mm_slli_epi64(x, c)
+#define Q2_MUL32(x, y) _mm_mul_epu32(x, y)
+#define Q2_SWAP(x) _mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2))
+
+#define Q4_T __m256i
+#define Q4_LOAD(p) _mm256_loadu_si256((const __m256i *)(p))
+#define Q4_STORE(p, x) _mm256_storeu_si256((__m256i *)(p), x)
+#define Q4_SET1(k) _mm256_set1_epi64x((long long)(k))
+#define Q4_ADD(x, y) _mm256_add_epi64(x, y)
+#define Q4_XOR(x, y) _mm256_xor_si256(x, y)
+#define Q4_SHR(x, c) _mm256_srli_epi64(x, c)
+#define Q4_SHL(x, c) _mm256_slli_epi64(x, c)
+#define Q4_MUL32(x, y) _mm256_mul_epu32(x, y)
+#define Q4_SWAP(x) _mm256_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2))
+
+#define Q8_T __m512i
+#define Q8_LOAD(p) _mm512_loadu_si512((const void *)(p))
+#define Q8_STORE(p, x) _mm512_storeu_si512((void *)(p), x)
+#define Q8_SET1(k) _mm512_set1_epi64((long long)(k))
+#define Q8_ADD(x, y) _mm512_add_epi64(x, y)
+#define Q8_XOR(x, y) _mm512_xor_si512(x, y)
+#define Q8_SHR(x, c) _mm512_srli_epi64(x, c)
+#define Q8_SHL(x, c) _mm512_slli_epi64(x, c)
+#define Q8_MUL32(x, y) _mm512_mul_epu32(x, y)
+#define Q8_SWAP(x) \
+  _mm512_shuffle_epi32(x, (_MM_PERM_ENUM)_MM_SHUFFLE(1, 0, 3, 2))
+#endif
+
+//Body of a stripes kernel with the eight accumulators in 8 / lanes vectors
+//of V: each stripe adds its words, swapped, and the products of the halves
+//of its words keyed with the secret, and the accumulators are scrambled
+//after the last stripe of every block
+#define XXH3_STRIPES(V, lanes) \
+  do{ \
+    V##_T a[8 / (lanes)], d, k; \
+    V##_T prime = V##_SET1(XXH_PRIME32_1); \
+    const uint8_t *secret; \
+    unsigned n = *done, i; \
+    for(i = 0; i < 8 / (lanes); i++){ \
+      a[i] = V##_LOAD(acc + i * (lanes)); \
+    } \
+    for(; stripes; stripes--, input += XXH3_STRIPE_LEN){ \
+      secret = xxh3_secret + 8 * n; \
+      for(i = 0; i < 8 / (lanes); i++){ \
+        d = V##_LOAD(input + 8 * (lanes) * i); \
+        k = V##_XOR(d, V##_LOAD(secret + 8 * (lanes) * i)); \
+        a[i] = V##_ADD(a[i], V##_ADD(V##_SWAP(d), \
+                                     V##_MUL32(k, V##_SHR(k, 32)))); \
+      } \
+      if(++n < XXH3_BLOCK_STRIPES){ \
+        continue; \
+      } \
+      n = 0; \
+      secret = xxh3_secret + XXH3_SECRET_LEN - XXH3_STRIPE_LEN; \
+      for(i = 0; i < 8 / (lanes); i++){ \
+        d = V##_XOR(V##_XOR(a[i], V##_SHR(a[i], 47)), \
+                    V##_LOAD(secret + 8 * (lanes) * i)); \
+        a[i] = V##_ADD(V##_MUL32(d, prime), \
+                       V##_SHL(V##_MUL32(V##_SHR(d, 32), prime), 32)); \
+      } \
+    } \
+    for(i = 0; i < 8 / (lanes); i++){ \
+      V##_STORE(acc + i * (lanes), a[i]); \
+    } \
+    *done = n; \
+  }while(0)
+
+/*---------------------------------------------------------------------------*/
+/* Static function prototypes                                                */
+/*---------------------------------------------------------------------------*/
+
+static void xxh64_use_scalar(void);
+
+static void xxh3_use_scalar(void);
+
+#ifdef HASH_X86
+static void xxh3_use_sse2(void);
+
+static void xxh3_use_avx2(void);
+
+static void xxh3_use_avx512(void);
+#endif
+
+static uint32_t xxh_load32(const uint8_t *p);
+
+static uint64_t xxh_load64(const uint8_t *p);
+
+static uint64_t xxh64_round(uint64_t acc, uint64_t input);
+
+static uint64_t xxh64_avalanche(uint64_t h);
+
+static uint64_t xxh3_avalanche(uint64_t h);
+
+static uint64_t xxh3_fold(uint64_t x, uint64_t y);
+
+static uint64_t xxh3_mix16(const uint8_t *input, const uint8_t *secret,
+                           uint64_t seed);
+
+static void xxh128_mix32(uint64_t acc[2], const uint8_t *input1,
+                         const uint8_t *input2, const uint8_t *secret,
+                         uint64_t seed);
+
+static void xxh3_stripe(uint64_t acc[8], const uint8_t *input,
+                        const uint8_t *secret);
+
+static void xxh3_last_stripes(const xxh3_ctx *ctx, uint64_t acc[8]);
+
+static uint64_t xxh3_merge(const uint64_t acc[8], const uint8_t *secret,
+                           uint64_t start);
+
+static uint64_t xxh3_short(const uint8_t *msg, size_t len);
+
+static void xxh128_short(const uint8_t *msg, size_t len, uint64_t h[2]);
+
+/*---------------------------------------------------------------------------*/
+/* Variable declarations                                                     */
+/*---------------------------------------------------------------------------*/
+
+//Stripes kernel, chosen by the implementations
+static xxh3_stripes_fn xxh3_stripes = xxh3_stripes_scalar;
+
+//xxh64 has no kernels, each of its stripes depends on the one before
+const hash_impl xxh64_impls[] = {
+  {"scalar", 0, xxh64_use_scalar},
+  {NULL, 0, NULL}
+};
+
+const hash_impl xxh3_impls[] = {
+  {"scalar", 0, xxh3_use_scalar},
+#ifdef HASH_X86
+  {"sse2", CPU_SSE2, xxh3_use_sse2},
+  {"avx2", CPU_AVX2, xxh3_use_avx2},
+  {"avx512", CPU_AVX512F, xxh3_use_avx512},
+#endif
+  {NULL, 0, NULL}
+};
+
+/*---------------------------------------------------------------------------*/
+/* Function definitions                                                      */
+/*---------------------------------------------------------------------------*/
+
+void xxh64_init(xxh64_ctx *ctx){
+  ctx->v[0] = XXH_PRIME64_1 + XXH_PRIME64_2;
+  ctx->v[1] = XXH_PRIME64_2;
+  ctx->v[2] = 0;
+  ctx->v[3] = -XXH_PRIME64_1;
+  ctx->len = 0;
+  ctx->block_len = 0;
+}
+
+void xxh64_update(xxh64_ctx *ctx, const uint8_t *msg, size_t len){
+  uint64_t v0, v1, v2, v3;
+
+  ctx->len += len;
+  if(ctx->block_len + len < XXH64_STRIPE_LEN){
+    memcpy(ctx->block + ctx->block_len, msg, len);
+    ctx->block_len += len;
+    return;
+  }
+
+  if(ctx->block_len){//Complete the pending stripe first
+    size_t fill = XXH64_STRIPE_LEN - ctx->block_len;
+    memcpy(ctx->block + ctx->block_len, msg, fill);
+    ctx->v[0] = xxh64_round(ctx->v[0], LOAD64_LE(ctx->block));
+    ctx->v[1] = xxh64_round(ctx->v[1], LOAD64_LE(ctx->block + 8));
+    ctx->v[2] = xxh64_round(ctx->v[2], LOAD64_LE(ctx->block + 16));
+    ctx->v[3] = xxh64_round(ctx->v[3], LOAD64_LE(ctx->block + 24));
+    msg += fill;
+    len -= fill;
+  }
+
+  //Full stripes are hashed in place
+  v0 = ctx->v[0];
+  v1 = ctx->v[1];
+  v2 = ctx->v[2];
+  v3 = ctx->v[3];
+  for(; len >= XXH64_STRIPE_LEN; len -= XXH64_STRIPE_LEN,
+      msg += XXH64_STRIPE_LEN){
+    v0 = xxh64_round(v0, LOAD64_LE(msg));
+    v1 = xxh64_round(v1, LOAD64_LE(msg + 8));
+    v2 = xxh64_round(v2, LOAD64_LE(msg + 16));
+    v3 = xxh64_round(v3, LOAD64_LE(msg + 24));
+  }
+  ctx->v[0] = v0;
+  ctx->v[1] = v1;
+  ctx->v[2] = v2;
+  ctx->v[3] = v3;
+
+  memcpy(ctx->block, msg, len);
+  ctx->block_len = len;
+}
+
+void xxh64_final(xxh64_ctx *ctx, uint8_t digest[8]){
+  const uint8_t *p = ctx->block;
+  size_t left = ctx->block_len;
+  uint64_t h;
+  int i;
+
+  if(ctx->len >= XXH64_STRIPE_LEN){
+    h = LEFTROTATE64(ctx->v[0], 1) + LEFTROTATE64(ctx->v[1], 7) +
+        LEFTROTATE64(ctx->v[2], 12) + LEFTROTATE64(ctx->v[3], 18);
+    for(i = 0; i < 4; i++){
+      h = (h ^ xxh64_round(0, ctx->v[i])) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    }
+  }else{
+    h = XXH_PRIME64_5;
+  }
+  h += ctx->len;
+
+  for(; left >= 8; left -= 8, p += 8){
+    h ^= xxh64_round(0, LOAD64_LE(p));
+    h = LEFTROTATE64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+  }
+  if(left >= 4){
+    h ^= (uint64_t)LOAD32_LE(p) * XXH_PRIME64_1;
+    h = LEFTROTATE64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+    left -= 4;
+    p += 4;
+  }
+  for(; left; left--, p++){
+    h ^= *p * XXH_PRIME64_5;
+    h = LEFTROTATE64(h, 11) * XXH_PRIME64_1;
+  }
+
+  h = xxh64_avalanche(h);
+  STORE64_BE(digest, h);
+}
+
+int xxh64_sum(uint8_t *initial_msg, size_t initial_len, uint8_t digest[8]){
+  xxh64_ctx ctx;
+
+  xxh64_init(&ctx);
+  xxh64_update(&ctx, initial_msg, initial_len);
+  xxh64_final(&ctx, digest);
+
+  return 0;
+}
+
+void xxh3_init(xxh3_ctx *ctx){
+  ctx->acc[0] = XXH_PRIME32_3;
+  ctx->acc[1] = XXH_PRIME64_1;
+  ctx->acc[2] = XXH_PRIME64_2;
+  ctx->acc[3] = XXH_PRIME64_3;
+  ctx->acc[4] = XXH_PRIME64_4;
+  ctx->acc[5] = XXH_PRIME32_2;
+  ctx->acc[6] = XXH_PRIME64_5;
+  ctx->acc[7] = XXH_PRIME32_1;
+  ctx->len = 0;
+  ctx->block_len = 0;
+  ctx->stripes = 0;
+}
+
+void xxh3_update(xxh3_ctx *ctx, const uint8_t *msg, size_t len){
+  size_t stripes;
+
+  //The buffer is only hashed once more bytes follow it, so xxh3_final
+  //always has the last stripe and the whole of short messages
+  ctx->len += len;
+  if(ctx->block_len + len <= XXH3_BUFFER_LEN){
+    memcpy(ctx->block + ctx->block_len, msg, len);
+    ctx->block_len += len;
+    return;
+  }
+
+  if(ctx->block_len){
+    size_t fill = XXH3_BUFFER_LEN - ctx->block_len;
+    memcpy(ctx->block + ctx->block_len, msg, fill);
+    xxh3_stripes(ctx->acc, ctx->block, XXH3_BUFFER_LEN / XXH3_STRIPE_LEN,
+                 &ctx->stripes);
+    msg += fill;
+    len -= fill;
+  }
+
+  //Stripes are hashed in place, the last one is copied to the end of the
+  //buffer in case fewer bytes than a stripe follow it
+  if(len > XXH3_BUFFER_LEN){
+    stripes = (len - 1) / XXH3_STRIPE_LEN;
+    xxh3_stripes(ctx->acc, msg, stripes, &ctx->stripes);
+    msg += stripes * XXH3_STRIPE_LEN;
+    len -= stripes * XXH3_STRIPE_LEN;
+    memcpy(ctx->block + XXH3_BUFFER_LEN - XXH3_STRIPE_LEN,
+           msg - XXH3_STRIPE_LEN, XXH3_STRIPE_LEN);
+  }
+
+  memcpy(ctx->block, msg, len);
+  ctx->block_len = len;
+}
+
+void xxh3_final(xxh3_ctx *ctx, uint8_t digest[8]){
+  uint64_t acc[8], h;
+
+  if(ctx->len > XXH3_MIDSIZE_MAX){
+    xxh3_last_stripes(ctx, acc);
+    h = xxh3_merge(acc, xxh3_secret + 11, ctx->len * XXH_PRIME64_1);
+  }else{
+    h = xxh3_short(ctx->block, ctx->len);
+  }
+  STORE64_BE(digest, h);
+}
+
+void xxh128_init(xxh128_ctx *ctx){
+  xxh3_init(ctx);
+}
+
+void xxh128_update(xxh128_ctx *ctx, const uint8_t *msg, size_t len){
+  xxh3_update(ctx, msg, len);
+}
+
+void xxh128_final(xxh128_ctx *ctx, uint8_t digest[16]){
+  uint64_t acc[8], h[2];
+
+  if(ctx->len > XXH3_MIDSIZE_MAX){
+    xxh3_last_stripes(ctx, acc);
+    h[0] = xxh3_merge(acc, xxh3_secret + 11, ctx->len * XXH_PRIME64_1);
+    h[1] = xxh3_merge(acc, xxh3_secret + XXH3_SECRET_LEN - 64 - 11,
+                      ~(ctx->len * XXH_PRIME64_2));
+  }else{
+    xxh128_short(ctx->block, ctx->len, h);
+  }
+  //The high half comes first
+  STORE64_BE(digest, h[1]);
+  STORE64_BE(digest + 8, h[0]);
+}
+
+int xxh3_sum(uint8_t *initial_msg, size_t initial_len, uint8_t digest[8]){
+  xxh3_ctx ctx;
+
+  xxh3_init(&ctx);
+  xxh3_update(&ctx, initial_msg, initial_len);
+  xxh3_final(&ctx, digest);
+
+  return 0;
+}
+
+int xxh128_sum(uint8_t *initial_msg, size_t initial_len, uint8_t digest[16]){
+  xxh128_ctx ctx;
+
+  xxh128_init(&ctx);
+  xxh128_update(&ctx, initial_msg, initial_len);
+  xxh128_final(&ctx, digest);
+
+  return 0;
+}
+
+void xxh3_stripes_scalar(uint64_t acc[8], const uint8_t *input,
+                         size_t stripes, unsigned *done){
+  const uint8_t *secret = xxh3_secret + XXH3_SECRET_LEN - XXH3_STRIPE_LEN;
+  uint64_t a[8];
+  unsigned n = *done;
+  int i;
+
+  //A local copy, the stores through input could alias acc
+  memcpy(a, acc, sizeof(a));
+  for(; stripes; stripes--, input += XXH3_STRIPE_LEN){
+    xxh3_stripe(a, input, xxh3_secret + 8 * n);
+    if(++n < XXH3_BLOCK_STRIPES){
+      continue;
+    }
+    n = 0;
+    for(i = 0; i < 8; i++){
+      a[i] ^= a[i] >> 47;
+      a[i] ^= LOAD64_LE(secret + 8 * i);
+      a[i] *= XXH_PRIME32_1;
+    }
+  }
+  memcpy(acc, a, sizeof(a));
+  *done = n;
+}
+
+#ifdef HASH_X86
+__attribute__((target("sse2")))
+void xxh3_stripes_sse2(uint64_t acc[8], const uint8_t *input,
+                       size_t stripes, unsigned *done){
+  XXH3_STRIPES(Q2, 2);
+}
+
+__attribute__((target("avx2")))
+void xxh3_stripes_avx2(uint64_t acc[8], const uint8_t *input,
+                       size_t stripes, unsigned *done){
+  XXH3_STRIPES(Q4, 4);
+}
+
+__attribute__((target("avx512f")))
+void xxh3_stripes_avx512(uint64_t acc[8], const uint8_t *input,
+                         size_t stripes, unsigned *done){
+  XXH3_STRIPES(Q8, 8);
+}
+#endif
+
+/*---------------------------------------------------------------------------*/
+/* Static function definitions                                               */
+/*---------------------------------------------------------------------------*/
+
+static void xxh64_use_scalar(void){
+  //There is nothing to choose
+}
+
+static void xxh3_use_scalar(void){
+  xxh3_stripes = xxh3_stripes_scalar;
+}
+
+#ifdef HASH_X86
+static void xxh3_use_sse2(void){
+  xxh3_stripes = xxh3_stripes_sse2;
+}
+
+static void xxh3_use_avx2(void){
+  xxh3_stripes = xxh3_stripes_avx2;
+}
+
+static void xxh3_use_avx512(void){
+  xxh3_stripes = xxh3_stripes_avx512;
+}
+#endif
+
+static uint32_t xxh_load32(const uint8_t *p){
+  uint32_t x;
+
+  memcpy(&x, p, sizeof(x));
+  return x;
+}
+
+static uint64_t xxh_load64(const uint8_t *p){
+  uint64_t x;
+
+  memcpy(&x, p, sizeof(x));
+  return x;
+}
+
+static uint64_t xxh64_round(uint64_t acc, uint64_t input){
+  acc += input * XXH_PRIME64_2;
+  return LEFTROTATE64(acc, 31) * XXH_PRIME64_1;
+}
+
+static uint64_t xxh64_avalanche(uint64_t h){
+  h ^= h >> 33;
+  h *= XXH_PRIME64_2;
+  h ^= h >> 29;
+  h *= XXH_PRIME64_3;
+  return h ^ (h >> 32);
+}
+
+static uint64_t xxh3_avalanche(uint64_t h){
+  h ^= h >> 37;
+  h *= XXH_PRIME_MX1;
+  return h ^ (h >> 32);
+}
+
+//Both halves of the 128-bit product of x and y, xored
+static uint64_t xxh3_fold(uint64_t x, uint64_t y){
+  uint128_t p = (uint128_t)x * y;
+
+  return (uint64_t)p ^ (uint64_t)(p >> 64);
+}
+
+static uint64_t xxh3_mix16(const uint8_t *input, const uint8_t *secret,
+                           uint64_t seed){
+  return xxh3_fold(LOAD64_LE(input) ^ (LOAD64_LE(secret) + seed),
+                   LOAD64_LE(input + 8) ^ (LOAD64_LE(secret + 8) - seed));
+}
+
+//acc is the low and the high half of xxh128
+static void xxh128_mix32(uint64_t acc[2], const uint8_t *input1,
+                         const uint8_t *input2, const uint8_t *secret,
+                         uint64_t seed){
+  acc[0] += xxh3_mix16(input1, secret, seed);
+  acc[0] ^= LOAD64_LE(input2) + LOAD64_LE(input2 + 8);
+  acc[1] += xxh3_mix16(input2, secret + 16, seed);
+  acc[1] ^= LOAD64_LE(input1) + LOAD64_LE(input1 + 8);
+}
+
+//A single stripe, as xxh3_stripes_scalar does with each of its stripes
+static void xxh3_stripe(uint64_t acc[8], const uint8_t *input,
+                        const uint8_t *secret){
+  uint64_t d, k;
+  int i;
+
+  for(i = 0; i < 8; i++){
+    d = LOAD64_LE(input + 8 * i);
+    k = d ^ LOAD64_LE(secret + 8 * i);
+    acc[i ^ 1] += d;
+    acc[i] += (uint64_t)(uint32_t)k * (k >> 32);
+  }
+}
+
+//Accumulators of a message longer than XXH3_MIDSIZE_MAX: the ones of ctx
+//with the buffer but its last stripe, and that stripe with its own key
+static void xxh3_last_stripes(const xxh3_ctx *ctx, uint64_t acc[8]){
+  uint8_t last[XXH3_STRIPE_LEN];
+  const uint8_t *stripe = last;
+  unsigned done = ctx->stripes;
+  size_t before;
+
+  memcpy(acc, ctx->acc, sizeof(ctx->acc));
+  if(ctx->block_len >= XXH3_STRIPE_LEN){
+    xxh3_stripes(acc, ctx->block, (ctx->block_len - 1) / XXH3_STRIPE_LEN,
+                 &done);
+    stripe = ctx->block + ctx->block_len - XXH3_STRIPE_LEN;
+  }else{//Begins with the end of the stripe hashed before
+    before = XXH3_STRIPE_LEN - ctx->block_len;
+    memcpy(last, ctx->block + XXH3_BUFFER_LEN - before, before);
+    memcpy(last + before, ctx->block, ctx->block_len);
+  }
+  xxh3_stripe(acc, stripe,
+              xxh3_secret + XXH3_SECRET_LEN - XXH3_STRIPE_LEN - 7);
+}
+
+static uint64_t xxh3_merge(const uint64_t acc[8], const uint8_t *secret,
+                           uint64_t start){
+  int i;
+
+  for(i = 0; i < 4; i++){
+    start += xxh3_fold(acc[2 * i] ^ LOAD64_LE(secret + 16 * i),
+                       acc[2 * i + 1] ^ LOAD64_LE(secret + 16 * i + 8));
+  }
+  return xxh3_avalanche(start);
+}
+
+//xxh3 of a message of up to XXH3_MIDSIZE_MAX bytes
+static uint64_t xxh3_short(const uint8_t *msg, size_t len){
+  const uint8_t *secret = xxh3_secret;
+  uint64_t h, end;
+  size_t i;
+
+  if(!len){
+    return xxh64_avalanche(LOAD64_LE(secret + 56) ^ LOAD64_LE(secret + 64));
+  }
+  if(len <= 3){
+    h = (uint32_t)msg[0] << 16 | (uint32_t)msg[len >> 1] << 24 |
+        msg[len - 1] | (uint32_t)len << 8;
+    return xxh64_avalanche(h ^ (LOAD32_LE(secret) ^ LOAD32_LE(secret + 4)));
+  }
+  if(len <= 8){
+    h = (LOAD32_LE(msg + len - 4) + ((uint64_t)LOAD32_LE(msg) << 32)) ^
+        (LOAD64_LE(secret + 8) ^ LOAD64_LE(secret + 16));
+    h ^= LEFTROTATE64(h, 49) ^ LEFTROTATE64(h, 24);
+    h *= XXH_PRIME_MX2;
+    h ^= (h >> 35) + len;
+    h *= XXH_PRIME_MX2;
+    return h ^ (h >> 28);
+  }
+  if(len <= 16){
+    uint64_t lo = LOAD64_LE(msg) ^
+                  (LOAD64_LE(secret + 24) ^ LOAD64_LE(secret + 32));
+    uint64_t hi = LOAD64_LE(msg + len - 8) ^
+                  (LOAD64_LE(secret + 40) ^ LOAD64_LE(secret + 48));
+    return xxh3_avalanche(len + __builtin_bswap64(lo) + hi +
+                          xxh3_fold(lo, hi));
+  }
+
+  h = len * XXH_PRIME64_1;
+  if(len <= 128){//Pairs of 16 bytes from both ends
+    for(i = (len - 1) / 32 + 1; i--;){
+      h += xxh3_mix16(msg + 16 * i, secret + 32 * i, 0);
+      h += xxh3_mix16(msg + len - 16 * (i + 1), secret + 32 * i + 16, 0);
+    }
+    return xxh3_avalanche(h);
+  }
+
+  for(i = 0; i < 8; i++){
+    h += xxh3_mix16(msg + 16 * i, secret + 16 * i, 0);
+  }
+  end = xxh3_mix16(msg + len - 16, secret + 136 - 17, 0);
+  h = xxh3_avalanche(h);
+  for(i = 8; i < len / 16; i++){
+    end += xxh3_mix16(msg + 16 * i, secret + 16 * (i - 8) + 3, 0);
+  }
+  return xxh3_avalanche(h + end);
+}
+
+//xxh128 of a message of up to XXH3_MIDSIZE_MAX bytes, h is the low and the
+//high half
+static void xxh128_short(const uint8_t *msg, size_t len, uint64_t h[2]){
+  const uint8_t *secret = xxh3_secret;
+  uint64_t acc[2];
+  uint128_t m;
+  uint32_t c;
+  size_t i;
+
+  if(!len){
+    h[0] = xxh64_avalanche(LOAD64_LE(secret + 64) ^ LOAD64_LE(secret + 72));
+    h[1] = xxh64_avalanche(LOAD64_LE(secret + 80) ^ LOAD64_LE(secret + 88));
+    return;
+  }
+  if(len <= 3){
+    c = (uint32_t)msg[0] << 16 | (uint32_t)msg[len >> 1] << 24 |
+        msg[len - 1] | (uint32_t)len << 8;
+    h[0] = xxh64_avalanche(c ^ (LOAD32_LE(secret) ^ LOAD32_LE(secret + 4)));
+    c = __builtin_bswap32(c);
+    h[1] = xxh64_avalanche(LEFTROTATE(c, 13) ^
+                           (LOAD32_LE(secret + 8) ^ LOAD32_LE(secret + 12)));
+    return;
+  }
+  if(len <= 8){
+    m = (uint128_t)((LOAD32_LE(msg) + ((uint64_t)LOAD32_LE(msg + len - 4)
+                                       << 32)) ^
+                    (LOAD64_LE(secret + 16) ^ LOAD64_LE(secret + 24))) *
+        (XXH_PRIME64_1 + (len << 2));
+    h[1] = (uint64_t)(m >> 64) + ((uint64_t)m << 1);
+    h[0] = (uint64_t)m ^ (h[1] >> 3);
+    h[0] ^= h[0] >> 35;
+    h[0] *= XXH_PRIME_MX2;
+    h[0] ^= h[0] >> 28;
+    h[1] = xxh3_avalanche(h[1]);
+    return;
+  }
+  if(len <= 16){
+    uint64_t lo = LOAD64_LE(msg), hi = LOAD64_LE(msg + len - 8);
+    uint64_t mlo, mhi;
+    m = (uint128_t)(lo ^ hi ^ (LOAD64_LE(secret + 32) ^
+                               LOAD64_LE(secret + 40))) * XXH_PRIME64_1;
+    mlo = (uint64_t)m + ((uint64_t)(len - 1) << 54);
+    hi ^= LOAD64_LE(secret + 48) ^ LOAD64_LE(secret + 56);
+    mhi = (uint64_t)(m >> 64) + hi +
+          (uint64_t)(uint32_t)hi * (XXH_PRIME32_2 - 1);
+    mlo ^= __builtin_bswap64(mhi);
+    m = (uint128_t)mlo * XXH_PRIME64_2;
+    h[0] = xxh3_avalanche((uint64_t)m);
+    h[1] = xxh3_avalanche((uint64_t)(m >> 64) + mhi * XXH_PRIME64_2);
+    return;
+  }
+
+  acc[0] = len * XXH_PRIME64_1;
+  acc[1] = 0;
+  if(len <= 128){
+    for(i = (len - 1) / 32 + 1; i--;){
+      xxh128_mix32(acc, msg + 16 * i, msg + len - 16 * (i + 1),
+                   secret + 32 * i, 0);
+    }
+  }else{
+    for(i = 32; i < 160; i += 32){
+      xxh128_mix32(acc, msg + i - 32, msg + i - 16, secret + i - 32, 0);
+    }
+    acc[0] = xxh3_avalanche(acc[0]);
+    acc[1] = xxh3_avalanche(acc[1]);
+    for(i = 160; i <= len; i += 32){
+      xxh128_mix32(acc, msg + i - 32, msg + i - 16, secret + 3 + i - 160, 0);
+    }
+    xxh128_mix32(acc, msg + len - 16, msg + len - 32, secret + 136 - 17 - 16,
+                 0);
+  }
+  h[0] = xxh3_avalanche(acc[0] + acc[1]);
+  h[1] = -xxh3_avalanche(acc[0] * XXH_PRIME64_1 + acc[1] * XXH_PRIME64_4 +
+                         len * XXH_PRIME64_2);
+}